@@ -15,6 +15,11 @@ using namespace std;
 
 bool continueOverwrite(string winLabel, string message, string fileName)
 {
+#ifdef DARWIN_NO_GUI
+	//***2.3 - nobody to ask in darwin-match, so never overwrite
+	cerr << winLabel << " " << message << " " << fileName << endl;
+	return false;
+#else
 	GtkWidget *dialog = gtk_dialog_new_with_buttons (
 				winLabel.c_str(),
 				NULL, // do not have parent
@@ -45,6 +50,7 @@ bool continueOverwrite(string winLabel, string message, string fileName)
 	gtk_widget_destroy (dialog);
 
 	return (result == GTK_RESPONSE_ACCEPT);
+#endif
 }
 
 // The woCaseLesThan::operator() is used to compare strings without 
@@ -128,16 +134,22 @@ Database * openDatabase(MainWindow *mainWin, string filename)
 	{
 	case cannotOpen:
 			// notify user of problem
-			g_print("Could not open selected database file!\n");
+			cout << "Could not open selected database file!" << endl;
 		break;
 	case convert:
 		{
+#ifndef DARWIN_NO_GUI
 			// convert the OldDatabase
 			DBConvertDialog *cdlg = new DBConvertDialog(
 					mainWin,
 					filename,
 					&db); // this is set to return converted/opened SQLDatabase
 			cdlg->run_and_respond();
+#else
+			//***2.3 - conversion needs the GUI, db stays NULL
+			cerr << "Old database must be converted by DARWIN first: "
+			     << filename << endl;
+#endif
 		}
 		break;
 	case canOpen:
@@ -969,7 +981,11 @@ bool saveFin(DatabaseFin<ColorImage>* fin, string fileName)
 	try {
 		fin->save(fileName);
 	} catch (Error e) {
+#ifndef DARWIN_NO_GUI
 		showError(e.errorString());
+#else
+		cerr << e.errorString() << endl;
+#endif
 	}
 
 	fin->mImageFilename = copyfilename; //***1.8 - save this filename now
@@ -3,13 +3,19 @@
 #ifndef CATALOG_SUPPORT_H
 #define CATALOG_SUPPORT_H
 
+#ifndef DARWIN_NO_GUI
 #include "interface/ErrorDialog.h"
+#endif
 #include "Database.h"
 #include "SQLiteDatabase.h"
 #include "OldDatabase.h"
 #include "DummyDatabase.h"
+#ifndef DARWIN_NO_GUI
 #include "interface/MainWindow.h"
 #include "interface/DBConvertDialog.h"
+#else
+class MainWindow; //***2.3 - darwin-match is built without the interface
+#endif
 #include "utility.h"
 
 typedef enum {
@@ -11,7 +11,11 @@
 //
 //*******************************************************************
 
+#include <algorithm> //***2.3
+#include <cstdlib>
 #include "Database.h"
+#include "MatchSnapshot.h" //***2.3
+#include "utility.h" //***2.3
 
 using namespace std;
 
@@ -270,6 +274,81 @@ int Database::getItemListPosFromOffset(db_sort_t whichList, string item) {
 }
 
 
+// *****************************************************************************
+//
+// ***2.3 - Selects from the damage list in memory.  Its entries are
+// "<damage> <offset>", the offset being that kept in the absolute offset
+// list at the fin's absolute position.
+//
+
+bool Database::getFinsInCategories(bool categoryToMatch[], std::vector<int> *positions) {
+
+	std::map<long int, int> positionOfOffset;
+	for (int pos = 0; pos < (int)mAbsoluteOffset.size(); pos++)
+		if (mAbsoluteOffset[pos] != -1)
+			positionOfOffset[mAbsoluteOffset[pos]] = pos;
+
+	std::vector<std::string> selected;
+	for (int c = 0; c < catCategoryNamesMax(); c++)
+		if (categoryToMatch[c])
+			selected.push_back(catCategoryName(c));
+
+	std::vector<std::string>::iterator it;
+	for (it = mDamageList.begin(); it != mDamageList.end(); ++it) {
+
+		std::string::size_type space = it->rfind(" ");
+		if (std::string::npos == space)
+			return false;
+
+		std::string damage = it->substr(0, space);
+		if (std::find(selected.begin(), selected.end(), damage) == selected.end())
+			continue;
+
+		std::map<long int, int>::iterator found =
+				positionOfOffset.find(atol(it->substr(space + 1).c_str()));
+		if (found == positionOfOffset.end())
+			return false;
+
+		positions->push_back(found->second);
+	}
+
+	std::sort(positions->begin(), positions->end());
+
+	return true;
+}
+
+
+// *****************************************************************************
+//
+// ***2.3 - Searches the ID list in memory.  Its entries are
+// "<ID code> <offset>", as for the damage list.
+//
+
+void Database::getFinsWithID(std::string idCode, std::vector<int> *positions) {
+
+	std::map<long int, int> positionOfOffset;
+	for (int pos = 0; pos < (int)mAbsoluteOffset.size(); pos++)
+		if (mAbsoluteOffset[pos] != -1)
+			positionOfOffset[mAbsoluteOffset[pos]] = pos;
+
+	std::vector<std::string>::iterator it;
+	for (it = mIDList.begin(); it != mIDList.end(); ++it) {
+
+		std::string::size_type space = it->rfind(" ");
+		if ((std::string::npos == space)
+		    || ! caseInsensitiveStringCompare(it->substr(0, space), idCode))
+			continue;
+
+		std::map<long int, int>::iterator found =
+				positionOfOffset.find(atol(it->substr(space + 1).c_str()));
+		if (found != positionOfOffset.end())
+			positions->push_back(found->second);
+	}
+
+	std::sort(positions->begin(), positions->end());
+}
+
+
 // *****************************************************************************
 //
 // Returns db filename
@@ -291,7 +370,8 @@ Database::Database(Options *o, CatalogScheme cat, bool createEmptyDB)
 		mFilename(o->mDatabaseFileName),
 		mCurrentSort(DB_SORT_NAME),
 		mDBStatus(errorLoading),
-		mCatSchemeName("")
+		mCatSchemeName(""),
+		mMatchSnapshot(NULL) //***2.3
 {
 	mCatCategoryNames.clear();
 	// set the category names for the database here initially for a create situation
@@ -309,7 +389,52 @@ Database::Database()
 		mFilename("DummyDatabase"),
 		mCurrentSort(DB_SORT_NAME),
 		mDBStatus(errorLoading),
-		mCatSchemeName("")
+		mCatSchemeName(""),
+		mMatchSnapshot(NULL) //***2.3
 {
 	mCatCategoryNames.clear();
 }
+
+
+// *****************************************************************************
+//
+// Destructor
+//
+
+Database::~Database()
+{
+	delete mMatchSnapshot; //***2.3
+}
+
+
+// *****************************************************************************
+//
+// MatchSnapshot* Database::getMatchSnapshot()
+//
+//    ***2.3 - returns the catalog snapshot used for matching, creating an
+//    empty one if needed.  The snapshot is owned by the Database and must
+//    not be kept across calls that may change the catalog.
+//
+
+MatchSnapshot* Database::getMatchSnapshot()
+{
+	if (NULL == mMatchSnapshot)
+		mMatchSnapshot = new MatchSnapshot(this);
+
+	return mMatchSnapshot;
+}
+
+
+// *****************************************************************************
+//
+// void Database::invalidateMatchSnapshot()
+//
+//    ***2.3 - called by derived classes whenever a fin is added, updated
+//    or deleted, so the next match sees the catalog as it now is.
+//
+
+void Database::invalidateMatchSnapshot()
+{
+	delete mMatchSnapshot;
+	mMatchSnapshot = NULL;
+}
@@ -20,12 +20,14 @@
 #include "Options.h"
 
 #include "CatalogScheme.h" //***1.99
+#include "MatchCache.h" //***2.3
 
 #include <fstream>
 #pragma warning(disable:4786) //***1.95 removes debug warnings in <string> <vector> <map> etc
 #include <string>
 #include <strstream>
 #include <vector>
+#include <map>
 #include <algorithm>
 
 #ifdef HAVE_CONFIG_H
@@ -47,6 +49,9 @@
 
 #define NOT_IN_LIST -1
 
+class MatchSnapshot; //***2.3
+class OutlineIndex; //***2.3
+
 typedef enum {
 	DB_SORT_NAME,
 	DB_SORT_ID,
@@ -74,7 +79,7 @@ public:
 
 	Database(Options *o, CatalogScheme cat, bool createEmptyDB);
 	Database(); // called only by DummyDatabase()
-	virtual ~Database() {};
+	virtual ~Database(); //***2.3 - no longer inline, deletes the match snapshot
 	
 	virtual void createEmptyDatabase(Options *o) = 0;
 
@@ -125,6 +130,61 @@ public:
 	void clearCatalogScheme();
 	CatalogScheme catalogScheme();
 
+	//***2.3 - in-memory copy of the catalog outlines used by Match, built
+	// as fins are first matched and discarded whenever the catalog changes
+	MatchSnapshot* getMatchSnapshot();
+	void invalidateMatchSnapshot();
+
+	//***2.3 - match results kept between runs (see MatchCache.h), by
+	// Individuals id.  Databases that cannot keep them find nothing.
+	virtual void getCachedMatches(
+			std::string unknownHash,
+			int registrationMethod,
+			bool useFullFinError,
+			std::map<int, MatchCacheEntry> *entries) { }
+	virtual void putCachedMatches(
+			std::string unknownHash,
+			int registrationMethod,
+			bool useFullFinError,
+			const std::vector<MatchCacheEntry> &entries) { }
+
+	//***2.3 - insertion generations.  Every fin added or updated is given
+	// the next catalog generation, so results saved when the catalog was at
+	// generation g are brought up to date by matching the fins added since.
+	// Deleting a fin advances the generation too, so any change to the
+	// fins is seen (see reloadChanged()).  Databases without generations
+	// are at generation -1.
+	virtual int catalogGeneration() { return -1; }
+	virtual void getFinsAddedSince(int generation, std::vector<int> *positions) { }
+
+	//***2.3 - absolute positions of the fins whose damage category is
+	// selected (categoryToMatch[] as indexed by catCategoryName()), found
+	// without loading any fin.  Returns false if the database cannot
+	// tell, in which case every fin must be checked once loaded.
+	virtual bool getFinsInCategories(bool categoryToMatch[], std::vector<int> *positions);
+
+	//***2.3 - absolute positions of the fins with this ID code (ignoring
+	// case), found without loading any fin
+	void getFinsWithID(std::string idCode, std::vector<int> *positions);
+
+	//***2.3 - nearest neighbour index over the catalog outlines (see
+	// OutlineIndex.h), kept up to date as fins are added, updated and
+	// deleted.  Owned by the database, and like the match snapshot not
+	// to be kept across calls that may change the catalog.  NULL for
+	// databases that keep no index.  rebuildOutlineIndex() makes the
+	// outline embeddings again for every fin.
+	virtual OutlineIndex* getOutlineIndex() { return NULL; }
+	virtual void rebuildOutlineIndex() { }
+
+	//***2.3 - Brings the lists up to date with changes made to the
+	// catalog file since it was opened, by another program or another
+	// Database on the same file.  Only the fins added, updated or deleted
+	// since are read, their absolute positions are added to changed, and
+	// only they are read again into the match snapshot.  Returns false,
+	// having changed nothing, if the database cannot reload, in which
+	// case it must be opened again.
+	virtual bool reloadChanged(std::vector<int> *changed) { return false; }
+
 protected:
 	bool dbOpen;
 
@@ -163,6 +223,8 @@ protected:
 
 	db_sort_t mCurrentSort;
 
+	MatchSnapshot *mMatchSnapshot; //***2.3 - NULL until first requested
+
 	//DatabaseFin* getItem(unsigned pos, std::list<std::string>::iterator it);
 	virtual DatabaseFin<ColorImage>* getItem(unsigned pos, std::vector<std::string> *theList) = 0;
 
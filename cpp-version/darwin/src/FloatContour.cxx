@@ -54,14 +54,9 @@ FloatContour& FloatContour::operator=(FloatContour& fc) { //***006FC new
 	if (this == &fc)
 		return *this;
 
-	// empty this mPointVector
-	mPointVector.erase(mPointVector.begin(),mPointVector.end());
-
-	// copy items over from fc.mPointVector
-	vector<point_t>::iterator it;
-	it = fc.mPointVector.begin();
-	while (it != fc.mPointVector.end())
-		mPointVector.push_back(*it);
+	//***2.3 - copy items over from fc.mPointVector, reusing this one's
+	// storage (the old loop never advanced its iterator)
+	mPointVector = fc.mPointVector;
 
 	return *this;
 }
@@ -103,6 +98,17 @@ int FloatContour::length() const {
 
 }
 
+//********************************************************************
+// resize()
+//***2.3 - new function, lets a contour be reused as an output buffer
+// (e.g. by mapContour) without giving back its storage
+//
+void FloatContour::resize(int numPoints) {
+
+  mPointVector.resize(numPoints);
+
+}
+
 //***005FC next 5 functions are new
 //********************************************************************
 // popFront()
@@ -398,6 +404,28 @@ FloatContour* FloatContour::evenlySpaceContourPoints(int space) {
   return newContour;
 }
 
+//********************************************************************
+// subsample()
+//***2.3 - new function, returns the contour made of every stride-th point
+// (0, stride, 2 * stride, ...), so point k of the new contour is point
+// k * stride of this one.  Every other point of an evenly spaced contour
+// is itself (near enough) evenly spaced at twice the spacing, so these
+// are the coarse levels of the outline pyramids used in coarse-to-fine
+// registration.
+//
+FloatContour* FloatContour::subsample(int stride) const {
+
+  if (stride <= 0)
+    return NULL;
+
+  FloatContour *newContour = new FloatContour();
+
+  for (unsigned i = 0; i < mPointVector.size(); i += stride)
+    newContour->mPointVector.push_back(mPointVector[i]);
+
+  return newContour;
+}
+
 //***006FC next function moved from header
 
 //********************************************************************
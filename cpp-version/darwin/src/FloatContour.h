@@ -21,6 +21,10 @@
 #include "Contour.h" //***005DB
 #include "Point.h" // ***06FC for point_t type
 
+//***2.3 - number of levels of an outline pyramid (see subsample()), level l
+// of an evenly spaced outline being its subsample(1 << l)
+#define OUTLINE_PYRAMID_LEVELS 3
+
 /***06FC
 this type is being replaced with point_t declared in Chain.h
 typedef struct {
@@ -38,9 +42,11 @@ class FloatContour
 		FloatContour& operator=(FloatContour& fc); //***006FC new
 
 		int length() const;
+		void resize(int numPoints); //***2.3 new
 
 		void popFront(unsigned numPops); //***005DB
 		FloatContour* evenlySpaceContourPoints(int space); //***005DB
+		FloatContour* subsample(int stride) const; //***2.3 new
 		//void normalizeContour(); //***06FC removed FloatContour::
 
 		//Find the X,Y Location Closest to desx, desy
@@ -0,0 +1,111 @@
+//*******************************************************************
+//   file: MatchCache.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+//*******************************************************************
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "MatchCache.h"
+#include "Error.h"
+
+using namespace std;
+
+//*******************************************************************
+//
+// static void hashWord(unsigned int word, unsigned int &h1,
+//                      unsigned int &h2)
+//
+//    Adds one 32 bit word to two independent 32 bit hashes, FNV-1a
+//    (byte by byte) and a multiply and rotate mix of the whole word,
+//    which together make up the 64 bit outline hash.
+//
+static void hashWord(unsigned int word, unsigned int &h1, unsigned int &h2)
+{
+	for (int b = 0; b < 4; b++)
+	{
+		h1 ^= (word >> (8 * b)) & 0xff;
+		h1 *= 16777619u;
+	}
+
+	word *= 0xcc9e2d51u;
+	word = (word << 15) | (word >> 17);
+	word *= 0x1b873593u;
+
+	h2 ^= word;
+	h2 = (h2 << 13) | (h2 >> 19);
+	h2 = h2 * 5 + 0xe6546b64u;
+}
+
+//*******************************************************************
+//
+// string outlineHash(const float *x, const float *y, int numPoints,
+//                    const int *featurePoints, int numFeaturePoints)
+//
+//    ***2.3 - The bits of each coordinate are hashed, so any change to
+//    the outline, however small, gives a different hash.
+//
+string outlineHash(
+		const float *x,
+		const float *y,
+		int numPoints,
+		const int *featurePoints,
+		int numFeaturePoints)
+{
+	if ((numPoints > 0) && ((NULL == x) || (NULL == y)))
+		throw EmptyArgumentError("outlineHash() [const float *x, *y]");
+
+	if ((numFeaturePoints > 0) && (NULL == featurePoints))
+		throw EmptyArgumentError("outlineHash() [const int *featurePoints]");
+
+	unsigned int
+		h1 = 2166136261u,
+		h2 = 0x9747b28cu,
+		word;
+
+	hashWord((unsigned int)numPoints, h1, h2);
+
+	for (int i = 0; i < numPoints; i++)
+	{
+		memcpy(&word, &x[i], sizeof(word));
+		hashWord(word, h1, h2);
+		memcpy(&word, &y[i], sizeof(word));
+		hashWord(word, h1, h2);
+	}
+
+	for (int f = 0; f < numFeaturePoints; f++)
+		hashWord((unsigned int)featurePoints[f], h1, h2);
+
+	char hash[17];
+	sprintf(hash, "%08x%08x", h1, h2);
+
+	return string(hash);
+}
+
+//*******************************************************************
+//
+string outlineHash(
+		const FloatContour *c,
+		const int *featurePoints,
+		int numFeaturePoints)
+{
+	if (NULL == c)
+		throw EmptyArgumentError("outlineHash() [const FloatContour *c]");
+
+	int numPoints = c->length();
+
+	vector<float> x(numPoints + 1), y(numPoints + 1); // never empty
+
+	for (int i = 0; i < numPoints; i++)
+	{
+		x[i] = (*c)[i].x;
+		y[i] = (*c)[i].y;
+	}
+
+	return outlineHash(&x[0], &y[0], numPoints, featurePoints, numFeaturePoints);
+}
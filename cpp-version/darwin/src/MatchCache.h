@@ -0,0 +1,60 @@
+//*******************************************************************
+//   file: MatchCache.h
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// ***2.3 - Results of registering an unknown fin to catalog fins, kept
+// in the catalog database (see Database::getCachedMatches()) so that
+// matching the same unknown again only registers fins that are new or
+// have changed since.
+//
+// An entry belongs to one unknown outline (outlineHash() of its points
+// and feature points), one catalog fin (its Individuals id and the
+// outlineHash() of its outline), one registration method and one
+// setting of useFullFinError.  It holds the error and the mapping
+// control points, from which the mapped unknown outline is rebuilt
+// with a single call of mapContour(), as MatchResults::load() does.
+//
+// Only the optimal trim methods are cached, since the fixed percent
+// and original 3 point methods do not map through the control points.
+//
+//*******************************************************************
+
+#ifndef MATCHCACHE_H
+#define MATCHCACHE_H
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <string>
+
+#include "FloatContour.h"
+
+// bump whenever registration or error functions change the results,
+// so that entries made by older versions are never used
+#define MATCH_CACHE_VERSION         1
+
+typedef struct {
+	int individualID;          // Individuals id (DatabaseFin::mDataPos)
+	std::string outlineHash;   // of the catalog fin when it was matched
+	double error;              // ranking error (mseInfo::error)
+	double optimizerError;     // mseInfo::optimizerError, for top-K mode
+	int b1, t1, e1;            // beginning, tip & end of unknown fin
+	int b2, t2, e2;            // beginning, tip & end of database fin
+} MatchCacheEntry;
+
+// 16 hex digits summarizing every point of the evenly spaced outline
+// and the given feature point indices (LE_BEGIN ... POINT_OF_INFLECTION)
+std::string outlineHash(
+		const float *x,
+		const float *y,
+		int numPoints,
+		const int *featurePoints,
+		int numFeaturePoints);
+
+std::string outlineHash(
+		const FloatContour *c,
+		const int *featurePoints,
+		int numFeaturePoints);
+
+#endif
@@ -0,0 +1,431 @@
+//*******************************************************************
+//   file: MatchProfile.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+//*******************************************************************
+
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <vector>
+
+#include "MatchProfile.h"
+
+#ifndef WIN32
+#include <sys/time.h>
+#include <time.h>
+#endif
+
+using namespace std;
+
+// the timeline is not kept beyond this many events
+#define MATCH_PROFILE_MAX_TRACE_EVENTS  1000000
+
+static const char *PHASE_NAMES[NUM_PROFILE_PHASES] = {
+	"dbGetFin",
+	"outlineBuild",
+	"snapshotAdd",
+	"registerFin",
+	"mapContour",
+	"errorMSE",
+	"errorArea",
+	"display",
+	"saveResults"
+};
+
+static const char *COUNTER_NAMES[NUM_PROFILE_COUNTERS] = {
+	"optimizerIterations"
+};
+
+typedef struct {
+	int phase;
+	int thread;     // in the order threads were first seen
+	double start, end;
+} profileTraceEvent_t;
+
+//*******************************************************************
+//
+// class ProfileGlobals
+//
+//    The thread local current profile and the trace, made before main()
+//    runs so no thread can race to make them.
+//
+class ProfileGlobals
+{
+	public:
+#ifdef WIN32
+		DWORD currentKey;
+		CRITICAL_SECTION traceLock;
+		LARGE_INTEGER frequency;
+#else
+		pthread_key_t currentKey;
+		pthread_mutex_t traceLock;
+#endif
+
+		// guarded by traceLock
+		vector<profileTraceEvent_t> trace;
+		map<unsigned long, int> threadNumbers;
+		double traceStart;
+
+		ProfileGlobals()
+		:	traceStart(0.0)
+		{
+#ifdef WIN32
+			currentKey = TlsAlloc();
+			InitializeCriticalSection(&traceLock);
+			QueryPerformanceFrequency(&frequency);
+#else
+			pthread_key_create(&currentKey, NULL);
+			pthread_mutex_init(&traceLock, NULL);
+#endif
+		}
+};
+
+static ProfileGlobals gProfileGlobals;
+
+bool MatchProfile::sTracing = false;
+
+//*******************************************************************
+//
+MatchProfile::MatchProfile()
+{
+#ifdef WIN32
+	InitializeCriticalSection(&mLock);
+#else
+	pthread_mutex_init(&mLock, NULL);
+#endif
+	reset();
+}
+
+//*******************************************************************
+//
+MatchProfile::MatchProfile(const MatchProfile &profile)
+{
+#ifdef WIN32
+	InitializeCriticalSection(&mLock);
+#else
+	pthread_mutex_init(&mLock, NULL);
+#endif
+	reset();
+	add(profile);
+}
+
+//*******************************************************************
+//
+MatchProfile::~MatchProfile()
+{
+#ifdef WIN32
+	DeleteCriticalSection(&mLock);
+#else
+	pthread_mutex_destroy(&mLock);
+#endif
+}
+
+//*******************************************************************
+//
+MatchProfile &MatchProfile::operator=(const MatchProfile &profile)
+{
+	if (this != &profile)
+	{
+		reset();
+		add(profile);
+	}
+	return *this;
+}
+
+//*******************************************************************
+//
+void MatchProfile::reset()
+{
+	for (int p = 0; p < NUM_PROFILE_PHASES; p++)
+	{
+		mSeconds[p] = 0.0;
+		mCalls[p] = 0;
+	}
+
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++)
+		mCounts[c] = 0;
+}
+
+//*******************************************************************
+//
+void MatchProfile::add(const MatchProfile &profile)
+{
+#ifdef WIN32
+	EnterCriticalSection(&mLock);
+#else
+	pthread_mutex_lock(&mLock);
+#endif
+
+	for (int p = 0; p < NUM_PROFILE_PHASES; p++)
+	{
+		mSeconds[p] += profile.mSeconds[p];
+		mCalls[p] += profile.mCalls[p];
+	}
+
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++)
+		mCounts[c] += profile.mCounts[c];
+
+#ifdef WIN32
+	LeaveCriticalSection(&mLock);
+#else
+	pthread_mutex_unlock(&mLock);
+#endif
+}
+
+//*******************************************************************
+//
+bool MatchProfile::empty() const
+{
+	for (int p = 0; p < NUM_PROFILE_PHASES; p++)
+		if (mCalls[p] > 0)
+			return false;
+
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++)
+		if (mCounts[c] > 0)
+			return false;
+
+	return true;
+}
+
+//*******************************************************************
+//
+double MatchProfile::seconds(int phase) const
+{
+	return mSeconds[phase];
+}
+
+long MatchProfile::calls(int phase) const
+{
+	return mCalls[phase];
+}
+
+long MatchProfile::count(int counter) const
+{
+	return mCounts[counter];
+}
+
+//*******************************************************************
+//
+// void MatchProfile::summarize(ostream &out, string prefix) const
+//
+//    Lines such as
+//
+//       <prefix>registerFin 1.234567 s in 200 calls
+//       <prefix>optimizerIterations 5400
+//
+void MatchProfile::summarize(ostream &out, string prefix) const
+{
+	char line[128];
+
+	for (int p = 0; p < NUM_PROFILE_PHASES; p++)
+		if (mCalls[p] > 0)
+		{
+			sprintf(line, "%s %.6f s in %ld calls", PHASE_NAMES[p], mSeconds[p], mCalls[p]);
+			out << prefix << line << endl;
+		}
+
+	for (int c = 0; c < NUM_PROFILE_COUNTERS; c++)
+		if (mCounts[c] > 0)
+			out << prefix << COUNTER_NAMES[c] << " " << mCounts[c] << endl;
+}
+
+//*******************************************************************
+//
+MatchProfile *MatchProfile::current()
+{
+#ifdef WIN32
+	return (MatchProfile *)TlsGetValue(gProfileGlobals.currentKey);
+#else
+	return (MatchProfile *)pthread_getspecific(gProfileGlobals.currentKey);
+#endif
+}
+
+//*******************************************************************
+//
+double MatchProfile::now()
+{
+#ifdef WIN32
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / gProfileGlobals.frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+//*******************************************************************
+//
+const char *MatchProfile::phaseName(int phase)
+{
+	return PHASE_NAMES[phase];
+}
+
+const char *MatchProfile::counterName(int counter)
+{
+	return COUNTER_NAMES[counter];
+}
+
+//*******************************************************************
+//
+// bool MatchProfile::isTraced(int phase)
+//
+//    The phases called once or a few times per catalog fin.  The mapping
+//    and error functions run thousands of times per fin and would swamp
+//    the timeline.
+//
+bool MatchProfile::isTraced(int phase)
+{
+	return (PHASE_MAP_CONTOUR != phase) && (PHASE_ERROR_MSE != phase)
+	       && (PHASE_ERROR_AREA != phase);
+}
+
+//*******************************************************************
+//
+void MatchProfile::traceEvent(int phase, double start, double end)
+{
+#ifdef WIN32
+	unsigned long thread = GetCurrentThreadId();
+	EnterCriticalSection(&gProfileGlobals.traceLock);
+#else
+	unsigned long thread = (unsigned long)pthread_self();
+	pthread_mutex_lock(&gProfileGlobals.traceLock);
+#endif
+
+	if (sTracing && (gProfileGlobals.trace.size() < MATCH_PROFILE_MAX_TRACE_EVENTS))
+	{
+		map<unsigned long, int>::iterator it = gProfileGlobals.threadNumbers.find(thread);
+		if (it == gProfileGlobals.threadNumbers.end())
+		{
+			int number = gProfileGlobals.threadNumbers.size() + 1;
+			it = gProfileGlobals.threadNumbers.insert(make_pair(thread, number)).first;
+		}
+
+		profileTraceEvent_t event;
+		event.phase = phase;
+		event.thread = it->second;
+		event.start = start;
+		event.end = end;
+		gProfileGlobals.trace.push_back(event);
+	}
+
+#ifdef WIN32
+	LeaveCriticalSection(&gProfileGlobals.traceLock);
+#else
+	pthread_mutex_unlock(&gProfileGlobals.traceLock);
+#endif
+}
+
+//*******************************************************************
+//
+void MatchProfile::startTrace()
+{
+#ifdef WIN32
+	EnterCriticalSection(&gProfileGlobals.traceLock);
+#else
+	pthread_mutex_lock(&gProfileGlobals.traceLock);
+#endif
+
+	gProfileGlobals.trace.clear();
+	gProfileGlobals.threadNumbers.clear();
+	gProfileGlobals.traceStart = now();
+	sTracing = true;
+
+#ifdef WIN32
+	LeaveCriticalSection(&gProfileGlobals.traceLock);
+#else
+	pthread_mutex_unlock(&gProfileGlobals.traceLock);
+#endif
+}
+
+//*******************************************************************
+//
+// bool MatchProfile::writeTrace(string fileName)
+//
+//    Complete ("X") events in microseconds since startTrace(), one
+//    track per thread.
+//
+bool MatchProfile::writeTrace(string fileName)
+{
+#ifdef WIN32
+	EnterCriticalSection(&gProfileGlobals.traceLock);
+#else
+	pthread_mutex_lock(&gProfileGlobals.traceLock);
+#endif
+
+	sTracing = false;
+
+	ofstream outFile(fileName.c_str());
+	bool ok = ! outFile.fail();
+
+	if (ok)
+	{
+		char event[256];
+
+		outFile << "{\"traceEvents\":[";
+		for (unsigned i = 0; i < gProfileGlobals.trace.size(); i++)
+		{
+			const profileTraceEvent_t &e = gProfileGlobals.trace[i];
+			sprintf(event,
+					"%s\n{\"name\":\"%s\",\"cat\":\"match\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+					(0 == i) ? "" : ",",
+					PHASE_NAMES[e.phase],
+					1000000.0 * (e.start - gProfileGlobals.traceStart),
+					1000000.0 * (e.end - e.start),
+					e.thread);
+			outFile << event;
+		}
+		outFile << "\n],\"displayTimeUnit\":\"ms\"}" << endl;
+
+		ok = ! outFile.fail();
+	}
+
+	gProfileGlobals.trace.clear();
+	gProfileGlobals.threadNumbers.clear();
+
+#ifdef WIN32
+	LeaveCriticalSection(&gProfileGlobals.traceLock);
+#else
+	pthread_mutex_unlock(&gProfileGlobals.traceLock);
+#endif
+
+	return ok;
+}
+
+//*******************************************************************
+//
+// class ProfileCollector
+//
+ProfileCollector::ProfileCollector(MatchProfile *target)
+:	mTarget(target),
+	mPrevious(MatchProfile::current())
+{
+#ifdef WIN32
+	TlsSetValue(gProfileGlobals.currentKey, &mProfile);
+#else
+	pthread_setspecific(gProfileGlobals.currentKey, &mProfile);
+#endif
+}
+
+//*******************************************************************
+//
+ProfileCollector::~ProfileCollector()
+{
+#ifdef WIN32
+	TlsSetValue(gProfileGlobals.currentKey, mPrevious);
+#else
+	pthread_setspecific(gProfileGlobals.currentKey, mPrevious);
+#endif
+
+	if (NULL != mTarget)
+		mTarget->add(mProfile);
+}
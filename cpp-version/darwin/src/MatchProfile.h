@@ -0,0 +1,195 @@
+//*******************************************************************
+//   file: MatchProfile.h
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// Timers and counters for the phases of matching: reading catalog fins,
+// building outlines, registration, mapping, the error functions and
+// drawing.  A phase is timed by putting PROFILE_PHASE() at the top of
+// the block that does it, and counted with PROFILE_COUNT().  Times of
+// nested phases are inclusive.
+//
+// Each thread adds to the profile of the ProfileCollector that is
+// current on that thread, so timing never takes a lock.  When the
+// collector goes out of scope its totals are added, under a lock, to
+// the profile it collects for (see MatchResults::getProfile()).  With no
+// collector on a thread, PROFILE_PHASE() only reads the thread's current
+// profile, and building with DARWIN_NO_PROFILE removes even that.
+//
+// The coarse phases (those not called thousands of times per fin) can
+// also be kept as a timeline, and written in the Chrome trace event
+// format for chrome://tracing or Perfetto (see startTrace()).
+//
+//*******************************************************************
+
+#ifndef MATCHPROFILE_H
+#define MATCHPROFILE_H
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <iostream>
+#include <string>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+typedef enum {
+	PHASE_DB_GET_FIN = 0,     // SQLiteDatabase::getFin()
+	PHASE_OUTLINE_BUILD,      // Outline and Chain of a catalog fin
+	PHASE_SNAPSHOT_ADD,       // MatchSnapshot::addFin()
+	PHASE_REGISTER_FIN,       // registration of one catalog fin
+	PHASE_MAP_CONTOUR,        // mapContour()
+	PHASE_ERROR_MSE,          // mean squared error functions
+	PHASE_ERROR_AREA,         // area based error functions
+	PHASE_DISPLAY,            // MatchingDialog::showOutlines()
+	PHASE_SAVE_RESULTS,       // MatchResults::save()
+	NUM_PROFILE_PHASES
+} profilePhase_t;
+
+typedef enum {
+	COUNT_OPTIMIZER_ITERATIONS = 0,
+	NUM_PROFILE_COUNTERS
+} profileCounter_t;
+
+class MatchProfile
+{
+	public:
+		MatchProfile();
+		MatchProfile(const MatchProfile &profile);
+		~MatchProfile();
+
+		MatchProfile &operator=(const MatchProfile &profile);
+
+		void reset();
+
+		// adds the totals of profile, may be called from several threads
+		void add(const MatchProfile &profile);
+
+		bool empty() const;
+
+		double seconds(int phase) const;
+		long calls(int phase) const;
+		long count(int counter) const;
+
+		// one line per phase used and counter set, each starting with prefix
+		void summarize(std::ostream &out, std::string prefix) const;
+
+		// only called through ProfileScope and PROFILE_COUNT()
+		void addPhase(int phase, double start, double end)
+		{
+			mSeconds[phase] += end - start;
+			mCalls[phase]++;
+			if (sTracing && isTraced(phase))
+				traceEvent(phase, start, end);
+		}
+
+		void addCount(int counter, long n)
+		{
+			mCounts[counter] += n;
+		}
+
+		// profile of the calling thread's ProfileCollector, or NULL
+		static MatchProfile *current();
+
+		// seconds from an arbitrary start, high resolution
+		static double now();
+
+		static const char *phaseName(int phase);
+		static const char *counterName(int counter);
+
+		// The timeline of the coarse phases, on every thread, is kept from
+		// startTrace() until writeTrace() writes it (in Chrome trace event
+		// JSON) and stops.  Returns false if the file could not be written.
+		static void startTrace();
+		static bool writeTrace(std::string fileName);
+
+	private:
+		double mSeconds[NUM_PROFILE_PHASES];
+		long mCalls[NUM_PROFILE_PHASES];
+		long mCounts[NUM_PROFILE_COUNTERS];
+
+#ifdef WIN32
+		CRITICAL_SECTION mLock;
+#else
+		pthread_mutex_t mLock;
+#endif
+
+		static bool sTracing;
+
+		static bool isTraced(int phase);
+		static void traceEvent(int phase, double start, double end);
+
+		friend class ProfileCollector;
+};
+
+//*******************************************************************
+//
+// class ProfileCollector
+//
+//    Makes a profile of its own the current profile of the thread for
+//    as long as it exists, and then adds it to target (if not NULL).
+//    Collectors may be nested, the outer one being current again once
+//    the inner one is gone.
+//
+class ProfileCollector
+{
+	public:
+		ProfileCollector(MatchProfile *target);
+		~ProfileCollector();
+
+	private:
+		MatchProfile
+			mProfile,
+			*mTarget,
+			*mPrevious;
+
+		// not copied
+		ProfileCollector(const ProfileCollector &);
+		ProfileCollector &operator=(const ProfileCollector &);
+};
+
+//*******************************************************************
+//
+// class ProfileScope
+//
+//    Times one call of a phase into the thread's current profile.
+//
+class ProfileScope
+{
+	public:
+		ProfileScope(int phase)
+		:	mProfile(MatchProfile::current()),
+			mPhase(phase),
+			mStart(0.0)
+		{
+			if (NULL != mProfile)
+				mStart = MatchProfile::now();
+		}
+
+		~ProfileScope()
+		{
+			if (NULL != mProfile)
+				mProfile->addPhase(mPhase, mStart, MatchProfile::now());
+		}
+
+	private:
+		MatchProfile *mProfile;
+		int mPhase;
+		double mStart;
+};
+
+#ifdef DARWIN_NO_PROFILE
+#define PROFILE_PHASE(phase)
+#define PROFILE_COUNT(counter, n)
+#else
+#define PROFILE_PHASE(phase)       ProfileScope profileScope(phase)
+#define PROFILE_COUNT(counter, n) \
+	{ MatchProfile *currentProfile = MatchProfile::current(); \
+	  if (NULL != currentProfile) currentProfile->addCount(counter, n); }
+#endif
+
+#endif
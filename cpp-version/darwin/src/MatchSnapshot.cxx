@@ -0,0 +1,392 @@
+//*******************************************************************
+//   file: MatchSnapshot.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+//*******************************************************************
+
+#include "MatchSnapshot.h"
+#include "MatchCache.h"
+#include "MatchProfile.h"
+#include "Database.h"
+#include "Error.h"
+
+using namespace std;
+
+//*******************************************************************
+//
+MatchSnapshot::MatchSnapshot(Database *db)
+	: mDatabase(db)
+{
+}
+
+//*******************************************************************
+//
+MatchSnapshot::~MatchSnapshot()
+{
+}
+
+//*******************************************************************
+//
+// int MatchSnapshot::fetch(int finID)
+//
+//    Loads the fin through Database::getItemAbsolute() only the first
+//    time it is asked for.  Holes are remembered too, so a deleted fin
+//    is not looked up again.
+//
+int MatchSnapshot::fetch(int finID)
+{
+	if (finID < 0)
+		throw InvalidArgumentError("MatchSnapshot::fetch() [int finID]");
+
+	if (finID >= (int)mIndexOfFin.size())
+		mIndexOfFin.resize(finID + 1, NOT_FETCHED);
+
+	if (NOT_FETCHED != mIndexOfFin[finID])
+		return mIndexOfFin[finID];
+
+	if (NULL == mDatabase)
+		throw Error("MatchSnapshot::fetch() no database to fetch from");
+
+	DatabaseFin<ColorImage> *fin = mDatabase->getItemAbsolute(finID);
+
+	if (NULL == fin)
+	{
+		mIndexOfFin[finID] = -1;
+		return -1;
+	}
+
+	try {
+		addFin(fin, finID); // sets mIndexOfFin[finID]
+	} catch (...) {
+		delete fin;
+		throw;
+	}
+
+	delete fin;
+
+	return mIndexOfFin[finID];
+}
+
+//*******************************************************************
+//
+void MatchSnapshot::forget(int finID)
+{
+	if ((finID >= 0) && (finID < (int)mIndexOfFin.size()))
+		mIndexOfFin[finID] = NOT_FETCHED;
+}
+
+//*******************************************************************
+//
+int MatchSnapshot::addFin(DatabaseFin<ColorImage> *fin, int finID)
+{
+	PROFILE_PHASE(PHASE_SNAPSHOT_ADD);
+
+	if (NULL == fin)
+		throw EmptyArgumentError("MatchSnapshot::addFin() [DatabaseFin<ColorImage> *fin]");
+
+	int i = mFinID.size();
+
+	Outline *outline = fin->mFinOutline;
+	FloatContour *contour = outline->getFloatContour();
+	int length = contour->length();
+
+	mFinID.push_back(finID);
+	mDataPos.push_back((int)fin->mDataPos);
+	mStart.push_back(mX.size());
+	mLength.push_back(length);
+
+	for (int p = 0; p < length; p++)
+	{
+		mX.push_back((*contour)[p].x);
+		mY.push_back((*contour)[p].y);
+	}
+
+	//***2.3 - coarser levels of the outline pyramid
+	for (int level = 1; level < OUTLINE_PYRAMID_LEVELS; level++)
+	{
+		mLevelStart[level - 1].push_back(mLevelX[level - 1].size());
+
+		for (int p = 0; p < length; p += (1 << level))
+		{
+			mLevelX[level - 1].push_back((*contour)[p].x);
+			mLevelY[level - 1].push_back((*contour)[p].y);
+		}
+	}
+
+	mBeginLE.push_back(outline->getFeaturePoint(LE_BEGIN));
+	mEndLE.push_back(outline->getFeaturePoint(LE_END));
+	mNotch.push_back(outline->getFeaturePoint(NOTCH));
+	mTip.push_back(outline->getFeaturePoint(TIP));
+	mEndTE.push_back(outline->getFeaturePoint(POINT_OF_INFLECTION));
+
+	mDescriptor.resize(mDescriptor.size() + SHAPE_DESCRIPTOR_SIZE);
+	shapeDescriptor(contour, mBeginLE.back(), mTip.back(), mEndTE.back(),
+	                &mDescriptor[mDescriptor.size() - SHAPE_DESCRIPTOR_SIZE]);
+
+	int features[] = {mBeginLE.back(), mEndLE.back(), mNotch.back(), mTip.back(), mEndTE.back()};
+	mOutlineHash.push_back(::outlineHash(&mX[mStart.back()], &mY[mStart.back()], length, features, 5));
+
+	mDamage.push_back(fin->mDamageCategory);
+	mIDCode.push_back(fin->mIDCode);
+	mName.push_back(fin->mName);
+	mDateOfSighting.push_back(fin->mDateOfSighting);
+	mLocationCode.push_back(fin->mLocationCode);
+	mImageFilename.push_back(fin->mImageFilename);
+
+	if (finID >= 0)
+	{
+		if (finID >= (int)mIndexOfFin.size())
+			mIndexOfFin.resize(finID + 1, NOT_FETCHED);
+		mIndexOfFin[finID] = i;
+	}
+
+	return i;
+}
+
+//*******************************************************************
+//
+int MatchSnapshot::size() const
+{
+	return mFinID.size();
+}
+
+//*******************************************************************
+//
+int MatchSnapshot::finID(int i) const
+{
+	return mFinID[i];
+}
+
+//*******************************************************************
+//
+int MatchSnapshot::dataPos(int i) const
+{
+	return mDataPos[i];
+}
+
+//*******************************************************************
+//
+int MatchSnapshot::numPoints(int i) const
+{
+	return mLength[i];
+}
+
+//*******************************************************************
+//
+const float *MatchSnapshot::xCoords(int i) const
+{
+	return &mX[mStart[i]];
+}
+
+//*******************************************************************
+//
+const float *MatchSnapshot::yCoords(int i) const
+{
+	return &mY[mStart[i]];
+}
+
+//*******************************************************************
+//
+// int MatchSnapshot::featurePoint(int i, int type) const
+//
+//    Same feature point types and errors as Outline::getFeaturePoint().
+//
+int MatchSnapshot::featurePoint(int i, int type) const
+{
+	switch (type)
+	{
+	case TIP:
+		return mTip[i];
+	case NOTCH:
+		return mNotch[i];
+	case LE_BEGIN:
+		return mBeginLE[i];
+	case LE_END:
+		return mEndLE[i];
+	case POINT_OF_INFLECTION:
+		return mEndTE[i];
+	default:
+		throw InvalidArgumentError("MatchSnapshot::featurePoint() [int type]");
+	}
+}
+
+//*******************************************************************
+//
+point_t MatchSnapshot::featurePointCoords(int i, int type) const
+{
+	int p = mStart[i] + featurePoint(i, type);
+
+	point_t pt;
+	pt.x = mX[p];
+	pt.y = mY[p];
+	pt.z = 0.0;
+
+	return pt;
+}
+
+//*******************************************************************
+//
+const float *MatchSnapshot::descriptor(int i) const
+{
+	return &mDescriptor[i * SHAPE_DESCRIPTOR_SIZE];
+}
+
+//*******************************************************************
+//
+const string &MatchSnapshot::outlineHash(int i) const
+{
+	return mOutlineHash[i];
+}
+
+//*******************************************************************
+//
+FloatContour *MatchSnapshot::newFloatContour(int i) const
+{
+	FloatContour *contour = new FloatContour();
+
+	int
+		start = mStart[i],
+		end = mStart[i] + mLength[i];
+
+	for (int p = start; p < end; p++)
+		contour->addPoint(mX[p], mY[p]);
+
+	return contour;
+}
+
+//*******************************************************************
+//
+FloatContour *MatchSnapshot::newFloatContour(int i, int level) const
+{
+	if (0 == level)
+		return newFloatContour(i);
+
+	if ((level < 0) || (level >= OUTLINE_PYRAMID_LEVELS))
+		throw BoundsError("MatchSnapshot::newFloatContour() [int level]");
+
+	const vector<float>
+		&x = mLevelX[level - 1],
+		&y = mLevelY[level - 1];
+
+	FloatContour *contour = new FloatContour();
+
+	int
+		start = mLevelStart[level - 1][i],
+		end = start + (mLength[i] + (1 << level) - 1) / (1 << level);
+
+	for (int p = start; p < end; p++)
+		contour->addPoint(x[p], y[p]);
+
+	return contour;
+}
+
+//*******************************************************************
+//
+const string &MatchSnapshot::damage(int i) const
+{
+	return mDamage[i];
+}
+
+const string &MatchSnapshot::idCode(int i) const
+{
+	return mIDCode[i];
+}
+
+const string &MatchSnapshot::name(int i) const
+{
+	return mName[i];
+}
+
+const string &MatchSnapshot::dateOfSighting(int i) const
+{
+	return mDateOfSighting[i];
+}
+
+const string &MatchSnapshot::locationCode(int i) const
+{
+	return mLocationCode[i];
+}
+
+const string &MatchSnapshot::imageFilename(int i) const
+{
+	return mImageFilename[i];
+}
+
+
+//*******************************************************************
+//
+// class SnapshotFin
+//
+SnapshotFin::SnapshotFin(const MatchSnapshot *snapshot, int i)
+	: mSnapshot(snapshot),
+	  mIndex(i),
+	  mFloatContour(NULL)
+{
+	for (int level = 1; level < OUTLINE_PYRAMID_LEVELS; level++)
+		mLevelContour[level - 1] = NULL;
+}
+
+//*******************************************************************
+//
+SnapshotFin::~SnapshotFin()
+{
+	delete mFloatContour;
+
+	for (int level = 1; level < OUTLINE_PYRAMID_LEVELS; level++)
+		delete mLevelContour[level - 1];
+}
+
+//*******************************************************************
+//
+int SnapshotFin::getFeaturePoint(int type) const
+{
+	return mSnapshot->featurePoint(mIndex, type);
+}
+
+//*******************************************************************
+//
+point_t SnapshotFin::getFeaturePointCoords(int type) const
+{
+	return mSnapshot->featurePointCoords(mIndex, type);
+}
+
+//*******************************************************************
+//
+// FloatContour *SnapshotFin::getFloatContour() const
+//
+//    Built on first use and owned by this SnapshotFin, like the
+//    chain points returned by Outline::getFloatContour().
+//
+FloatContour *SnapshotFin::getFloatContour() const
+{
+	if (NULL == mFloatContour)
+		mFloatContour = mSnapshot->newFloatContour(mIndex);
+
+	return mFloatContour;
+}
+
+//*******************************************************************
+//
+FloatContour *SnapshotFin::getFloatContour(int level) const
+{
+	if (0 == level)
+		return getFloatContour();
+
+	if ((level < 0) || (level >= OUTLINE_PYRAMID_LEVELS))
+		throw BoundsError("SnapshotFin::getFloatContour() [int level]");
+
+	if (NULL == mLevelContour[level - 1])
+		mLevelContour[level - 1] = mSnapshot->newFloatContour(mIndex, level);
+
+	return mLevelContour[level - 1];
+}
+
+//*******************************************************************
+//
+string SnapshotFin::getID() const
+{
+	return mSnapshot->idCode(mIndex);
+}
@@ -0,0 +1,164 @@
+//*******************************************************************
+//   file: MatchSnapshot.h
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// A read-only, in-memory copy of the parts of each catalog fin that
+// matching needs: the evenly spaced outline points, the feature point
+// indices, a shape descriptor (see shapeDescriptor.h), an outline hash
+// (see MatchCache.h), the damage category and the few fields shown in
+// the match results.  Outline points of all fins are kept in one pair
+// of x and y arrays (fin after fin), so no Outline, Chain or DatabaseFin
+// has to be rebuilt for every comparison.  The coarser levels of each
+// outline's pyramid (see OUTLINE_PYRAMID_LEVELS) are kept the same way,
+// for coarse-to-fine registration (see Match::setCoarseToFine()).
+//
+// The snapshot belongs to the Database (see Database::getMatchSnapshot())
+// and is filled the first time each fin is matched.  The Database
+// deletes it whenever a fin is added, updated or deleted, or forgets
+// just the fins changed by another program (see
+// Database::reloadChanged()).
+//
+//*******************************************************************
+
+#ifndef MATCHSNAPSHOT_H
+#define MATCHSNAPSHOT_H
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <string>
+#include <vector>
+#include "DatabaseFin.h"
+#include "FloatContour.h"
+#include "Point.h"
+#include "shapeDescriptor.h"
+
+class Database;
+
+class MatchSnapshot
+{
+	public:
+		// db is only used to fetch fins not yet in the snapshot, and may be
+		// NULL for a snapshot filled by addFin() alone
+		MatchSnapshot(Database *db);
+		~MatchSnapshot();
+
+		// Index in the snapshot of the catalog fin at absolute position
+		// finID (as for Database::getItemAbsolute()), fetching the fin
+		// from the database the first time.  Returns -1 for deleted fins.
+		int fetch(int finID);
+
+		// Appends a copy of the matching data of fin as catalog fin finID
+		// and returns its index in the snapshot.
+		int addFin(DatabaseFin<ColorImage> *fin, int finID);
+
+		// The catalog fin at absolute position finID is fetched again the
+		// next time it is asked for.  Its old copy is left unused, so
+		// snapshot indices already handed out stay valid.
+		void forget(int finID);
+
+		int size() const;
+
+		// accessors, all by index in the snapshot
+
+		int finID(int i) const;
+		int dataPos(int i) const; // DatabaseFin::mDataPos
+
+		int numPoints(int i) const;
+		const float *xCoords(int i) const;
+		const float *yCoords(int i) const;
+
+		int featurePoint(int i, int type) const;
+		point_t featurePointCoords(int i, int type) const;
+
+		// SHAPE_DESCRIPTOR_SIZE values, see shapeDescriptor.h
+		const float *descriptor(int i) const;
+
+		// outlineHash() of the outline and feature points
+		const std::string &outlineHash(int i) const;
+
+		FloatContour *newFloatContour(int i) const; // caller must delete
+
+		// level 0 < level < OUTLINE_PYRAMID_LEVELS of the outline pyramid,
+		// as FloatContour::subsample(1 << level) of the outline would be
+		FloatContour *newFloatContour(int i, int level) const; // caller must delete
+
+		const std::string &damage(int i) const;
+		const std::string &idCode(int i) const;
+		const std::string &name(int i) const;
+		const std::string &dateOfSighting(int i) const;
+		const std::string &locationCode(int i) const;
+		const std::string &imageFilename(int i) const;
+
+	private:
+		Database *mDatabase;
+
+		// by absolute position in the catalog: index in snapshot,
+		// NOT_FETCHED, or -1 for a hole left by a deleted fin
+		std::vector<int> mIndexOfFin;
+
+		// outline points of all fins, fin after fin
+		std::vector<float> mX, mY;
+
+		// outline points of all fins at each coarser level of the outline
+		// pyramid (by level - 1), fin after fin, and the first point of
+		// each fin in them
+		std::vector<float> mLevelX[OUTLINE_PYRAMID_LEVELS - 1], mLevelY[OUTLINE_PYRAMID_LEVELS - 1];
+		std::vector<int> mLevelStart[OUTLINE_PYRAMID_LEVELS - 1];
+
+		// shape descriptors of all fins, fin after fin
+		std::vector<float> mDescriptor;
+
+		std::vector<int>
+			mFinID,
+			mDataPos,
+			mStart,   // first point of each fin in mX, mY
+			mLength,  // number of points of each fin
+			mBeginLE,
+			mEndLE,
+			mNotch,
+			mTip,
+			mEndTE;
+
+		std::vector<std::string>
+			mOutlineHash,
+			mDamage,
+			mIDCode,
+			mName,
+			mDateOfSighting,
+			mLocationCode,
+			mImageFilename;
+
+		static const int NOT_FETCHED = -2;
+};
+
+//*******************************************************************
+//
+// One fin of a MatchSnapshot, with the same feature point accessors
+// as Outline so that the registration code can use either.  The
+// FloatContour is only built if it is asked for.
+//
+class SnapshotFin
+{
+	public:
+		SnapshotFin(const MatchSnapshot *snapshot, int i);
+		~SnapshotFin();
+
+		int getFeaturePoint(int type) const;
+		point_t getFeaturePointCoords(int type) const;
+		FloatContour *getFloatContour() const;
+
+		// 2.3 - level of the outline pyramid, level 0 being getFloatContour()
+		FloatContour *getFloatContour(int level) const;
+
+		std::string getID() const;
+
+	private:
+		const MatchSnapshot *mSnapshot;
+		int mIndex;
+		mutable FloatContour *mFloatContour;
+		mutable FloatContour *mLevelContour[OUTLINE_PYRAMID_LEVELS - 1]; // 2.3
+};
+
+#endif
@@ -491,6 +491,8 @@ unsigned long OldDatabase::add(DatabaseFin<ColorImage> *data) //***1.85
 		int version = CURRENT_DBVERSION; //***001DB
 		if (!mDbFile)
 			return false;
+
+		invalidateMatchSnapshot(); //***2.3
 	
 		//***054 - assume that the filename for the image file contains path
 		// information which must be stripped BEFORE saving fin in file and
@@ -1289,6 +1291,8 @@ void OldDatabase::Delete(DatabaseFin<ColorImage> *Fin){
 	// First delete Fin from the list ..  
 	DeleteFinFromList(Fin);
 
+	invalidateMatchSnapshot(); //***2.3
+
 	unsigned long numEntries = mNameList.size();
   
 	if(numEntries == 0)
@@ -46,7 +46,15 @@ class Options
 			mCurrentSurveyArea(""), //***2.22 - default is now NO default survey area
 			mCurrentDataPath(""), //***2.22 - NO default data path - figure out from $HOME or $HOMEPATH
 			mNumberOfDefinedCatalogSchemes(0), //***1.4 - none is default
-			mHideIDs(true) //***1.65
+			mHideIDs(true), //***1.65
+			mUseMatchTopK(false), //***2.3
+			mMatchTopK(20),       //***2.3
+			mUseMatchPrefilter(false),     //***2.3
+			mMatchShortlistFraction(0.25f), //***2.3
+			mUseMatchCache(true),           //***2.3
+			mUseCoarseToFine(false),        //***2.3
+			mUseOutlineIndex(false),        //***2.3
+			mOutlineIndexCandidates(200)    //***2.3
 		{
 			mCurrentColor[0] = 0.0;
 			mCurrentColor[1] = 1.0;
@@ -146,6 +154,22 @@ class Options
 		bool mHideIDs; //***1.65 - hide or show dolphin IDs throughout software
 		               // used for blind testing at EC
 
+		bool mUseMatchTopK; //***2.3 - only fully optimize fins that can still
+		int mMatchTopK;     // rank in the top mMatchTopK (see Match::setTopK())
+
+		bool mUseMatchPrefilter;        //***2.3 - register only the fraction of the
+		float mMatchShortlistFraction;  // catalog with the most similar shape descriptors
+
+		bool mUseMatchCache; //***2.3 - keep match results in the catalog database
+		                     // and reuse them (see MatchCache.h)
+
+		bool mUseCoarseToFine; //***2.3 - make the early registration moves on
+		                       // coarse outlines (see Match::setCoarseToFine())
+
+		bool mUseOutlineIndex;        //***2.3 - register only the catalog fins nearest
+		int mOutlineIndexCandidates;  // the unknown in the outline index (see
+		                              // Match::setNearestCandidates())
+
 		std::string
 			mCurrentFontName; //***1.85 - font for all lists and txt fields
 
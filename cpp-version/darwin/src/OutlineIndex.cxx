@@ -0,0 +1,572 @@
+//*******************************************************************
+//   file: OutlineIndex.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+//*******************************************************************
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "OutlineIndex.h"
+#include "mapContour.h"
+#include "Error.h"
+
+using namespace std;
+
+// where the beginning of the leading edge, the tip and the end of the
+// trailing edge are moved to before the edges are resampled
+static const float CANONICAL_X[3] = {0.0f, 0.5f, 1.0f};
+static const float CANONICAL_Y[3] = {0.0f, 1.0f, 0.0f};
+
+// Jacobi sweeps allowed when finding the principal components
+#define MAX_JACOBI_SWEEPS  50
+
+//*******************************************************************
+//
+// static void resampleEdge(const FloatContour *c, int from, int to,
+//                          const float transformCoeff[2][3], float *values)
+//
+//    OUTLINE_EMBEDDING_POINTS points evenly spaced (by index) strictly
+//    between points from and to of c, moved by the transform, as x and
+//    y pairs.
+//
+static void resampleEdge(
+		const FloatContour *c,
+		int from,
+		int to,
+		const float transformCoeff[2][3],
+		float *values)
+{
+	for (int k = 0; k < OUTLINE_EMBEDDING_POINTS; k++)
+	{
+		double
+			place = from + (double)(to - from) * (k + 1) / (OUTLINE_EMBEDDING_POINTS + 1),
+			fraction = place - floor(place);
+
+		int i = (int)floor(place);
+
+		double
+			x = (*c)[i].x,
+			y = (*c)[i].y;
+
+		if ((fraction > 0.0) && (i + 1 < c->length()))
+		{
+			x += fraction * ((*c)[i+1].x - x);
+			y += fraction * ((*c)[i+1].y - y);
+		}
+
+		values[2*k]     = (float)(transformCoeff[0][0] * x + transformCoeff[0][1] * y + transformCoeff[0][2]);
+		values[2*k + 1] = (float)(transformCoeff[1][0] * x + transformCoeff[1][1] * y + transformCoeff[1][2]);
+	}
+}
+
+//*******************************************************************
+//
+// bool outlineEmbedding(const FloatContour *c, int begin, int tip,
+//                       int end, float embedding[OUTLINE_EMBEDDING_SIZE])
+//
+//    ***2.3 - Fills embedding with the leading edge (begin to tip) and
+//    then the trailing edge (tip to end), each after the affine
+//    transform that takes begin, tip and end to the canonical points.
+//
+bool outlineEmbedding(
+		const FloatContour *c,
+		int begin,
+		int tip,
+		int end,
+		float embedding[OUTLINE_EMBEDDING_SIZE])
+{
+	if (NULL == c)
+		throw EmptyArgumentError("outlineEmbedding() [const FloatContour *c]");
+
+	if ((begin < 0) || (begin >= tip) || (tip >= end) || (end >= c->length()))
+		return false;
+
+	point_t canonical[3];
+	for (int p = 0; p < 3; p++)
+	{
+		canonical[p].x = CANONICAL_X[p];
+		canonical[p].y = CANONICAL_Y[p];
+		canonical[p].z = 0.0f;
+	}
+
+	float transformCoeff[2][3];
+
+	if (! affineMapCoefficients(
+			(*c)[begin], (*c)[tip], (*c)[end],
+			canonical[0], canonical[1], canonical[2],
+			transformCoeff))
+		return false;
+
+	resampleEdge(c, begin, tip, transformCoeff, embedding);
+	resampleEdge(c, tip, end, transformCoeff, embedding + 2 * OUTLINE_EMBEDDING_POINTS);
+
+	return true;
+}
+
+//*******************************************************************
+//
+// static void symmetricEigen(int n, vector<double> &a,
+//                            vector<double> &values, vector<double> &vectors)
+//
+//    Eigenvalues and eigenvectors (the columns of vectors, n by n row
+//    by row) of the symmetric matrix a (n by n row by row, destroyed)
+//    by cyclic Jacobi rotations.
+//
+static void symmetricEigen(
+		int n,
+		vector<double> &a,
+		vector<double> &values,
+		vector<double> &vectors)
+{
+	vectors.assign(n * n, 0.0);
+	for (int i = 0; i < n; i++)
+		vectors[i * n + i] = 1.0;
+
+	double total = 0.0;
+	for (int i = 0; i < n * n; i++)
+		total += a[i] * a[i];
+
+	for (int sweep = 0; sweep < MAX_JACOBI_SWEEPS; sweep++)
+	{
+		double off = 0.0;
+		for (int p = 0; p < n; p++)
+			for (int q = p + 1; q < n; q++)
+				off += a[p * n + q] * a[p * n + q];
+
+		if (off <= 1e-24 * total)
+			break;
+
+		for (int p = 0; p < n; p++)
+			for (int q = p + 1; q < n; q++)
+			{
+				double apq = a[p * n + q];
+
+				if (fabs(apq) <= 1e-300)
+					continue;
+
+				double
+					theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq),
+					t = ((theta < 0.0) ? -1.0 : 1.0) / (fabs(theta) + sqrt(theta * theta + 1.0)),
+					c = 1.0 / sqrt(t * t + 1.0),
+					s = t * c;
+
+				int k;
+
+				// a = J' a J, and vectors = vectors J
+				for (k = 0; k < n; k++)
+				{
+					double akp = a[k * n + p], akq = a[k * n + q];
+					a[k * n + p] = c * akp - s * akq;
+					a[k * n + q] = s * akp + c * akq;
+				}
+				for (k = 0; k < n; k++)
+				{
+					double apk = a[p * n + k], aqk = a[q * n + k];
+					a[p * n + k] = c * apk - s * aqk;
+					a[q * n + k] = s * apk + c * aqk;
+				}
+				for (k = 0; k < n; k++)
+				{
+					double vkp = vectors[k * n + p], vkq = vectors[k * n + q];
+					vectors[k * n + p] = c * vkp - s * vkq;
+					vectors[k * n + q] = s * vkp + c * vkq;
+				}
+			}
+	}
+
+	values.resize(n);
+	for (int i = 0; i < n; i++)
+		values[i] = a[i * n + i];
+}
+
+//*******************************************************************
+//
+OutlineIndex::OutlineIndex()
+	: mBuilt(false)
+{
+	for (int j = 0; j < OUTLINE_EMBEDDING_SIZE; j++)
+		mMean[j] = 0.0f;
+
+	for (int d = 0; d < OUTLINE_INDEX_DIMENSIONS; d++)
+		for (int j = 0; j < OUTLINE_EMBEDDING_SIZE; j++)
+			mBasis[d][j] = 0.0f;
+}
+
+//*******************************************************************
+//
+void OutlineIndex::add(int position, const float *embedding)
+{
+	if (mBuilt)
+		throw Error("OutlineIndex::add() after build()");
+
+	if (position < 0)
+		throw BoundsError("OutlineIndex::add()");
+
+	if (NULL == embedding)
+	{
+		mUnindexed.push_back(position);
+		return;
+	}
+
+	if (position >= (int)mEntryOfPosition.size())
+		mEntryOfPosition.resize(position + 1, -1);
+
+	mEntryOfPosition[position] = mPositions.size();
+	mPositions.push_back(position);
+	mEmbeddings.insert(mEmbeddings.end(), embedding, embedding + OUTLINE_EMBEDDING_SIZE);
+}
+
+//*******************************************************************
+//
+// void OutlineIndex::build()
+//
+//    The principal components are the eigenvectors of the covariance
+//    of the embeddings with the largest eigenvalues.  The embeddings
+//    are not needed once they are projected onto them.
+//
+void OutlineIndex::build()
+{
+	if (mBuilt)
+		return;
+
+	mBuilt = true;
+
+	int
+		numEntries = mPositions.size(),
+		n = OUTLINE_EMBEDDING_SIZE,
+		e, i, j, d;
+
+	if (0 == numEntries)
+		return;
+
+	vector<double> mean(n, 0.0);
+	for (e = 0; e < numEntries; e++)
+		for (j = 0; j < n; j++)
+			mean[j] += mEmbeddings[e * n + j];
+	for (j = 0; j < n; j++)
+	{
+		mean[j] /= numEntries;
+		mMean[j] = (float)mean[j];
+	}
+
+	vector<double>
+		covariance(n * n, 0.0),
+		centered(n);
+
+	for (e = 0; e < numEntries; e++)
+	{
+		for (j = 0; j < n; j++)
+			centered[j] = mEmbeddings[e * n + j] - mean[j];
+
+		for (i = 0; i < n; i++)
+			for (j = i; j < n; j++)
+				covariance[i * n + j] += centered[i] * centered[j];
+	}
+
+	for (i = 0; i < n; i++)
+		for (j = i; j < n; j++)
+			covariance[j * n + i] = covariance[i * n + j];
+
+	vector<double> values, vectors;
+	symmetricEigen(n, covariance, values, vectors);
+
+	// (-eigenvalue, column), ties to the earlier column
+	vector<pair<double,int> > order(n);
+	for (j = 0; j < n; j++)
+		order[j] = make_pair(-values[j], j);
+	sort(order.begin(), order.end());
+
+	for (d = 0; d < OUTLINE_INDEX_DIMENSIONS; d++)
+		for (j = 0; j < n; j++)
+			mBasis[d][j] = (float)vectors[j * n + order[d].second];
+
+	mProjected.resize(numEntries * OUTLINE_INDEX_DIMENSIONS);
+	for (e = 0; e < numEntries; e++)
+		project(&mEmbeddings[e * n], &mProjected[e * OUTLINE_INDEX_DIMENSIONS]);
+
+	vector<float>().swap(mEmbeddings);
+
+	mOrder.resize(numEntries);
+	for (e = 0; e < numEntries; e++)
+		mOrder[e] = e;
+	mRadius.assign(numEntries, 0.0f);
+
+	unsigned long random = 12345UL; // the same tree every time
+	buildTree(0, numEntries, random);
+}
+
+//*******************************************************************
+//
+int OutlineIndex::size() const
+{
+	return mPositions.size();
+}
+
+//*******************************************************************
+//
+const vector<int> &OutlineIndex::unindexed() const
+{
+	return mUnindexed;
+}
+
+//*******************************************************************
+//
+void OutlineIndex::project(const float *embedding, float *projected) const
+{
+	for (int d = 0; d < OUTLINE_INDEX_DIMENSIONS; d++)
+	{
+		double sum = 0.0;
+		for (int j = 0; j < OUTLINE_EMBEDDING_SIZE; j++)
+			sum += mBasis[d][j] * (embedding[j] - mMean[j]);
+		projected[d] = (float)sum;
+	}
+}
+
+//*******************************************************************
+//
+float OutlineIndex::distance(const float *projected, int entry) const
+{
+	const float *other = &mProjected[entry * OUTLINE_INDEX_DIMENSIONS];
+
+	float sum = 0.0f;
+	for (int d = 0; d < OUTLINE_INDEX_DIMENSIONS; d++)
+	{
+		float diff = projected[d] - other[d];
+		sum += diff * diff;
+	}
+
+	return sqrt(sum);
+}
+
+//*******************************************************************
+//
+// void OutlineIndex::buildTree(int lo, int hi, unsigned long &random)
+//
+//    Picks a vantage point for the range [lo,hi) of mOrder at random,
+//    moves it to lo and splits the rest of the range at the median of
+//    their distances from it.
+//
+void OutlineIndex::buildTree(int lo, int hi, unsigned long &random)
+{
+	while (hi - lo > 1)
+	{
+		random = (random * 1103515245UL + 12345UL) & 0x7fffffffUL;
+		swap(mOrder[lo], mOrder[lo + random % (hi - lo)]);
+
+		const float *vantage = &mProjected[mOrder[lo] * OUTLINE_INDEX_DIMENSIONS];
+
+		// (distance, entry) of the others
+		vector<pair<float,int> > others(hi - lo - 1);
+		for (int i = lo + 1; i < hi; i++)
+			others[i - lo - 1] = make_pair(distance(vantage, mOrder[i]), mOrder[i]);
+
+		int mid = lo + 1 + (hi - lo - 1) / 2;
+
+		nth_element(others.begin(), others.begin() + (mid - lo - 1), others.end());
+
+		for (int i = lo + 1; i < hi; i++)
+			mOrder[i] = others[i - lo - 1].second;
+
+		mRadius[lo] = others[mid - lo - 1].first;
+
+		buildTree(lo + 1, mid, random);
+
+		lo = mid; // the outer range, without recursion
+	}
+}
+
+//*******************************************************************
+//
+bool OutlineIndex::isAccepted(int entry, const vector<char> &accept) const
+{
+	int position = mPositions[entry];
+
+	return (position < (int)accept.size()) && accept[position];
+}
+
+//*******************************************************************
+//
+// void OutlineIndex::searchNearest(...)
+//
+//    Adds the accepted entries of the range [lo,hi) of mOrder that are
+//    nearer than the k in heap (a max heap of (distance, position)).  A
+//    side of the split is skipped when the triangle inequality puts all
+//    of it further away than the k-th nearest found so far.
+//
+void OutlineIndex::searchNearest(
+		int lo,
+		int hi,
+		const float *query,
+		int k,
+		const vector<char> &accept,
+		vector<pair<float,int> > &heap) const
+{
+	if (lo >= hi)
+		return;
+
+	int entry = mOrder[lo];
+	float d = distance(query, entry);
+
+	if (isAccepted(entry, accept))
+	{
+		pair<float,int> found(d, mPositions[entry]);
+
+		if ((int)heap.size() < k)
+		{
+			heap.push_back(found);
+			push_heap(heap.begin(), heap.end());
+		}
+		else if (found < heap.front())
+		{
+			pop_heap(heap.begin(), heap.end());
+			heap.back() = found;
+			push_heap(heap.begin(), heap.end());
+		}
+	}
+
+	if (hi - lo == 1)
+		return;
+
+	int mid = lo + 1 + (hi - lo - 1) / 2;
+	float radius = mRadius[lo];
+
+	if (d <= radius)
+	{
+		searchNearest(lo + 1, mid, query, k, accept, heap);
+		if (((int)heap.size() < k) || (radius - d <= heap.front().first))
+			searchNearest(mid, hi, query, k, accept, heap);
+	}
+	else
+	{
+		searchNearest(mid, hi, query, k, accept, heap);
+		if (((int)heap.size() < k) || (d - radius <= heap.front().first))
+			searchNearest(lo + 1, mid, query, k, accept, heap);
+	}
+}
+
+//*******************************************************************
+//
+void OutlineIndex::nearest(
+		const float embedding[OUTLINE_EMBEDDING_SIZE],
+		int k,
+		const vector<char> &accept,
+		vector<int> *positions) const
+{
+	positions->clear();
+
+	if (! mBuilt)
+		throw Error("OutlineIndex::nearest() before build()");
+
+	if ((k < 1) || mPositions.empty())
+		return;
+
+	float query[OUTLINE_INDEX_DIMENSIONS];
+	project(embedding, query);
+
+	vector<pair<float,int> > heap;
+	heap.reserve(k);
+
+	searchNearest(0, mOrder.size(), query, k, accept, heap);
+
+	sort_heap(heap.begin(), heap.end());
+
+	for (int i = 0; i < (int)heap.size(); i++)
+		positions->push_back(heap[i].second);
+}
+
+//*******************************************************************
+//
+int OutlineIndex::numAccepted(const vector<char> &accept) const
+{
+	int count = 0;
+
+	for (int e = 0; e < (int)mPositions.size(); e++)
+		if (isAccepted(e, accept))
+			count++;
+
+	return count;
+}
+
+//*******************************************************************
+//
+// int OutlineIndex::countWithin(...)
+//
+//    Number of accepted entries of the range [lo,hi) of mOrder nearer
+//    the query than radius.
+//
+int OutlineIndex::countWithin(
+		int lo,
+		int hi,
+		const float *query,
+		float radius,
+		const vector<char> &accept) const
+{
+	if (lo >= hi)
+		return 0;
+
+	int entry = mOrder[lo];
+	float d = distance(query, entry);
+
+	int count = ((d < radius) && isAccepted(entry, accept)) ? 1 : 0;
+
+	if (hi - lo > 1)
+	{
+		int mid = lo + 1 + (hi - lo - 1) / 2;
+
+		if (d - radius < mRadius[lo])
+			count += countWithin(lo + 1, mid, query, radius, accept);
+
+		if (d + radius > mRadius[lo])
+			count += countWithin(mid, hi, query, radius, accept);
+	}
+
+	return count;
+}
+
+//*******************************************************************
+//
+// int OutlineIndex::rank(...)
+//
+//    Ties with the nearest of the given fins go to it.
+//
+int OutlineIndex::rank(
+		const float embedding[OUTLINE_EMBEDDING_SIZE],
+		const vector<int> &positions,
+		const vector<char> &accept) const
+{
+	if (! mBuilt)
+		throw Error("OutlineIndex::rank() before build()");
+
+	float query[OUTLINE_INDEX_DIMENSIONS];
+	project(embedding, query);
+
+	float best = -1.0f;
+
+	for (int i = 0; i < (int)positions.size(); i++)
+	{
+		int position = positions[i];
+
+		if ((position < 0) || (position >= (int)mEntryOfPosition.size()))
+			continue;
+
+		int entry = mEntryOfPosition[position];
+
+		if ((-1 == entry) || ! isAccepted(entry, accept))
+			continue;
+
+		float d = distance(query, entry);
+		if ((best < 0.0f) || (d < best))
+			best = d;
+	}
+
+	if (best < 0.0f)
+		return -1;
+
+	return 1 + countWithin(0, mOrder.size(), query, best, accept);
+}
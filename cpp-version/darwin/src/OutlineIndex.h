@@ -0,0 +1,137 @@
+//*******************************************************************
+//   file: OutlineIndex.h
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// ***2.3 - A nearest neighbour index over the outlines of a catalog,
+// so that a large catalog can be cut down to the few fins most like
+// the unknown without reading the others (see
+// Match::setNearestCandidates()).
+//
+// Each outline is summarized by a fixed length embedding: the outline
+// is moved by the affine transform taking its beginning of leading
+// edge, tip and end of trailing edge to fixed points, as the
+// registration would, and each edge is then resampled to
+// OUTLINE_EMBEDDING_POINTS points.  The embeddings are what the
+// database keeps (see SQLiteDatabase::getOutlineIndex()).  The index
+// is built from them in memory: they are reduced by principal
+// component analysis to OUTLINE_INDEX_DIMENSIONS values, and these
+// are searched with a vantage point tree.
+//
+//*******************************************************************
+
+#ifndef OUTLINEINDEX_H
+#define OUTLINEINDEX_H
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <vector>
+
+#include "FloatContour.h"
+
+#define OUTLINE_EMBEDDING_POINTS    32   // per edge
+#define OUTLINE_EMBEDDING_SIZE      (2 * 2 * OUTLINE_EMBEDDING_POINTS) // x and y of both edges
+
+// stored with each embedding, so a change to how they are made is
+// noticed and the old ones are made again
+#define OUTLINE_EMBEDDING_VERSION   1
+
+#define OUTLINE_INDEX_DIMENSIONS    16   // principal components searched
+
+// c must be evenly spaced, begin, tip and end are indices of c
+// (normally LE_BEGIN, TIP and POINT_OF_INFLECTION).  Returns false,
+// and fills nothing, if the three points are out of order or collinear.
+bool outlineEmbedding(
+		const FloatContour *c,
+		int begin,
+		int tip,
+		int end,
+		float embedding[OUTLINE_EMBEDDING_SIZE]);
+
+class OutlineIndex
+{
+	public:
+		OutlineIndex();
+
+		// Adds the embedding of the catalog fin at absolute position
+		// position, or (with a NULL embedding) notes that its outline
+		// could not be embedded.  Only before build().
+		void add(int position, const float *embedding);
+
+		// principal components and the tree, once every fin is added
+		void build();
+
+		// number of fins with an embedding
+		int size() const;
+
+		// catalog fins that could not be embedded, and so can never be
+		// found as neighbours
+		const std::vector<int> &unindexed() const;
+
+		// In positions, the absolute positions of (up to) the k fins
+		// nearest the embedding, nearest first, of those accepted.
+		// accept is by absolute position; fins past its end are not
+		// accepted.
+		void nearest(
+				const float embedding[OUTLINE_EMBEDDING_SIZE],
+				int k,
+				const std::vector<char> &accept,
+				std::vector<int> *positions) const;
+
+		// number of fins accepted with an embedding
+		int numAccepted(const std::vector<char> &accept) const;
+
+		// Rank (1 is nearest), among the accepted fins, of the nearest of
+		// the accepted fins at the given positions, or -1 if none of them
+		// is accepted and has an embedding.
+		int rank(
+				const float embedding[OUTLINE_EMBEDDING_SIZE],
+				const std::vector<int> &positions,
+				const std::vector<char> &accept) const;
+
+	private:
+		bool mBuilt;
+
+		std::vector<int> mPositions;          // of each entry
+		std::vector<float> mEmbeddings;       // OUTLINE_EMBEDDING_SIZE per entry, freed by build()
+		std::vector<int> mEntryOfPosition;    // by absolute position, -1 if none
+		std::vector<int> mUnindexed;
+
+		// principal components
+		float mMean[OUTLINE_EMBEDDING_SIZE];
+		float mBasis[OUTLINE_INDEX_DIMENSIONS][OUTLINE_EMBEDDING_SIZE];
+
+		// the tree, over the entries in mOrder.  The node of the range
+		// [lo,hi) of mOrder is its first entry, the vantage point.  With
+		// mid = lo + 1 + (hi - lo - 1) / 2, the entries in [lo+1,mid) are
+		// no further from it than mRadius[lo], and those in [mid,hi) no
+		// nearer.
+		std::vector<int> mOrder;
+		std::vector<float> mRadius;            // by place in mOrder
+		std::vector<float> mProjected;         // OUTLINE_INDEX_DIMENSIONS per entry
+
+		void project(const float *embedding, float *projected) const;
+		float distance(const float *projected, int entry) const;
+
+		void buildTree(int lo, int hi, unsigned long &random);
+
+		bool isAccepted(int entry, const std::vector<char> &accept) const;
+
+		void searchNearest(
+				int lo,
+				int hi,
+				const float *query,
+				int k,
+				const std::vector<char> &accept,
+				std::vector<std::pair<float,int> > &heap) const;
+
+		int countWithin(
+				int lo,
+				int hi,
+				const float *query,
+				float radius,
+				const std::vector<char> &accept) const;
+};
+
+#endif
@@ -4,6 +4,9 @@
  */
 
 #include "SQLiteDatabase.h"
+#include "MatchProfile.h" //***2.3
+#include "MatchSnapshot.h" //***2.3
+#include "OutlineIndex.h" //***2.3
 
 using namespace std;
 
@@ -1150,7 +1153,7 @@ void SQLiteDatabase::updateImage(DBImage *image) {
 	sql << "DateOfSighting = '" << escapeString(image->dateofsighting) << "', ";
 	sql << "RollAndFrame = '" << escapeString(image->rollandframe) << "', ";
 	sql << "LocationCode = '" << escapeString(image->locationcode) << "', ";
-	sql << "ShortDescription = '" << escapeString(image->shortdescription) << "' ";
+	sql << "ShortDescription = '" << escapeString(image->shortdescription) << "', ";
 	sql << "fkIndividualID = " << image->fkindividualid << " ";
 
 	sql << "WHERE ID = " << image->id << ";";
@@ -1227,7 +1230,7 @@ void SQLiteDatabase::updateDBInfo(DBInfo *dbinfo) {
 	stringstream sql;
 
 	sql << "UPDATE DBInfo SET ";
-	sql << "Value = '" << escapeString(dbinfo->value) << "', ";
+	sql << "Value = '" << escapeString(dbinfo->value) << "' "; //***2.3 - no comma before WHERE
 	sql << "WHERE Key = '" <<escapeString(dbinfo->key) << "';";
 
 	rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
@@ -1424,6 +1427,811 @@ void SQLiteDatabase::deleteThumbnailByFkImageID(int id) {
 	}
 }
 
+// *****************************************************************************
+//
+// ***2.3 - Delete cached match results for one individual from MatchCache
+//
+void SQLiteDatabase::deleteCachedMatches(int fkIndividualID) {
+
+	if (! mMatchCacheOK)
+		return;
+
+	stringstream sql;
+
+	sql << "DELETE FROM MatchCache ";
+	sql << "WHERE fkIndividualID = " << fkIndividualID << ";";
+
+	rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+		sqlite3_free(zErrMsg);
+	}
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Sets the insertion generation of one individual
+//
+void SQLiteDatabase::setIndividualGeneration(int id, int generation) {
+
+	if (! mGenerationsOK)
+		return;
+
+	stringstream sql;
+
+	sql << "UPDATE Individuals SET ";
+	sql << "Generation = " << generation << " ";
+	sql << "WHERE ID = " << id << ";";
+
+	rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+		sqlite3_free(zErrMsg);
+	}
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Adds what insertion generations need to catalogs made before 2.3:
+// the DBInfo table, which holds the catalog generation, and the Generation
+// column of Individuals.  Fins already in the catalog are in generation 0
+// (their Generation is NULL).
+//
+void SQLiteDatabase::createGenerations() {
+
+	stringstream sql;
+
+	sql << "CREATE TABLE IF NOT EXISTS DBInfo ( ";
+	sql << "Key TEXT, ";
+	sql << "Value TEXT ";
+	sql << ");" << endl;
+
+	rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
+
+	mGenerationsOK = (rc == SQLITE_OK);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+		sqlite3_free(zErrMsg);
+		return;
+	}
+
+	// the column is missing if it cannot be selected
+	rc = sqlite3_exec(db, "SELECT Generation FROM Individuals LIMIT 1;", NULL, 0, &zErrMsg);
+
+	if( rc!=SQLITE_OK ) {
+		sqlite3_free(zErrMsg);
+
+		sql.str("");
+		sql << "ALTER TABLE Individuals ADD COLUMN Generation INTEGER;";
+
+		rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
+
+		mGenerationsOK = (rc == SQLITE_OK);
+
+		if( rc!=SQLITE_OK ) {
+			fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+			sqlite3_free(zErrMsg);
+		}
+	}
+}
+
+// *****************************************************************************
+//
+// ***2.3 - The catalog generation is the generation given to the fin most
+// recently added or updated, 0 if none has been since generations began.
+// Deleting a fin advances it too.
+//
+int SQLiteDatabase::catalogGeneration() {
+
+	if (! mGenerationsOK)
+		return -1;
+
+	std::list<DBInfo> dbinfo;
+
+	selectAllDBInfo(&dbinfo);
+
+	std::list<DBInfo>::iterator it;
+	for (it = dbinfo.begin(); it != dbinfo.end(); ++it)
+		if (it->key == "Generation")
+			return atoi(it->value.c_str());
+
+	return 0;
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Advances the catalog generation and returns the new one.
+//
+int SQLiteDatabase::nextGeneration() {
+
+	if (! mGenerationsOK)
+		return -1;
+
+	int generation = catalogGeneration();
+
+	stringstream value;
+	value << generation + 1;
+
+	DBInfo info;
+	info.key = "Generation";
+	info.value = value.str();
+
+	if (0 == generation)
+		insertDBInfo(&info); // there is no row until the first fin is added
+	else
+		updateDBInfo(&info);
+
+	return generation + 1;
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Absolute positions (Individuals ids) of the fins added or updated
+// after the catalog was at the given generation.
+//
+void SQLiteDatabase::getFinsAddedSince(int generation, std::vector<int> *positions) {
+
+	if (! mGenerationsOK)
+		return;
+
+	std::list<DBIndividual> individuals;
+
+	stringstream sql;
+
+	sql << "SELECT * FROM Individuals WHERE Generation > " << generation << ";";
+
+	rc = sqlite3_exec(db, sql.str().c_str(), SQLiteDatabase::callbackIndividuals, &individuals, &zErrMsg);
+
+	if( rc!=SQLITE_OK ){
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+		sqlite3_free(zErrMsg);
+	}
+
+	std::list<DBIndividual>::iterator it;
+	for (it = individuals.begin(); it != individuals.end(); ++it)
+		positions->push_back(it->id);
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Finds the fins added or updated (by generation) and deleted since
+// the lists were read, and reads only those again.  A catalog without
+// generations is read again in full, every fin being taken as changed.
+//
+bool SQLiteDatabase::reloadChanged(std::vector<int> *changed) {
+
+	if (! mGenerationsOK) {
+		std::vector<long int> previous = mAbsoluteOffset;
+
+		loadLists();
+		invalidateMatchSnapshot();
+		invalidateOutlineIndex();
+
+		for (unsigned pos = 0; pos < std::max(previous.size(), mAbsoluteOffset.size()); pos++)
+			if (((pos < previous.size()) && (previous[pos] != -1))
+			    || ((pos < mAbsoluteOffset.size()) && (mAbsoluteOffset[pos] != -1)))
+				changed->push_back(pos);
+
+		return true;
+	}
+
+	// before the fins are read, as in loadLists()
+	int generation = catalogGeneration();
+
+	const char *sql = "SELECT ID, Generation FROM Individuals;";
+
+	sqlite3_stmt *stmt = NULL;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+		return false;
+	}
+
+	std::vector<char> inCatalog(mAbsoluteOffset.size(), 0);
+	std::vector<int> found;
+
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+		int id = sqlite3_column_int(stmt, 0);
+
+		if (id < 0)
+			continue;
+
+		if (id >= (int)inCatalog.size())
+			inCatalog.resize(id + 1, 0);
+		inCatalog[id] = 1;
+
+		bool listed = (id < (int)mAbsoluteOffset.size()) && (mAbsoluteOffset[id] != -1);
+
+		// a fin added by a program that gives no generations is still
+		// noticed, as it is not listed
+		if (! listed
+		    || ((sqlite3_column_type(stmt, 1) != SQLITE_NULL)
+		        && (sqlite3_column_int(stmt, 1) > mListsGeneration)))
+			found.push_back(id);
+	}
+
+	bool ok = (rc == SQLITE_DONE);
+	if (! ok)
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+
+	sqlite3_finalize(stmt);
+
+	if (! ok)
+		return false;
+
+	// deleted since
+	for (unsigned pos = 0; pos < mAbsoluteOffset.size(); pos++)
+		if ((mAbsoluteOffset[pos] != -1) && ! inCatalog[pos])
+			found.push_back(pos);
+
+	for (unsigned i = 0; i < found.size(); i++) {
+		int id = found[i];
+
+		deleteFinFromLists(id);
+
+		if (inCatalog[id]) {
+			DatabaseFin<ColorImage> *fin = getFin(id);
+			addFinToLists(fin);
+			delete fin;
+		}
+
+		if (NULL != mMatchSnapshot)
+			mMatchSnapshot->forget(id);
+
+		changed->push_back(id);
+	}
+
+	if (! found.empty()) {
+		sortLists();
+		invalidateOutlineIndex();
+	}
+
+	mListsGeneration = generation;
+
+	return true;
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Indexes Individuals by damage category, for getFinsInCategories(),
+// in catalogs that do not have the index yet.
+//
+void SQLiteDatabase::createCategoryIndex() {
+
+	stringstream sql;
+
+	sql << "CREATE INDEX IF NOT EXISTS indiv_dmgcat ON Individuals (fkDamageCategoryID);" << endl;
+
+	rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+		sqlite3_free(zErrMsg);
+	}
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Absolute positions (Individuals ids) of the fins in the selected
+// damage categories, in order, without loading any of them.
+//
+bool SQLiteDatabase::getFinsInCategories(bool categoryToMatch[], std::vector<int> *positions) {
+
+	std::vector<std::string> selected;
+	for (int c = 0; c < catCategoryNamesMax(); c++)
+		if (categoryToMatch[c])
+			selected.push_back(catCategoryName(c));
+
+	if (selected.empty())
+		return true;
+
+	stringstream sql;
+
+	sql << "SELECT Individuals.ID FROM Individuals, DamageCategories ";
+	sql << "WHERE Individuals.fkDamageCategoryID = DamageCategories.ID ";
+	sql << "AND DamageCategories.Name IN (?";
+	for (int i = 1; i < (int)selected.size(); i++)
+		sql << ", ?";
+	sql << ") ORDER BY Individuals.ID;";
+
+	sqlite3_stmt *stmt = NULL;
+
+	rc = sqlite3_prepare_v2(db, sql.str().c_str(), -1, &stmt, NULL);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql.str().c_str());
+		return false;
+	}
+
+	for (int i = 0; i < (int)selected.size(); i++)
+		sqlite3_bind_text(stmt, i + 1, selected[i].c_str(), -1, SQLITE_TRANSIENT);
+
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+		positions->push_back(sqlite3_column_int(stmt, 0));
+
+	bool ok = (rc == SQLITE_DONE);
+
+	if (! ok) {
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql.str().c_str());
+		positions->clear();
+	}
+
+	sqlite3_finalize(stmt);
+
+	return ok;
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Creates the OutlineIndex table, which keeps the outline embedding
+// (see OutlineIndex.h) of each fin, in catalogs that do not have one yet.
+// Fins whose outline cannot be embedded have a NULL Embedding.
+//
+void SQLiteDatabase::createOutlineIndexTable() {
+
+	stringstream sql;
+
+	sql << "CREATE TABLE IF NOT EXISTS OutlineIndex ( ";
+	sql << "fkIndividualID INTEGER PRIMARY KEY, ";
+	sql << "Version INTEGER, ";
+	sql << "Embedding BLOB ";
+	sql << ");" << endl;
+
+	rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
+
+	mOutlineIndexOK = (rc == SQLITE_OK);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+		sqlite3_free(zErrMsg);
+	}
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Keeps the embedding of one fin's outline, NULL if it has none,
+// replacing any it had.
+//
+void SQLiteDatabase::putOutlineEmbedding(int fkIndividualID, const float *embedding) {
+
+	if (! mOutlineIndexOK)
+		return;
+
+	const char *sql =
+		"INSERT OR REPLACE INTO OutlineIndex (fkIndividualID, Version, Embedding) "
+		"VALUES (?, ?, ?);";
+
+	sqlite3_stmt *stmt = NULL;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+		return;
+	}
+
+	sqlite3_bind_int(stmt, 1, fkIndividualID);
+	sqlite3_bind_int(stmt, 2, OUTLINE_EMBEDDING_VERSION);
+	if (NULL == embedding)
+		sqlite3_bind_null(stmt, 3);
+	else
+		sqlite3_bind_blob(stmt, 3, embedding, OUTLINE_EMBEDDING_SIZE * sizeof(float), SQLITE_TRANSIENT);
+
+	rc = sqlite3_step(stmt);
+
+	if( rc!=SQLITE_DONE )
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+
+	sqlite3_finalize(stmt);
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Keeps the embedding of the outline of a fin being added or updated.
+//
+void SQLiteDatabase::putOutlineEmbedding(int fkIndividualID, Outline *outline) {
+
+	float embedding[OUTLINE_EMBEDDING_SIZE];
+
+	bool embedded = outlineEmbedding(
+			outline->getFloatContour(),
+			outline->getFeaturePoint(LE_BEGIN),
+			outline->getFeaturePoint(TIP),
+			outline->getFeaturePoint(POINT_OF_INFLECTION),
+			embedding);
+
+	putOutlineEmbedding(fkIndividualID, (embedded) ? embedding : NULL);
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Embeds the outlines, as kept in the catalog, of the fins (by
+// Individuals id) not yet embedded, keeps the embeddings and adds them to
+// index.  Only feature points and outline points are read, in one pass
+// over the Points table in outline order, which is far faster than asking
+// for each outline in turn.
+//
+void SQLiteDatabase::embedOutlines(std::vector<char> &embedded, OutlineIndex *index) {
+
+	std::list<DBOutline> outlines;
+	selectAllOutlines(&outlines);
+
+	std::map<int, DBOutline> outlineByID;
+	std::list<DBOutline>::iterator it;
+	for (it = outlines.begin(); it != outlines.end(); ++it)
+		if ((it->fkindividualid >= 0) && (it->fkindividualid < (int)embedded.size())
+		    && ! embedded[it->fkindividualid])
+			outlineByID[it->id] = *it;
+
+	if (outlineByID.empty())
+		return;
+
+	const char *sql =
+		"SELECT fkOutlineID, XCoordinate, YCoordinate FROM Points "
+		"ORDER BY fkOutlineID, OrderID;";
+
+	sqlite3_stmt *stmt = NULL;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+		return;
+	}
+
+	beginTransaction();
+
+	float embedding[OUTLINE_EMBEDDING_SIZE];
+	FloatContour contour;
+	std::map<int, DBOutline>::iterator outline = outlineByID.end();
+	int outlineID = -1;
+
+	// one more pass than there are rows, to finish the last outline
+	bool more = true;
+	while (more) {
+		rc = sqlite3_step(stmt);
+		more = (rc == SQLITE_ROW);
+
+		if ((! more) || (sqlite3_column_int(stmt, 0) != outlineID)) {
+
+			// the outline read so far is complete
+			if (outline != outlineByID.end()) {
+				int id = outline->second.fkindividualid;
+
+				bool ok = outlineEmbedding(
+						&contour,
+						outline->second.beginle,
+						outline->second.tipposition,
+						outline->second.endte,
+						embedding);
+
+				putOutlineEmbedding(id, (ok) ? embedding : NULL);
+				index->add(id, (ok) ? embedding : NULL);
+				embedded[id] = 1;
+			}
+
+			if (! more)
+				break;
+
+			outlineID = sqlite3_column_int(stmt, 0);
+			outline = outlineByID.find(outlineID);
+			contour.resize(0);
+		}
+
+		if (outline != outlineByID.end())
+			contour.addPoint(
+					(float)sqlite3_column_double(stmt, 1),
+					(float)sqlite3_column_double(stmt, 2));
+	}
+
+	if( rc!=SQLITE_DONE )
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+
+	sqlite3_finalize(stmt);
+
+	commitTransaction();
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Forgets the embedding of a fin being deleted.
+//
+void SQLiteDatabase::deleteOutlineEmbedding(int fkIndividualID) {
+
+	if (! mOutlineIndexOK)
+		return;
+
+	stringstream sql;
+
+	sql << "DELETE FROM OutlineIndex ";
+	sql << "WHERE fkIndividualID = " << fkIndividualID << ";";
+
+	rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+		sqlite3_free(zErrMsg);
+	}
+}
+
+// *****************************************************************************
+//
+// ***2.3 - The index in memory is made again from the table the next time it
+// is needed, which takes milliseconds once every fin has its embedding.
+//
+void SQLiteDatabase::invalidateOutlineIndex() {
+
+	delete mOutlineIndex;
+	mOutlineIndex = NULL;
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Builds the index from the embeddings in the OutlineIndex table.
+// Fins without one (those added before the table existed, or by an older
+// version of DARWIN) or with one made another way (an older Version) are
+// embedded now, and their embeddings kept for next time.
+//
+OutlineIndex* SQLiteDatabase::getOutlineIndex() {
+
+	if (NULL != mOutlineIndex)
+		return mOutlineIndex;
+
+	if (! mOutlineIndexOK)
+		return NULL;
+
+	const char *sql =
+		"SELECT fkIndividualID, Embedding FROM OutlineIndex WHERE Version = ?;";
+
+	sqlite3_stmt *stmt = NULL;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+		return NULL;
+	}
+
+	sqlite3_bind_int(stmt, 1, OUTLINE_EMBEDDING_VERSION);
+
+	OutlineIndex *index = new OutlineIndex();
+	float embedding[OUTLINE_EMBEDDING_SIZE];
+
+	// Individuals ids are the absolute positions, so only ids still in
+	// the absolute offset list are fins of the catalog
+	std::vector<char> embedded(mAbsoluteOffset.size(), 0);
+
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+		int id = sqlite3_column_int(stmt, 0);
+
+		if ((id < 0) || (id >= (int)mAbsoluteOffset.size()) || (mAbsoluteOffset[id] != id))
+			continue;
+
+		const void *blob = sqlite3_column_blob(stmt, 1);
+		int bytes = sqlite3_column_bytes(stmt, 1);
+
+		if (NULL == blob)
+			index->add(id, NULL);
+		else if (bytes == OUTLINE_EMBEDDING_SIZE * sizeof(float)) {
+			memcpy(embedding, blob, bytes); // blobs need not be aligned for floats
+			index->add(id, embedding);
+		}
+		else
+			continue; // made again below
+
+		embedded[id] = 1;
+	}
+
+	if( rc!=SQLITE_DONE )
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+
+	sqlite3_finalize(stmt);
+
+	for (int id = 0; id < (int)mAbsoluteOffset.size(); id++)
+		if ((mAbsoluteOffset[id] == id) && ! embedded[id]) {
+			embedOutlines(embedded, index);
+			break;
+		}
+
+	index->build();
+
+	mOutlineIndex = index;
+
+	return mOutlineIndex;
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Embeds the outline of every fin again, as after a change to how
+// the embeddings are made.
+//
+void SQLiteDatabase::rebuildOutlineIndex() {
+
+	invalidateOutlineIndex();
+
+	if (! mOutlineIndexOK)
+		return;
+
+	rc = sqlite3_exec(db, "DELETE FROM OutlineIndex;", NULL, 0, &zErrMsg);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, "DELETE FROM OutlineIndex;");
+		sqlite3_free(zErrMsg);
+	}
+
+	getOutlineIndex();
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Creates the MatchCache table (see MatchCache.h) in catalogs that
+// do not have one yet, which includes every catalog made before 2.3.
+//
+void SQLiteDatabase::createMatchCacheTable() {
+
+	stringstream sql;
+
+	sql << "CREATE TABLE IF NOT EXISTS MatchCache ( ";
+	sql << "ID INTEGER PRIMARY KEY AUTOINCREMENT, ";
+	sql << "UnknownHash TEXT, ";
+	sql << "Method INTEGER, ";
+	sql << "FullFinError INTEGER, ";
+	sql << "Version INTEGER, ";
+	sql << "fkIndividualID INTEGER, ";
+	sql << "OutlineHash TEXT, ";
+	sql << "Error REAL, ";
+	sql << "OptimizerError REAL, ";
+	sql << "UnknownBegin INTEGER, ";
+	sql << "UnknownTip INTEGER, ";
+	sql << "UnknownEnd INTEGER, ";
+	sql << "DBBegin INTEGER, ";
+	sql << "DBTip INTEGER, ";
+	sql << "DBEnd INTEGER, ";
+	sql << "UNIQUE (UnknownHash, Method, FullFinError, Version, fkIndividualID) ";
+	sql << ");" << endl;
+
+	sql << "CREATE INDEX IF NOT EXISTS mtchcache_indiv ON MatchCache (fkIndividualID);" << endl;
+
+	rc = sqlite3_exec(db, sql.str().c_str(), NULL, 0, &zErrMsg);
+
+	mMatchCacheOK = (rc == SQLITE_OK);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", zErrMsg, sql.str().c_str());
+		sqlite3_free(zErrMsg);
+	}
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Returns (in entries, by Individuals id) the cached results of
+// matching the unknown with outline hash unknownHash using the given method.
+//
+// The cache uses prepared statements rather than sqlite3_exec() so that
+// the errors are stored and read back as exact doubles.  Otherwise a
+// cached error could print differently than the one it replaces.
+//
+void SQLiteDatabase::getCachedMatches(
+		std::string unknownHash,
+		int registrationMethod,
+		bool useFullFinError,
+		std::map<int, MatchCacheEntry> *entries) {
+
+	if (! mMatchCacheOK)
+		return;
+
+	const char *sql = 
+		"SELECT fkIndividualID, OutlineHash, Error, OptimizerError, "
+		"UnknownBegin, UnknownTip, UnknownEnd, DBBegin, DBTip, DBEnd "
+		"FROM MatchCache "
+		"WHERE UnknownHash = ? AND Method = ? AND FullFinError = ? AND Version = ?;";
+
+	sqlite3_stmt *stmt = NULL;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+		return;
+	}
+
+	sqlite3_bind_text(stmt, 1, unknownHash.c_str(), -1, SQLITE_TRANSIENT);
+	sqlite3_bind_int(stmt, 2, registrationMethod);
+	sqlite3_bind_int(stmt, 3, (useFullFinError) ? 1 : 0);
+	sqlite3_bind_int(stmt, 4, MATCH_CACHE_VERSION);
+
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+		MatchCacheEntry entry;
+
+		entry.individualID = sqlite3_column_int(stmt, 0);
+		entry.outlineHash = handleNull((char *) sqlite3_column_text(stmt, 1));
+		entry.error = sqlite3_column_double(stmt, 2);
+		entry.optimizerError = sqlite3_column_double(stmt, 3);
+		entry.b1 = sqlite3_column_int(stmt, 4);
+		entry.t1 = sqlite3_column_int(stmt, 5);
+		entry.e1 = sqlite3_column_int(stmt, 6);
+		entry.b2 = sqlite3_column_int(stmt, 7);
+		entry.t2 = sqlite3_column_int(stmt, 8);
+		entry.e2 = sqlite3_column_int(stmt, 9);
+
+		(*entries)[entry.individualID] = entry;
+	}
+
+	if( rc!=SQLITE_DONE )
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+
+	sqlite3_finalize(stmt);
+}
+
+// *****************************************************************************
+//
+// ***2.3 - Adds (or replaces) cached results of matching the unknown with
+// outline hash unknownHash, all in one transaction.
+//
+void SQLiteDatabase::putCachedMatches(
+		std::string unknownHash,
+		int registrationMethod,
+		bool useFullFinError,
+		const std::vector<MatchCacheEntry> &entries) {
+
+	if ((! mMatchCacheOK) || entries.empty())
+		return;
+
+	const char *sql = 
+		"INSERT OR REPLACE INTO MatchCache (UnknownHash, Method, FullFinError, "
+		"Version, fkIndividualID, OutlineHash, Error, OptimizerError, "
+		"UnknownBegin, UnknownTip, UnknownEnd, DBBegin, DBTip, DBEnd) "
+		"VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);";
+
+	sqlite3_stmt *stmt = NULL;
+
+	rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
+
+	if( rc!=SQLITE_OK ) {
+		fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+		return;
+	}
+
+	beginTransaction();
+
+	for (unsigned i = 0; i < entries.size(); i++) {
+		const MatchCacheEntry &entry = entries[i];
+
+		sqlite3_bind_text(stmt, 1, unknownHash.c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_int(stmt, 2, registrationMethod);
+		sqlite3_bind_int(stmt, 3, (useFullFinError) ? 1 : 0);
+		sqlite3_bind_int(stmt, 4, MATCH_CACHE_VERSION);
+		sqlite3_bind_int(stmt, 5, entry.individualID);
+		sqlite3_bind_text(stmt, 6, entry.outlineHash.c_str(), -1, SQLITE_TRANSIENT);
+		sqlite3_bind_double(stmt, 7, entry.error);
+		sqlite3_bind_double(stmt, 8, entry.optimizerError);
+		sqlite3_bind_int(stmt, 9, entry.b1);
+		sqlite3_bind_int(stmt, 10, entry.t1);
+		sqlite3_bind_int(stmt, 11, entry.e1);
+		sqlite3_bind_int(stmt, 12, entry.b2);
+		sqlite3_bind_int(stmt, 13, entry.t2);
+		sqlite3_bind_int(stmt, 14, entry.e2);
+
+		rc = sqlite3_step(stmt);
+
+		if( rc!=SQLITE_DONE ) {
+			fprintf(stdout, "SQL error: %s %s\n", sqlite3_errmsg(db), sql);
+			break;
+		}
+
+		sqlite3_reset(stmt);
+	}
+
+	sqlite3_finalize(stmt);
+
+	commitTransaction();
+}
+
 unsigned long SQLiteDatabase::add(DatabaseFin<ColorImage> *fin) {
 
 	DBIndividual individual;
@@ -1497,6 +2305,10 @@ unsigned long SQLiteDatabase::add(DatabaseFin<ColorImage> *fin) {
 	thumbnail.pixmap = pixTemp;
 	thumbnail.fkimageid = image.id;
 	insertThumbnail(&thumbnail);
+
+	setIndividualGeneration(individual.id, nextGeneration()); //***2.3
+
+	putOutlineEmbedding(individual.id, finOutline); //***2.3
 	
 	commitTransaction();
 
@@ -1504,6 +2316,9 @@ unsigned long SQLiteDatabase::add(DatabaseFin<ColorImage> *fin) {
 		image.rollandframe, image.locationcode, dmgCat.name, image.shortdescription);
 
 	sortLists();
+
+	invalidateMatchSnapshot(); //***2.3
+	invalidateOutlineIndex(); //***2.3
 	
 	delete points;
 
@@ -1588,6 +2403,16 @@ void SQLiteDatabase::update(DatabaseFin<ColorImage> *fin) {
 		image.rollandframe, image.locationcode, dmgCat.name, image.shortdescription);
 
 	sortLists();
+
+	//***2.3 - cached match results would no longer agree with the outline,
+	// and saved results are brought up to date by matching it again
+	deleteCachedMatches(individual.id);
+	setIndividualGeneration(individual.id, nextGeneration());
+
+	putOutlineEmbedding(individual.id, finOutline); //***2.3
+
+	invalidateMatchSnapshot(); //***2.3
+	invalidateOutlineIndex(); //***2.3
 }
 
 // *****************************************************************************
@@ -1598,6 +2423,8 @@ void SQLiteDatabase::update(DatabaseFin<ColorImage> *fin) {
 
 DatabaseFin<ColorImage>* SQLiteDatabase::getFin(int id) {
 
+	PROFILE_PHASE(PHASE_DB_GET_FIN); //***2.3
+
 	DBIndividual individual;
 	DBImage image;
 	DBOutline outline;
@@ -1646,13 +2473,17 @@ DatabaseFin<ColorImage>* SQLiteDatabase::getFin(int id) {
 		fc->addPoint(point.xcoordinate, point.ycoordinate);
 	}
 
-	finOutline = new Outline(fc);
-	finOutline->setFeaturePoint(LE_BEGIN, outline.beginle);
-	finOutline->setFeaturePoint(LE_END, outline.endle);
-	finOutline->setFeaturePoint(NOTCH, outline.notchposition);
-	finOutline->setFeaturePoint(TIP, outline.tipposition);
-	finOutline->setFeaturePoint(POINT_OF_INFLECTION, outline.endte);
-	finOutline->setLEAngle(0.0,true);
+	{
+		PROFILE_PHASE(PHASE_OUTLINE_BUILD); //***2.3
+
+		finOutline = new Outline(fc);
+		finOutline->setFeaturePoint(LE_BEGIN, outline.beginle);
+		finOutline->setFeaturePoint(LE_END, outline.endle);
+		finOutline->setFeaturePoint(NOTCH, outline.notchposition);
+		finOutline->setFeaturePoint(TIP, outline.tipposition);
+		finOutline->setFeaturePoint(POINT_OF_INFLECTION, outline.endte);
+		finOutline->setLEAngle(0.0,true);
+	}
 
 	
 	// Based on thumbnail size in DatabaseFin<ColorImage>
@@ -1789,9 +2620,15 @@ void SQLiteDatabase::Delete(DatabaseFin<ColorImage> *fin) {
 	this->deleteThumbnailByFkImageID(image.id);
 	this->deleteImage(image.id);
 	this->deleteIndividual(id);
+	this->deleteCachedMatches(id); //***2.3
+	this->deleteOutlineEmbedding(id); //***2.3
+	nextGeneration(); //***2.3 - so a program with the catalog open notices
 	commitTransaction();
 	
 	deleteFinFromLists(id);
+
+	invalidateMatchSnapshot(); //***2.3
+	invalidateOutlineIndex(); //***2.3
 }
 
 // *****************************************************************************
@@ -1972,6 +2809,10 @@ void SQLiteDatabase::loadLists() {
 	mDescriptionList.clear();
 	mAbsoluteOffset.clear();
 
+	//***2.3 - before the fins are read, so any written meanwhile are read
+	// again by reloadChanged()
+	mListsGeneration = catalogGeneration();
+
 	fins = getAllFins();
 
 	while(! fins->empty() ) {
@@ -2048,7 +2889,8 @@ void SQLiteDatabase::createEmptyDatabase(Options *o) {
 	sql << "ID INTEGER PRIMARY KEY, ";
 	sql << "IDCode TEXT, ";
 	sql << "Name TEXT, ";
-	sql << "fkDamageCategoryID INTEGER ";
+	sql << "fkDamageCategoryID INTEGER, ";
+	sql << "Generation INTEGER "; //***2.3
 	sql << ");" << endl;
 	
 	sql << "CREATE TABLE Images ( ";
@@ -2199,6 +3041,11 @@ SQLiteDatabase::SQLiteDatabase(Options *o, const CatalogScheme cat, bool createE
 	
 	zErrMsg = 0;
 	dbOpen = false;
+	mMatchCacheOK = false; //***2.3
+	mGenerationsOK = false; //***2.3
+	mOutlineIndexOK = false; //***2.3
+	mOutlineIndex = NULL; //***2.3
+	mListsGeneration = -1; //***2.3
 	mFilename = std::string(o->mDatabaseFileName);
 	mCurrentSort = DB_SORT_NAME;
 
@@ -2219,6 +3066,9 @@ SQLiteDatabase::SQLiteDatabase(Options *o, const CatalogScheme cat, bool createE
 	// set sync mode to OFF.  Significant improvement in write speed.
 	this->setSyncMode(0);
 
+	//***2.3 - wait for, rather than fail on, another program's write
+	sqlite3_busy_timeout(db, SQLITE_DATABASE_BUSY_MS);
+
 	if(createEmptyDB)
 		createEmptyDatabase(o);
 	else 
@@ -2232,6 +3082,11 @@ SQLiteDatabase::SQLiteDatabase(Options *o, const CatalogScheme cat, bool createE
 			mCatCategoryNames.push_back(damagecategory.name);
 		}
 	}
+
+	createGenerations(); //***2.3
+	createMatchCacheTable(); //***2.3
+	createCategoryIndex(); //***2.3
+	createOutlineIndexTable(); //***2.3
 	
 	loadLists();
 	mDBStatus = loaded;
@@ -2249,6 +3104,8 @@ SQLiteDatabase::~SQLiteDatabase() {
 	
 	closedb();
 
+	delete mOutlineIndex; //***2.3
+
 }
 
 //*******************************************************************
@@ -28,6 +28,7 @@
 #include <string>
 #include <strstream>
 #include <vector>
+#include <map>
 #include <algorithm>
 
 #ifdef HAVE_CONFIG_H
@@ -49,6 +50,10 @@
 
 #define NOT_IN_LIST -1
 
+//***2.3 - how long a read or write waits for another program (such as
+// darwind or the GUI) to finish writing the catalog
+#define SQLITE_DATABASE_BUSY_MS  5000
+
 #include "sqlite3.h"
 
 //******************************************************************
@@ -95,6 +100,26 @@ public:
 	std::list< DatabaseFin<ColorImage>* >* getAllFins(void);
 	virtual void Delete(DatabaseFin<ColorImage> *Fin); //***002DB
 
+	//***2.3 - match results kept in the MatchCache table
+	virtual void getCachedMatches(std::string unknownHash, int registrationMethod,
+			bool useFullFinError, std::map<int, MatchCacheEntry> *entries);
+	virtual void putCachedMatches(std::string unknownHash, int registrationMethod,
+			bool useFullFinError, const std::vector<MatchCacheEntry> &entries);
+
+	//***2.3 - insertion generations
+	virtual int catalogGeneration();
+	virtual void getFinsAddedSince(int generation, std::vector<int> *positions);
+
+	//***2.3 - category selection by indexed query
+	virtual bool getFinsInCategories(bool categoryToMatch[], std::vector<int> *positions);
+
+	//***2.3 - outline embeddings kept in the OutlineIndex table
+	virtual OutlineIndex* getOutlineIndex();
+	virtual void rebuildOutlineIndex();
+
+	//***2.3 - changes made by other programs, found by generation
+	virtual bool reloadChanged(std::vector<int> *changed);
+
 	virtual DatabaseFin<ColorImage>* getItemAbsolute(unsigned pos); //***1.3
 
 	virtual DatabaseFin<ColorImage>* getItem(unsigned pos);
@@ -112,6 +137,11 @@ private:
 	sqlite3 *db;
 	char *zErrMsg;
 	int rc;
+	bool mMatchCacheOK; //***2.3 - false if the MatchCache table could not be created
+	bool mGenerationsOK; //***2.3 - false if the catalog could not be given generations
+	bool mOutlineIndexOK; //***2.3 - false if the OutlineIndex table could not be created
+	OutlineIndex *mOutlineIndex; //***2.3 - NULL until first requested
+	int mListsGeneration; //***2.3 - catalog generation when the lists were last read
 
 	static char* handleNull(char *);
 	static std::string escapeString(std::string);
@@ -171,6 +201,22 @@ private:
 	void deleteImageModification(int);
 	void deleteThumbnail(int);
 	void deleteThumbnailByFkImageID(int id);
+	void deleteCachedMatches(int fkIndividualID); //***2.3
+
+	void createMatchCacheTable(); //***2.3
+
+	void createCategoryIndex(); //***2.3
+
+	void createGenerations(); //***2.3
+	int nextGeneration(); //***2.3
+	void setIndividualGeneration(int id, int generation); //***2.3
+
+	void createOutlineIndexTable(); //***2.3
+	void putOutlineEmbedding(int fkIndividualID, const float *embedding); //***2.3
+	void putOutlineEmbedding(int fkIndividualID, Outline *outline); //***2.3
+	void embedOutlines(std::vector<char> &embedded, OutlineIndex *index); //***2.3
+	void deleteOutlineEmbedding(int fkIndividualID); //***2.3
+	void invalidateOutlineIndex(); //***2.3
 
 	void opendb(const char *);
 	void closedb();
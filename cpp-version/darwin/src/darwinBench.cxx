@@ -0,0 +1,666 @@
+//*******************************************************************
+//   file: darwinBench.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// Headless matching benchmark.  Builds a synthetic catalog of any
+// size from the outlines of a sample catalog and times
+// Match::matchSingleFin() with each registration method, so that
+// matching speed can be measured the same way from one build to the
+// next.
+//
+//   usage: darwin-bench [options] <sample catalog.db> <work folder>
+//
+//     -fins N        synthetic catalog size (default 1000)
+//     -unknowns N    unknowns matched with each method (default 3)
+//     -limit N       catalog fins timed per unknown (default all)
+//     -methods a,b   methods to time, by the names darwin-match accepts
+//                    (default original,trimFixed,trimOptimalTotal,
+//                    trimOptimalTip,trimOptimalArea)
+//     -seed N        seed of the perturbations (default 1)
+//     -coarse        register coarse-to-fine (see Match::setCoarseToFine())
+//     -nearest M     register only the M fins nearest each unknown in the
+//                    outline index (see Match::setNearestCandidates())
+//     -json file     where to write the report (default standard output)
+//
+// Synthetic fin n is sample fin (n mod sample size) with a random
+// similarity transform and a smooth random bend along the outline
+// normals of a few thousandths of the fin's size.  The feature points
+// keep their indices, so no tracing is needed.  The catalog is written
+// to <work folder>/synthetic-<fins>-<seed>.db, and reused when it is
+// already there.  The unknowns are perturbed again from the same sample
+// fins, so each has a true match in the catalog.
+//
+// The report gives, per method, fins matched per second, percentiles
+// of the time to match one catalog fin, and the peak resident memory
+// of the process so far.  Catalog fins are read into the match snapshot
+// before timing starts, so only registration is timed.  The time to
+// build the outline index from scratch (embedding every catalog outline
+// again) is also given.
+//
+//*******************************************************************
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "Error.h"
+#include "Options.h"
+#include "CatalogSupport.h"
+#include "SQLiteDatabase.h"
+#include "matching/Match.h"
+
+#ifdef WIN32
+#include <windows.h>
+#include <psapi.h>
+#define PATH_SLASH "\\"
+#else
+#include <sys/resource.h>
+#define PATH_SLASH "/"
+#endif
+
+using namespace std;
+
+Options *gOptions = NULL; // referenced GLOBALLY, normally defined in main.cxx
+
+//*******************************************************************
+//
+// the registration methods, by the names darwin-match accepts
+//
+static const struct {
+	const char *name;
+	int method;
+} gMethodNames[] = {
+	{"original",           ORIGINAL_3_POINT},
+	{"trimFixed",          TRIM_FIXED_PERCENT},
+	{"trimOptimal",        TRIM_OPTIMAL},
+	{"trimOptimalTotal",   TRIM_OPTIMAL_TOTAL},
+	{"trimOptimalTip",     TRIM_OPTIMAL_TIP},
+	{"trimOptimalArea",    TRIM_OPTIMAL_AREA},
+	{"trimOptimalInOut",   TRIM_OPTIMAL_IN_OUT},
+	{"trimOptimalInOutTip",TRIM_OPTIMAL_IN_OUT_TIP}
+};
+
+static const int gNumMethodNames = sizeof(gMethodNames) / sizeof(gMethodNames[0]);
+
+static const char *DEFAULT_METHODS =
+		"original,trimFixed,trimOptimalTotal,trimOptimalTip,trimOptimalArea";
+
+// perturbation of the synthetic fins, as fractions of the fin's size
+// (diagonal of its bounding box) and in degrees
+#define BENCH_MAX_SCALE_CHANGE      0.05
+#define BENCH_MAX_ROTATION          3.0
+#define BENCH_MAX_SHIFT             0.02
+#define BENCH_MAX_BEND              0.004
+#define BENCH_BEND_WAVES            3
+
+//*******************************************************************
+//
+void usage(const char *progName)
+{
+	cerr << "usage: " << progName
+	     << " [-fins N] [-unknowns N] [-limit N] [-methods a,b,...] [-seed N] [-coarse] [-nearest M]"
+	     << " [-json file] <sample catalog.db> <work folder>" << endl
+	     << "  methods are:";
+	for (int i = 0; i < gNumMethodNames; i++)
+		cerr << " " << gMethodNames[i].name;
+	cerr << endl;
+}
+
+//*******************************************************************
+//
+int methodFromName(string name)
+{
+	for (int i = 0; i < gNumMethodNames; i++)
+		if (name == gMethodNames[i].name)
+			return gMethodNames[i].method;
+	return -1;
+}
+
+//*******************************************************************
+//
+// class BenchRandom
+//
+//    A small linear congruential generator, so the synthetic catalog
+//    is the same on every platform for a given seed.
+//
+class BenchRandom
+{
+	public:
+		BenchRandom(unsigned long seed)
+		:	mState(seed * 2654435761UL + 12345UL)
+		{ }
+
+		// uniform in [0,1)
+		double next()
+		{
+			mState = (mState * 1103515245UL + 12345UL) & 0x7fffffffUL;
+			return mState / 2147483648.0;
+		}
+
+		// uniform in [-range,range)
+		double symmetric(double range)
+		{
+			return range * (2.0 * next() - 1.0);
+		}
+
+	private:
+		unsigned long mState;
+};
+
+//*******************************************************************
+//
+// Outline *perturbOutline(const Outline *source, BenchRandom &random)
+//
+//    A new outline, source moved by a random similarity transform and
+//    bent smoothly along its normals, with the same feature points.
+//    The points stay in order and nearly evenly spaced.
+//
+Outline *perturbOutline(const Outline *source, BenchRandom &random)
+{
+	FloatContour *c = source->getFloatContour();
+	int numPoints = c->length();
+
+	if (numPoints < 3)
+		throw Error("perturbOutline() outline too short");
+
+	float xMin = (*c)[0].x, xMax = xMin, yMin = (*c)[0].y, yMax = yMin;
+	double cx = 0.0, cy = 0.0;
+	int i;
+
+	for (i = 0; i < numPoints; i++)
+	{
+		float x = (*c)[i].x, y = (*c)[i].y;
+		if (x < xMin) xMin = x;
+		if (x > xMax) xMax = x;
+		if (y < yMin) yMin = y;
+		if (y > yMax) yMax = y;
+		cx += x;
+		cy += y;
+	}
+	cx /= numPoints;
+	cy /= numPoints;
+
+	double size = sqrt((double)(xMax - xMin) * (xMax - xMin) + (double)(yMax - yMin) * (yMax - yMin));
+
+	double
+		scale = 1.0 + random.symmetric(BENCH_MAX_SCALE_CHANGE),
+		angle = random.symmetric(BENCH_MAX_ROTATION) * 3.14159265358979 / 180.0,
+		shiftX = random.symmetric(BENCH_MAX_SHIFT) * size,
+		shiftY = random.symmetric(BENCH_MAX_SHIFT) * size,
+		cosA = cos(angle),
+		sinA = sin(angle);
+
+	double amplitude[BENCH_BEND_WAVES], frequency[BENCH_BEND_WAVES], phase[BENCH_BEND_WAVES];
+	int w;
+	for (w = 0; w < BENCH_BEND_WAVES; w++)
+	{
+		amplitude[w] = random.next() * BENCH_MAX_BEND * size / BENCH_BEND_WAVES;
+		frequency[w] = 1 + (int)(random.next() * 6);
+		phase[w] = random.next() * 2.0 * 3.14159265358979;
+	}
+
+	FloatContour bent;
+
+	for (i = 0; i < numPoints; i++)
+	{
+		int
+			prev = (i > 0) ? i - 1 : i,
+			next = (i < numPoints - 1) ? i + 1 : i;
+
+		double
+			tx = (*c)[next].x - (*c)[prev].x,
+			ty = (*c)[next].y - (*c)[prev].y,
+			len = sqrt(tx * tx + ty * ty);
+
+		double bend = 0.0;
+		for (w = 0; w < BENCH_BEND_WAVES; w++)
+			bend += amplitude[w] * sin(2.0 * 3.14159265358979 * frequency[w] * i / numPoints + phase[w]);
+
+		double x = (*c)[i].x - cx, y = (*c)[i].y - cy;
+		if (len > 0.0)
+		{
+			x += bend * -ty / len;
+			y += bend * tx / len;
+		}
+
+		bent.addPoint(
+				(float)(cx + shiftX + scale * (cosA * x - sinA * y)),
+				(float)(cy + shiftY + scale * (sinA * x + cosA * y)));
+	}
+
+	Outline *outline = new Outline(&bent);
+
+	int types[] = {TIP, NOTCH, LE_BEGIN, LE_END, POINT_OF_INFLECTION};
+	for (int t = 0; t < 5; t++)
+		outline->setFeaturePoint(types[t], source->getFeaturePoint(types[t]));
+
+	return outline;
+}
+
+//*******************************************************************
+//
+// DatabaseFin<ColorImage> *perturbFin(DatabaseFin<ColorImage> *source,
+//                                     BenchRandom &random)
+//
+//    A copy of source with a perturbed outline.
+//
+DatabaseFin<ColorImage> *perturbFin(DatabaseFin<ColorImage> *source, BenchRandom &random)
+{
+	DatabaseFin<ColorImage> *fin = new DatabaseFin<ColorImage>(source);
+
+	Outline *outline = perturbOutline(source->mFinOutline, random);
+	delete fin->mFinOutline;
+	fin->mFinOutline = outline;
+
+	return fin;
+}
+
+//*******************************************************************
+//
+// void loadSampleFins(Database *db, vector<DatabaseFin<ColorImage>*> &fins)
+//
+void loadSampleFins(Database *db, vector<DatabaseFin<ColorImage>*> &fins)
+{
+	for (unsigned pos = 0; pos < db->sizeAbsolute(); pos++)
+	{
+		DatabaseFin<ColorImage> *fin = db->getItemAbsolute(pos);
+		if (NULL != fin)
+			fins.push_back(fin);
+	}
+}
+
+//*******************************************************************
+//
+// Database *syntheticCatalog(Options *o, Database *sample,
+//                            const vector<DatabaseFin<ColorImage>*> &sampleFins,
+//                            int numFins, unsigned long seed, bool &generated)
+//
+//    Opens the synthetic catalog named in o, creating it (with the
+//    catalog scheme of the sample) if it does not exist yet.
+//
+Database *syntheticCatalog(Options *o, Database *sample,
+                           const vector<DatabaseFin<ColorImage>*> &sampleFins,
+                           int numFins, unsigned long seed, bool &generated)
+{
+	generated = false;
+
+	if (ifstream(o->mDatabaseFileName.c_str()))
+	{
+		Database *db = openDatabase(o, false);
+
+		if (db->status() != Database::loaded)
+		{
+			delete db;
+			throw Error("could not open " + o->mDatabaseFileName);
+		}
+
+		if ((int)db->size() != numFins)
+		{
+			delete db;
+			throw Error(o->mDatabaseFileName + " has the wrong number of fins, remove it to rebuild it");
+		}
+
+		return db;
+	}
+
+	Database *db = new SQLiteDatabase(o, sample->catalogScheme(), true);
+
+	BenchRandom random(seed);
+
+	for (int n = 0; n < numFins; n++)
+	{
+		DatabaseFin<ColorImage> *fin = perturbFin(sampleFins[n % sampleFins.size()], random);
+
+		char idCode[32];
+		sprintf(idCode, "SYN%06d", n);
+		fin->mName = fin->mIDCode; // the sample fin it came from
+		fin->mIDCode = idCode;
+
+		db->add(fin);
+		delete fin;
+
+		if ((n + 1) % 1000 == 0)
+			cerr << "  " << (n + 1) << " of " << numFins << " synthetic fins" << endl;
+	}
+
+	generated = true;
+
+	return db;
+}
+
+//*******************************************************************
+//
+// long peakMemoryKB()
+//
+//    Peak resident memory (working set) of the process, -1 if unknown.
+//
+long peakMemoryKB()
+{
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS pmc;
+	if (! GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return -1;
+	return (long)(pmc.PeakWorkingSetSize / 1024);
+#else
+	struct rusage usage;
+	if (0 != getrusage(RUSAGE_SELF, &usage))
+		return -1;
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024; // bytes on Mac OS X
+#else
+	return usage.ru_maxrss;
+#endif
+#endif
+}
+
+//*******************************************************************
+//
+// double percentile(const vector<double> &sorted, double p)
+//
+//    Nearest rank percentile (0 < p <= 100) of sorted values.
+//
+double percentile(const vector<double> &sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0;
+
+	int rank = (int)ceil(p / 100.0 * sorted.size());
+	if (rank < 1)
+		rank = 1;
+	if (rank > (int)sorted.size())
+		rank = sorted.size();
+
+	return sorted[rank - 1];
+}
+
+//*******************************************************************
+//
+// string jsonString(string s)
+//
+string jsonString(string s)
+{
+	string quoted = "\"";
+	for (unsigned i = 0; i < s.length(); i++)
+	{
+		if (('"' == s[i]) || ('\\' == s[i]))
+			quoted += '\\';
+		quoted += s[i];
+	}
+	return quoted + "\"";
+}
+
+//*******************************************************************
+//
+// void splitNames(string list, vector<string> &names)
+//
+void splitNames(string list, vector<string> &names)
+{
+	string::size_type start = 0, comma;
+	while (string::npos != (comma = list.find(',', start)))
+	{
+		names.push_back(list.substr(start, comma - start));
+		start = comma + 1;
+	}
+	names.push_back(list.substr(start));
+}
+
+//*******************************************************************
+//
+int main(int argc, char *argv[])
+{
+	const char *progName = argv[0];
+
+	int
+		numFins = 1000,
+		numUnknowns = 3,
+		limit = 0,
+		nearest = 0;
+	unsigned long seed = 1;
+	string
+		methodList = DEFAULT_METHODS,
+		jsonFilename;
+	bool coarse = false;
+
+	int arg = 1;
+	while ((arg < argc) && ('-' == argv[arg][0]))
+	{
+		string flag = argv[arg++];
+
+		// the only flag without a value
+		if ("-coarse" == flag)
+		{
+			coarse = true;
+			continue;
+		}
+
+		if (arg >= argc)
+		{
+			usage(progName);
+			return 1;
+		}
+
+		if ("-fins" == flag)
+			numFins = atoi(argv[arg]);
+		else if ("-unknowns" == flag)
+			numUnknowns = atoi(argv[arg]);
+		else if ("-limit" == flag)
+			limit = atoi(argv[arg]);
+		else if ("-methods" == flag)
+			methodList = argv[arg];
+		else if ("-seed" == flag)
+			seed = strtoul(argv[arg], NULL, 10);
+		else if ("-nearest" == flag)
+			nearest = atoi(argv[arg]);
+		else if ("-json" == flag)
+			jsonFilename = argv[arg];
+		else
+		{
+			usage(progName);
+			return 1;
+		}
+		arg++;
+	}
+
+	if ((argc - arg != 2) || (numFins < 1) || (numUnknowns < 1) || (limit < 0) || (nearest < 0))
+	{
+		usage(progName);
+		return 1;
+	}
+
+	string
+		sampleFilename = argv[arg],
+		workFolder = argv[arg+1];
+
+	vector<string> methodNames;
+	splitNames(methodList, methodNames);
+	for (unsigned m = 0; m < methodNames.size(); m++)
+		if (-1 == methodFromName(methodNames[m]))
+		{
+			cerr << "Unknown registration method: " << methodNames[m] << endl;
+			usage(progName);
+			return 1;
+		}
+
+	gOptions = new Options();
+	gOptions->mDatabaseFileName = sampleFilename;
+	gOptions->mUseMatchTopK = false;
+	gOptions->mUseMatchPrefilter = false;
+	gOptions->mUseMatchCache = false; // every fin must really be registered
+	gOptions->mUseCoarseToFine = coarse;
+	gOptions->mUseOutlineIndex = (nearest > 0);
+	gOptions->mOutlineIndexCandidates = nearest;
+
+	Database
+		*sample = NULL,
+		*db = NULL;
+	vector<DatabaseFin<ColorImage>*> sampleFins;
+	int exitStatus = 0;
+
+	try {
+
+		sample = openDatabase(gOptions, false);
+
+		if (sample->status() != Database::loaded)
+			throw Error("could not open sample catalog " + sampleFilename);
+
+		loadSampleFins(sample, sampleFins);
+
+		if (sampleFins.empty())
+			throw Error("sample catalog " + sampleFilename + " has no fins");
+
+		ostringstream catalogName;
+		catalogName << workFolder << PATH_SLASH << "synthetic-" << numFins << "-" << seed << ".db";
+		gOptions->mDatabaseFileName = catalogName.str();
+
+		bool generated;
+		double startTime = wallClockSeconds();
+		db = syntheticCatalog(gOptions, sample, sampleFins, numFins, seed, generated);
+		double generateSeconds = wallClockSeconds() - startTime;
+
+		// read every catalog fin now, so that only registration is timed
+		startTime = wallClockSeconds();
+		MatchSnapshot *snapshot = db->getMatchSnapshot();
+		for (int pos = 0; pos < (int)db->sizeAbsolute(); pos++)
+			snapshot->fetch(pos);
+		double loadSeconds = wallClockSeconds() - startTime;
+
+		// the outline index from scratch, as for a catalog made before it
+		startTime = wallClockSeconds();
+		db->rebuildOutlineIndex();
+		double indexSeconds = wallClockSeconds() - startTime;
+
+		// unknowns spread over the sample, perturbed with another seed
+		BenchRandom random(seed + 7919);
+		vector<DatabaseFin<ColorImage>*> unknowns;
+		for (int u = 0; u < numUnknowns; u++)
+			unknowns.push_back(perturbFin(
+					sampleFins[(u * sampleFins.size()) / numUnknowns % sampleFins.size()], random));
+
+		bool categoriesToMatch[32] =
+				{true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true};
+
+		ostringstream json;
+		json << "{" << endl
+		     << "  \"catalog\": {" << endl
+		     << "    \"file\": " << jsonString(catalogName.str()) << "," << endl
+		     << "    \"sample\": " << jsonString(sampleFilename) << "," << endl
+		     << "    \"sample_fins\": " << sampleFins.size() << "," << endl
+		     << "    \"fins\": " << numFins << "," << endl
+		     << "    \"seed\": " << seed << "," << endl
+		     << "    \"generated\": " << ((generated) ? "true" : "false") << "," << endl
+		     << "    \"open_seconds\": " << generateSeconds << "," << endl
+		     << "    \"load_seconds\": " << loadSeconds << "," << endl
+		     << "    \"index_seconds\": " << indexSeconds << endl
+		     << "  }," << endl
+		     << "  \"unknowns\": " << numUnknowns << "," << endl
+		     << "  \"coarse_to_fine\": " << ((coarse) ? "true" : "false") << "," << endl
+		     << "  \"nearest\": " << nearest << "," << endl
+		     << "  \"methods\": [";
+
+		for (unsigned m = 0; m < methodNames.size(); m++)
+		{
+			int method = methodFromName(methodNames[m]);
+
+			cerr << "Timing " << methodNames[m] << " ";
+
+			vector<double> finSeconds;
+			double totalSeconds = 0.0;
+
+			for (int u = 0; u < numUnknowns; u++)
+			{
+				Match matcher(unknowns[u], db, gOptions);
+
+				float percentDatabaseProcessed = 0.0;
+				int matched = 0;
+
+				while ((percentDatabaseProcessed < 1.0) && ((0 == limit) || (matched < limit)))
+				{
+					startTime = wallClockSeconds();
+					percentDatabaseProcessed = matcher.matchSingleFin(
+							method,
+							ALL_POINTS,
+							categoriesToMatch,
+							false, // use trailing edge only in final error
+							true); // use absolute offsets to access database fins
+					double seconds = wallClockSeconds() - startTime;
+
+					if (percentDatabaseProcessed > 1.0)
+						break; // past the end, nothing was matched
+
+					finSeconds.push_back(seconds);
+					totalSeconds += seconds;
+					matched++;
+				}
+
+				cerr << ".";
+			}
+			cerr << endl;
+
+			sort(finSeconds.begin(), finSeconds.end());
+
+			double mean = (finSeconds.empty()) ? 0.0 : totalSeconds / finSeconds.size();
+
+			json << ((0 == m) ? "" : ",") << endl
+			     << "    {" << endl
+			     << "      \"method\": " << jsonString(methodNames[m]) << "," << endl
+			     << "      \"fins_matched\": " << finSeconds.size() << "," << endl
+			     << "      \"seconds\": " << totalSeconds << "," << endl
+			     << "      \"fins_per_second\": " << ((totalSeconds > 0.0) ? finSeconds.size() / totalSeconds : 0.0) << "," << endl
+			     << "      \"fin_ms\": {"
+			     << "\"mean\": " << 1000.0 * mean
+			     << ", \"p50\": " << 1000.0 * percentile(finSeconds, 50.0)
+			     << ", \"p90\": " << 1000.0 * percentile(finSeconds, 90.0)
+			     << ", \"p99\": " << 1000.0 * percentile(finSeconds, 99.0)
+			     << ", \"max\": " << 1000.0 * percentile(finSeconds, 100.0) << "}," << endl
+			     << "      \"peak_rss_kb\": " << peakMemoryKB() << endl
+			     << "    }";
+		}
+
+		json << endl << "  ]," << endl
+		     << "  \"peak_rss_kb\": " << peakMemoryKB() << endl
+		     << "}" << endl;
+
+		for (unsigned u = 0; u < unknowns.size(); u++)
+			delete unknowns[u];
+
+		if (jsonFilename.empty())
+			cout << json.str();
+		else
+		{
+			ofstream outFile(jsonFilename.c_str());
+			if (outFile.fail())
+				throw Error("could not write " + jsonFilename);
+			outFile << json.str();
+		}
+
+	} catch (Error e) {
+		cerr << "ERROR: " << e.errorString() << endl;
+		exitStatus = 1;
+	}
+
+	for (unsigned f = 0; f < sampleFins.size(); f++)
+		delete sampleFins[f];
+
+	delete db;
+	delete sample;
+	delete gOptions;
+
+	return exitStatus;
+}
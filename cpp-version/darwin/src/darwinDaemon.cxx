@@ -0,0 +1,1535 @@
+//*******************************************************************
+//   file: darwinDaemon.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// Matching daemon.  Opens one or more catalogs once, keeps every
+// catalog fin in the match snapshot (see MatchSnapshot.h), and serves
+// match requests over a Unix domain socket, so that a client pays only
+// for registering its unknown rather than for opening the catalog and
+// reading every fin again each time.
+//
+//   usage: darwind [-threads <n>] [-poll <seconds>]
+//                  <socket> <catalog.db> [<catalog.db> ...]
+//          darwind -match <socket> <catalog> <method> <fin file> [results]
+//          darwind -status <socket>
+//          darwind -reload <socket>
+//
+// The first form runs the daemon.  The others are a small client: the
+// .fin or .finz file is read here and only its outline and feature
+// points are sent, and the daemon's JSON reply is written to standard
+// output.
+//
+// Each connection carries one request, a few lines of text ended by a
+// line "end", and gets one JSON object back before it is closed.
+//
+//   match <catalog> <method>
+//   id <ID code>               optional, the rank of that ID is reported
+//   results <n>                optional, best n results (default 50, 0 all)
+//   topk <k>                   optional, see Match::setTopK()
+//   shortlist <percent>        optional, see Match::setShortlistFraction()
+//   nearest <m>                optional, see Match::setNearestCandidates()
+//   coarse                     optional, see Match::setCoarseToFine()
+//   outline <n>
+//   <x> <y>                    n lines, the evenly spaced outline points
+//   features <LE begin> <LE end> <notch> <tip> <TE end>
+//   end
+//
+// The catalog is named by its file name without ".db", or as given on
+// the command line, and the method by the names darwin-match accepts.
+// The feature points are indices into the outline, as in a .fin file.
+// "status" asks for the catalogs being served and "reload" reloads any
+// that have changed now (see below), each on a line of its own before
+// "end".
+//
+// Requests are served on a pool of worker threads, one per processor
+// unless a thread count is given.  A worker reads a request and
+// prepares its unknown (see Match::prepareSlices()), and the catalog is
+// then registered to it in slices of DAEMON_SLICE_SIZE fins by whichever
+// workers are free, so one request uses every processor when it is
+// alone and many requests share them when they are not.  The worker
+// that registers the last slice writes the reply.  Calls that use the
+// database are made by one request at a time per catalog.
+//
+// Every poll interval (DAEMON_POLL_SECONDS by default) the daemon looks
+// at each catalog file.  When one has been written since, and another
+// program has added, updated or deleted fins (the catalog generation has
+// moved, see Database::catalogGeneration()), the daemon waits for the
+// requests against that catalog to finish, holds new ones back, and
+// reads only the changed fins again (see Database::reloadChanged()).
+// Catalogs changed by DARWIN versions that give no generations are only
+// reloaded on a "reload" request.
+//
+// The daemon stops on SIGINT or SIGTERM, once the requests already
+// taken are answered, and removes its socket.  Only built on Unix.
+//
+//*******************************************************************
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef WIN32
+#error darwind serves a Unix domain socket and is only built on Unix
+#endif
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "Error.h"
+#include "Options.h"
+#include "CatalogSupport.h"
+#include "Database.h"
+#include "MatchSnapshot.h"
+#include "matching/Match.h"
+#include "matching/MatchResults.h"
+
+#define PATH_SLASH "/"
+
+#define DAEMON_SLICE_SIZE        16        // catalog fins registered per task
+#define DAEMON_POLL_SECONDS      2         // between looks at the catalog files
+#define DAEMON_DEFAULT_RESULTS   50        // results in a reply unless asked
+#define DAEMON_MAX_REQUEST       (16 * 1024 * 1024) // bytes
+#define DAEMON_MAX_POINTS        100000    // in an unknown's outline
+#define DAEMON_READ_SECONDS      30        // to send a whole request
+#define DAEMON_BACKLOG           64        // connections waiting to be taken
+
+using namespace std;
+
+Options *gOptions = NULL; // referenced GLOBALLY, normally defined in main.cxx
+
+static volatile sig_atomic_t gStop = 0;
+
+//*******************************************************************
+//
+// the registration methods that matchSingleFin() knows how to run,
+// by the names darwin-match accepts
+//
+static const struct {
+	const char *name;
+	int method;
+} gMethodNames[] = {
+	{"original",           ORIGINAL_3_POINT},
+	{"trimFixed",          TRIM_FIXED_PERCENT},
+	{"trimOptimal",        TRIM_OPTIMAL},
+	{"trimOptimalTotal",   TRIM_OPTIMAL_TOTAL},
+	{"trimOptimalTip",     TRIM_OPTIMAL_TIP},
+	{"trimOptimalArea",    TRIM_OPTIMAL_AREA},
+	{"trimOptimalInOut",   TRIM_OPTIMAL_IN_OUT},
+	{"trimOptimalInOutTip",TRIM_OPTIMAL_IN_OUT_TIP}
+};
+
+static const int gNumMethodNames = sizeof(gMethodNames) / sizeof(gMethodNames[0]);
+
+//*******************************************************************
+//
+// class DaemonCatalog
+//
+//    One catalog being served.  dbLock is held for every call a
+//    request makes that uses the database.  useLock guards numActive,
+//    the requests being matched against the catalog, and reloading,
+//    set while changed fins are read again.  A reload waits for
+//    numActive to fall to 0, and requests wait for it to finish, both
+//    on useChanged.
+//
+class DaemonCatalog
+{
+	public:
+		string
+			name,
+			filename;
+		Options options;
+		Database *db;
+
+		int generation;      // of the catalog when last read
+		time_t modified;     // of the file when last looked at
+		off_t fileSize;
+		int numFins;
+		int numReloads;
+		int numServed;       // guarded by useLock
+
+		pthread_mutex_t dbLock;
+		pthread_mutex_t useLock;
+		pthread_cond_t useChanged;
+		int numActive;
+		bool reloading;
+
+		DaemonCatalog()
+		:	db(NULL),
+			generation(-1),
+			modified(0),
+			fileSize(0),
+			numFins(0),
+			numReloads(0),
+			numServed(0),
+			numActive(0),
+			reloading(false)
+		{
+			pthread_mutex_init(&dbLock, NULL);
+			pthread_mutex_init(&useLock, NULL);
+			pthread_cond_init(&useChanged, NULL);
+		}
+
+		~DaemonCatalog()
+		{
+			delete db;
+			pthread_mutex_destroy(&dbLock);
+			pthread_mutex_destroy(&useLock);
+			pthread_cond_destroy(&useChanged);
+		}
+};
+
+//*******************************************************************
+//
+// class DaemonRequest
+//
+//    One match request, from the time its unknown is prepared until
+//    its reply is written.  lock guards slicesLeft and the matcher's
+//    top-K errors (see Match::noteSliceErrors()).
+//
+class DaemonRequest
+{
+	public:
+		int fd;
+		DaemonCatalog *catalog;
+		Options options;         // the catalog's, with the request's choices
+		string methodName;
+		int registrationMethod;
+		int maxResults;
+		DatabaseFin<ColorImage> *unknown;
+		Match *matcher;
+		int slicesLeft;
+		double startTime;
+
+		pthread_mutex_t lock;
+
+		DaemonRequest()
+		:	fd(-1),
+			catalog(NULL),
+			registrationMethod(0),
+			maxResults(DAEMON_DEFAULT_RESULTS),
+			unknown(NULL),
+			matcher(NULL),
+			slicesLeft(0),
+			startTime(0.0)
+		{
+			pthread_mutex_init(&lock, NULL);
+		}
+
+		~DaemonRequest()
+		{
+			delete matcher;
+			delete unknown;
+			if (-1 != fd)
+				close(fd);
+			pthread_mutex_destroy(&lock);
+		}
+};
+
+// a connection to read (request NULL), or one slice of a request
+typedef struct {
+	int fd;
+	DaemonRequest *request;
+	int slice;
+} daemonTask_t;
+
+//*******************************************************************
+//
+// class DaemonPool
+//
+//    The worker threads and their tasks, guarded by lock.  Slices are
+//    queued ahead of connections, so the requests already begun finish
+//    first (and a reload waiting for them is not held up by workers
+//    waiting for the reload).  reloadLock is held by whoever reloads a
+//    catalog, so only one catalog is read at a time.
+//
+class DaemonPool
+{
+	public:
+		vector<DaemonCatalog*> catalogs;
+
+		deque<daemonTask_t> tasks;
+		bool stopping;
+		pthread_mutex_t lock;
+		pthread_cond_t taskReady;
+
+		pthread_mutex_t reloadLock;
+		pthread_mutex_t logLock;
+
+		int numWorkers;
+		double startTime;
+
+		DaemonPool()
+		:	stopping(false),
+			numWorkers(0),
+			startTime(0.0)
+		{
+			pthread_mutex_init(&lock, NULL);
+			pthread_cond_init(&taskReady, NULL);
+			pthread_mutex_init(&reloadLock, NULL);
+			pthread_mutex_init(&logLock, NULL);
+		}
+
+		~DaemonPool()
+		{
+			for (unsigned c = 0; c < catalogs.size(); c++)
+				delete catalogs[c];
+
+			pthread_mutex_destroy(&lock);
+			pthread_cond_destroy(&taskReady);
+			pthread_mutex_destroy(&reloadLock);
+			pthread_mutex_destroy(&logLock);
+		}
+};
+
+//*******************************************************************
+//
+void usage(const char *progName)
+{
+	cerr << "usage: " << progName
+	     << " [-threads <n>] [-poll <seconds>] <socket> <catalog.db> [<catalog.db> ...]" << endl
+	     << "       " << progName << " -match <socket> <catalog> <method> <fin file> [results]" << endl
+	     << "       " << progName << " -status <socket>" << endl
+	     << "       " << progName << " -reload <socket>" << endl
+	     << "  method is one of:";
+	for (int i = 0; i < gNumMethodNames; i++)
+		cerr << " " << gMethodNames[i].name;
+	cerr << endl;
+}
+
+//*******************************************************************
+//
+// int methodFromName(string name)
+//
+//    Returns the registration method constant, or -1 if name is not
+//    a known method.
+//
+int methodFromName(string name)
+{
+	for (int i = 0; i < gNumMethodNames; i++)
+		if (name == gMethodNames[i].name)
+			return gMethodNames[i].method;
+	return -1;
+}
+
+//*******************************************************************
+//
+// void setupOptions(Options *o, string dbFilename)
+//
+//    Fills in the catalog location as darwin-match does, using the
+//    same survey area convention as readConfig() in main.cxx
+//    (<area>/catalog/<name>.db).
+//
+void setupOptions(Options *o, string dbFilename)
+{
+	o->mDatabaseFileName = dbFilename;
+
+	string::size_type pos = dbFilename.rfind(string(PATH_SLASH) + "catalog");
+	if (string::npos == pos)
+		pos = dbFilename.rfind(PATH_SLASH);
+	if (string::npos == pos)
+		o->mCurrentSurveyArea = ".";
+	else
+		o->mCurrentSurveyArea = dbFilename.substr(0,pos);
+
+	pos = o->mCurrentSurveyArea.rfind(PATH_SLASH);
+	if (string::npos == pos)
+		o->mCurrentDataPath = ".";
+	else
+		o->mCurrentDataPath = o->mCurrentSurveyArea.substr(0,pos);
+
+	const char *home = getenv("DARWINHOME");
+	if (NULL != home)
+		o->mDarwinHome = home;
+	else
+		o->mDarwinHome = o->mCurrentDataPath;
+
+	// openFinz() unpacks into the temp directory
+	const char *homeDir = getenv("HOME");
+	o->mTempDirectory = (NULL == homeDir) ? "/tmp" : homeDir;
+	o->mTempDirectory += "/darwintmp";
+}
+
+//*******************************************************************
+//
+// string catalogName(string dbFilename)
+//
+//    The name a catalog is asked for by: its file name without the
+//    folder and ".db", as MatchingQueue::resultsFilename() names it.
+//
+string catalogName(string dbFilename)
+{
+	string::size_type pos = dbFilename.find_last_of(PATH_SLASH);
+	if (string::npos != pos)
+		dbFilename = dbFilename.substr(pos+1);
+	return dbFilename.substr(0,dbFilename.rfind(".db"));
+}
+
+//*******************************************************************
+//
+// string jsonString(string s)
+//
+string jsonString(string s)
+{
+	string quoted = "\"";
+	for (unsigned i = 0; i < s.length(); i++)
+	{
+		if (('"' == s[i]) || ('\\' == s[i]))
+			quoted += '\\';
+		if ((unsigned char)s[i] < ' ')
+			quoted += ' '; // no control characters in a string
+		else
+			quoted += s[i];
+	}
+	return quoted + "\"";
+}
+
+//*******************************************************************
+//
+// string errorReply(string message)
+//
+string errorReply(string message)
+{
+	return "{\"status\": \"error\", \"message\": " + jsonString(message) + "}\n";
+}
+
+//*******************************************************************
+//
+// void logLine(DaemonPool *pool, string line)
+//
+//    Writes one line of the daemon's log to standard output, from any
+//    thread.
+//
+void logLine(DaemonPool *pool, string line)
+{
+	time_t now = time(NULL);
+	char stamp[32];
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+	pthread_mutex_lock(&pool->logLock);
+	cout << stamp << " " << line << endl;
+	pthread_mutex_unlock(&pool->logLock);
+}
+
+//*******************************************************************
+//
+// bool writeAll(int fd, string text)
+//
+bool writeAll(int fd, string text)
+{
+	const char *p = text.c_str();
+	size_t left = text.length();
+
+	while (left > 0)
+	{
+		ssize_t n = write(fd, p, left);
+		if (n < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			return false;
+		}
+		p += n;
+		left -= n;
+	}
+
+	return true;
+}
+
+//*******************************************************************
+//
+// bool readRequest(int fd, string &text)
+//
+//    Reads a request up to its "end" line, or to the end of the
+//    connection.  Returns false if it is too large or does not arrive
+//    within DAEMON_READ_SECONDS.
+//
+bool readRequest(int fd, string &text)
+{
+	struct timeval timeout;
+	timeout.tv_sec = DAEMON_READ_SECONDS;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	text.erase();
+
+	char buffer[8192];
+	while (text.length() < DAEMON_MAX_REQUEST)
+	{
+		ssize_t n = read(fd, buffer, sizeof(buffer));
+		if (n < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			return false;
+		}
+		if (0 == n)
+			return true;
+
+		// only the new text (and the newline before it) need be searched
+		string::size_type from = (text.length() > 0) ? text.length() - 1 : 0;
+		text.append(buffer, n);
+
+		string::size_type end = text.find("end", from);
+		while (string::npos != end)
+		{
+			bool lineStart = (0 == end) || ('\n' == text[end - 1]);
+			string::size_type after = end + 3;
+			while ((after < text.length()) && (('\r' == text[after]) || (' ' == text[after])))
+				after++;
+			if (lineStart && (after < text.length()) && ('\n' == text[after]))
+				return true;
+			end = text.find("end", end + 1);
+		}
+	}
+
+	return false;
+}
+
+//*******************************************************************
+//
+// void setGlobalOptions(DaemonCatalog *catalog)
+//
+//    SQLiteDatabase::getFin() finds the images of catalog fins through
+//    gOptions, so it is pointed at the catalog being read.  Only the
+//    thread holding the pool's reloadLock (or the main thread before
+//    the workers start) reads catalog fins.
+//
+void setGlobalOptions(DaemonCatalog *catalog)
+{
+	gOptions = &catalog->options;
+}
+
+//*******************************************************************
+//
+// void fetchCatalog(DaemonCatalog *catalog)
+//
+//    Reads every catalog fin not yet in the match snapshot, so that the
+//    workers never change it.
+//
+void fetchCatalog(DaemonCatalog *catalog)
+{
+	Database *db = catalog->db;
+	MatchSnapshot *snapshot = db->getMatchSnapshot();
+
+	catalog->numFins = 0;
+	for (int pos = 0; pos < (int)db->sizeAbsolute(); pos++)
+		if (-1 != snapshot->fetch(pos))
+			catalog->numFins++;
+}
+
+//*******************************************************************
+//
+// void noteFileState(DaemonCatalog *catalog)
+//
+void noteFileState(DaemonCatalog *catalog)
+{
+	struct stat st;
+	if (0 == stat(catalog->filename.c_str(), &st))
+	{
+		catalog->modified = st.st_mtime;
+		catalog->fileSize = st.st_size;
+	}
+}
+
+//*******************************************************************
+//
+// bool openCatalog(DaemonCatalog *catalog)
+//
+//    Opens the catalog and reads every fin into its match snapshot.
+//    Returns false if it cannot be opened.
+//
+bool openCatalog(DaemonCatalog *catalog)
+{
+	setGlobalOptions(catalog);
+
+	noteFileState(catalog); // before reading, so any write meanwhile is seen
+
+	delete catalog->db;
+	catalog->db = openDatabase(&catalog->options, false);
+
+	if ((NULL == catalog->db) || (catalog->db->status() != Database::loaded))
+	{
+		delete catalog->db;
+		catalog->db = NULL;
+		return false;
+	}
+
+	catalog->generation = catalog->db->catalogGeneration();
+
+	fetchCatalog(catalog);
+
+	return true;
+}
+
+//*******************************************************************
+//
+// bool beginUse(DaemonCatalog *catalog)
+//
+//    A request starts using the catalog, once any reload is done.
+//    Returns false if the catalog could not be reloaded.
+//
+bool beginUse(DaemonCatalog *catalog)
+{
+	pthread_mutex_lock(&catalog->useLock);
+	while (catalog->reloading)
+		pthread_cond_wait(&catalog->useChanged, &catalog->useLock);
+	bool open = (NULL != catalog->db);
+	if (open)
+		catalog->numActive++;
+	pthread_mutex_unlock(&catalog->useLock);
+
+	return open;
+}
+
+//*******************************************************************
+//
+// void endUse(DaemonCatalog *catalog)
+//
+void endUse(DaemonCatalog *catalog)
+{
+	pthread_mutex_lock(&catalog->useLock);
+	catalog->numActive--;
+	catalog->numServed++;
+	pthread_cond_broadcast(&catalog->useChanged);
+	pthread_mutex_unlock(&catalog->useLock);
+}
+
+//*******************************************************************
+//
+// bool reloadCatalog(DaemonPool *pool, DaemonCatalog *catalog, bool force)
+//
+//    Reads again the fins of the catalog changed by other programs,
+//    when its file has been written since it was last looked at and
+//    its generation has moved, or always when force is set.  The
+//    pool's reloadLock must be held.  Returns true if it was reloaded.
+//
+bool reloadCatalog(DaemonPool *pool, DaemonCatalog *catalog, bool force)
+{
+	if (! force)
+	{
+		struct stat st;
+		if (0 != stat(catalog->filename.c_str(), &st))
+			return false;
+
+		// a write in the same second as the last look would not change
+		// the time, so a file written that recently is looked at again
+		bool written = (st.st_mtime != catalog->modified) || (st.st_size != catalog->fileSize)
+		               || (time(NULL) - st.st_mtime <= 1);
+		if (! written)
+			return false;
+
+		catalog->modified = st.st_mtime;
+		catalog->fileSize = st.st_size;
+
+		// the daemon's own writes (the match cache) leave the generation
+		pthread_mutex_lock(&catalog->dbLock);
+		int generation = (NULL == catalog->db) ? -1 : catalog->db->catalogGeneration();
+		pthread_mutex_unlock(&catalog->dbLock);
+
+		if ((NULL != catalog->db) && (generation == catalog->generation))
+			return false;
+	}
+	else
+		noteFileState(catalog);
+
+	double startTime = wallClockSeconds();
+
+	pthread_mutex_lock(&catalog->useLock);
+	catalog->reloading = true;
+	while (catalog->numActive > 0)
+		pthread_cond_wait(&catalog->useChanged, &catalog->useLock);
+	pthread_mutex_unlock(&catalog->useLock);
+
+	ostringstream line;
+	line << "Reloaded " << catalog->name << ": ";
+
+	try {
+		setGlobalOptions(catalog);
+
+		vector<int> changed;
+
+		if ((NULL != catalog->db) && catalog->db->reloadChanged(&changed))
+		{
+			catalog->generation = catalog->db->catalogGeneration();
+			fetchCatalog(catalog);
+			line << changed.size() << " fins changed";
+		}
+		else if (openCatalog(catalog))
+			line << "opened again";
+		else
+			line << "could not open " << catalog->filename;
+
+	} catch (Error e) {
+		line << e.errorString();
+	} catch (...) {
+		line << "failed";
+	}
+
+	line << ", " << catalog->numFins << " fins, generation " << catalog->generation
+	     << " (" << (wallClockSeconds() - startTime) << " s)";
+
+	catalog->numReloads++;
+
+	pthread_mutex_lock(&catalog->useLock);
+	catalog->reloading = false;
+	pthread_cond_broadcast(&catalog->useChanged);
+	pthread_mutex_unlock(&catalog->useLock);
+
+	logLine(pool, line.str());
+
+	return true;
+}
+
+//*******************************************************************
+//
+// void reloadCatalogs(DaemonPool *pool, bool force)
+//
+void reloadCatalogs(DaemonPool *pool, bool force)
+{
+	pthread_mutex_lock(&pool->reloadLock);
+	for (unsigned c = 0; c < pool->catalogs.size(); c++)
+		reloadCatalog(pool, pool->catalogs[c], force);
+	pthread_mutex_unlock(&pool->reloadLock);
+}
+
+//*******************************************************************
+//
+// void queueTask(DaemonPool *pool, daemonTask_t task, bool first)
+//
+void queueTask(DaemonPool *pool, daemonTask_t task, bool first)
+{
+	pthread_mutex_lock(&pool->lock);
+	if (first)
+		pool->tasks.push_front(task);
+	else
+		pool->tasks.push_back(task);
+	pthread_cond_signal(&pool->taskReady);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+//*******************************************************************
+//
+// string statusReply(DaemonPool *pool)
+//
+string statusReply(DaemonPool *pool)
+{
+	ostringstream json;
+	json << "{\"status\": \"ok\", \"workers\": " << pool->numWorkers
+	     << ", \"uptime_seconds\": " << (wallClockSeconds() - pool->startTime)
+	     << ", \"catalogs\": [";
+
+	for (unsigned c = 0; c < pool->catalogs.size(); c++)
+	{
+		DaemonCatalog *catalog = pool->catalogs[c];
+
+		pthread_mutex_lock(&catalog->useLock);
+		json << ((0 == c) ? "" : ",") << endl
+		     << "  {\"name\": " << jsonString(catalog->name)
+		     << ", \"file\": " << jsonString(catalog->filename)
+		     << ", \"open\": " << ((NULL == catalog->db) ? "false" : "true")
+		     << ", \"fins\": " << catalog->numFins
+		     << ", \"generation\": " << catalog->generation
+		     << ", \"reloads\": " << catalog->numReloads
+		     << ", \"active\": " << catalog->numActive
+		     << ", \"served\": " << catalog->numServed << "}";
+		pthread_mutex_unlock(&catalog->useLock);
+	}
+
+	json << endl << "]}" << endl;
+
+	return json.str();
+}
+
+//*******************************************************************
+//
+// DatabaseFin<ColorImage> *parseMatch(DaemonPool *pool, istream &in,
+//                                     DaemonRequest *request)
+//
+//    Reads the rest of a match request, after its first line, into
+//    request and returns the unknown fin it describes.  Throws an Error
+//    saying what is wrong with a request that cannot be matched.
+//
+DatabaseFin<ColorImage> *parseMatch(DaemonPool *pool, istream &in, DaemonRequest *request)
+{
+	string idCode;
+	FloatContour contour;
+	int features[5] = {-1, -1, -1, -1, -1};
+	bool haveOutline = false, haveFeatures = false;
+
+	request->options = request->catalog->options;
+
+	string line;
+	while (getline(in, line))
+	{
+		istringstream fields(line);
+		string keyword;
+		if (! (fields >> keyword))
+			continue;
+
+		if ("end" == keyword)
+			break;
+		else if ("id" == keyword)
+		{
+			getline(fields >> ws, idCode);
+			if (! idCode.empty() && ('\r' == idCode[idCode.length() - 1]))
+				idCode.erase(idCode.length() - 1);
+		}
+		else if ("results" == keyword)
+		{
+			if (! (fields >> request->maxResults) || (request->maxResults < 0))
+				throw Error("bad results line");
+		}
+		else if ("topk" == keyword)
+		{
+			int k;
+			if (! (fields >> k))
+				throw Error("bad topk line");
+			request->options.mUseMatchTopK = (k > 0);
+			request->options.mMatchTopK = k;
+		}
+		else if ("shortlist" == keyword)
+		{
+			float percent;
+			if (! (fields >> percent))
+				throw Error("bad shortlist line");
+			request->options.mUseMatchPrefilter = (percent > 0.0f) && (percent < 100.0f);
+			request->options.mMatchShortlistFraction = percent / 100.0f;
+		}
+		else if ("nearest" == keyword)
+		{
+			int m;
+			if (! (fields >> m))
+				throw Error("bad nearest line");
+			request->options.mUseOutlineIndex = (m > 0);
+			request->options.mOutlineIndexCandidates = m;
+		}
+		else if ("coarse" == keyword)
+			request->options.mUseCoarseToFine = true;
+		else if ("outline" == keyword)
+		{
+			int numPoints;
+			if (! (fields >> numPoints) || (numPoints < 3) || (numPoints > DAEMON_MAX_POINTS))
+				throw Error("bad outline line");
+
+			for (int p = 0; p < numPoints; p++)
+			{
+				float x, y;
+				if (! getline(in, line))
+					throw Error("outline ends early");
+				istringstream point(line);
+				if (! (point >> x >> y))
+					throw Error("bad outline point");
+				contour.addPoint(x, y);
+			}
+			haveOutline = true;
+		}
+		else if ("features" == keyword)
+		{
+			for (int f = 0; f < 5; f++)
+				if (! (fields >> features[f]))
+					throw Error("bad features line");
+			haveFeatures = true;
+		}
+		else
+			throw Error("unknown line: " + keyword);
+	}
+
+	if (! haveOutline || ! haveFeatures)
+		throw Error("a match request needs an outline and its features");
+
+	for (int f = 0; f < 5; f++)
+		if ((features[f] < 0) || (features[f] >= contour.length()))
+			throw Error("feature point not on the outline");
+
+	// LE begin, tip and TE end must be in order, as registration maps them
+	if ((features[0] >= features[3]) || (features[3] >= features[4]))
+		throw Error("feature points out of order");
+
+	Outline outline(&contour);
+	outline.setFeaturePoint(LE_BEGIN, features[0]);
+	outline.setFeaturePoint(LE_END, features[1]);
+	outline.setFeaturePoint(NOTCH, features[2]);
+	outline.setFeaturePoint(TIP, features[3]);
+	outline.setFeaturePoint(POINT_OF_INFLECTION, features[4]);
+	outline.setLEAngle(0.0, true);
+
+	return new DatabaseFin<ColorImage>(
+			"",
+			&outline,
+			idCode,
+			"", "", "", "", "", "",
+			-1,      // not a catalog fin
+			NULL,    // no thumbnail
+			0);
+}
+
+//*******************************************************************
+//
+// void finishRequest(DaemonPool *pool, DaemonRequest *request)
+//
+//    Once every slice is registered, adds the results in catalog order,
+//    writes the reply and deletes the request.
+//
+void finishRequest(DaemonPool *pool, DaemonRequest *request)
+{
+	DaemonCatalog *catalog = request->catalog;
+	Match *matcher = request->matcher;
+	string reply;
+
+	try {
+		pthread_mutex_lock(&catalog->dbLock);
+		try {
+			matcher->finishSlices(); // writes the match cache
+		} catch (...) {
+			pthread_mutex_unlock(&catalog->dbLock);
+			throw;
+		}
+		pthread_mutex_unlock(&catalog->dbLock);
+
+		MatchResults *results = matcher->getMatchResults();
+		results->sort();
+
+		double seconds = wallClockSeconds() - request->startTime;
+
+		ostringstream json;
+		json << "{\"status\": \"ok\""
+		     << ", \"catalog\": " << jsonString(catalog->name)
+		     << ", \"method\": " << jsonString(request->methodName)
+		     << ", \"generation\": " << results->getCatalogGeneration()
+		     << ", \"matched\": " << results->size()
+		     << ", \"unranked\": " << results->numUnranked()
+		     << ", \"cache_hits\": " << matcher->getNumCacheHits()
+		     << ", \"seconds\": " << seconds;
+
+		if (matcher->getNumPrefilterCandidates() > 0)
+			json << ", \"prefilter_candidates\": " << matcher->getNumPrefilterCandidates()
+			     << ", \"prefilter_true_rank\": " << matcher->getPrefilterTrueRank();
+
+		if (! request->unknown->mIDCode.empty())
+			json << ", \"id\": " << jsonString(request->unknown->mIDCode)
+			     << ", \"id_rank\": " << results->findRank();
+
+		json << ", \"results\": [";
+
+		int numResults = results->size();
+		if ((request->maxResults > 0) && (request->maxResults < numResults))
+			numResults = request->maxResults;
+
+		for (int r = 0; r < numResults; r++)
+		{
+			Result *result = results->getResultNum(r);
+
+			json << ((0 == r) ? "" : ",") << endl
+			     << "  {\"rank\": " << (r + 1)
+			     << ", \"position\": " << result->getPosition()
+			     << ", \"id\": " << jsonString(result->getIdCode())
+			     << ", \"name\": " << jsonString(result->getName())
+			     << ", \"error\": " << result->getErrorValue()
+			     << ", \"ranked\": " << (result->isRanked() ? "true" : "false")
+			     << ", \"damage\": " << jsonString(result->getDamage())
+			     << ", \"date\": " << jsonString(result->getDate())
+			     << ", \"location\": " << jsonString(result->getLocation())
+			     << ", \"image\": " << jsonString(result->getImageFilename()) << "}";
+		}
+
+		json << endl << "]}" << endl;
+		reply = json.str();
+
+		ostringstream line;
+		line << "Matched against " << catalog->name << " (" << request->methodName << "): "
+		     << results->size() << " fins in " << seconds << " s";
+		logLine(pool, line.str());
+
+	} catch (Error e) {
+		reply = errorReply(e.errorString());
+	} catch (...) {
+		reply = errorReply("matching failed");
+	}
+
+	writeAll(request->fd, reply);
+
+	endUse(catalog);
+	delete request;
+}
+
+//*******************************************************************
+//
+// void serveConnection(DaemonPool *pool, int fd)
+//
+//    Reads one request.  Status and reload requests are answered here.
+//    A match request is prepared and its slices queued, or answered
+//    here when there is nothing to register.
+//
+void serveConnection(DaemonPool *pool, int fd)
+{
+	string text;
+	if (! readRequest(fd, text))
+	{
+		writeAll(fd, errorReply("request too large or too slow"));
+		close(fd);
+		return;
+	}
+
+	istringstream in(text);
+	string line, command;
+	while (command.empty() && getline(in, line))
+	{
+		istringstream fields(line);
+		fields >> command;
+	}
+
+	if (("status" == command) || ("reload" == command))
+	{
+		if ("reload" == command)
+			reloadCatalogs(pool, true);
+		writeAll(fd, statusReply(pool));
+		close(fd);
+		return;
+	}
+
+	if ("match" != command)
+	{
+		writeAll(fd, errorReply("expected match, status or reload"));
+		close(fd);
+		return;
+	}
+
+	DaemonRequest *request = new DaemonRequest();
+	request->fd = fd;
+	request->startTime = wallClockSeconds();
+
+	bool inUse = false;
+
+	try {
+		string name;
+		istringstream fields(line);
+		fields >> command >> name >> request->methodName;
+
+		for (unsigned c = 0; c < pool->catalogs.size(); c++)
+			if ((name == pool->catalogs[c]->name) || (name == pool->catalogs[c]->filename))
+				request->catalog = pool->catalogs[c];
+
+		if (NULL == request->catalog)
+			throw Error("no catalog " + name);
+
+		request->registrationMethod = methodFromName(request->methodName);
+		if (-1 == request->registrationMethod)
+			throw Error("unknown registration method " + request->methodName);
+
+		request->unknown = parseMatch(pool, in, request);
+
+		if (! beginUse(request->catalog))
+			throw Error("catalog " + name + " could not be opened");
+		inUse = true;
+
+		bool categoryToMatch[32] =
+				{true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true};
+
+		DaemonCatalog *catalog = request->catalog;
+
+		pthread_mutex_lock(&catalog->dbLock);
+		try {
+			request->matcher = new Match(request->unknown, catalog->db, &request->options);
+			request->slicesLeft = request->matcher->prepareSlices(
+					request->registrationMethod, categoryToMatch,
+					false, // use trailing edge only in final error
+					DAEMON_SLICE_SIZE);
+		} catch (...) {
+			pthread_mutex_unlock(&catalog->dbLock);
+			throw;
+		}
+		pthread_mutex_unlock(&catalog->dbLock);
+
+	} catch (Error e) {
+		writeAll(fd, errorReply(e.errorString()));
+		if (inUse)
+			endUse(request->catalog);
+		delete request;
+		return;
+	} catch (...) {
+		writeAll(fd, errorReply("could not prepare the match"));
+		if (inUse)
+			endUse(request->catalog);
+		delete request;
+		return;
+	}
+
+	int numSlices = request->slicesLeft;
+
+	if (0 == numSlices)
+	{
+		finishRequest(pool, request);
+		return;
+	}
+
+	// first in line, in slice order
+	pthread_mutex_lock(&pool->lock);
+	for (int s = numSlices - 1; s >= 0; s--)
+	{
+		daemonTask_t task;
+		task.fd = -1;
+		task.request = request;
+		task.slice = s;
+		pool->tasks.push_front(task);
+	}
+	pthread_cond_broadcast(&pool->taskReady);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+//*******************************************************************
+//
+// void runSlice(DaemonPool *pool, const daemonTask_t &task)
+//
+//    Registers one slice of the catalog to its request's unknown, and
+//    finishes the request if it was the last.
+//
+void runSlice(DaemonPool *pool, const daemonTask_t &task)
+{
+	DaemonRequest *request = task.request;
+	bool last = false;
+
+	try {
+		pthread_mutex_lock(&request->lock);
+		double abandonAbove = request->matcher->abandonThreshold();
+		pthread_mutex_unlock(&request->lock);
+
+		request->matcher->registerSlice(task.slice, abandonAbove);
+
+		pthread_mutex_lock(&request->lock);
+		request->matcher->noteSliceErrors(task.slice);
+		last = (0 == --request->slicesLeft);
+		pthread_mutex_unlock(&request->lock);
+
+	} catch (...) {
+		// the slice's fins keep the error they were given, and the
+		// request is still answered
+		logLine(pool, "Registering a slice failed");
+
+		pthread_mutex_lock(&request->lock);
+		last = (0 == --request->slicesLeft);
+		pthread_mutex_unlock(&request->lock);
+	}
+
+	if (last)
+		finishRequest(pool, request);
+}
+
+//*******************************************************************
+//
+// void *daemonWorkerThread(void *arg)
+//
+//    One worker, runs tasks until the pool is stopping and none are
+//    left.
+//
+void *daemonWorkerThread(void *arg)
+{
+	DaemonPool *pool = (DaemonPool *)arg;
+
+	while (true)
+	{
+		pthread_mutex_lock(&pool->lock);
+		while (pool->tasks.empty() && ! pool->stopping)
+			pthread_cond_wait(&pool->taskReady, &pool->lock);
+
+		if (pool->tasks.empty())
+		{
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+
+		daemonTask_t task = pool->tasks.front();
+		pool->tasks.pop_front();
+		pthread_mutex_unlock(&pool->lock);
+
+		if (NULL == task.request)
+			serveConnection(pool, task.fd);
+		else
+			runSlice(pool, task);
+	}
+
+	return NULL;
+}
+
+//*******************************************************************
+//
+// void stopSignal(int sig)
+//
+void stopSignal(int sig)
+{
+	gStop = 1;
+}
+
+//*******************************************************************
+//
+// int openSocket(string socketName)
+//
+//    Listens on the socket, replacing one left by a daemon that is no
+//    longer running.  Returns -1, having said why, if it cannot.
+//
+int openSocket(string socketName)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (socketName.length() >= sizeof(address.sun_path))
+	{
+		cerr << "Socket name too long: " << socketName << endl;
+		return -1;
+	}
+	strcpy(address.sun_path, socketName.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (-1 == fd)
+	{
+		cerr << "Could not make a socket: " << strerror(errno) << endl;
+		return -1;
+	}
+
+	// a socket nobody answers on was left behind
+	struct stat st;
+	if ((0 == stat(socketName.c_str(), &st)) && S_ISSOCK(st.st_mode))
+	{
+		if (0 == connect(fd, (struct sockaddr *)&address, sizeof(address)))
+		{
+			cerr << "A daemon is already serving " << socketName << endl;
+			close(fd);
+			return -1;
+		}
+		close(fd);
+		unlink(socketName.c_str());
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	}
+
+	if ((0 != bind(fd, (struct sockaddr *)&address, sizeof(address)))
+	    || (0 != listen(fd, DAEMON_BACKLOG)))
+	{
+		cerr << "Could not listen on " << socketName << ": " << strerror(errno) << endl;
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+//*******************************************************************
+//
+// int runDaemon(int argc, char *argv[], const char *progName)
+//
+int runDaemon(int argc, char *argv[], const char *progName)
+{
+	int
+		numThreads = numberOfProcessors(),
+		pollSeconds = DAEMON_POLL_SECONDS;
+
+	int arg = 1;
+	while ((arg + 1 < argc) && ('-' == argv[arg][0]))
+	{
+		string flag = argv[arg++];
+
+		if ("-threads" == flag)
+			numThreads = atoi(argv[arg]);
+		else if ("-poll" == flag)
+			pollSeconds = atoi(argv[arg]);
+		else
+		{
+			usage(progName);
+			return 1;
+		}
+		arg++;
+	}
+
+	if ((argc - arg < 2) || (pollSeconds < 1))
+	{
+		usage(progName);
+		return 1;
+	}
+
+	if (numThreads < 1)
+		numThreads = 1;
+
+	string socketName = argv[arg++];
+
+	// before the catalogs are read, so a second daemon gives up at once
+	// and clients connecting meanwhile wait for the first reply
+	int listenFd = openSocket(socketName);
+	if (-1 == listenFd)
+		return 1;
+
+	DaemonPool pool;
+	pool.numWorkers = numThreads;
+	pool.startTime = wallClockSeconds();
+
+	try {
+		for (; arg < argc; arg++)
+		{
+			DaemonCatalog *catalog = new DaemonCatalog();
+			catalog->filename = argv[arg];
+			catalog->name = catalogName(catalog->filename);
+			setupOptions(&catalog->options, catalog->filename);
+			pool.catalogs.push_back(catalog);
+
+			double startTime = wallClockSeconds();
+
+			if (! openCatalog(catalog))
+			{
+				cerr << "Could not open catalog: " << catalog->filename << endl;
+				close(listenFd);
+				unlink(socketName.c_str());
+				return 1;
+			}
+
+			ostringstream line;
+			line << "Opened " << catalog->name << ": " << catalog->numFins << " fins, generation "
+			     << catalog->generation << " (" << (wallClockSeconds() - startTime) << " s)";
+			logLine(&pool, line.str());
+		}
+	} catch (Error e) {
+		cerr << "ERROR: " << e.errorString() << endl;
+		close(listenFd);
+		unlink(socketName.c_str());
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN); // a client that has gone is noticed by write()
+	signal(SIGINT, stopSignal);
+	signal(SIGTERM, stopSignal);
+
+	vector<pthread_t> threads(numThreads);
+	for (int t = 0; t < numThreads; t++)
+		pthread_create(&threads[t], NULL, daemonWorkerThread, &pool);
+
+	ostringstream line;
+	line << "Serving " << pool.catalogs.size() << " catalogs on " << socketName
+	     << " with " << numThreads << " workers";
+	logLine(&pool, line.str());
+
+	time_t lastPoll = time(NULL);
+
+	while (! gStop)
+	{
+		fd_set readable;
+		FD_ZERO(&readable);
+		FD_SET(listenFd, &readable);
+
+		struct timeval wait;
+		wait.tv_sec = 1;
+		wait.tv_usec = 0;
+
+		int n = select(listenFd + 1, &readable, NULL, NULL, &wait);
+
+		if ((n > 0) && FD_ISSET(listenFd, &readable))
+		{
+			int fd = accept(listenFd, NULL, NULL);
+			if (-1 != fd)
+			{
+				daemonTask_t task;
+				task.fd = fd;
+				task.request = NULL;
+				task.slice = -1;
+				queueTask(&pool, task, false);
+			}
+		}
+
+		if (time(NULL) - lastPoll >= pollSeconds)
+		{
+			reloadCatalogs(&pool, false);
+			lastPoll = time(NULL);
+		}
+	}
+
+	logLine(&pool, "Stopping");
+
+	close(listenFd);
+	unlink(socketName.c_str());
+
+	pthread_mutex_lock(&pool.lock);
+	pool.stopping = true;
+	pthread_cond_broadcast(&pool.taskReady);
+	pthread_mutex_unlock(&pool.lock);
+
+	for (int t = 0; t < numThreads; t++)
+		pthread_join(threads[t], NULL);
+
+	return 0;
+}
+
+//*******************************************************************
+//
+// int sendRequest(string socketName, string request)
+//
+//    The client: sends one request and writes the reply to standard
+//    output.  Returns the exit status for main().
+//
+int sendRequest(string socketName, string request)
+{
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+
+	if (socketName.length() >= sizeof(address.sun_path))
+	{
+		cerr << "Socket name too long: " << socketName << endl;
+		return 1;
+	}
+	strcpy(address.sun_path, socketName.c_str());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if ((-1 == fd) || (0 != connect(fd, (struct sockaddr *)&address, sizeof(address))))
+	{
+		cerr << "No daemon on " << socketName << ": " << strerror(errno) << endl;
+		if (-1 != fd)
+			close(fd);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if (! writeAll(fd, request))
+	{
+		cerr << "Could not send the request: " << strerror(errno) << endl;
+		close(fd);
+		return 1;
+	}
+
+	string reply;
+	char buffer[8192];
+	ssize_t n;
+	while ((n = read(fd, buffer, sizeof(buffer))) != 0)
+	{
+		if (n < 0)
+		{
+			if (EINTR == errno)
+				continue;
+			break;
+		}
+		reply.append(buffer, n);
+	}
+	close(fd);
+
+	cout << reply;
+
+	return (string::npos == reply.find("\"status\": \"ok\"")) ? 1 : 0;
+}
+
+//*******************************************************************
+//
+// int matchClient(int argc, char *argv[], const char *progName)
+//
+//    -match, argv[1] being the socket.  Sends the outline and feature
+//    points of the fin file as a match request.
+//
+int matchClient(int argc, char *argv[], const char *progName)
+{
+	if ((argc < 5) || (argc > 6))
+	{
+		usage(progName);
+		return 1;
+	}
+
+	string
+		socketName = argv[1],
+		catalog = argv[2],
+		method = argv[3],
+		finFilename = argv[4];
+
+	if (-1 == methodFromName(method))
+	{
+		cerr << "Unknown registration method: " << method << endl;
+		usage(progName);
+		return 1;
+	}
+
+	gOptions = new Options();
+	setupOptions(gOptions, finFilename);
+
+	DatabaseFin<ColorImage> *fin = NULL;
+
+	try {
+		if (string::npos == finFilename.rfind(".finz"))
+		{
+			if (isTracedFinFile(finFilename))
+				fin = new DatabaseFin<ColorImage>(finFilename);
+		}
+		else
+			fin = openFinz(finFilename);
+	} catch (Error e) {
+		cerr << "ERROR: " << e.errorString() << endl;
+	}
+
+	if (NULL == fin)
+	{
+		cerr << "Could not read " << finFilename << endl;
+		delete gOptions;
+		return 1;
+	}
+
+	Outline *outline = fin->mFinOutline;
+	FloatContour *contour = outline->getFloatContour();
+
+	ostringstream request;
+	request << "match " << catalog << " " << method << endl;
+	if (! fin->mIDCode.empty())
+		request << "id " << fin->mIDCode << endl;
+	if (6 == argc)
+		request << "results " << atoi(argv[5]) << endl;
+	request << "outline " << contour->length() << endl
+	        << setprecision(9); // every float read back exactly
+	for (int p = 0; p < contour->length(); p++)
+		request << (*contour)[p].x << " " << (*contour)[p].y << endl;
+	request << "features "
+	        << outline->getFeaturePoint(LE_BEGIN) << " "
+	        << outline->getFeaturePoint(LE_END) << " "
+	        << outline->getFeaturePoint(NOTCH) << " "
+	        << outline->getFeaturePoint(TIP) << " "
+	        << outline->getFeaturePoint(POINT_OF_INFLECTION) << endl
+	        << "end" << endl;
+
+	delete fin;
+	delete gOptions;
+
+	return sendRequest(socketName, request.str());
+}
+
+//*******************************************************************
+//
+int main(int argc, char *argv[])
+{
+	const char *progName = argv[0];
+
+	if ((argc > 1) && (string(argv[1]) == "-match"))
+		return matchClient(argc - 1, argv + 1, progName);
+
+	if ((argc == 3) && (string(argv[1]) == "-status"))
+		return sendRequest(argv[2], "status\nend\n");
+
+	if ((argc == 3) && (string(argv[1]) == "-reload"))
+		return sendRequest(argv[2], "reload\nend\n");
+
+	return runDaemon(argc, argv, progName);
+}
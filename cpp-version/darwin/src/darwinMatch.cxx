@@ -0,0 +1,465 @@
+//*******************************************************************
+//   file: darwinMatch.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// Headless batch matcher.  Runs every unknown in a match queue
+// against a catalog exactly as the MatchingQueueDialog does, but
+// without GTK, so that long queues can be run from a shell or a
+// cron job on a machine with no display.
+//
+//   usage: darwin-match [-update] [-batch] [-coarse] [-nearest <M>] [-trace <trace.json>]
+//                       <catalog.db>
+//                       <queue file> <method> <output folder>
+//                       [threads [topK [shortlist%]]]
+//          darwin-match -duplicates <catalog.db> <method> <output.csv>
+//                       [threads [neighbours [pairsPerFin]]]
+//
+// The queue is matched on a pool of worker threads, one per processor
+// unless a thread count is given (1 matches serially).  Each task
+// registers one unknown against a slice of the catalog, and idle
+// workers steal tasks from busy ones, so a few unknowns with a large
+// catalog and many unknowns with a small one both keep every thread
+// busy (see MatchingQueue::matchAll()).  Each .res file is written as
+// soon as its unknown is done, so they may finish out of queue order.
+//
+// With -batch, the loops are turned inside out: the unknowns are loaded
+// in batches and each task registers one block of catalog fins to every
+// unknown of the batch, so each catalog outline is brought into cache
+// once per batch rather than once per unknown (see
+// MatchingQueue::matchBatch()).  Best for long queues.
+// With -coarse, the early moves of the optimal registration methods are
+// made on coarse outlines and only the final ones at full resolution,
+// which is faster but can change the results slightly (see
+// Match::setCoarseToFine()).
+// With -nearest, only the M catalog fins nearest each unknown in the
+// catalog's outline index are read and registered (see
+// Match::setNearestCandidates()), and the recall of this prefilter is
+// reported in the summary.
+// With a topK (> 0), fins that can no longer rank in the top K are
+// not fully optimized and are listed as unranked (see Match::setTopK()).
+// With a shortlist percentage (0 < % < 100), only that percentage of
+// the catalog, most similar in shape to the unknown, is registered
+// (see Match::setShortlistFraction()) and the recall of this prefilter
+// is reported in the summary.
+//
+// One .res file per unknown and a results-summary file are written
+// into the output folder.  The .res files are named exactly as the
+// MatchingQueueDialog names them so they load into MatchResultsWindow.
+//
+// With -update, an unknown whose .res file is already in the output
+// folder is only matched against the catalog fins added or updated
+// since that file was written, and the new results are merged into it
+// (see Match::matchAddedSince()).  The same method must be used as
+// before.  Files written before catalog generations existed are
+// matched in full.
+//
+// The time spent in each phase of matching (reading catalog fins,
+// registration, the error functions, saving) is written in the header
+// of each .res file and, over all unknowns, in the summary.  With
+// -trace, the coarse phases on each thread are also written as a
+// timeline in Chrome trace event format, for chrome://tracing or
+// Perfetto (see MatchProfile.h).
+//
+// With -duplicates, the catalog fins are registered against each
+// other instead (see CatalogSelfMatch.h), every pair unless a number
+// of nearest neighbours by shape is given, and the pairs of fins with
+// different IDs that best match each fin (pairsPerFin, 3 by default)
+// are written to the CSV file as suspected duplicates.
+//
+//*******************************************************************
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <iostream>
+#include <fstream>
+
+#include "Error.h"
+#include "Options.h"
+#include "CatalogSupport.h"
+#include "MatchProfile.h"
+#include "matching/CatalogSelfMatch.h"
+#include "matching/Match.h"
+#include "matching/MatchResults.h"
+#include "matching/MatchingQueue.h"
+
+#ifdef WIN32
+#define PATH_SLASH "\\"
+#else
+#define PATH_SLASH "/"
+#endif
+
+using namespace std;
+
+Options *gOptions = NULL; // referenced GLOBALLY, normally defined in main.cxx
+
+//*******************************************************************
+//
+// the registration methods that matchSingleFin() knows how to run,
+// by the names accepted on the command line
+//
+static const struct {
+	const char *name;
+	int method;
+} gMethodNames[] = {
+	{"original",           ORIGINAL_3_POINT},
+	{"trimFixed",          TRIM_FIXED_PERCENT},
+	{"trimOptimal",        TRIM_OPTIMAL},
+	{"trimOptimalTotal",   TRIM_OPTIMAL_TOTAL},
+	{"trimOptimalTip",     TRIM_OPTIMAL_TIP},
+	{"trimOptimalArea",    TRIM_OPTIMAL_AREA},
+	{"trimOptimalInOut",   TRIM_OPTIMAL_IN_OUT},
+	{"trimOptimalInOutTip",TRIM_OPTIMAL_IN_OUT_TIP}
+};
+
+static const int gNumMethodNames = sizeof(gMethodNames) / sizeof(gMethodNames[0]);
+
+//*******************************************************************
+//
+void usage(const char *progName)
+{
+	cerr << "usage: " << progName
+	     << " [-update] [-batch] [-coarse] [-nearest <M>] [-trace <trace.json>] <catalog.db> <queue file> <method>"
+	     << " <output folder>"
+	     << " [threads [topK [shortlist%]]]" << endl
+	     << "       " << progName
+	     << " -duplicates <catalog.db> <method> <output.csv>"
+	     << " [threads [neighbours [pairsPerFin]]]" << endl
+	     << "  method is one of:";
+	for (int i = 0; i < gNumMethodNames; i++)
+		cerr << " " << gMethodNames[i].name;
+	cerr << endl;
+}
+
+//*******************************************************************
+//
+// int methodFromName(string name)
+//
+//    Returns the registration method constant, or -1 if name is not
+//    a known method.
+//
+int methodFromName(string name)
+{
+	for (int i = 0; i < gNumMethodNames; i++)
+		if (name == gMethodNames[i].name)
+			return gMethodNames[i].method;
+	return -1;
+}
+
+//*******************************************************************
+//
+// void setupOptions(string dbFilename)
+//
+//    Builds gOptions from the catalog location rather than from the
+//    darwin.cfg file, using the same survey area convention as
+//    readConfig() in main.cxx (<area>/catalog/<name>.db).
+//
+void setupOptions(string dbFilename)
+{
+	gOptions = new Options();
+
+	gOptions->mDatabaseFileName = dbFilename;
+
+	string::size_type pos = dbFilename.rfind(string(PATH_SLASH) + "catalog");
+	if (string::npos == pos)
+		pos = dbFilename.rfind(PATH_SLASH);
+	if (string::npos == pos)
+		gOptions->mCurrentSurveyArea = ".";
+	else
+		gOptions->mCurrentSurveyArea = dbFilename.substr(0,pos);
+
+	pos = gOptions->mCurrentSurveyArea.rfind(PATH_SLASH);
+	if (string::npos == pos)
+		gOptions->mCurrentDataPath = ".";
+	else
+		gOptions->mCurrentDataPath = gOptions->mCurrentSurveyArea.substr(0,pos);
+
+	const char *home = getenv("DARWINHOME");
+	if (NULL != home)
+		gOptions->mDarwinHome = home;
+	else
+		gOptions->mDarwinHome = gOptions->mCurrentDataPath;
+
+	// openFinz() unpacks into the temp directory
+#ifdef WIN32
+	const char *tempDir = getenv("TEMP");
+	gOptions->mTempDirectory = (NULL == tempDir) ? "." : tempDir;
+	gOptions->mTempDirectory += "\\darwin";
+#else
+	const char *homeDir = getenv("HOME");
+	gOptions->mTempDirectory = (NULL == homeDir) ? "/tmp" : homeDir;
+	gOptions->mTempDirectory += "/darwintmp";
+#endif
+}
+
+//*******************************************************************
+//
+// int findDuplicates(int argc, char *argv[], const char *progName)
+//
+//    The -duplicates job, argv[1] being the catalog.  Returns the exit
+//    status for main().
+//
+int findDuplicates(int argc, char *argv[], const char *progName)
+{
+	if ((argc < 4) || (argc > 7))
+	{
+		usage(progName);
+		return 1;
+	}
+
+	string
+		dbFilename = argv[1],
+		csvFilename = argv[3];
+
+	int registrationMethod = methodFromName(argv[2]);
+	if (-1 == registrationMethod)
+	{
+		cerr << "Unknown registration method: " << argv[2] << endl;
+		usage(progName);
+		return 1;
+	}
+
+	int numThreads = (argc >= 5) ? atoi(argv[4]) : numberOfProcessors();
+	if (numThreads < 1)
+		numThreads = 1;
+
+	int
+		neighbours = (argc >= 6) ? atoi(argv[5]) : 0,
+		pairsPerFin = (argc == 7) ? atoi(argv[6]) : 3;
+
+	setupOptions(dbFilename);
+
+	Database *db = NULL;
+
+	try {
+
+		db = openDatabase(gOptions, false);
+
+		if (db->status() != Database::loaded)
+		{
+			cerr << "Could not open catalog: " << dbFilename << endl;
+			delete db;
+			delete gOptions;
+			return 1;
+		}
+
+		double startTime = wallClockSeconds();
+
+		CatalogSelfMatch selfMatch(db);
+		selfMatch.setNeighbours(neighbours);
+		selfMatch.setPairsPerFin(pairsPerFin);
+
+		cout << "Matching " << selfMatch.getNumFins() << " catalog fins against each other ";
+
+		float percentPairsDone = 0.0;
+		int tenths = 0;
+		while (percentPairsDone < 1.0)
+		{
+			percentPairsDone = selfMatch.matchNextBlock(
+					registrationMethod,
+					false, // use trailing edge only in final error
+					numThreads);
+			for (; tenths < (int)(percentPairsDone * 10); tenths++)
+				cout << ".";
+			cout.flush();
+		}
+		cout << endl;
+
+		selfMatch.summarize(cout);
+		cout << "\t" << (wallClockSeconds() - startTime) << " seconds" << endl;
+
+		if (! selfMatch.saveCSV(csvFilename))
+			cerr << "Could not write " << csvFilename << endl;
+
+	} catch (Error e) {
+		cerr << "ERROR: " << e.errorString() << endl;
+		delete db;
+		delete gOptions;
+		return 1;
+	}
+
+	delete db;
+	delete gOptions;
+
+	return 0;
+}
+
+//*******************************************************************
+//
+int main(int argc, char *argv[])
+{
+	const char *progName = argv[0];
+
+	// register the catalog against itself rather than matching a queue
+	if ((argc > 1) && (string(argv[1]) == "-duplicates"))
+		return findDuplicates(argc - 1, argv + 1, progName);
+
+	// bring existing results up to date rather than matching in full,
+	// match the unknowns in batches, register coarse-to-fine, register
+	// only the nearest fins in the outline index and/or write a timeline
+	// of matching
+	bool
+		update = false,
+		batch = false,
+		coarse = false;
+	int nearest = 0;
+	string traceFilename;
+	while ((argc > 1) && ((string(argv[1]) == "-update") || (string(argv[1]) == "-batch")
+	                      || (string(argv[1]) == "-coarse") || (string(argv[1]) == "-nearest")
+	                      || (string(argv[1]) == "-trace")))
+	{
+		if (string(argv[1]) == "-update")
+			update = true;
+		else if (string(argv[1]) == "-batch")
+			batch = true;
+		else if (string(argv[1]) == "-coarse")
+			coarse = true;
+		else if ((string(argv[1]) == "-nearest") && (argc > 2) && (atoi(argv[2]) > 0))
+		{
+			nearest = atoi(argv[2]);
+			argc--;
+			argv++;
+		}
+		else if ((string(argv[1]) == "-trace") && (argc > 2))
+		{
+			traceFilename = argv[2];
+			argc--;
+			argv++;
+		}
+		else
+		{
+			usage(progName);
+			return 1;
+		}
+		argc--;
+		argv++;
+	}
+
+	if ((argc < 5) || (argc > 8))
+	{
+		usage(progName);
+		return 1;
+	}
+
+	string
+		dbFilename = argv[1],
+		queueFilename = argv[2],
+		outFolder = argv[4];
+
+	int registrationMethod = methodFromName(argv[3]);
+	if (-1 == registrationMethod)
+	{
+		cerr << "Unknown registration method: " << argv[3] << endl;
+		usage(progName);
+		return 1;
+	}
+
+	int numThreads = (argc >= 6) ? atoi(argv[5]) : numberOfProcessors();
+	if (numThreads < 1)
+		numThreads = 1;
+
+	int topK = (argc >= 7) ? atoi(argv[6]) : 0;
+
+	float shortlistPercent = (argc == 8) ? atof(argv[7]) : 0.0f;
+
+	setupOptions(dbFilename);
+
+	if (topK > 0)
+	{
+		gOptions->mUseMatchTopK = true;
+		gOptions->mMatchTopK = topK;
+	}
+
+	if ((shortlistPercent > 0.0f) && (shortlistPercent < 100.0f))
+	{
+		gOptions->mUseMatchPrefilter = true;
+		gOptions->mMatchShortlistFraction = shortlistPercent / 100.0f;
+	}
+
+	gOptions->mUseCoarseToFine = coarse;
+
+	if (nearest > 0)
+	{
+		gOptions->mUseOutlineIndex = true;
+		gOptions->mOutlineIndexCandidates = nearest;
+	}
+
+	Database *db = NULL;
+
+	try {
+
+		db = openDatabase(gOptions, false);
+
+		if (db->status() != Database::loaded)
+		{
+			cerr << "Could not open catalog: " << dbFilename << endl;
+			delete db;
+			delete gOptions;
+			return 1;
+		}
+
+		MatchingQueue queue(db, gOptions);
+		queue.load(queueFilename);
+		queue.setupMatching();
+
+		if (! traceFilename.empty())
+			MatchProfile::startTrace();
+
+		bool categoriesToMatch[32] =
+				{true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true,
+				 true,true,true,true,true,true,true,true};
+
+		if (batch)
+			queue.matchBatch(
+					registrationMethod,
+					categoriesToMatch,
+					false, // use trailing edge only in final error
+					outFolder,
+					numThreads,
+					update);
+		else
+			queue.matchAll(
+					registrationMethod,
+					categoriesToMatch,
+					false, // use trailing edge only in final error
+					outFolder,
+					numThreads,
+					update);
+
+		if (! traceFilename.empty() && ! MatchProfile::writeTrace(traceFilename))
+			cerr << "Could not write " << traceFilename << endl;
+
+		queue.summarizeMatching(); // output to console
+
+		string summaryFilename = outFolder + PATH_SLASH + "results-summary";
+		ofstream outFile(summaryFilename.c_str());
+		if (! outFile.fail())
+		{
+			queue.summarizeMatching(outFile); // output to file
+			outFile.close();
+		}
+		else
+			cerr << "Could not write " << summaryFilename << endl;
+
+	} catch (Error e) {
+		cerr << "ERROR: " << e.errorString() << endl;
+		delete db;
+		delete gOptions;
+		return 1;
+	}
+
+	delete db;
+	delete gOptions;
+
+	return 0;
+}
@@ -43,6 +43,7 @@ static const int FIN_IMAGE_WIDTH = 400; // was 320
 static const int FIN_IMAGE_HEIGHT = 300; // was 240
 static const int POINT_SIZE = 1;
 static const int TABLE_COLS = 4; // was 3 prior to version 1.0
+static const int FIRST_PAGE_ROWS = 20; //***2.3 - thumbnails loaded before the list is shown
 
 gboolean on_matchResultsWindow_delete_event(
 						GtkWidget *widget,
@@ -77,6 +78,10 @@ void on_mMRCList_select_row(
 				GdkEvent *event,
 				gpointer userData);
 
+void on_mMRCList_scrolled( //***2.3 - new
+				GtkAdjustment *adjustment,
+				gpointer userData);
+
 void on_mMRButtonPrev_clicked(
 				GtkButton *button,
 				gpointer userData);
@@ -337,14 +342,9 @@ void MatchResultsWindow::updateList()
 	for (unsigned i = 0; i < numEntries; i++) {
 		Result *r = mResults->getResultNum(i);
 
-		if (NULL == r->mThumbnailPixmap)
-			create_gdk_pixmap_from_data(mMRCList, &pixmap, &mask, fin_xpm);
-		else
-			create_gdk_pixmap_from_data(
-					mMRCList,
-					&pixmap,
-					&mask,
-					r->mThumbnailPixmap);
+		//***2.3 - every row starts with the placeholder fin, the thumbnails
+		// are loaded as rows come into view, see showVisibleThumbnails()
+		create_gdk_pixmap_from_data(mMRCList, &pixmap, &mask, fin_xpm);
 
 		gchar *idCode, *name, *damage, *date, *location,*error;
 
@@ -442,6 +442,73 @@ void MatchResultsWindow::updateList()
 	}
 
 	gtk_clist_thaw(GTK_CLIST(mMRCList));
+
+	mThumbnailShown.assign(numEntries, false); //***2.3
+	showVisibleThumbnails();
+}
+
+//*******************************************************************
+//
+// void MatchResultsWindow::showVisibleThumbnails()
+//
+//    ***2.3 - Loads the thumbnails of the rows that can be seen, and of
+//    no others, so that opening a long list of results does not read
+//    every fin from the catalog.  Called again as the list scrolls.
+//
+void MatchResultsWindow::showVisibleThumbnails()
+{
+	if ((NULL == mResults) || (NULL == mMRCList) || (NULL == mScrolledWindow))
+		return;
+
+	int numEntries = mResults->size();
+
+	if ((int)mThumbnailShown.size() != numEntries)
+		return; // list not filled in yet
+
+	GtkAdjustment *adj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(mScrolledWindow));
+
+	const int lineHeight = GTK_CLIST(mMRCList)->row_height + 1; // rows are 1 pixel apart
+
+	int
+		first = (int)(adj->value) / lineHeight,
+		last = (int)(adj->value + adj->page_size) / lineHeight;
+
+	if (adj->page_size <= 0.0) // not yet shown, so fill in the first page
+		last = first + FIRST_PAGE_ROWS;
+
+	if (last >= numEntries)
+		last = numEntries - 1;
+
+	GdkPixmap *pixmap = NULL;
+	GdkBitmap *mask = NULL;
+
+	for (int i = first; i <= last; i++)
+	{
+		if (mThumbnailShown[i])
+			continue;
+
+		mThumbnailShown[i] = true;
+
+		mResults->loadThumbnail(i);
+		Result *r = mResults->getResultNum(i);
+
+		if (NULL == r->mThumbnailPixmap)
+			continue; // keeps the placeholder
+
+		create_gdk_pixmap_from_data(mMRCList, &pixmap, &mask, r->mThumbnailPixmap);
+
+		if (NULL != pixmap)
+		{
+			gtk_clist_set_pixmap(GTK_CLIST(mMRCList), i, 0, pixmap, mask);
+			gdk_pixmap_unref(pixmap);
+		}
+
+		if (NULL != mask)
+			gdk_bitmap_unref(mask);
+
+		pixmap = NULL;
+		mask = NULL;
+	}
 }
 
 //*******************************************************************
@@ -736,6 +803,14 @@ GtkWidget* MatchResultsWindow::createMatchResultsWindow()
 	MatchResultsWindow::createMRCList();
     gtk_container_add(GTK_CONTAINER(mScrolledWindow), mMRCList);
 
+	//***2.3 - thumbnails are loaded as rows scroll into view, and when the
+	// size of the list (so the number of rows seen) changes
+	GtkAdjustment *listAdj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(mScrolledWindow));
+	gtk_signal_connect(GTK_OBJECT(listAdj), "value_changed",
+			GTK_SIGNAL_FUNC(on_mMRCList_scrolled), (void*)this);
+	gtk_signal_connect(GTK_OBJECT(listAdj), "changed",
+			GTK_SIGNAL_FUNC(on_mMRCList_scrolled), (void*)this);
+
 	// attach scrolling list of results (lower-left of table)
 
     gtk_table_attach(GTK_TABLE(table), mScrolledWindow, 0, 1, 1, 2,
@@ -1254,6 +1329,7 @@ void MatchResultsWindow::createMRIconTable()
 				++r;
 		}
 
+		mResults->loadThumbnail(i); //***2.3
 		Result *res = mResults->getResultNum(i);
 		GtkWidget *rb = createFinRadioButton(res->getIdCode(), res->mThumbnailPixmap, i, buttonGroup);
 		buttonGroup = gtk_radio_button_group(GTK_RADIO_BUTTON(rb));
@@ -1448,6 +1524,10 @@ gboolean on_mDrawingAreaOutlines_expose_event(
 	FloatContour *c = resWin->mUnknownContour; //***005CM
 	FloatContour *fc = resWin->mRegContour;
 
+	//***2.3 - contours could not be loaded (see MatchResults::loadContours())
+	if ((NULL == c) || (NULL == fc))
+		return FALSE;
+
 	float
 		xMax = (fc->maxX() > (float)c->maxX()) ? fc->maxX() : (float)c->maxX(),
 		yMax = (fc->maxY() > (float)c->maxY()) ? fc->maxY() : (float)c->maxY(),
@@ -1869,6 +1949,8 @@ void on_mMRCList_select_row(
 	resWin->selectFromCList(resWin->mCurEntry);
 
   //***005CM - get the saved contours from Match results.
+	//***2.3 - which are now only loaded when the result is selected
+	resWin->mResults->loadContours(row);
 	resWin->mRegContour = r->dbContour;
 	resWin->mUnknownContour = r->unknownContour;
 
@@ -1924,6 +2006,24 @@ void on_mMRCList_click_column(
 	}
 }
 
+//*******************************************************************
+//
+// void on_mMRCList_scrolled(GtkAdjustment *adjustment, gpointer userData)
+//
+//    ***2.3 - The list was scrolled or resized.
+//
+void on_mMRCList_scrolled(
+	GtkAdjustment *adjustment,
+	gpointer userData)
+{
+	MatchResultsWindow *resWin = (MatchResultsWindow *) userData;
+
+	if (NULL == resWin)
+		return;
+
+	resWin->showVisibleThumbnails();
+}
+
 //*******************************************************************
 //
 //
@@ -2031,6 +2131,10 @@ gboolean on_eventBoxOutlines_button_press_event(
 
 	if (NULL == resWin->mSelectedFin)
 		return FALSE;
+
+	//***2.3 - contours could not be loaded (see MatchResults::loadContours())
+	if ((NULL == resWin->mUnknownContour) || (NULL == resWin->mRegContour))
+		return FALSE;
 	
 	int uBegin,uTip,uEnd,dbBegin,dbTip,dbEnd;
 	resWin->mResults->getResultNum(resWin->mCurEntry)->getMappingControlPoints(
@@ -2332,6 +2436,7 @@ void on_finRadioButton_toggled(
 
   //***005CM with the next 3 lines
   // Now, get the saved contours from Match results.
+	resWin->mResults->loadContours(i); //***2.3
 	resWin->mRegContour = r->dbContour;
 	resWin->mUnknownContour = r->unknownContour;
 
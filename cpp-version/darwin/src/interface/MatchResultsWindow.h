@@ -101,6 +101,10 @@ class MatchResultsWindow
 						GdkEvent *event,
 						gpointer userData);
 
+		friend void on_mMRCList_scrolled( //***2.3 - new
+						GtkAdjustment *adjustment,
+						gpointer userData);
+
 		friend void on_mMRButtonPrev_clicked(
 						GtkButton *button,
 						gpointer userData);
@@ -244,6 +248,8 @@ class MatchResultsWindow
 		int mTimerID; //***1.85 - id of active timer function
 
 		std::vector<GtkWidget*> mRadioButtonVector;
+
+		std::vector<bool> mThumbnailShown; //***2.3 - by row of mMRCList
 	
 		MatchResults *mResults;
 		int mCurEntry;
@@ -280,6 +286,7 @@ class MatchResultsWindow
 		void selectFromReorderedCList(std::string filename); //***1.75CL
 
 		void updateList();
+		void showVisibleThumbnails(); //***2.3
 
 		void refreshSelectedFin();
 		void refreshUnknownFin();
@@ -14,6 +14,7 @@
 #include <gdk/gdkkeysyms.h>
 #include "../support.h"
 #include "MatchingDialog.h"
+#include "../MatchProfile.h" //***2.3
 #include "MatchResultsWindow.h"
 //#include "ErrorDialog.h"
 //#include "../CatalogCategories.h"
@@ -66,9 +67,20 @@ void on_mButtonShowHide_toggled(
 		GtkButton *button,
 		gpointer userData);
 
+void on_mButtonParallel_toggled( //***2.3
+		GtkButton *button,
+		gpointer userData);
+
+void on_mButtonTopK_toggled( //***2.3
+		GtkButton *button,
+		gpointer userData);
+
 gboolean matchingIdleFunction(
 		gpointer userData);
 
+gboolean matchingRedrawTimer( //***2.3
+		gpointer userData);
+
 void on_radioOriginal_clicked(
 		GtkObject *object,
 		gpointer userData);
@@ -182,7 +194,10 @@ MatchingDialog::MatchingDialog(
 	  mGC2(NULL),
 	  mShowingOutlines(false),
 	  mUseFullFinError(true), //***055ER, ***1.5 - new default value
-	  mCategoriesSelected(0) //***051
+	  mUseParallelMatch(numberOfProcessors() > 1), //***2.3
+	  mCategoriesSelected(0), //***051
+	  mOutlinesPending(false), //***2.3
+	  mRedrawTimerID(0) //***2.3
 {
 	if (NULL == dbFin || NULL == db)
 		throw EmptyArgumentError("MatchingDialog ctor.");
@@ -209,6 +224,10 @@ MatchingDialog::MatchingDialog(
 MatchingDialog::~MatchingDialog()
 {
 	gNumReferences--;
+
+	if (0 != mRedrawTimerID)
+		gtk_timeout_remove(mRedrawTimerID); //***2.3 - stop the timer FIRST
+
 	gtk_widget_destroy(mDialog);
 	delete mFin;
 	delete mMatch;
@@ -315,6 +334,14 @@ void MatchingDialog::show(bool returning)
 	// The idle function is stopped (removed) each time a MatchResultsWindow is
 	// created.
 	gtk_idle_add(matchingIdleFunction, (void *) this);
+
+	//***2.3 - the outlines are drawn from this timer, for as long as the
+	// dialog exists
+	if (0 == mRedrawTimerID)
+		mRedrawTimerID = gtk_timeout_add(
+				1000 / MATCHING_DIALOG_FRAMES_PER_SECOND,
+				matchingRedrawTimer,
+				(void *) this);
 }
 
 
@@ -324,11 +351,39 @@ void MatchingDialog::show(bool returning)
 //
 //    Display the two contours (outlines) during registratin process
 //
+//    ***2.3 - Only copies them into the mailbox, replacing any outlines
+//    not drawn yet.  The registration calls this several times for each
+//    optimizer step, far more often than they could be drawn.
+//
 void MatchingDialog::showOutlines(FloatContour *unk, FloatContour *db)
 {
+	PROFILE_PHASE(PHASE_DISPLAY); //***2.3
+
 	if ((NULL == unk) || (NULL == db))
 		return;
 
+	mShownUnknown = *unk;
+	mShownDB = *db;
+	mShownLines.clear();
+	mOutlinesPending = true;
+}
+
+//*******************************************************************
+//
+// void MatchingDialog::drawOutlines()
+//
+//    ***2.3 - Draws the outlines last published by showOutlines(), with
+//    any point to point lines, called only from the GTK main loop.
+//
+void MatchingDialog::drawOutlines()
+{
+	FloatContour
+		*unk = &mShownUnknown,
+		*db = &mShownDB;
+
+	if ((0 == unk->length()) || (0 == db->length()))
+		return;
+
 	// Redraw the background
 	gdk_draw_rectangle(
 		mDrawingAreaOutlines->window,
@@ -404,24 +459,19 @@ void MatchingDialog::showOutlines(FloatContour *unk, FloatContour *db)
 			POINT_SIZE);
 	}
 
-#ifdef CREATE_POINT_2_POINT_LINES
-	g_usleep(100000); // 0.1 second delay
-#endif
-/*
-	// Redraw the background
-	gdk_draw_rectangle(
-		mDrawingAreaOutlines->window,
-		mDrawingAreaOutlines->style->bg_gc[GTK_STATE_NORMAL],
-		TRUE,
-		0,
-		0,
-		FIN_IMAGE_WIDTH,
-		FIN_IMAGE_HEIGHT);
-*/
-#ifndef CREATE_POINT_2_POINT_LINES
-	g_usleep(100000); // 0.1 second delay
-#endif
+	// draw lines from point to point in RED
 
+	for (i = 0; i + 3 < mShownLines.size(); i += 4)
+		gdk_draw_line(
+				mDrawingAreaOutlines->window,
+				mGC1,
+				(int) round((mShownLines[i] - xMin) * ratio + xOffset),
+				(int) round((mShownLines[i+1] - yMin) * ratio + yOffset),
+				(int) round((mShownLines[i+2] - xMin) * ratio + xOffset),
+				(int) round((mShownLines[i+3] - yMin) * ratio + yOffset));
+
+	//***2.3 - the 0.1 second delays that paced the display are gone, the
+	// frame rate of matchingRedrawTimer() paces it now
 }
 
 //*******************************************************************
@@ -431,6 +481,9 @@ void MatchingDialog::showOutlines(FloatContour *unk, FloatContour *db)
 //    Display line segment between corresponding points on two contours 
 //    during error calculation
 //
+//    ***2.3 - The line is kept with the outlines last published and drawn
+//    with them by drawOutlines().
+//
 void MatchingDialog::showErrorPt2Pt(FloatContour *unk, FloatContour *db,
 									float x1, float y1, float x2, float y2)
 {
@@ -442,60 +495,11 @@ void MatchingDialog::showErrorPt2Pt(FloatContour *unk, FloatContour *db,
 	if ((NULL == unk) || (NULL == db))
 		return;
 
-	// Redraw the background
-/*	gdk_draw_rectangle(
-		mDrawingAreaOutlines->window,
-		mDrawingAreaOutlines->style->bg_gc[GTK_STATE_NORMAL],
-		TRUE,
-		0,
-		0,
-		FIN_IMAGE_WIDTH,
-		FIN_IMAGE_HEIGHT);
-*/
-	float
-		xMax = (db->maxX() > (float)unk->maxX()) ? db->maxX() : (float)unk->maxX(),
-		yMax = (db->maxY() > (float)unk->maxY()) ? db->maxY() : (float)unk->maxY(),
-		xMin = (db->minX() < (float)unk->minX()) ? db->minX() : (float)unk->minX(),
-		yMin = (db->minY() < (float)unk->minY()) ? db->minY() : (float)unk->minY();
-
-	float
-		xRange = xMax - xMin,
-		yRange = yMax - yMin;
-
-	float
-		heightRatio = FIN_IMAGE_HEIGHT / yRange,
-		widthRatio = FIN_IMAGE_WIDTH / xRange;
-
-	float ratio;
-
-	int xOffset = 0, yOffset = 0;
-
-	if (heightRatio < widthRatio) {
-		ratio = heightRatio;
-		xOffset = (int) round((FIN_IMAGE_WIDTH - ratio * xRange) / 2);
-	} else {
-		ratio = widthRatio;
-		yOffset = (int) round((FIN_IMAGE_HEIGHT - ratio * yRange) / 2);
-	}
-
-	unsigned i; // declared here for MSVC++ compatibility
-
-	// draw line from point to point in RED
-
-	int xCoord1 = (int) round((x1 - xMin) * ratio + xOffset);
-	int yCoord1 = (int) round((y1 - yMin) * ratio + yOffset);
-	int xCoord2 = (int) round((x2 - xMin) * ratio + xOffset);
-	int yCoord2 = (int) round((y2 - yMin) * ratio + yOffset);
-
-	gdk_draw_line(
-			mDrawingAreaOutlines->window,
-			mGC1,
-			xCoord1,
-			yCoord1,
-			xCoord2,
-			yCoord2);
-
-	//g_usleep(10000); // 0.01 second delay
+	mShownLines.push_back(x1);
+	mShownLines.push_back(y1);
+	mShownLines.push_back(x2);
+	mShownLines.push_back(y2);
+	mOutlinesPending = true;
 
 #endif
 }
@@ -892,6 +896,30 @@ GtkWidget* MatchingDialog::createMatchingDialog()
 		       GTK_SIGNAL_FUNC
 		       (on_mButtonShowHide_toggled), (void*)this);
 
+	//***2.3 - checkbox to match on all processors at once
+
+	mButtonParallel = gtk_check_button_new_with_label(_("Use All Processors"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(mButtonParallel), mUseParallelMatch);
+	gtk_widget_show(mButtonParallel);
+	gtk_box_pack_start(GTK_BOX (matchingVBox), mButtonParallel, FALSE, FALSE, 6);
+
+	gtk_signal_connect(GTK_OBJECT(mButtonParallel), "toggled",
+		       GTK_SIGNAL_FUNC
+		       (on_mButtonParallel_toggled), (void*)this);
+
+	//***2.3 - checkbox to stop optimizing fins that cannot make the top K
+
+	char topKLabel[64];
+	sprintf(topKLabel, _("Fully Optimize Top %d Matches Only"), mOptions->mMatchTopK);
+	mButtonTopK = gtk_check_button_new_with_label(topKLabel);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(mButtonTopK), mOptions->mUseMatchTopK);
+	gtk_widget_show(mButtonTopK);
+	gtk_box_pack_start(GTK_BOX (matchingVBox), mButtonTopK, FALSE, FALSE, 6);
+
+	gtk_signal_connect(GTK_OBJECT(mButtonTopK), "toggled",
+		       GTK_SIGNAL_FUNC
+		       (on_mButtonTopK_toggled), (void*)this);
+
 	// Place label "Progress:" above the sliding progress bar
 
 	matchingLabel = gtk_label_new (_("Progress:"));
@@ -1351,6 +1379,30 @@ GtkWidget* MatchingDialog::createMatchingDialog()
 		       GTK_SIGNAL_FUNC
 		       (on_mButtonShowHide_toggled), (void*)this);
 
+	//***2.3 - checkbox to match on all processors at once
+
+	mButtonParallel = gtk_check_button_new_with_label(_("Use All Processors"));
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(mButtonParallel), mUseParallelMatch);
+	gtk_widget_show(mButtonParallel);
+	gtk_box_pack_start(GTK_BOX (matchingVBox), mButtonParallel, FALSE, FALSE, 6);
+
+	gtk_signal_connect(GTK_OBJECT(mButtonParallel), "toggled",
+		       GTK_SIGNAL_FUNC
+		       (on_mButtonParallel_toggled), (void*)this);
+
+	//***2.3 - checkbox to stop optimizing fins that cannot make the top K
+
+	char topKLabel[64];
+	sprintf(topKLabel, _("Fully Optimize Top %d Matches Only"), mOptions->mMatchTopK);
+	mButtonTopK = gtk_check_button_new_with_label(topKLabel);
+	gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(mButtonTopK), mOptions->mUseMatchTopK);
+	gtk_widget_show(mButtonTopK);
+	gtk_box_pack_start(GTK_BOX (matchingVBox), mButtonTopK, FALSE, FALSE, 6);
+
+	gtk_signal_connect(GTK_OBJECT(mButtonTopK), "toggled",
+		       GTK_SIGNAL_FUNC
+		       (on_mButtonTopK_toggled), (void*)this);
+
 	// Place label "Progress:" above the sliding progress bar
 
 	matchingLabel = gtk_label_new (_("Progress:"));
@@ -1471,7 +1523,9 @@ gboolean on_mMatchDialogDrawingAreaOutlines_expose_event(
 	if (NULL == matchWin)
 		return FALSE;
 
-	// not sure what to do here
+	//***2.3 - redraw the outlines last shown
+	if (matchWin->mShowingOutlines && (NULL != matchWin->mGC1))
+		matchWin->drawOutlines();
 
 	return TRUE;
 }
@@ -1577,6 +1631,54 @@ void on_mButtonShowHide_toggled(
    		dlg->mMatch->setDisplay(dlg);
    else
 	   dlg->mMatch->setDisplay(NULL);
+
+   dlg->mOutlinesPending = false; //***2.3 - nothing left to draw
+}
+
+
+//*******************************************************************
+//
+// void on_mButtonParallel_toggled(...)
+//
+//    ***2.3 - switches between matching one fin per idle call and a
+//    block of fins per call on all processors.  Results are the same.
+//
+void on_mButtonParallel_toggled(
+	GtkButton *button,
+	gpointer userData)
+{
+	MatchingDialog *dlg = (MatchingDialog *) userData;
+
+	if (NULL == dlg)
+		return;
+
+	dlg->mUseParallelMatch = !(dlg->mUseParallelMatch);
+}
+
+
+//*******************************************************************
+//
+// void on_mButtonTopK_toggled(...)
+//
+//    ***2.3 - turns top-K matching on or off.  Fins that can no longer
+//    make the top K are not fully optimized and are listed unranked.
+//    The setting is kept in the Options and saved with them.
+//
+void on_mButtonTopK_toggled(
+	GtkButton *button,
+	gpointer userData)
+{
+	MatchingDialog *dlg = (MatchingDialog *) userData;
+
+	if (NULL == dlg)
+		return;
+
+	dlg->mOptions->mUseMatchTopK = !(dlg->mOptions->mUseMatchTopK);
+
+	if (dlg->mOptions->mUseMatchTopK)
+		dlg->mMatch->setTopK(dlg->mOptions->mMatchTopK);
+	else
+		dlg->mMatch->setTopK(0);
 }
 
 
@@ -1684,6 +1786,32 @@ void on_matchingButtonCancel_clicked(
 	dlg->mMatchCancelled = true;
 }
 
+//*******************************************************************
+//
+// gboolean matchingRedrawTimer(...)
+//
+//    ***2.3 - Timer CALLBACK, MATCHING_DIALOG_FRAMES_PER_SECOND times a
+//    second.  Draws the outlines published since the last call, if any.
+//    As the matching runs in the idle function, this draws between
+//    fins (or blocks of fins), whatever their number.
+//
+gboolean matchingRedrawTimer(
+	gpointer userData)
+{
+	MatchingDialog *dlg = (MatchingDialog *)userData;
+
+	if (NULL == dlg)
+		return FALSE; // terminate me
+
+	if (dlg->mOutlinesPending && dlg->mShowingOutlines && (NULL != dlg->mGC1))
+	{
+		dlg->drawOutlines();
+		dlg->mOutlinesPending = false;
+	}
+
+	return TRUE;
+}
+
 //*******************************************************************
 //
 // gboolean matchingIdleFunction(...)
@@ -1716,7 +1844,18 @@ gboolean matchingIdleFunction(
 	// for now treat STOP the same as PAUSE
 
 	try {
-		float percentComplete = dlg->mMatch->matchSingleFin(
+		float percentComplete;
+
+		//***2.3 - a block of fins per call on all processors, or one fin per call
+		if (dlg->mUseParallelMatch)
+			percentComplete = dlg->mMatch->matchFinBlock(
+			                          dlg->mRegistrationMethod,
+			                          dlg->mRegSegmentsUsed,
+									  dlg->mCategoryToMatch,
+									  dlg->mUseFullFinError,
+									  true);
+		else
+			percentComplete = dlg->mMatch->matchSingleFin(
 			                          dlg->mRegistrationMethod,
 			                          dlg->mRegSegmentsUsed,
 									  dlg->mCategoryToMatch,
@@ -1744,6 +1883,13 @@ gboolean matchingIdleFunction(
 		//***1.5 - sort the results here, ONCE, rather than as list is built
 		dlg->mMatch->getMatchResults()->sort();
 
+		//***2.3 - report on top-K matching
+		if (dlg->mMatch->getNumAbandoned() > 0)
+			cout << dlg->mMatch->getNumAbandoned() << " of "
+			     << dlg->mMatch->getMatchResults()->size()
+			     << " catalog fins abandoned early (top "
+			     << dlg->mMatch->getTopK() << " matching)" << endl;
+
 		gtk_widget_hide(dlg->mDialog); // ***2.2 - to hide this behind match results window
 
 		// matching is done and some match, so display results
@@ -20,12 +20,16 @@
 
 #include "../Database.h"
 #include "../DatabaseFin.h"
+#include "../FloatContour.h"
 #include "../matching/Match.h"
 #include "../Options.h"
 #include "MainWindow.h"
 							     //***004CL ^
 int getNumMatchingDialogReferences();
 
+//***2.3 - the registration display is redrawn at most this often
+#define MATCHING_DIALOG_FRAMES_PER_SECOND  15
+
 class MatchingDialog
 {
 	public:
@@ -51,6 +55,10 @@ class MatchingDialog
 		//  Restores state when returning from MatchResultsWindow.
 		void show(bool returning);
 
+		//***2.3 - these only publish the outlines (and point to point
+		// lines) to be drawn, replacing any not yet drawn.  They are
+		// drawn by matchingRedrawTimer(), so the display no longer
+		// slows matching down.
 		void showOutlines(FloatContour *unk, FloatContour *db);
 		void showErrorPt2Pt(FloatContour *unk, FloatContour *db,
 				float x1, float y1, float x2, float y2);
@@ -95,9 +103,20 @@ class MatchingDialog
 				GtkButton *button,
 				gpointer userData);
 
+		friend	void on_mButtonParallel_toggled( //***2.3
+				GtkButton *button,
+				gpointer userData);
+
+		friend	void on_mButtonTopK_toggled( //***2.3
+				GtkButton *button,
+				gpointer userData);
+
 		friend gboolean matchingIdleFunction(
 				gpointer userData);
 
+		friend gboolean matchingRedrawTimer( //***2.3
+				gpointer userData);
+
 		friend void on_radioOriginal_clicked(
 				GtkObject *object,
 				gpointer userData);
@@ -156,6 +175,8 @@ class MatchingDialog
 			*mDialog,
 			*mProgressBar,
 			*mButtonShowHide,
+			*mButtonParallel, //***2.3
+			*mButtonTopK, //***2.3
 			*mButtonStartStop,
 			*mButtonPauseContinue,
 			*mDrawingAreaOutlines,
@@ -176,6 +197,7 @@ class MatchingDialog
 			mCategoryToMatch[32]; //***051CC max categories 32
 
 		bool 
+			mUseParallelMatch, //***2.3 - match blocks of fins on all processors
 			mShowingOutlines,
 			mMatchCancelled, // indicates matching has been aborted
 			mMatchRunning,   // match started and not stopped or finished
@@ -185,6 +207,21 @@ class MatchingDialog
 			mRegistrationMethod, // indicates current matching method
 			mRegSegmentsUsed;    // indicates
 
+		//***2.3 - single slot mailbox between the matcher and the display,
+		// holding the latest outlines published by showOutlines()
+
+		FloatContour
+			mShownUnknown,
+			mShownDB;
+
+		std::vector<float> mShownLines; // x1,y1,x2,y2 from showErrorPt2Pt()
+
+		bool mOutlinesPending; // published and not yet drawn
+
+		guint mRedrawTimerID; // 0 when the timer is not running
+
+		void drawOutlines();
+
 		GtkWidget* createMatchingDialog();
 
 		void updateGC();
@@ -307,7 +307,8 @@ gboolean matchingQueueIdleFunction(
 		// will reach 1.0 first and terminate returns to this idle function,
 		// but test just in case
 
-		float percentDatabaseProcessed = matcher->matchSingleFin(
+		//***2.3 - a block of database fins at a time, on all processors
+		float percentDatabaseProcessed = matcher->matchFinBlock(
 				TRIM_OPTIMAL_TIP,
 				ALL_POINTS,
 				categoriesToMatch,
@@ -331,6 +331,42 @@ void readConfig(string homedir)
 	if (!gCfg->getItem("HideFinIDsinAllWindows",gOptions->mHideIDs)) //***1.65
 		gOptions->mHideIDs = false; // ShowIDs by default, this is the normal use setting
 
+	//***2.3 - top-K early abandon mode for matching, off by default
+
+	if (!gCfg->getItem("UseMatchTopK",gOptions->mUseMatchTopK))
+		gOptions->mUseMatchTopK = false;
+
+	if (!gCfg->getItem("MatchTopK",gOptions->mMatchTopK) || (gOptions->mMatchTopK < 1))
+		gOptions->mMatchTopK = 20;
+
+	//***2.3 - shape descriptor prefilter for matching, off by default
+
+	if (!gCfg->getItem("UseMatchPrefilter",gOptions->mUseMatchPrefilter))
+		gOptions->mUseMatchPrefilter = false;
+
+	if (!gCfg->getItem("MatchShortlistFraction",gOptions->mMatchShortlistFraction) 
+	    || (gOptions->mMatchShortlistFraction <= 0.0f) || (gOptions->mMatchShortlistFraction > 1.0f))
+		gOptions->mMatchShortlistFraction = 0.25f;
+
+	//***2.3 - persistent match cache, on by default
+
+	if (!gCfg->getItem("UseMatchCache",gOptions->mUseMatchCache))
+		gOptions->mUseMatchCache = true;
+
+	//***2.3 - coarse-to-fine registration, off by default
+
+	if (!gCfg->getItem("UseCoarseToFine",gOptions->mUseCoarseToFine))
+		gOptions->mUseCoarseToFine = false;
+
+	//***2.3 - outline index for matching, off by default
+
+	if (!gCfg->getItem("UseOutlineIndex",gOptions->mUseOutlineIndex))
+		gOptions->mUseOutlineIndex = false;
+
+	if (!gCfg->getItem("OutlineIndexCandidates",gOptions->mOutlineIndexCandidates)
+	    || (gOptions->mOutlineIndexCandidates < 1))
+		gOptions->mOutlineIndexCandidates = 200;
+
 	//***1.85 - add support for multiple survey areas and databases
 	if (!gCfg->getItem("NumberOfExistingSurveyAreas",gOptions->mNumberOfExistingSurveyAreas))
 	{
@@ -504,6 +540,29 @@ void saveConfig()
 
 	gCfg->addItem("HideFinIDsinAllWindows",gOptions->mHideIDs); //***1.65
 
+	//***2.3 - top-K early abandon mode for matching
+
+	gCfg->addItem("UseMatchTopK",gOptions->mUseMatchTopK);
+	gCfg->addItem("MatchTopK",gOptions->mMatchTopK);
+
+	//***2.3 - shape descriptor prefilter for matching
+
+	gCfg->addItem("UseMatchPrefilter",gOptions->mUseMatchPrefilter);
+	gCfg->addItem("MatchShortlistFraction",gOptions->mMatchShortlistFraction);
+
+	//***2.3 - persistent match cache
+
+	gCfg->addItem("UseMatchCache",gOptions->mUseMatchCache);
+
+	//***2.3 - coarse-to-fine registration
+
+	gCfg->addItem("UseCoarseToFine",gOptions->mUseCoarseToFine);
+
+	//***2.3 - outline index for matching
+
+	gCfg->addItem("UseOutlineIndex",gOptions->mUseOutlineIndex);
+	gCfg->addItem("OutlineIndexCandidates",gOptions->mOutlineIndexCandidates);
+
 	//***1.85 - save selected FONT used in various lists
 
 	gCfg->addItem("SelectedFontForLists", gOptions->mCurrentFontName); //***1.85
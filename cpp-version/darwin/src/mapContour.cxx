@@ -5,168 +5,284 @@
 //
 //   mods: J H Stewman (1/21/2008)
 //         -- reformatting of code and addition of comment blocks
+//         (2.3)
+//         -- closed form affine solve, and mapping into a caller's buffer
 // 
 //
 //*******************************************************************
 
 #include "mapContour.h"
+#include "MatchProfile.h" //***2.3
 #include "feature.h"
-#include "math/gaussj.h"
 #include "utility.h"
 
+//***2.3 - SSE is used to map by several transforms at once where the
+// compiler provides it, anything else uses the scalar code
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define MAP_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+// transforms mapped in one pass by mapContours(), more take several passes
+#define MAP_CONTOURS_MAX_TRANSFORMS  8
+
 using namespace std;
 
 //*******************************************************************
 //
+// bool affineMapCoefficients(...)
 //
-FloatContour* mapContour(
-		//Contour *c, removed 008OL
-		FloatContour *c, //***008OL
+//    ***2.3 - Finds the affine transform taking p1, p2, p3 to desP1,
+//    desP2, desP3.  We are solving two systems of linear equations:
+// 
+//    x'0 = a11 * x0 + a12 * y0 + a13
+//    x'1 = a11 * x1 + a12 * y1 + a13
+//    x'2 = a11 * x2 + a12 * y2 + a13
+//
+//    and
+//
+//    y'0 = a21 * x0 + a22 * y0 + a23
+//    y'1 = a21 * x1 + a22 * y1 + a23
+//    y'2 = a21 * x2 + a22 * y2 + a23
+//
+//    Both share the same 3x3 matrix, so they are solved directly by
+//    Cramer's rule rather than twice with gaussj() on heap matrices.
+//
+//    Returns false (and the identity transform) if the three points
+//    are collinear.
+//
+bool affineMapCoefficients(
 		point_t p1,
 		point_t p2,
 		point_t p3,
 		point_t desP1,
 		point_t desP2,
-		point_t desP3
-)
+		point_t desP3,
+		float transformCoeff[2][3])
 {
-	// Well, we're basically trying to solve two systems of linear
-	// equations here.  They are:
-	// 
-	// x'0 = a11 * x0 + a12 * y0 + a13
-	// x'1 = a11 * x1 + a12 * y1 + a13
-	// x'2 = a11 * x2 + a12 * y2 + a13
-	//
-	// and
-	//
-	// y'0 = a21 * x0 + a22 * y0 + a23
-	// y'1 = a21 * x1 + a22 * y1 + a23
-	// y'2 = a21 * x2 + a22 * y2 + a23
-	//
-	// So, we're going to put our known quantities in an augmented
-	// matrix form, and solve for the a(rc)'s that will transform
-	// the initial four points to the desired four points.
-
-	//FloatContour *dstContour = NULL; removed 008OL
-	float **a = NULL, **b = NULL;
-	int i;
-
-	try {
-		a = new float*[3];
-		b = new float*[3];
-	
-		for (i = 0; i < 3; i++) {
-			a[i] = new float[3];
-			a[i][2] = 1.0f;
-			b[i] = new float[4];
-		}
+	double
+		x1 = p1.x, y1 = p1.y,
+		x2 = p2.x, y2 = p2.y,
+		x3 = p3.x, y3 = p3.y;
+
+	// cofactors of the matrix | x y 1 |, shared by both solutions
+	double
+		cx1 = y2 - y3,   cx2 = y3 - y1,   cx3 = y1 - y2,
+		cy1 = x3 - x2,   cy2 = x1 - x3,   cy3 = x2 - x1,
+		c1 = x2 * y3 - x3 * y2,
+		c2 = x3 * y1 - x1 * y3,
+		c3 = x1 * y2 - x2 * y1;
+
+	double det = c1 + c2 + c3;
+
+	if (0.0 == det)
+	{
+		transformCoeff[0][0] = 1.0f;  transformCoeff[0][1] = 0.0f;  transformCoeff[0][2] = 0.0f;
+		transformCoeff[1][0] = 0.0f;  transformCoeff[1][1] = 1.0f;  transformCoeff[1][2] = 0.0f;
+		return false;
+	}
 
-		a[0][0] = p1.x;
-		a[0][1] = p1.y;
+	double
+		u1 = desP1.x, u2 = desP2.x, u3 = desP3.x,
+		v1 = desP1.y, v2 = desP2.y, v3 = desP3.y;
 
-		a[1][0] = p2.x;
-		a[1][1] = p2.y;
-	
-		a[2][0] = p3.x;
-		a[2][1] = p3.y;
+	transformCoeff[0][0] = (float)((u1 * cx1 + u2 * cx2 + u3 * cx3) / det);
+	transformCoeff[0][1] = (float)((u1 * cy1 + u2 * cy2 + u3 * cy3) / det);
+	transformCoeff[0][2] = (float)((u1 * c1  + u2 * c2  + u3 * c3)  / det);
 
-		size_t rowSize = 3 * sizeof(float);
-	
-		for (i = 0; i < 3; i++)
-			memcpy(b[i], a[i], rowSize);
+	transformCoeff[1][0] = (float)((v1 * cx1 + v2 * cx2 + v3 * cx3) / det);
+	transformCoeff[1][1] = (float)((v1 * cy1 + v2 * cy2 + v3 * cy3) / det);
+	transformCoeff[1][2] = (float)((v1 * c1  + v2 * c2  + v3 * c3)  / det);
 
-		b[0][3] = (float)desP1.x;
-		b[1][3] = (float)desP2.x;
-		b[2][3] = (float)desP3.x;
-
-		// First, we'll find the transformation coefficients
-		// which will map the contour.
-		gaussj((float **)a, 3, (float **)b, 4);
+	return true;
+}
 
-		float transformCoeff[2][3];
-		for (i = 0; i < 3; i++)
-			transformCoeff[0][i] = b[i][3];
+//*******************************************************************
+//
+// void mapContour(...)
+//
+//    ***2.3 - Maps contour c into dstContour, which the caller owns and
+//    may reuse from call to call.  dstContour keeps its storage, so
+//    mapping into a buffer that is already long enough does no
+//    allocation.  c and dstContour may NOT be the same contour.
+//
+void mapContour(
+		const FloatContour *c,
+		point_t p1,
+		point_t p2,
+		point_t p3,
+		point_t desP1,
+		point_t desP2,
+		point_t desP3,
+		FloatContour *dstContour)
+{
+	float transformCoeff[2][3];
 
-		// Ok, now we have one row of coefficients.  We now need to reinitialize
-		// the a and b matrices since the gaussj() solver function has changed
-		// their values
-		for (i = 0; i < 3; i++)
-			a[i][2] = 1.0f;
+	affineMapCoefficients(p1, p2, p3, desP1, desP2, desP3, transformCoeff);
 
-		a[0][0] = p1.x;
-		a[0][1] = p1.y;
+	mapContour(c, transformCoeff, dstContour);
+}
 
-		a[1][0] = p2.x;
-		a[1][1] = p2.y;
-	
-		a[2][0] = p3.x;
-		a[2][1] = p3.y;
+//*******************************************************************
+//
+// void mapContour(const FloatContour *c, const float transformCoeff[2][3],
+//                 FloatContour *dstContour)
+//
+//    ***2.3 - Applies a transform already solved for, as saved with
+//    match results.  Same buffer rules as above.
+//
+void mapContour(
+		const FloatContour *c,
+		const float transformCoeff[2][3],
+		FloatContour *dstContour)
+{
+	PROFILE_PHASE(PHASE_MAP_CONTOUR); //***2.3
+
+	int numPoints = c->length();
+	dstContour->resize(numPoints);
+
+	float cx, cy;
+	for (int i = 0; i < numPoints; i++) {
+		cx = (*c)[i].x;
+		cy = (*c)[i].y;
+
+		point_t &p = (*dstContour)[i];
+		p.x = transformCoeff[0][0] * cx
+			+ transformCoeff[0][1] * cy
+			+ transformCoeff[0][2];
+		p.y = transformCoeff[1][0] * cx
+			+ transformCoeff[1][1] * cy
+			+ transformCoeff[1][2];
+	}
+}
 
-		for (i = 0; i < 3; i++)
-			memcpy(b[i], a[i], rowSize);
+//*******************************************************************
+//
+// void mapContours(const FloatContour *c, int numTransforms,
+//                  const float transformCoeff[][2][3],
+//                  FloatContour *dstContours[])
+//
+//    ***2.3 - Maps c by several transforms at once, for the trial moves
+//    that the optimal registration methods test on each step.  Each
+//    point of c is read once, and with SSE it is mapped by four
+//    transforms at a time, one in each lane.  The products and sums are
+//    made in the same order as mapContour() makes them, so the mapped
+//    points are identical.  Same buffer rules as mapContour().
+//
+void mapContours(
+		const FloatContour *c,
+		int numTransforms,
+		const float transformCoeff[][2][3],
+		FloatContour *dstContours[])
+{
+	if (numTransforms > MAP_CONTOURS_MAX_TRANSFORMS)
+	{
+		mapContours(c, MAP_CONTOURS_MAX_TRANSFORMS, transformCoeff, dstContours);
+		mapContours(c, numTransforms - MAP_CONTOURS_MAX_TRANSFORMS,
+		            transformCoeff + MAP_CONTOURS_MAX_TRANSFORMS,
+		            dstContours + MAP_CONTOURS_MAX_TRANSFORMS);
+		return;
+	}
 
-		// and, obviously, this time, we're going to solve for the second row of
-		// coefficients, so we'll put the desired y values in the augmented
-		// section
-		b[0][3] = (float)desP1.y;
-		b[1][3] = (float)desP2.y;
-		b[2][3] = (float)desP3.y;
+	PROFILE_PHASE(PHASE_MAP_CONTOUR);
 
-		gaussj((float **)a, 3, (float **)b, 4);
+	int numPoints = c->length();
+	int t;
 
-		// Save the transform coefficients
-		for (i = 0; i < 3; i++)
-			transformCoeff[1][i] = b[i][3];
+	point_t *dst[MAP_CONTOURS_MAX_TRANSFORMS];
+	for (t = 0; t < numTransforms; t++)
+	{
+		dstContours[t]->resize(numPoints);
+		if (numPoints > 0)
+			dst[t] = &(*dstContours[t])[0];
+	}
 
-		// Now that we have all the required coefficients, we'll transform
-		// the points in the original Contour, and store them in a new one
-	
-		for (i = 0; i < 3; i++) {
-			delete[] a[i];
-			a[i] = NULL;
-			delete[] b[i];
-			b[i] = NULL;
+	if ((numPoints <= 0) || (numTransforms <= 0))
+		return;
+
+	const point_t *src = &(*c)[0];
+
+#ifdef MAP_USE_SSE
+	// the coefficients by transform, in groups of four (one per lane)
+	// padded with zeros
+	float coeff[2][3][MAP_CONTOURS_MAX_TRANSFORMS];
+	for (t = 0; t < MAP_CONTOURS_MAX_TRANSFORMS; t++)
+		for (int row = 0; row < 2; row++)
+			for (int col = 0; col < 3; col++)
+				coeff[row][col][t] = (t < numTransforms) ? transformCoeff[t][row][col] : 0.0f;
+
+	int numGroups = (numTransforms + 3) / 4;
+
+	for (int i = 0; i < numPoints; i++)
+	{
+		__m128 
+			cx = _mm_set1_ps(src[i].x),
+			cy = _mm_set1_ps(src[i].y);
+
+		for (int g = 0; g < numGroups; g++)
+		{
+			int first = 4 * g;
+			float x[4], y[4];
+
+			_mm_storeu_ps(x, _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_loadu_ps(&coeff[0][0][first]), cx),
+					_mm_mul_ps(_mm_loadu_ps(&coeff[0][1][first]), cy)),
+					_mm_loadu_ps(&coeff[0][2][first])));
+			_mm_storeu_ps(y, _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_loadu_ps(&coeff[1][0][first]), cx),
+					_mm_mul_ps(_mm_loadu_ps(&coeff[1][1][first]), cy)),
+					_mm_loadu_ps(&coeff[1][2][first])));
+
+			for (t = first; (t < first + 4) && (t < numTransforms); t++)
+			{
+				dst[t][i].x = x[t - first];
+				dst[t][i].y = y[t - first];
+			}
 		}
-
-		delete[] a;
-		a = NULL;
-		delete[] b;
-		b = NULL;
-
-		FloatContour *dstContour = new FloatContour(); //***008OL
-		int numPoints = c->length();
-		//int cx, cy; removed 008OL
-		float cx,cy; //***008OL
-		float x, y;
-		for (i = 0; i < numPoints; i++) {
-			cx = (*c)[i].x;
-			cy = (*c)[i].y;
-		
-			x =	transformCoeff[0][0] * cx
-				+ transformCoeff[0][1] * cy
-				+ transformCoeff[0][2];
-			y =	transformCoeff[1][0] * cx
-				+ transformCoeff[1][1] * cy
-				+ transformCoeff[1][2];
-
-			dstContour->addPoint(x, y);
+	}
+#else
+	for (int i = 0; i < numPoints; i++)
+	{
+		float 
+			cx = src[i].x,
+			cy = src[i].y;
+
+		for (t = 0; t < numTransforms; t++)
+		{
+			dst[t][i].x = transformCoeff[t][0][0] * cx
+				+ transformCoeff[t][0][1] * cy
+				+ transformCoeff[t][0][2];
+			dst[t][i].y = transformCoeff[t][1][0] * cx
+				+ transformCoeff[t][1][1] * cy
+				+ transformCoeff[t][1][2];
 		}
+	}
+#endif
+}
 
-		return dstContour;
-
-	} catch (...) {
-		for (i = 0; i < 3; i++) {
-			delete[] a[i];
-			delete[] b[i];
-		}
+//*******************************************************************
+//
+// FloatContour* mapContour(...)
+//
+//    Returns a NEW contour, c mapped so that p1, p2, p3 land on desP1,
+//    desP2, desP3.  Caller must delete it.
+//
+FloatContour* mapContour(
+		//Contour *c, removed 008OL
+		FloatContour *c, //***008OL
+		point_t p1,
+		point_t p2,
+		point_t p3,
+		point_t desP1,
+		point_t desP2,
+		point_t desP3
+)
+{
+	FloatContour *dstContour = new FloatContour(); //***008OL
 
-		delete[] a;
-		delete[] b;
-		
-		//delete dstContour; removed 008OL
+	mapContour(c, p1, p2, p3, desP1, desP2, desP3, dstContour); //***2.3
 
-		throw;
-	}
+	return dstContour;
 }
 
 //***008OL remove this function -- if needed, rewrite using two Outlines
@@ -30,6 +30,46 @@ FloatContour* mapContour(
 		point_t desP3
 );
 
+//***2.3 - closed form solution of the affine transform used by mapContour(),
+// false if p1, p2, p3 are collinear
+bool affineMapCoefficients(
+		point_t p1,
+		point_t p2,
+		point_t p3,
+		point_t desP1,
+		point_t desP2,
+		point_t desP3,
+		float transformCoeff[2][3]);
+
+//***2.3 - same mapping, but written into dstContour (resized to match c)
+// so that the caller can reuse one buffer for many mappings
+void mapContour(
+		const FloatContour *c,
+		point_t p1,
+		point_t p2,
+		point_t p3,
+		point_t desP1,
+		point_t desP2,
+		point_t desP3,
+		FloatContour *dstContour);
+
+//***2.3 - maps c by a transform from affineMapCoefficients() into dstContour
+// (resized to match c)
+void mapContour(
+		const FloatContour *c,
+		const float transformCoeff[2][3],
+		FloatContour *dstContour);
+
+//***2.3 - maps c by each of numTransforms transforms from
+// affineMapCoefficients() into dstContours[] (each resized to match c),
+// all in one pass over the points of c.  Each mapped point is exactly
+// what mapContour() gives for that transform.
+void mapContours(
+		const FloatContour *c,
+		int numTransforms,
+		const float transformCoeff[][2][3],
+		FloatContour *dstContours[]);
+
 //***008OL remove this function for now - if needed use two Outlines
 /*
 FloatContour* autoMapContour(
@@ -10,7 +10,9 @@
 //
 //*******************************************************************
 
+#include <algorithm> //***2.3 - max()
 #include "AreaMatch.h"
+#include "../Error.h" //***2.3
 
 using namespace std;
 
@@ -1210,6 +1212,599 @@ double findAreaBetweenOutlineSegments_Vec(
 */
 }
 
+//*******************************************************************
+//
+// ***2.3 - flat array version
+//
+// The functions below find the same polygons as findSegsAndRefPointsForContour(),
+// intersect() and findAreaBetweenOutlineSegments() above, in the same order
+// and with the same arithmetic, so the areas are identical.  What differs
+// is the bookkeeping ...
+//
+//   the segments, reference points, active segment lists and intersection
+//   points are arrays in an AreaMatchScratch, which keeps its space from
+//   one call to the next
+//
+//   the reference points of each contour are insertion sorted (they are
+//   almost in order as found, as noted for the _Vec version) and the two
+//   contours merged, rather than each being put in a multimap
+//
+//   each pair of database and unknown segments is tested once, in the
+//   group of reference points where the second of them becomes active,
+//   rather than in every group while both are active until an
+//   intersection is found (and kept in a set).  intersect() depends only
+//   on the two segments, so a pair with no intersection in its first
+//   test has none in any later one, and the intersections are found in
+//   the same order.
+//
+//   the polygon areas are summed as the points are visited rather than
+//   from a vector of copied points, and contour points are read without
+//   the bounds check of FloatContour::operator[]
+//
+
+//*******************************************************************
+//
+// static void findSegsAndRefPointsForContour_Flat(const point_t *c1, ...)
+//
+//    As findSegsAndRefPointsForContour(), with c1 the points of the
+//    contour.  The reference points are appended in the order found and
+//    sorted at the end.
+//
+static void findSegsAndRefPointsForContour_Flat (
+		const point_t *c1, // part of some contour (DB or UNK)
+		int begin1,
+		int end1,
+		char conType, // 'd' or 'u'
+		vector<flatSegment_t> &segments,
+		vector<ref_point> &refPts
+		)
+{
+	double 
+		dxL = c1[end1].x - c1[begin1].x, 
+		dyL = c1[end1].y - c1[begin1].y,
+		dxLsq = dxL * dxL,
+		dyLsq = dyL * dyL,
+		denom = dxLsq + dyLsq,
+		xB = c1[begin1].x,
+		yB = c1[begin1].y;
+
+	flatSegment_t seg;
+	ref_point pt;
+
+	seg.contourType = conType; // unknown or database
+	seg.activeFrom = -1;
+
+	// first point
+
+	seg.parameter = 0.0;   // first point on reference line
+	seg.reversed = false;
+	seg.startIndex = begin1;
+	segments.push_back(seg);
+
+	pt.parameter = 0.0;
+	pt.segId = segments.size() - 1;
+	pt.segOp = 0;       // indicate "add" op
+	refPts.push_back(pt);
+
+	int lastAdd = refPts.size() - 1; // where the last segment is "added"
+
+	// all middle points
+	for (int i = begin1+1; i < end1; i++)
+	{
+		double s = ((c1[i].x - xB)*dxL + (c1[i].y - yB)*dyL) / denom;
+
+		// this is the end of previous segment
+		flatSegment_t &prev = segments.back();
+		bool
+			seg_reversed = (s < prev.parameter),
+			seg_perpendicular = (s == prev.parameter);
+		if (seg_reversed)
+		{
+			// the segment is a reversed segment, so correct info in previous segment
+			prev.reversed = true;
+			prev.parameter = s;
+			prev.startIndex = i;
+		}
+
+		pt.parameter = s;
+		pt.segId = segments.size() - 1;
+		if (seg_reversed)
+		{
+			// segment runs in reverse direction so ...
+			refPts[lastAdd].segOp = 1;  // previous endpoint is where segment is "removed" 
+			pt.segOp = 0;               // and this 2nd endpoint is where segment is "added"
+			refPts.push_back(pt);
+		}
+		else if (seg_perpendicular)
+			refPts[lastAdd].segOp = 2;  // indicate immediate processing (seg perp to ref line)
+		else
+		{
+			pt.segOp = 1;       // indicate "remove" op
+			refPts.push_back(pt);
+		}
+
+		// it is also the beginning of a new segment
+		seg.parameter = s;
+		seg.reversed = false;
+		seg.startIndex = i;
+		segments.push_back(seg);
+
+		pt.parameter = s;
+		pt.segId = segments.size() - 1;
+		pt.segOp = 0;       // indicate "add" op
+		refPts.push_back(pt);
+		lastAdd = refPts.size() - 1;
+	}
+
+	// last point (does NOT begin any new segment -- just ends last one)
+
+	pt.parameter = 1.0;
+	pt.segId = segments.size() - 1;
+	if (1.0 < segments.back().parameter)
+	{
+		// segment runs in reverse direction so ...
+		refPts[lastAdd].segOp = 1;  // previous endpoint is where segment is "removed" 
+		pt.segOp = 0;               // and this 2nd endpoint is where segment is "added"
+		refPts.push_back(pt);
+	}
+	else if (1.0 == segments.back().parameter)
+		refPts[lastAdd].segOp = 2;  // indicate immediate processing (seg perp to ref line)
+	else
+	{
+		pt.segOp = 1;       // indicate "remove" op
+		refPts.push_back(pt);
+	}
+
+	// insertion sort by parameter, keeping points with the same parameter
+	// in the order found (as the multimap does)
+	for (int k = 1; k < (int)refPts.size(); k++)
+	{
+		if (refPts[k-1].parameter <= refPts[k].parameter)
+			continue;
+
+		ref_point moving = refPts[k];
+		int m = k;
+		while ((m > 0) && (refPts[m-1].parameter > moving.parameter))
+		{
+			refPts[m] = refPts[m-1];
+			m--;
+		}
+		refPts[m] = moving;
+	}
+}
+
+//*******************************************************************
+//
+// static void intersect_Flat(...)
+//
+//    As intersect(), with c1 and c2 the points of the two contours, and
+//    without recording the intersection in the segment.
+//
+static void intersect_Flat(
+			   const flatSegment_t &dbSeg,
+			   const flatSegment_t &unkSeg,
+			   const point_t *c1, // unknown contour
+			   const point_t *c2, // database contour
+			   double &s1, double &t1, point_t &p1,  // db param, point coords & unk param
+			   double &s2, point_t &p2,       // db param, point coords
+			   int &n)
+{
+	double
+		dx1, dy1,
+		dx2, dy2;
+	int 
+		idA, idB, // indices of A & B
+		idC, idD; // indices of C & D
+
+	idA = dbSeg.startIndex;
+	if (! dbSeg.reversed)
+		idB = idA + 1;
+	else
+		idB = idA - 1;
+
+	idC = unkSeg.startIndex;
+	if (! unkSeg.reversed)
+		idD = idC + 1;
+	else
+		idD = idC - 1;
+
+	const point_t 
+		&A = c2[idA], &B = c2[idB], // begin and end of database segment
+		&C = c1[idC], &D = c1[idD]; // begin and end of unknown segment
+
+	dx1 = B.x - A.x;
+	dy1 = B.y - A.y;
+	dx2 = D.x - C.x;
+	dy2 = D.y - C.y;
+
+	double 
+		beta1, // parameter on database segment
+		beta2; // parameter on unknown segment
+
+	double denom = dx1 * dy2 - dy1 * dx2;
+	if (denom != 0.0) // thre is a unique intersection between the lines
+	{
+		beta1 = ((A.y - C.y) * dx2 - (A.x - C.x) * dy2) / denom; // on database
+
+		// most pairs tested miss on the database segment, so beta2 is
+		// only found once beta1 is known to be on it
+		n = 0; // no intersection within both segments
+		if ((0.0 <= beta1) && (beta1 < 1.0))
+		{
+			if (dx2 != 0.0)
+				beta2 = ((A.x - C.x) + beta1 * dx1) / dx2; // on unknown
+			else
+				beta2 = ((A.y - C.y) + beta1 * dy1) / dy2; // on unknown
+
+			if ((0.0 <= beta2) && (beta2 < 1.0))
+			{
+				// found single point of intersection
+				p1.x = A.x + beta1 * dx1;
+				p1.y = A.y + beta1 * dy1;
+				n = 1;
+				if (! dbSeg.reversed)
+					s1 = idA + beta1;
+				else
+					s1 = idB - beta1;
+				if (! unkSeg.reversed)
+					t1 = idC + beta2;
+				else
+					t1 = idD - beta2;
+			}
+		}
+	}
+	else // might have segment overlap
+	{
+		double det = C.x * (A.y - B.y) - A.x * (C.y - B.y) + B.x * (C.y - A.y);
+		if (det == 0.0) // point C is on line containing A * B
+		{
+			// find out range of parameter overlap on database segment
+			if (dx1 != 0.0)
+			{
+				beta1 = (C.x - A.x) / dx1;
+				beta2 = (D.x - A.x) / dx1;
+			}
+			else if (dy1 != 0.0)
+			{
+				beta1 = (C.y - A.y) / dy1;
+				beta2 = (D.y - A.y) / dy1;
+			}
+			else
+			{
+				cout << "ERROR in match calc: zero length segment in contour\n";
+				n = 0;
+				return;
+			}
+
+			if (((beta1 > 1.0) && (beta2 > 1.0)) || ((beta1 < 0.0) && (beta2 < 0.0)))
+			{
+				// no segment overlap
+				n = 0;
+				return;
+			}
+
+			// entire database segment may be within unknown segment
+			// if so, then pull in the boundaries
+			if (beta1 > 1.0)
+				beta1 = 1.0;
+			else if (beta1 < 0.0)
+				beta1 = 0.0;
+
+			if (beta2 > 1.0)
+				beta2 = 1.0;
+			else if (beta2 < 0.0)
+				beta2 = 0.0;
+
+			p1.x = A.x + beta1 * dx1;
+			p1.y = A.y + beta1 * dy1;
+			p2.x = A.x + beta2 * dx1;
+			p2.y = A.y + beta2 * dy1;
+			n = 2;
+			if (! dbSeg.reversed)
+			{
+				s1 = idA + beta1;
+				s2 = idA + beta2;
+			}
+			else
+			{
+				s1 = idB - beta1;
+				s2 = idB - beta2;
+			}
+
+			// find parameter of first point along unknown, since it marks the end of
+			// some polygon at the beginning of the overlap zone
+			// (the unknown's dx2 is tested but the database's dx1 used, as in intersect())
+			double u1;
+			if (dx2 != 0.0)
+				u1 = (p1.x - C.x) / dx1; // on unknown
+			else
+				u1 = (p1.y - C.y) / dy1; // on unknown
+			if (! unkSeg.reversed)
+				t1 = idC + u1;
+			else
+				t1 = idD - u1;
+		}
+		else
+			n = 0; // no intersection
+	}
+}
+
+//*******************************************************************
+//
+// active segment lists, kept in increasing order of segment ID so they
+// are visited in the same order as the sets they replace (they seldom
+// hold more than two segments)
+//
+static void insertSegId(vector<int> &ids, int id)
+{
+	int k = ids.size();
+
+	ids.push_back(id);
+	while ((k > 0) && (ids[k-1] > id))
+	{
+		ids[k] = ids[k-1];
+		k--;
+	}
+
+	if ((k > 0) && (ids[k-1] == id))
+		ids.erase(ids.begin() + k); // already there
+	else
+		ids[k] = id;
+}
+
+static void eraseSegId(vector<int> &ids, int id)
+{
+	int n = ids.size();
+
+	for (int k = 0; k < n; k++)
+		if (ids[k] == id)
+		{
+			for (; k+1 < n; k++)
+				ids[k] = ids[k+1];
+			ids.pop_back();
+			return;
+		}
+}
+
+//*******************************************************************
+//
+// adds the term of the polygonArea() sum for the edge from a to b
+//
+static inline void addPolygonEdge(double &sum, const point_t &a, const point_t &b)
+{
+	sum += (a.x * b.y - b.x * a.y);
+}
+
+//*******************************************************************
+//
+// double findAreaBetweenOutlineSegments_Flat(...)
+//
+//    Returns the same area as findAreaBetweenOutlineSegments(), using
+//    (and leaving the contents of) scratch.
+//
+double findAreaBetweenOutlineSegments_Flat( 
+		FloatContour *c1, // mapped unknown fin 
+		int begin1,
+		int end1,
+		FloatContour *c2, // envenly spaced database fin
+		int begin2,
+		int end2,
+		AreaMatchScratch &scratch)
+{
+	int
+		n1 = c1->length(),
+		n2 = c2->length();
+
+	// the segments all lie between begin and end, so checking these once
+	// stands in for the checks of FloatContour::operator[] (the polygons
+	// are checked as they are walked)
+	if ((begin1 < 0) || (end1 < begin1) || (end1 >= n1) ||
+	    (begin2 < 0) || (end2 < begin2) || (end2 >= n2))
+		throw BoundsError("findAreaBetweenOutlineSegments_Flat()");
+
+	const point_t
+		*unk = &(*c1)[0],
+		*db = &(*c2)[0];
+
+	vector<flatSegment_t> &segments = scratch.segments;
+	vector<ref_point> &refPts = scratch.refPts;
+	vector<int>
+		&activeDBsegs = scratch.activeDBsegs,
+		&activeUNKsegs = scratch.activeUNKsegs,
+		&perpsDB = scratch.perpsDB,
+		&perpsUNK = scratch.perpsUNK;
+	vector<int_point> &intersectPoints = scratch.intersectPoints;
+
+	segments.clear();
+	scratch.refPtsUnk.clear();
+	scratch.refPtsDb.clear();
+	refPts.clear();
+	activeDBsegs.clear();
+	activeUNKsegs.clear();
+	perpsDB.clear();
+	perpsUNK.clear();
+	intersectPoints.clear();
+
+	findSegsAndRefPointsForContour_Flat (unk,begin1,end1,'u',segments,scratch.refPtsUnk); // unknown contour
+	findSegsAndRefPointsForContour_Flat (db,begin2,end2,'d',segments,scratch.refPtsDb); // database contour
+
+	// merge the two, unknown first where parameters are equal (as the
+	// multimap has them)
+	int 
+		unkI = 0, dbI = 0,
+		unkN = scratch.refPtsUnk.size(), 
+		dbN = scratch.refPtsDb.size();
+	while ((unkI < unkN) && (dbI < dbN))
+		if (scratch.refPtsDb[dbI].parameter < scratch.refPtsUnk[unkI].parameter)
+			refPts.push_back(scratch.refPtsDb[dbI++]);
+		else
+			refPts.push_back(scratch.refPtsUnk[unkI++]);
+	while (unkI < unkN)
+		refPts.push_back(scratch.refPtsUnk[unkI++]);
+	while (dbI < dbN)
+		refPts.push_back(scratch.refPtsDb[dbI++]);
+
+	// push first point common to both contours (this may cause point to be in list twice
+	// but that is better than it being missed)
+
+	int_point iPt;
+	iPt.paramDb = begin2;
+	iPt.paramUnk = begin1;
+	iPt.pt = unk[begin1];
+	intersectPoints.push_back(iPt);
+
+	int 
+		numRefPts = refPts.size(),
+		r, r2;
+
+	for (r = 0; r < numRefPts; r = r2)
+	{
+		// find all refPts with same projection parameter
+		// "add" all segments beginning here ore perpendicular to here
+		// "remove" all segments ending here
+		// (each group has at least its first point, so a parameter that is
+		// not a number, from a reference line of no length, cannot stop the
+		// walk as it does in findAreaBetweenOutlineSegments())
+		for (r2 = r; (r2 == r) || ((r2 < numRefPts) && (refPts[r2].parameter == refPts[r].parameter)); r2++)
+		{
+			int segId = refPts[r2].segId;
+			bool isDB = (segments[segId].contourType == 'd');
+
+			if (refPts[r2].segOp == 1) // remove segment from active list
+				eraseSegId(isDB ? activeDBsegs : activeUNKsegs, segId);
+			else // add segment to active list
+			{
+				insertSegId(isDB ? activeDBsegs : activeUNKsegs, segId);
+				segments[segId].activeFrom = r;
+				if (refPts[r2].segOp == 2) // perpendicular, only active in this group
+					insertSegId(isDB ? perpsDB : perpsUNK, segId);
+			}
+		}
+
+		// now find all intersesctions between active DB segs and active UNK segs
+		// (pairs active together in an earlier group have been tested)
+
+		for (int d = 0; d < (int)activeDBsegs.size(); d++)
+		{
+			int dbId = activeDBsegs[d];
+			bool dbNew = (segments[dbId].activeFrom == r);
+
+			for (int u = 0; u < (int)activeUNKsegs.size(); u++)
+			{
+				int unkId = activeUNKsegs[u];
+
+				if ((! dbNew) && (segments[unkId].activeFrom != r))
+					continue;
+
+				double 
+					s1, s2, // parameter of intersection along database contour
+					t1; // parameter of intersection along unknown contour
+				point_t 
+					p1, p2; // intersection point(s) .. 2 if segmetns overlap
+				int n;      // number of intersection pts
+
+				intersect_Flat(segments[dbId], segments[unkId], unk, db, s1, t1, p1, s2, p2, n);
+
+				// a single crossing, or the start of an overlap (the rest
+				// of which bounds no area)
+				if ((n == 1) || (n == 2))
+				{
+					iPt.paramDb = s1;
+					iPt.paramUnk = t1;
+					iPt.pt = p1;
+					intersectPoints.push_back(iPt);
+				}
+			}
+		}
+
+		// now remove all perps before going on to nex ref point
+
+		int k;
+
+		for (k = 0; k < (int)perpsDB.size(); k++)
+			eraseSegId(activeDBsegs, perpsDB[k]);
+		perpsDB.clear();
+
+		for (k = 0; k < (int)perpsUNK.size(); k++)
+			eraseSegId(activeUNKsegs, perpsUNK[k]);
+		perpsUNK.clear();
+	}
+
+	// push last point common to both contours
+	iPt.paramDb = end2;
+	iPt.paramUnk = end1;
+	iPt.pt = unk[end1];
+	intersectPoints.push_back(iPt);
+
+	// now calculate the area between the contours
+	double sum = 0.0;
+	
+	for (int i = 0; i+1 < (int)intersectPoints.size(); i++) // index into intersectPoints
+	{
+		// sequence of points for area calc is from intersect point
+		// then IN order through database contour points to next intersect point
+		// then in reverse order through unknown points to first intersect point
+
+		const int_point
+			&from = intersectPoints[i],
+			&to = intersectPoints[i+1];
+
+		double polySum = 0.0;
+		const point_t *prev = &from.pt;
+
+		int lo, hi, j;
+
+		// limits of index alond database contour between intersect points
+		if (floor(from.paramDb) == from.paramDb)
+			lo = from.paramDb + 1;
+		else
+			lo = ceil(from.paramDb);
+
+		if (ceil(to.paramDb) == to.paramDb)
+			hi = to.paramDb - 1;
+		else
+			hi = floor(to.paramDb);
+
+		if ((lo <= hi) && ((lo < 0) || (hi >= n2)))
+			throw BoundsError("findAreaBetweenOutlineSegments_Flat()");
+
+		for (j = lo; j <= hi; j++)
+		{
+			addPolygonEdge(polySum, *prev, db[j]); // database contour points between intersections
+			prev = &db[j];
+		}
+
+		addPolygonEdge(polySum, *prev, to.pt); // next intersect point
+		prev = &to.pt;
+
+		// limits of index alond unknown contour between intersect points
+		if (ceil(to.paramUnk) == to.paramUnk)
+			hi = to.paramUnk - 1;
+		else
+			hi = floor(to.paramUnk);
+
+		if (floor(from.paramUnk) == from.paramUnk)
+			lo = from.paramUnk + 1;
+		else
+			lo = ceil(from.paramUnk);
+
+		if ((lo <= hi) && ((lo < 0) || (hi >= n1)))
+			throw BoundsError("findAreaBetweenOutlineSegments_Flat()");
+
+		for (j = hi; j >= lo; j--)
+		{
+			addPolygonEdge(polySum, *prev, unk[j]); // unknown contour points between intersections
+			prev = &unk[j];
+		}
+
+		addPolygonEdge(polySum, *prev, from.pt); // back to initial point
+
+		sum += fabs(0.5 * polySum);
+	}
+
+	return sum;
+}
+
 //*******************************************************************
 //
 //
@@ -1221,16 +1816,20 @@ double areaBasedErrorBetweenOutlineSegments_NEW(
 		FloatContour *c2, // envenly spaced database fin //***0005CM
 		int begin2,
 		int mid2,
-		int end2)
+		int end2,
+		AreaMatchScratch &scratch) //***2.3
 {
 	// find length of database fin outline
+	//***2.3 - only the segments between begin2 and end2 are visited
 	double dbArcLength = 0.0;
-	for (int k = 1; k < c2->length(); k++)
+	for (int k = max(1, begin2 + 1); (k <= end2) && (k < c2->length()); k++)
 	{
-		double dx = (*c2)[k].x - (*c2)[k-1].x;
-		double dy = (*c2)[k].y - (*c2)[k-1].y;
-		if ((begin2 < k) && (k <= end2))
-			dbArcLength += sqrt(dx * dx + dy * dy);
+		const point_t
+			&p = (*c2)[k],
+			&q = (*c2)[k-1];
+		double dx = p.x - q.x;
+		double dy = p.y - q.y;
+		dbArcLength += sqrt(dx * dx + dy * dy);
 	}
 
 	double area;
@@ -1240,11 +1839,37 @@ double areaBasedErrorBetweenOutlineSegments_NEW(
 	// area  = findAreaBetweenOutlineSegments_Vec(c1,begin1,mid1,c2,begin2,mid2);
 	// area += findAreaBetweenOutlineSegments_Vec(c1,mid1,end1,c2,mid2,end2);
 
-	area  = findAreaBetweenOutlineSegments(c1,begin1,mid1,c2,begin2,mid2);
-	area += findAreaBetweenOutlineSegments(c1,mid1,end1,c2,mid2,end2);
+	//***2.3 - the flat array version, same areas without the allocation
+	//area  = findAreaBetweenOutlineSegments(c1,begin1,mid1,c2,begin2,mid2);
+	//area += findAreaBetweenOutlineSegments(c1,mid1,end1,c2,mid2,end2);
+	area  = findAreaBetweenOutlineSegments_Flat(c1,begin1,mid1,c2,begin2,mid2,scratch);
+	area += findAreaBetweenOutlineSegments_Flat(c1,mid1,end1,c2,mid2,end2,scratch);
 
 	double returnVal = area / dbArcLength;
 	// cout << "AreaError: " << returnVal << endl;
 
 	return (returnVal);
 }
+
+//*******************************************************************
+//
+// ***2.3 - as above with scratch space of its own, for callers that
+// compute only one error
+//
+double areaBasedErrorBetweenOutlineSegments_NEW( 
+		FloatContour *c1, // mapped unknown fin 
+		int begin1,
+		int mid1,
+		int end1,
+		FloatContour *c2, // envenly spaced database fin //***0005CM
+		int begin2,
+		int mid2,
+		int end2)
+{
+	AreaMatchScratch scratch;
+
+	return areaBasedErrorBetweenOutlineSegments_NEW(
+			c1, begin1, mid1, end1,
+			c2, begin2, mid2, end2,
+			scratch);
+}
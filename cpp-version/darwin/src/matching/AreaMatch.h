@@ -64,6 +64,33 @@ class int_point {
 		{}
 };
 
+//***2.3 - flat array version of the above, see findAreaBetweenOutlineSegments_Flat()
+
+// a contour_segment without the set of intersecting segments
+typedef struct {
+	double parameter;
+	char contourType; // 'd' or 'u' for database or unknown
+	int startIndex;
+	bool reversed; // true means end index is startIndex - 1 rather than startIndex + 1
+	int activeFrom; // first reference point of the group where it became active
+} flatSegment_t;
+
+// Space for the segments, reference points and intersections of one
+// call, kept so that later calls (with outlines of about the same
+// length) allocate nothing.  One per thread.
+class AreaMatchScratch {
+	public:
+		std::vector<flatSegment_t> segments;
+		std::vector<ref_point>
+			refPtsUnk,
+			refPtsDb,
+			refPts; // the two above, merged
+		std::vector<int>
+			activeDBsegs, activeUNKsegs, // kept in increasing order
+			perpsDB, perpsUNK;
+		std::vector<int_point> intersectPoints;
+};
+
 double findAreaBetweenOutlineSegments( // called for either leading or training edge
 		FloatContour *c1, // mapped unknown fin 
 		int begin1,
@@ -82,6 +109,26 @@ double areaBasedErrorBetweenOutlineSegments_NEW( // called for entire fin .. sca
 		int mid2,
 		int end2);
 
+double findAreaBetweenOutlineSegments_Flat( //***2.3
+		FloatContour *c1, // mapped unknown fin 
+		int begin1,
+		int end1,
+		FloatContour *c2, // evenly spaced database fin
+		int begin2,
+		int end2,
+		AreaMatchScratch &scratch);
+
+double areaBasedErrorBetweenOutlineSegments_NEW( //***2.3 - with reusable scratch space
+		FloatContour *c1, // mapped unknown fin 
+		int begin1,
+		int mid1,
+		int end1,
+		FloatContour *c2, // evenly spaced database fin
+		int begin2,
+		int mid2,
+		int end2,
+		AreaMatchScratch &scratch);
+
 double polygonArea(const std::vector<point_t> &p);
 
 void intersect(std::vector<contour_segment> &segments, 
@@ -0,0 +1,683 @@
+//*******************************************************************
+//   file: CatalogSelfMatch.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+//*******************************************************************
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <algorithm>
+#include <fstream>
+
+#include "CatalogSelfMatch.h"
+#include "../Error.h"
+#include "../shapeDescriptor.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+using namespace std;
+
+//*******************************************************************
+//
+// class SelfMatchWork
+//
+//    One stage of the job shared by the worker threads.  Each worker
+//    repeatedly takes the next unclaimed tile, and tiles never write
+//    to the same data, so the lock only guards next and failed.
+//
+class SelfMatchWork
+{
+	public:
+		CatalogSelfMatch *job;
+		bool screening;                // shape screen, or registration
+		int registrationMethod;
+		bool useFullFinError;
+
+		int numTiles;
+		int next;                      // next unclaimed tile, guarded by lock
+		bool failed;
+		std::string errorMsg;
+
+#ifdef WIN32
+		CRITICAL_SECTION lock;
+#else
+		pthread_mutex_t lock;
+#endif
+
+		SelfMatchWork()
+		:	job(NULL),
+			screening(false),
+			registrationMethod(0),
+			useFullFinError(false),
+			numTiles(0),
+			next(0),
+			failed(false)
+		{
+#ifdef WIN32
+			InitializeCriticalSection(&lock);
+#else
+			pthread_mutex_init(&lock, NULL);
+#endif
+		}
+
+		~SelfMatchWork()
+		{
+#ifdef WIN32
+			DeleteCriticalSection(&lock);
+#else
+			pthread_mutex_destroy(&lock);
+#endif
+		}
+};
+
+#ifdef WIN32
+#define SELF_MATCH_LOCK(w)   EnterCriticalSection(&(w)->lock)
+#define SELF_MATCH_UNLOCK(w) LeaveCriticalSection(&(w)->lock)
+#else
+#define SELF_MATCH_LOCK(w)   pthread_mutex_lock(&(w)->lock)
+#define SELF_MATCH_UNLOCK(w) pthread_mutex_unlock(&(w)->lock)
+#endif
+
+//*******************************************************************
+//
+void *selfMatchWorkerThread(void *arg)
+{
+	SelfMatchWork *work = (SelfMatchWork *)arg;
+
+	while (true)
+	{
+		SELF_MATCH_LOCK(work);
+		int t = work->next++;
+		bool stop = work->failed;
+		SELF_MATCH_UNLOCK(work);
+
+		if (stop || (t >= work->numTiles))
+			break;
+
+		try {
+			if (work->screening)
+				work->job->screenTile(t);
+			else
+				work->job->registerTile(work, t);
+		} catch (Error e) {
+			SELF_MATCH_LOCK(work);
+			work->failed = true;
+			work->errorMsg = e.errorString();
+			SELF_MATCH_UNLOCK(work);
+		} catch (...) {
+			SELF_MATCH_LOCK(work);
+			work->failed = true;
+			work->errorMsg = "CatalogSelfMatch worker failed";
+			SELF_MATCH_UNLOCK(work);
+		}
+	}
+
+	return NULL;
+}
+
+#ifdef WIN32
+static DWORD WINAPI selfMatchWorkerThreadWin32(LPVOID arg)
+{
+	selfMatchWorkerThread(arg);
+	return 0;
+}
+#endif
+
+//*******************************************************************
+//
+// static void runSelfMatchWorkers(SelfMatchWork *work, int numThreads)
+//
+//    Runs numThreads workers over the tiles of work (the calling thread
+//    is one of them) and returns when every tile is done.
+//
+static void runSelfMatchWorkers(SelfMatchWork *work, int numThreads)
+{
+	if (numThreads > work->numTiles)
+		numThreads = work->numTiles;
+
+	if (numThreads <= 1)
+		selfMatchWorkerThread(work);
+	else
+	{
+#ifdef WIN32
+		std::vector<HANDLE> threads(numThreads - 1);
+		for (int t = 0; t < numThreads - 1; t++)
+			threads[t] = CreateThread(NULL, 0, selfMatchWorkerThreadWin32, work, 0, NULL);
+		selfMatchWorkerThread(work);
+		WaitForMultipleObjects(threads.size(), &threads[0], TRUE, INFINITE);
+		for (int t = 0; t < numThreads - 1; t++)
+			CloseHandle(threads[t]);
+#else
+		std::vector<pthread_t> threads(numThreads - 1);
+		for (int t = 0; t < numThreads - 1; t++)
+			pthread_create(&threads[t], NULL, selfMatchWorkerThread, work);
+		selfMatchWorkerThread(work);
+		for (int t = 0; t < numThreads - 1; t++)
+			pthread_join(threads[t], NULL);
+#endif
+	}
+
+	if (work->failed)
+		throw Error(work->errorMsg);
+}
+
+//*******************************************************************
+//
+// orderings of pairs: by error (ties by fins, so results never depend
+// on the order of registration), and by tile
+//
+static bool pairErrorLess(const selfMatchPair_t &a, const selfMatchPair_t &b)
+{
+	if (a.error != b.error)
+		return a.error < b.error;
+	if (a.fin1 != b.fin1)
+		return a.fin1 < b.fin1;
+	return a.fin2 < b.fin2;
+}
+
+static bool pairTileLess(const selfMatchPair_t &a, const selfMatchPair_t &b)
+{
+	int
+		tileA = a.fin2 / SELF_MATCH_TILE_SIZE,
+		tileB = b.fin2 / SELF_MATCH_TILE_SIZE;
+
+	if (tileA != tileB)
+		return tileA < tileB;
+	if (a.fin1 != b.fin1)
+		return a.fin1 < b.fin1;
+	return a.fin2 < b.fin2;
+}
+
+static bool pairFinsLess(const selfMatchPair_t &a, const selfMatchPair_t &b)
+{
+	if (a.fin1 != b.fin1)
+		return a.fin1 < b.fin1;
+	return a.fin2 < b.fin2;
+}
+
+static bool pairFinsEqual(const selfMatchPair_t &a, const selfMatchPair_t &b)
+{
+	return (a.fin1 == b.fin1) && (a.fin2 == b.fin2);
+}
+
+//*******************************************************************
+//
+// static string csvField(string s)
+//
+//    Quotes s if it holds a comma, quote or line break.
+//
+static string csvField(string s)
+{
+	if (string::npos == s.find_first_of(",\"\r\n"))
+		return s;
+
+	string quoted = "\"";
+	for (unsigned i = 0; i < s.length(); i++)
+	{
+		if ('"' == s[i])
+			quoted += '"';
+		quoted += s[i];
+	}
+	return quoted + "\"";
+}
+
+
+//*******************************************************************
+//
+CatalogSelfMatch::CatalogSelfMatch(Database *db)
+	: mDatabase(db),
+	  mSnapshot(NULL),
+	  mNeighbours(0),
+	  mPairsPerFin(3),
+	  mNextBlock(0),
+	  mNumPairs(0),
+	  mNumRegistered(0),
+	  mScreened(false)
+{
+	if (NULL == db)
+		throw EmptyArgumentError("CatalogSelfMatch::CatalogSelfMatch() [Database *db]");
+
+	mSnapshot = db->getMatchSnapshot();
+
+	for (int pos = 0; pos < (int)db->sizeAbsolute(); pos++)
+	{
+		int i = mSnapshot->fetch(pos);
+		if (-1 != i)
+			mFins.push_back(i);
+	}
+
+	int n = mFins.size();
+
+	mNumPairs = n * (n - 1) / 2;
+	mBestPairs.resize(n);
+}
+
+//*******************************************************************
+//
+CatalogSelfMatch::~CatalogSelfMatch()
+{
+	deleteBlockMatchers();
+}
+
+//*******************************************************************
+//
+void CatalogSelfMatch::setNeighbours(int n)
+{
+	if (mScreened)
+		throw Error("CatalogSelfMatch::setNeighbours() called after matching started");
+
+	mNeighbours = (n < 0) ? 0 : n;
+}
+
+//*******************************************************************
+//
+void CatalogSelfMatch::setPairsPerFin(int n)
+{
+	mPairsPerFin = (n < 1) ? 1 : n;
+}
+
+//*******************************************************************
+//
+int CatalogSelfMatch::getNumFins() const
+{
+	return mFins.size();
+}
+
+int CatalogSelfMatch::getNumPairs() const
+{
+	return mNumPairs;
+}
+
+int CatalogSelfMatch::getNumRegistered() const
+{
+	return mNumRegistered;
+}
+
+//*******************************************************************
+//
+// float CatalogSelfMatch::matchNextBlock(int registrationMethod,
+//                                        bool useFullFinError,
+//                                        int numThreads)
+//
+//    Matches the next block of fins, as an unknown would be matched,
+//    against every later fin it is paired with.  The Match objects are
+//    made and the results kept on this thread, only the registration
+//    is done by the workers.
+//
+float CatalogSelfMatch::matchNextBlock(
+		int registrationMethod,
+		bool useFullFinError,
+		int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = numberOfProcessors();
+
+	int n = mFins.size();
+
+	if (! mScreened)
+	{
+		if ((mNeighbours > 0) && (mNeighbours < n - 1))
+			screenByShape(numThreads);
+		mScreened = true;
+	}
+
+	if (mNextBlock >= n)
+		return 1.0;
+
+	try {
+		setupBlock(registrationMethod);
+
+		SelfMatchWork work;
+		work.job = this;
+		work.registrationMethod = registrationMethod;
+		work.useFullFinError = useFullFinError;
+		work.numTiles = mTileStart.size() - 1;
+
+		runSelfMatchWorkers(&work, numThreads);
+
+		keepBlockResults();
+
+	} catch (...) {
+		deleteBlockMatchers();
+		throw;
+	}
+
+	deleteBlockMatchers();
+
+	mNextBlock += SELF_MATCH_TILE_SIZE;
+
+	if ((mNextBlock >= n) || (0 == mNumPairs))
+		return 1.0;
+
+	return (float)mNumRegistered / mNumPairs;
+}
+
+//*******************************************************************
+//
+// void CatalogSelfMatch::screenByShape(int numThreads)
+//
+//    Finds the nearest neighbours of each fin by shape descriptor and
+//    pairs each fin with its neighbours and the fins it is a neighbour
+//    of, so that the pairs are the same whichever fin comes first.
+//
+void CatalogSelfMatch::screenByShape(int numThreads)
+{
+	int n = mFins.size();
+
+	mNearest.assign(n, std::vector<std::pair<float,int> >());
+
+	SelfMatchWork work;
+	work.job = this;
+	work.screening = true;
+	work.numTiles = (n + SELF_MATCH_TILE_SIZE - 1) / SELF_MATCH_TILE_SIZE;
+
+	runSelfMatchWorkers(&work, numThreads);
+
+	mCandidates.assign(n, std::vector<int>());
+
+	for (int a = 0; a < n; a++)
+		for (int k = 0; k < (int)mNearest[a].size(); k++)
+		{
+			int b = mNearest[a][k].second;
+			if (a < b)
+				mCandidates[a].push_back(b);
+			else
+				mCandidates[b].push_back(a);
+		}
+
+	std::vector<std::vector<std::pair<float,int> > >().swap(mNearest);
+
+	mNumPairs = 0;
+
+	for (int a = 0; a < n; a++)
+	{
+		std::sort(mCandidates[a].begin(), mCandidates[a].end());
+		mCandidates[a].erase(
+				std::unique(mCandidates[a].begin(), mCandidates[a].end()),
+				mCandidates[a].end());
+		mNumPairs += mCandidates[a].size();
+	}
+}
+
+//*******************************************************************
+//
+// void CatalogSelfMatch::screenTile(int rowBlock)
+//
+//    Nearest neighbours of the fins in one block, found one block of
+//    other fins at a time.  Only this block's lists are written.
+//
+void CatalogSelfMatch::screenTile(int rowBlock)
+{
+	int
+		n = mFins.size(),
+		rowStart = rowBlock * SELF_MATCH_TILE_SIZE,
+		rowEnd = std::min(rowStart + SELF_MATCH_TILE_SIZE, n);
+
+	for (int colStart = 0; colStart < n; colStart += SELF_MATCH_TILE_SIZE)
+	{
+		int colEnd = std::min(colStart + SELF_MATCH_TILE_SIZE, n);
+
+		for (int a = rowStart; a < rowEnd; a++)
+		{
+			const float *descA = mSnapshot->descriptor(mFins[a]);
+			std::vector<std::pair<float,int> > &nearest = mNearest[a];
+
+			for (int b = colStart; b < colEnd; b++)
+			{
+				if (a == b)
+					continue;
+
+				std::pair<float,int> candidate(
+						shapeDescriptorDistance(descA, mSnapshot->descriptor(mFins[b])), b);
+
+				if ((int)nearest.size() < mNeighbours)
+				{
+					nearest.push_back(candidate);
+					std::push_heap(nearest.begin(), nearest.end());
+				}
+				else if (candidate < nearest.front())
+				{
+					std::pop_heap(nearest.begin(), nearest.end());
+					nearest.back() = candidate;
+					std::push_heap(nearest.begin(), nearest.end());
+				}
+			}
+		}
+	}
+}
+
+//*******************************************************************
+//
+// void CatalogSelfMatch::setupBlock(int registrationMethod)
+//
+//    Makes a Match for each fin of the next block and lists the block's
+//    pairs tile by tile (a tile being the pairs with later fins in one
+//    block of SELF_MATCH_TILE_SIZE fins).
+//
+void CatalogSelfMatch::setupBlock(int registrationMethod)
+{
+	int
+		n = mFins.size(),
+		blockEnd = std::min(mNextBlock + SELF_MATCH_TILE_SIZE, n);
+
+	mBlockPairs.clear();
+	mTileStart.clear();
+
+	for (int a = mNextBlock; a < blockEnd; a++)
+	{
+		DatabaseFin<ColorImage> *fin = mDatabase->getItemAbsolute(mSnapshot->finID(mFins[a]));
+
+		if (NULL == fin)
+			throw Error("CatalogSelfMatch::matchNextBlock() catalog fin has been deleted");
+
+		Match *matcher = NULL;
+
+		try {
+			matcher = new Match(fin, mDatabase, NULL); // no top-K, prefilter or cache
+		} catch (...) {
+			delete fin;
+			throw;
+		}
+
+		delete fin;
+		mBlockMatchers.push_back(matcher);
+
+		if (! matcher->prepareRegistration(registrationMethod))
+			throw Error("CatalogSelfMatch::matchNextBlock() unsupported registration method");
+
+		selfMatchPair_t pair;
+		pair.fin1 = a;
+		pair.error = 0.0;
+
+		if (mCandidates.empty()) // every pair
+		{
+			for (pair.fin2 = a + 1; pair.fin2 < n; pair.fin2++)
+				mBlockPairs.push_back(pair);
+		}
+		else
+		{
+			for (int k = 0; k < (int)mCandidates[a].size(); k++)
+			{
+				pair.fin2 = mCandidates[a][k];
+				mBlockPairs.push_back(pair);
+			}
+		}
+	}
+
+	std::sort(mBlockPairs.begin(), mBlockPairs.end(), pairTileLess);
+
+	for (int p = 0; p < (int)mBlockPairs.size(); p++)
+		if ((0 == p) || (mBlockPairs[p].fin2 / SELF_MATCH_TILE_SIZE
+		                 != mBlockPairs[p-1].fin2 / SELF_MATCH_TILE_SIZE))
+			mTileStart.push_back(p);
+
+	mTileStart.push_back(mBlockPairs.size());
+}
+
+//*******************************************************************
+//
+void CatalogSelfMatch::registerTile(SelfMatchWork *work, int tile)
+{
+	for (int p = mTileStart[tile]; p < mTileStart[tile + 1]; p++)
+	{
+		selfMatchPair_t &pair = mBlockPairs[p];
+
+		pair.error = mBlockMatchers[pair.fin1 - mNextBlock]->registerSnapshotFin(
+				work->registrationMethod,
+				mSnapshot,
+				mFins[pair.fin2],
+				work->useFullFinError);
+	}
+}
+
+//*******************************************************************
+//
+void CatalogSelfMatch::keepBlockResults()
+{
+	for (int p = 0; p < (int)mBlockPairs.size(); p++)
+	{
+		const selfMatchPair_t &pair = mBlockPairs[p];
+
+		if (mSnapshot->idCode(mFins[pair.fin1]) == mSnapshot->idCode(mFins[pair.fin2]))
+			mSameIDErrors.push_back(pair.error);
+		else
+		{
+			keepBestPair(pair.fin1, pair);
+			keepBestPair(pair.fin2, pair);
+		}
+	}
+
+	mNumRegistered += mBlockPairs.size();
+}
+
+//*******************************************************************
+//
+void CatalogSelfMatch::deleteBlockMatchers()
+{
+	for (int i = 0; i < (int)mBlockMatchers.size(); i++)
+		delete mBlockMatchers[i];
+
+	mBlockMatchers.clear();
+}
+
+//*******************************************************************
+//
+void CatalogSelfMatch::keepBestPair(int fin, const selfMatchPair_t &pair)
+{
+	std::vector<selfMatchPair_t> &best = mBestPairs[fin];
+
+	if ((int)best.size() < mPairsPerFin)
+	{
+		best.push_back(pair);
+		std::push_heap(best.begin(), best.end(), pairErrorLess);
+	}
+	else if (pairErrorLess(pair, best.front()))
+	{
+		std::pop_heap(best.begin(), best.end(), pairErrorLess);
+		best.back() = pair;
+		std::push_heap(best.begin(), best.end(), pairErrorLess);
+	}
+}
+
+//*******************************************************************
+//
+// void CatalogSelfMatch::suspectedDuplicates(
+//                             std::vector<selfMatchPair_t> &pairs)
+//
+//    Every pair kept by either of its fins, once, best first.
+//
+void CatalogSelfMatch::suspectedDuplicates(std::vector<selfMatchPair_t> &pairs)
+{
+	pairs.clear();
+
+	for (int a = 0; a < (int)mBestPairs.size(); a++)
+		pairs.insert(pairs.end(), mBestPairs[a].begin(), mBestPairs[a].end());
+
+	std::sort(pairs.begin(), pairs.end(), pairFinsLess);
+	pairs.erase(std::unique(pairs.begin(), pairs.end(), pairFinsEqual), pairs.end());
+
+	std::sort(pairs.begin(), pairs.end(), pairErrorLess);
+}
+
+//*******************************************************************
+//
+// bool CatalogSelfMatch::saveCSV(std::string filename)
+//
+//    One line per suspected duplicate pair, with the catalog position
+//    (as in the .res files), ID, name and image of both fins.
+//
+bool CatalogSelfMatch::saveCSV(std::string filename)
+{
+	ofstream outFile(filename.c_str());
+
+	if (outFile.fail())
+		return false;
+
+	std::vector<selfMatchPair_t> pairs;
+	suspectedDuplicates(pairs);
+
+	outFile << "error,position1,id1,name1,image1,position2,id2,name2,image2" << endl;
+
+	for (int p = 0; p < (int)pairs.size(); p++)
+	{
+		int
+			i = mFins[pairs[p].fin1],
+			j = mFins[pairs[p].fin2];
+
+		outFile << pairs[p].error
+		        << "," << mSnapshot->finID(i)
+		        << "," << csvField(mSnapshot->idCode(i))
+		        << "," << csvField(mSnapshot->name(i))
+		        << "," << csvField(mSnapshot->imageFilename(i))
+		        << "," << mSnapshot->finID(j)
+		        << "," << csvField(mSnapshot->idCode(j))
+		        << "," << csvField(mSnapshot->name(j))
+		        << "," << csvField(mSnapshot->imageFilename(j))
+		        << endl;
+	}
+
+	return ! outFile.fail();
+}
+
+//*******************************************************************
+//
+void CatalogSelfMatch::summarize(std::ostream &out)
+{
+	std::vector<selfMatchPair_t> pairs;
+	suspectedDuplicates(pairs);
+
+	out << "Catalog self-match of " << mFins.size() << " fins:" << endl
+	    << "\t" << mNumRegistered << " of " << mNumPairs << " pairs registered";
+	if (mCandidates.empty())
+		out << " (every pair)" << endl;
+	else
+		out << " (" << mNeighbours << " nearest neighbours by shape)" << endl;
+
+	out << "\t" << mSameIDErrors.size() << " pairs with the same ID";
+
+	if (! mSameIDErrors.empty())
+	{
+		std::vector<double> errors(mSameIDErrors);
+		std::nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end());
+		double median = errors[errors.size() / 2];
+
+		int below = 0;
+		for (int p = 0; p < (int)pairs.size(); p++)
+			if (pairs[p].error <= median)
+				below++;
+
+		out << ", median error " << median << endl
+		    << "\t" << pairs.size() << " suspected duplicates (" << mPairsPerFin
+		    << " per fin), " << below << " of them with error at or below that median" << endl;
+	}
+	else
+		out << endl
+		    << "\t" << pairs.size() << " suspected duplicates (" << mPairsPerFin
+		    << " per fin)" << endl;
+}
@@ -0,0 +1,136 @@
+//*******************************************************************
+//   file: CatalogSelfMatch.h
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// ***2.3 - Catalog self-similarity.  A batch job that registers the
+// catalog fins against each other to find individuals entered twice
+// under different IDs.
+//
+// Each pair of fins is registered once, the fin earlier in the catalog
+// being mapped onto the later one as an unknown would be.  Given a
+// number of neighbours, a pair is only registered if one fin is among
+// the other's nearest neighbours by shape descriptor distance (see
+// shapeDescriptor.h).  That distance is symmetric and takes microseconds
+// rather than milliseconds, but it is a screen and NOT a bound on the
+// registration error, so a duplicate traced very differently can be
+// missed.  With no neighbours every pair is registered.
+//
+// Both stages work on tiles, a block of fins against a block of fins,
+// claimed by a pool of worker threads, so that the outlines of one
+// block stay in cache while the other block is registered to them.
+//
+// Each fin keeps its best pairs with fins of a different ID, and
+// saveCSV() writes all of those pairs, best first.  The errors of pairs
+// with the same ID show what a duplicate's error looks like in this
+// catalog, and their median is reported by summarize().
+//
+//*******************************************************************
+
+#ifndef CATALOGSELFMATCH_H
+#define CATALOGSELFMATCH_H
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../Database.h"
+#include "../MatchSnapshot.h"
+#include "Match.h"
+
+// fins in each side of a tile
+#define SELF_MATCH_TILE_SIZE        32
+
+typedef struct {
+	int fin1, fin2;   // by catalog order (fin1 < fin2), see CatalogSelfMatch::mFins
+	double error;
+} selfMatchPair_t;
+
+class SelfMatchWork; // defined in CatalogSelfMatch.cxx
+
+class CatalogSelfMatch
+{
+	public:
+		// Fetches every catalog fin into the database's match snapshot,
+		// which must not change (no fins added, updated or deleted) while
+		// the job runs.
+		CatalogSelfMatch(Database *db);
+		~CatalogSelfMatch();
+
+		// nearest neighbours (by shape) registered for each fin, 0 (the
+		// default) registers every pair.  Must be set before matching.
+		void setNeighbours(int n);
+
+		// best pairs of different IDs kept for each fin (default 3)
+		void setPairsPerFin(int n);
+
+		// Registers every pair whose earlier fin is in the next block of
+		// SELF_MATCH_TILE_SIZE fins on numThreads worker threads (one per
+		// processor when numThreads <= 0).  The first call screens pairs
+		// by shape if neighbours are set.
+		//
+		// RETURN:
+		// 	float - fraction of the pairs registered.  When done,
+		// 		returns 1.0
+		float matchNextBlock(int registrationMethod, bool useFullFinError,
+		                     int numThreads = 0);
+
+		int getNumFins() const;
+		int getNumPairs() const;      // to be registered
+		int getNumRegistered() const;
+
+		// writes the suspected duplicates, returns false if the file
+		// could not be written
+		bool saveCSV(std::string filename);
+
+		void summarize(std::ostream &out);
+
+	private:
+		Database *mDatabase;
+		MatchSnapshot *mSnapshot;  // belongs to mDatabase
+
+		std::vector<int> mFins;    // snapshot index of each catalog fin, in catalog order
+
+		int
+			mNeighbours,
+			mPairsPerFin,
+			mNextBlock,            // first fin of the next block
+			mNumPairs,
+			mNumRegistered;
+
+		bool mScreened;
+
+		// shape screen: nearest neighbours of each fin as max-heaps of
+		// (descriptor distance, fin), and then the later fins each fin is
+		// to be registered with (empty when every pair is registered)
+		std::vector<std::vector<std::pair<float,int> > > mNearest;
+		std::vector<std::vector<int> > mCandidates;
+
+		// the current block: one Match per fin in the block, its pairs in
+		// tile order, and the first pair of each tile
+		std::vector<Match*> mBlockMatchers;
+		std::vector<selfMatchPair_t> mBlockPairs;
+		std::vector<int> mTileStart;
+
+		// max-heaps (by error) of the best different ID pairs of each fin
+		std::vector<std::vector<selfMatchPair_t> > mBestPairs;
+		std::vector<double> mSameIDErrors;
+
+		void screenByShape(int numThreads);
+		void screenTile(int rowBlock);
+
+		void setupBlock(int registrationMethod);
+		void registerTile(SelfMatchWork *work, int tile);
+		void keepBlockResults();
+		void deleteBlockMatchers();
+
+		void keepBestPair(int fin, const selfMatchPair_t &pair);
+		void suspectedDuplicates(std::vector<selfMatchPair_t> &pairs);
+
+		friend void *selfMatchWorkerThread(void *arg);
+};
+
+#endif
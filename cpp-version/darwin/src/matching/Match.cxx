@@ -11,15 +11,39 @@
 //*******************************************************************
 
 // for display of outline images
+#ifndef DARWIN_NO_GUI
 #include <gtk/gtk.h>
 #include "../interface/GtkCompat.h"
 #include "../interface/MatchingDialog.h"
+#else
+//***2.3 - headless builds (darwin-match) never attach a display, so
+// this stands in for the real dialog and setDisplay() is never called
+#include "../FloatContour.h"
+class MatchingDialog
+{
+	public:
+		void showOutlines(FloatContour *unk, FloatContour *db) { }
+		void showErrorPt2Pt(FloatContour *unk, FloatContour *db,
+				float x1, float y1, float x2, float y2) { }
+};
+#endif
 
 #include <cstdio>
+#include <cmath>
+#include <algorithm> //***2.3 - top-K heap
+
+//***2.3 - SSE2 is used for the outline error kernel where available; all
+// x86-64 compilers provide it, anything else uses the scalar code
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define MATCH_USE_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "../Chain.h"
 #include "../Error.h"
 #include "../feature.h"
 #include "../mapContour.h"
+#include "../MatchProfile.h" //***2.3
 #include "../utility.h"
 #include "Match.h"
 #include "AreaMatch.h" //***1.85
@@ -29,8 +53,12 @@
 //#include "../CatalogCategories.h" //***051
 
 #ifdef WIN32
+#include <windows.h> //***2.3 - worker threads
 #define PATH_SLASH "\\"
 #else
+#include <pthread.h> //***2.3 - worker threads
+#include <unistd.h>
+#include <sys/time.h>
 #define PATH_SLASH "/"
 #endif
 
@@ -53,8 +81,28 @@ Match::Match(
 	  mOptions(o), //***054
 	  mCurrentFin(0),
 	  mMatchResults(new MatchResults(unknownFin->mIDCode)),
+	  mTopK(0), //***2.3
+	  mNumAbandoned(0), //***2.3
+	  mShortlistFraction(0.0f), //***2.3
+	  mShortlistBuilt(false), //***2.3
+	  mShortlistSize(0), //***2.3
+	  mNumPrefilterCandidates(0), //***2.3
+	  mPrefilterTrueRank(-1), //***2.3
+	  mNearestCandidates(0), //***2.3
+	  mMatchAddedOnly(false), //***2.3
+	  mCategoriesListed(false), //***2.3
+	  mNumAddedFins(0), //***2.3
+	  mCoarseToFine(false), //***2.3
+	  mUseMatchCache(false), //***2.3
+	  mMatchCacheLoaded(false), //***2.3
+	  mMatchCacheMethod(0), //***2.3
+	  mMatchCacheFullFinError(false), //***2.3
+	  mNumCacheHits(0), //***2.3
+	  mSliceWork(NULL), //***2.3
+	  mSliceSize(0), //***2.3
+	  mSliceUseCache(false) //***2.3
 	  //errorBetweenOutlines(meanSquaredErrorBetweenOutlineSegments) //***1.85 -- vc++6.0
-	  errorBetweenOutlines(&Match::meanSquaredErrorBetweenOutlineSegments) //***1.85 -- vc++2011
+	  //errorBetweenOutlines(&Match::meanSquaredErrorBetweenOutlineSegments) //***1.85 -- vc++2011
 {
 	if (NULL == unknownFin)
 		throw EmptyArgumentError("Match::Match() [*unknownFin]");
@@ -62,6 +110,12 @@ Match::Match(
 	if (NULL == db)
 		throw EmptyArgumentError("Match::Match() [*db]");
 
+	//***2.3 - saved with the results, see matchAddedSince()
+	mMatchResults->setCatalogGeneration(db->catalogGeneration());
+
+	//***2.3 - for loading contours and thumbnails of displayed results
+	mMatchResults->setSource(db, mUnknownFin->mFinOutline->getFloatContour());
+
 	mUnknownTipPosition = mUnknownFin->mFinOutline->getFeaturePoint(TIP); //***008OL
 	mUnknownNotchPosition = mUnknownFin->mFinOutline->getFeaturePoint(NOTCH); //***008OL
 	mUnknownBeginLE = mUnknownFin->mFinOutline->getFeaturePoint(LE_BEGIN); //***008OL
@@ -74,9 +128,34 @@ Match::Match(
 	mUnknownNotchPositionPoint = mUnknownFin->mFinOutline->getFeaturePointCoords(NOTCH); //***008OL
 	mUnknownEndTEPoint = mUnknownFin->mFinOutline->getFeaturePointCoords(POINT_OF_INFLECTION); //***008OL
 
+	//***2.3 - the unknown's outline pyramid, made once for all catalog fins
+	for (int level = 1; level < OUTLINE_PYRAMID_LEVELS; level++)
+		mUnknownLevelContour[level - 1] = 
+				mUnknownFin->mFinOutline->getFloatContour()->subsample(1 << level);
+
 	// just a pointer to the dialog for display purposes, this will be set
 	// to point to the actual dialog IF and WHEN display is desired
 	mMatchingDialog = NULL; 
+
+	//***2.3 - top-K early abandon mode
+	if ((NULL != o) && o->mUseMatchTopK)
+		mTopK = o->mMatchTopK;
+
+	//***2.3 - shape descriptor prefilter
+	if ((NULL != o) && o->mUseMatchPrefilter)
+		setShortlistFraction(o->mMatchShortlistFraction);
+
+	//***2.3 - outline index prefilter
+	if ((NULL != o) && o->mUseOutlineIndex)
+		setNearestCandidates(o->mOutlineIndexCandidates);
+
+	//***2.3 - persistent match cache
+	if (NULL != o)
+		mUseMatchCache = o->mUseMatchCache;
+
+	//***2.3 - coarse-to-fine registration
+	if (NULL != o)
+		mCoarseToFine = o->mUseCoarseToFine;
 }
 
 
@@ -88,6 +167,11 @@ Match::Match(
 //
 Match::~Match()
 {
+	deleteSliceWork(); //***2.3
+
+	for (int level = 1; level < OUTLINE_PYRAMID_LEVELS; level++) //***2.3
+		delete mUnknownLevelContour[level - 1];
+
 	delete mUnknownFin;
 	//***008OL copy of results is made in MatchResultsWindow constructor 
 	// so we can delete here (probably)
@@ -143,179 +227,1664 @@ float Match::matchSingleFin(int registrationMethod, int regSegmentsUsed,
                             bool categoryToMatch[], bool useFullFinError,
 							bool useAbsoluteOffsets)
 {
+	ProfileCollector collector(mMatchResults->getProfile()); //***2.3
+
+	MatchSnapshot *snapshot = NULL, *tempSnapshot = NULL;
+
 	try {
 
-		DatabaseFin<ColorImage> *thisDBFin;
+		//***2.3 - stage one of two stage matching, done once
+		if (shortlistPending())
+			buildShortlist(categoryToMatch, useAbsoluteOffsets);
+
+		int thisFin; //***2.3 - index of database fin in snapshot
 
 		if (useAbsoluteOffsets)
 		{
+			//***2.3 - fins come from the database's match snapshot, which
+			// only reads each fin from the database the first time
+			snapshot = mDatabase->getMatchSnapshot();
+
+			//***2.3 - fins in unselected categories are never read
+			listCategories(categoryToMatch);
+
 			// there may be holes in the absolute offset list so we loop until
 			// a non NULL fin is returned or until we reach the end of the list
 			do
 			{
 				if (mCurrentFin >= (int)mDatabase->sizeAbsolute())
+				{
+					flushMatchCache(); //***2.3
 					return 100.0;
+				}
 
-				thisDBFin = mDatabase->getItemAbsolute(mCurrentFin);
+				//***2.3 - fins already matched, in unselected categories or
+				// not shortlisted are skipped like holes, without reading them
+				thisFin = (addedSince(mCurrentFin) && inCategories(mCurrentFin)
+				           && inShortlist(mCurrentFin))
+				          ? snapshot->fetch(mCurrentFin) : -1;
 
-				if (NULL == thisDBFin)
+				if (-1 == thisFin)
 					mCurrentFin++;
 			} 
-			while (NULL == thisDBFin);
+			while (-1 == thisFin);
 		}
 		else
 		{
+			if (mMatchAddedOnly) //***2.3
+				throw Error("Match::matchSingleFin() matching added fins requires absolute offsets");
+
 			if (mCurrentFin >= (int)mDatabase->size())
+			{
+				flushMatchCache(); //***2.3
 				return 100.0;
+			}
 
-			thisDBFin = mDatabase->getItem(mCurrentFin);
+			//***2.3 - list positions change as the database is sorted, so these
+			// fins go in a snapshot of their own
+			DatabaseFin<ColorImage> *thisDBFin = mDatabase->getItem(mCurrentFin);
+			snapshot = tempSnapshot = new MatchSnapshot(NULL);
+			thisFin = tempSnapshot->addFin(thisDBFin, mCurrentFin);
+			delete thisDBFin; //***1.6 - moved here to fix memory leak
 		}
 
 
-		bool tryMatch = false;
-		for (int i = 0; (i < mDatabase->catCategoryNamesMax()) && (! tryMatch); i++)
+		bool tryMatch = categorySelected(snapshot, thisFin, categoryToMatch)
+		                && inShortlist(mCurrentFin); //***2.3
+
+		//***2.3 - registration and storing of the result are now shared
+		// with matchFinBlock()
+		if (tryMatch && registrationMethodSupported(registrationMethod))
 		{
-			tryMatch = (
-				(thisDBFin->getDamage() == mDatabase->catCategoryName(i)) && categoryToMatch[i]);
+			bool useCache = loadMatchCache(registrationMethod, useFullFinError); //***2.3
+
+			mseInfo result;
+
+			if (useCache && findCachedMatch(snapshot, thisFin, result))
+			{
+				if (mMatchingDialog != NULL)
+					mMatchingDialog->showOutlines(result.c1, result.c2);
+			}
+			else
+			{
+				SnapshotFin dbFin(snapshot, thisFin);
+
+				result = findErrorForMethod(
+						registrationMethod, &dbFin, useFullFinError,
+						abandonThreshold()); //***2.3
+
+				if (useCache)
+					noteCachedMatch(snapshot, thisFin, result);
+			}
+
+			addMatchResult(snapshot, thisFin, result);
 		}
 
-		if (tryMatch)
+		delete tempSnapshot;
+		tempSnapshot = NULL;
+
+		mCurrentFin++;
+
+		//***2.3 - write new match cache entries now and then, and at the end
+		if ((mCurrentFin >= (int)((useAbsoluteOffsets) ? mDatabase->sizeAbsolute() : mDatabase->size()))
+		    || (mNewCachedMatches.size() >= MATCH_CACHE_FLUSH_SIZE))
+			flushMatchCache();
+
+		if (useAbsoluteOffsets)
 		{
-			float timeTaken;
-			mseInfo result;
-			bool gotResult = true; // assume this unless error in switch below
+			if (mCurrentFin == (int)mDatabase->sizeAbsolute())
+				return 1.0;
+
+			return (float)mCurrentFin / mDatabase->sizeAbsolute();
+		}
+		else
+		{
+			if (mCurrentFin == (int)mDatabase->size())
+				return 1.0;
+
+			return (float)mCurrentFin / mDatabase->size();
+		}
+
+	} catch (...) {
+		delete tempSnapshot;
+		throw;
+	}
+}
+
+
+//*******************************************************************
+//
+// class MatchWork
+//
+//    ***2.3 - one block of database fins shared by the worker threads
+//    of matchFinBlock().  Slot i of results belongs to fins[i], which
+//    is the index of a database fin in the snapshot.
+//
+class MatchWork
+{
+	public:
+		Match *matcher;
+		int registrationMethod;
+		bool useFullFinError;
+		double abandonAbove;           // top-K threshold for the whole block
+
+		MatchSnapshot *snapshot;       // only read by the workers
+		std::vector<int> fins;
+		std::vector<mseInfo> results;
+		std::vector<char> cached;      // result was read from the match cache
+
+		int next;                      // next unclaimed fin, guarded by lock
+		bool failed;
+		std::string errorMsg;
+
+#ifdef WIN32
+		CRITICAL_SECTION lock;
+#else
+		pthread_mutex_t lock;
+#endif
+
+		MatchWork()
+		:	matcher(NULL),
+			registrationMethod(0),
+			useFullFinError(false),
+			abandonAbove(-1.0),
+			snapshot(NULL),
+			next(0),
+			failed(false)
+		{
+			// the lock is used even when the calling thread is the only worker
+#ifdef WIN32
+			InitializeCriticalSection(&lock);
+#else
+			pthread_mutex_init(&lock, NULL);
+#endif
+		}
+
+		~MatchWork()
+		{
+#ifdef WIN32
+			DeleteCriticalSection(&lock);
+#else
+			pthread_mutex_destroy(&lock);
+#endif
+		}
+};
+
+
+//*******************************************************************
+//
+// float Match::matchFinBlock(int registrationMethod, int regSegmentsUsed, 
+//                            bool categoryToMatch[], bool useFullFinError,
+//                            bool useAbsoluteOffsets, int numThreads)
+//
+//    ***2.3 - Parallel version of matchSingleFin().  Fetches the next block
+//    of database fins (a few per thread) and registers them against the
+//    unknown on a pool of worker threads, one per processor unless
+//    numThreads > 0.  The database (and its match snapshot) is only
+//    changed from the calling thread.
+//
+//    Results are added to mMatchResults in catalog order after all workers
+//    have finished, so the results (and rankings) are exactly those that
+//    repeated calls to matchSingleFin() would produce.  Workers never draw;
+//    if a display is set the last registration in the block is shown once
+//    the block is done.
+//
+//    RETURN: fraction of the database completed (1.0 when done)
+//
+float Match::matchFinBlock(int registrationMethod, int regSegmentsUsed, 
+                           bool categoryToMatch[], bool useFullFinError,
+                           bool useAbsoluteOffsets, int numThreads)
+{
+	if (numThreads <= 0)
+		numThreads = numberOfProcessors();
+
+	ProfileCollector collector(mMatchResults->getProfile()); //***2.3
+
+	int 
+		dbSize = (useAbsoluteOffsets) ? mDatabase->sizeAbsolute() : mDatabase->size(),
+		blockSize = 2 * numThreads;
 
-			//***043 JHS - select version of error finding function
-			switch (registrationMethod)
+	if (mCurrentFin >= dbSize)
+		return 1.0;
+
+	if (mMatchAddedOnly && ! useAbsoluteOffsets) //***2.3
+		throw Error("Match::matchFinBlock() matching added fins requires absolute offsets");
+
+	MatchWork work;
+	work.matcher = this;
+	work.registrationMethod = registrationMethod;
+	work.useFullFinError = useFullFinError;
+	work.abandonAbove = abandonThreshold(); // only updated between blocks
+
+	MatchSnapshot *tempSnapshot = NULL;
+
+	if (useAbsoluteOffsets)
+		work.snapshot = mDatabase->getMatchSnapshot();
+	else
+		work.snapshot = tempSnapshot = new MatchSnapshot(NULL); // see matchSingleFin()
+
+	try {
+
+		// fetch this block's fins on this thread, skipping holes in the 
+		// absolute offset list and fins in unselected categories
+
+		bool methodOK = registrationMethodSupported(registrationMethod);
+
+		//***2.3 - stage one of two stage matching, done once
+		if (shortlistPending())
+			buildShortlist(categoryToMatch, useAbsoluteOffsets);
+
+		if (useAbsoluteOffsets) //***2.3
+			listCategories(categoryToMatch);
+
+		while ((mCurrentFin < dbSize) && ((int)work.fins.size() < blockSize))
+		{
+			int thisFin;
+
+			if (useAbsoluteOffsets) //***2.3 - fins already matched are skipped like holes
+				thisFin = (addedSince(mCurrentFin) && inCategories(mCurrentFin)
+				           && inShortlist(mCurrentFin))
+				          ? work.snapshot->fetch(mCurrentFin) : -1;
+			else
 			{
-			case ORIGINAL_3_POINT :
-				// use beginning of leading edge, tip and largest trailing notch
-				// to map unknown outline to database outline, and then use
-				// version of meanSqError... that trims leading and trailing
-				// edge points to equalize number of points on eaach contour,
-				// and finally compute error between "corresponding" pairs of
-				// mapped points
-				result = Match::findErrorBetweenFins_Original3Point(thisDBFin, timeTaken);
-				break;
-			case TRIM_FIXED_PERCENT :
-				// use a series of calls to meanSqError..., each with different amounts
-				// of the leading edge of each fin "ignored" in order to find the BEST
-				// choice of "leading edge beginning point" correspondence.  This prevents
-				// "bulging" of outlines due to long or short placement of the
-				// beginning of the trace.  Also, the version of meanSqError... used
-				// is one that walks the unknown fin outline point by point, and 
-				// computes the "closest point" on the database outline by finding
-				// the intersection of a perpendicular from the unknown outline point.
-				// This helps minimize errors due to nonuniform point spacing created
-				// during the mapping process.
-				result = Match::findErrorBetweenFins(thisDBFin, timeTaken);
-				break;
-/*removed - JHS
-			case TRIM_OPTIMAL :
-				// use an optimization process (essentially Newton-Raphson) to
-				// shorten the leading edges of each fin to produce a correspondence
-				// that yeilds the BEST match.  A fin Outline walking approach
-				// is used to conpute the meanSqError....
-				result = Match::findErrorBetweenFinsJHS(
-							thisDBFin, timeTaken, regSegmentsUsed,
-							useFullFinError);
-				break;
-*/
-			case TRIM_OPTIMAL_TOTAL :
-				// use an optimization process (essentially Newton-Raphson) to
-				// shorten the leading AND trailing edges of each fin to produce a correspondence
-				// that yeilds the BEST match.  A fin Outline walking approach
-				// is used to compute the meanSqError....
-				//errorBetweenOutlines = meanSquaredErrorBetweenOutlineSegments; //***1.85 -- vc++6.0
-				errorBetweenOutlines = &Match::meanSquaredErrorBetweenOutlineSegments; //***1.85 -- vc++2011
-				// NOTE: error function MUST be set prior to following call
-				result = Match::findErrorBetweenFinsOptimal(
-							thisDBFin, timeTaken, /*regSegmentsUsed, */
-							false, false,
-							useFullFinError);
-				break;
-			case TRIM_OPTIMAL_TIP :
-				//errorBetweenOutlines = meanSquaredErrorBetweenOutlineSegments; //***1.85 -- vc++6.0
-				errorBetweenOutlines = &Match::meanSquaredErrorBetweenOutlineSegments; //***1.85 -- vc++2011
-				// NOTE: error function MUST be set prior to following call
-				result = Match::findErrorBetweenFinsOptimal(
-							thisDBFin, timeTaken, /*regSegmentsUsed, */
-							true, false, 
-							useFullFinError);
-				break;
-			case TRIM_OPTIMAL_AREA : //***1.85 - new area based metric option
-				//errorBetweenOutlines = areaBasedErrorBetweenOutlineSegments; //***1.85 -- vc++6.0
-				errorBetweenOutlines = &Match::areaBasedErrorBetweenOutlineSegments; //***1.85 -- vc++2011
-				// NOTE: error function MUST be set prior to following call
-				result = Match::findErrorBetweenFinsOptimal(
-							thisDBFin, timeTaken, /*regSegmentsUsed, */
-							true, false, 
-							useFullFinError);
-				break;
-			case TRIM_OPTIMAL_IN_OUT :
-			case TRIM_OPTIMAL_IN_OUT_TIP :
-			default :
-				gotResult = false;
+				DatabaseFin<ColorImage> *thisDBFin = mDatabase->getItem(mCurrentFin);
+				thisFin = tempSnapshot->addFin(thisDBFin, mCurrentFin);
+				delete thisDBFin;
 			}
 
-			if (gotResult)
+			if ((-1 != thisFin) && methodOK 
+			    && categorySelected(work.snapshot, thisFin, categoryToMatch)
+			    && inShortlist(mCurrentFin)) //***2.3
+				work.fins.push_back(thisFin);
+
+			mCurrentFin++;
+		}
+
+		work.results.resize(work.fins.size());
+		work.cached.resize(work.fins.size(), 0);
+
+		//***2.3 - results in the match cache are not registered again
+		bool useCache = methodOK && loadMatchCache(registrationMethod, useFullFinError);
+
+		if (useCache)
+			for (int i = 0; i < (int)work.fins.size(); i++)
+				work.cached[i] = findCachedMatch(work.snapshot, work.fins[i], work.results[i]);
+
+		runMatchWorkers(&work, numThreads);
+
+		if (work.failed)
+			throw Error(work.errorMsg);
+
+		// merge in catalog order
+
+		for (int i = 0; i < (int)work.fins.size(); i++)
+		{
+			if ((mMatchingDialog != NULL) && (i == (int)work.fins.size() - 1))
 			{
-				double errorBetweenFins = result.error; //***005CM
-
-				// Now, store the result
-				char errorTemp[20];
-				sprintf(errorTemp, "%6.2f", errorBetweenFins);
-
-				Result r(
-					result.c1, //***005CM
-					result.c2, //***005CM
-					thisDBFin->mImageFilename,  //***001DB
-					thisDBFin->mThumbnailPixmap, //***1.0
-					thisDBFin->mThumbnailRows,    //***1.0
-					mCurrentFin,
-					errorTemp,
-					thisDBFin->mIDCode,
-					thisDBFin->mName,
-					thisDBFin->mDamageCategory,
-					thisDBFin->mDateOfSighting,
-					thisDBFin->mLocationCode);
-
-				//***1.1 - set indices of beginning, tip and end points used in mapping
-				r.setMappingControlPoints(
-					result.b1,result.t1,result.e1,  // beginning, tip & end of unknown fin
-					result.b2,result.t2,result.e2); // beginning, tip & end of database fin
-
-				mMatchResults->addResult(r);
-
-				delete result.c1; //***1.3 - Mem Leak - delete here since Result() makes copy 
-				delete result.c2; //***1.3 - Mem Leak - delete here since Result() makes copy 
-
-				//delete thisDBFin; ///***1.6 - old location, did not delete fins not tried
+				// outlines only, registration is already done
+				mMatchingDialog->showOutlines(work.results[i].c1, work.results[i].c2);
 			}
+
+			if (useCache && ! work.cached[i])
+				noteCachedMatch(work.snapshot, work.fins[i], work.results[i]); //***2.3
+
+			addMatchResult(work.snapshot, work.fins[i], work.results[i]);
+		}
+
+		//***2.3 - write new match cache entries now and then, and at the end
+		if ((mCurrentFin >= dbSize) || (mNewCachedMatches.size() >= MATCH_CACHE_FLUSH_SIZE))
+			flushMatchCache();
+
+	} catch (...) {
+		delete tempSnapshot;
+		throw;
+	}
+
+	delete tempSnapshot;
+
+	if (mCurrentFin >= dbSize)
+		return 1.0;
+
+	return (float)mCurrentFin / dbSize;
+}
+
+
+//*******************************************************************
+//
+// bool Match::categorySelected(MatchSnapshot *snapshot, int i,
+//                              bool categoryToMatch[])
+//
+//    Returns true if the damage category of fin i of the snapshot is
+//    one of those selected for matching.
+//
+bool Match::categorySelected(MatchSnapshot *snapshot, int i, bool categoryToMatch[])
+{
+	return categorySelected(snapshot->damage(i), categoryToMatch);
+}
+
+//*******************************************************************
+//
+bool Match::categorySelected(const std::string &damage, bool categoryToMatch[])
+{
+	bool tryMatch = false;
+	for (int c = 0; (c < mDatabase->catCategoryNamesMax()) && (! tryMatch); c++)
+	{
+		tryMatch = (
+			(damage == mDatabase->catCategoryName(c)) && categoryToMatch[c]);
+	}
+	return tryMatch;
+}
+
+
+//*******************************************************************
+//
+// bool Match::registrationMethodSupported(int registrationMethod)
+//
+//    ***2.3 - Returns false for methods findErrorForMethod() cannot
+//    register with.  The optimal methods once set the error function
+//    (errorBetweenOutlines) here, but each now has its own instance of
+//    findErrorBetweenFinsOptimal() with the error metric built in.
+//
+bool Match::registrationMethodSupported(int registrationMethod)
+{
+	switch (registrationMethod)
+	{
+	case ORIGINAL_3_POINT :
+	case TRIM_FIXED_PERCENT :
+	case TRIM_OPTIMAL_TOTAL :
+	case TRIM_OPTIMAL_TIP :
+	case TRIM_OPTIMAL_AREA : //***1.85 - new area based metric option
+		return true;
+	case TRIM_OPTIMAL_IN_OUT :
+	case TRIM_OPTIMAL_IN_OUT_TIP :
+	default :
+		return false;
+	}
+}
+
+
+//*******************************************************************
+//
+// mseInfo Match::findErrorForMethod(int registrationMethod,
+//                                   SnapshotFin *dbFin,
+//                                   bool useFullFinError,
+//                                   double abandonAbove)
+//
+//    Registers the unknown to dbFin using the given method and returns
+//    the error and mapped outlines.  registrationMethodSupported() MUST
+//    have returned true for the method.  Only reads the Match object, so
+//    it may be called from several threads at once when no display is set.
+//
+//    abandonAbove > 0 lets the optimal methods stop early (see
+//    abandonThreshold()), other methods ignore it.
+//
+mseInfo Match::findErrorForMethod(
+		int registrationMethod,
+		SnapshotFin *dbFin,
+		bool useFullFinError,
+		double abandonAbove)
+{
+	PROFILE_PHASE(PHASE_REGISTER_FIN); //***2.3
+	float timeTaken;
+	mseInfo result;
+
+	//***043 JHS - select version of error finding function
+	switch (registrationMethod)
+	{
+	case ORIGINAL_3_POINT :
+		// use beginning of leading edge, tip and largest trailing notch
+		// to map unknown outline to database outline, and then use
+		// version of meanSqError... that trims leading and trailing
+		// edge points to equalize number of points on eaach contour,
+		// and finally compute error between "corresponding" pairs of
+		// mapped points
+		result = Match::findErrorBetweenFins_Original3Point(dbFin, timeTaken);
+		break;
+	case TRIM_FIXED_PERCENT :
+		// use a series of calls to meanSqError..., each with different amounts
+		// of the leading edge of each fin "ignored" in order to find the BEST
+		// choice of "leading edge beginning point" correspondence.  This prevents
+		// "bulging" of outlines due to long or short placement of the
+		// beginning of the trace.  Also, the version of meanSqError... used
+		// is one that walks the unknown fin outline point by point, and 
+		// computes the "closest point" on the database outline by finding
+		// the intersection of a perpendicular from the unknown outline point.
+		// This helps minimize errors due to nonuniform point spacing created
+		// during the mapping process.
+		result = Match::findErrorBetweenFins(dbFin, timeTaken);
+		break;
+	case TRIM_OPTIMAL_TOTAL :
+		// use an optimization process (essentially Newton-Raphson) to
+		// shorten the leading AND trailing edges of each fin to produce a correspondence
+		// that yeilds the BEST match.  A fin Outline walking approach
+		// is used to compute the meanSqError....
+		result = Match::findErrorBetweenFinsOptimal<MedialErrorMetric>( //***2.3
+					dbFin, timeTaken, /*regSegmentsUsed, */
+					false, false,
+					useFullFinError,
+					abandonAbove); //***2.3
+		break;
+	case TRIM_OPTIMAL_TIP :
+		result = Match::findErrorBetweenFinsOptimal<MedialErrorMetric>( //***2.3
+					dbFin, timeTaken, /*regSegmentsUsed, */
+					true, false, 
+					useFullFinError,
+					abandonAbove); //***2.3
+		break;
+	case TRIM_OPTIMAL_AREA : //***1.85 - new area based metric option
+		result = Match::findErrorBetweenFinsOptimal<AreaErrorMetric>( //***2.3
+					dbFin, timeTaken, /*regSegmentsUsed, */
+					true, false, 
+					useFullFinError,
+					abandonAbove); //***2.3
+		break;
+	default :
+		throw Error("Match::findErrorForMethod() unsupported registration method");
+	}
+
+	// methods without an optimization are ranked on their final error
+	if (result.optimizerError < 0.0)
+		result.optimizerError = result.error;
+
+	return result;
+}
+
+
+//*******************************************************************
+//
+// void Match::addMatchResult(MatchSnapshot *snapshot, int i,
+//                            mseInfo &result)
+//
+//    Stores the result of registering the unknown to fin i of the
+//    snapshot in mMatchResults and deletes the mapped outlines.
+//
+//    ***2.3 - in top-K mode a fin that was abandoned early is stored
+//    as not ranked, the others update the K best errors.
+//
+void Match::addMatchResult(MatchSnapshot *snapshot, int i, mseInfo &result)
+{
+	double errorBetweenFins = result.error; //***005CM
+
+	// Now, store the result
+	//***2.3 - the contours and thumbnail are no longer kept with every
+	// result, MatchResults loads them for the results that are displayed
+	Result r(
+		snapshot->imageFilename(i),  //***001DB
+		snapshot->finID(i),
+		errorBetweenFins, //***2.3 - was formatted "%6.2f" string
+		snapshot->idCode(i),
+		snapshot->name(i),
+		snapshot->damage(i),
+		snapshot->dateOfSighting(i),
+		snapshot->locationCode(i));
+
+	//***1.1 - set indices of beginning, tip and end points used in mapping
+	r.setMappingControlPoints(
+		result.b1,result.t1,result.e1,  // beginning, tip & end of unknown fin
+		result.b2,result.t2,result.e2); // beginning, tip & end of database fin
+
+	//***2.3 - and the transform MatchResults::loadContours() would solve for
+	// with them, which is saved in the binary results
+	FloatContour *unknownContour = mUnknownFin->mFinOutline->getFloatContour();
+	int
+		unknownLength = unknownContour->length(),
+		dbLength = snapshot->numPoints(i);
+
+	if ((result.b1 >= 0) && (result.t1 >= 0) && (result.e1 >= 0)
+	    && (result.b1 < unknownLength) && (result.t1 < unknownLength) && (result.e1 < unknownLength)
+	    && (result.b2 >= 0) && (result.t2 >= 0) && (result.e2 >= 0)
+	    && (result.b2 < dbLength) && (result.t2 < dbLength) && (result.e2 < dbLength))
+	{
+		const float
+			*x = snapshot->xCoords(i),
+			*y = snapshot->yCoords(i);
+		point_t dbTip, dbBegin, dbEnd;
+		dbTip.x = x[result.t2];    dbTip.y = y[result.t2];    dbTip.z = 0.0;
+		dbBegin.x = x[result.b2];  dbBegin.y = y[result.b2];  dbBegin.z = 0.0;
+		dbEnd.x = x[result.e2];    dbEnd.y = y[result.e2];    dbEnd.z = 0.0;
+
+		float coeff[2][3];
+		affineMapCoefficients(
+				(*unknownContour)[result.t1],
+				(*unknownContour)[result.b1],
+				(*unknownContour)[result.e1],
+				dbTip, dbBegin, dbEnd,
+				coeff);
+		r.setMappingCoefficients(coeff);
+	}
+
+	if (result.abandoned) //***2.3
+	{
+		r.setRanked(false);
+		mNumAbandoned++;
+	}
+	else if (mTopK > 0)
+		noteTopKError(result.optimizerError);
+
+	mMatchResults->addResult(r);
+
+	delete result.c1; //***1.3 - Mem Leak - Result() no longer keeps them
+	delete result.c2;
+	result.c1 = result.c2 = NULL;
+}
+
+
+//*******************************************************************
+//
+// Worker pool used by matchFinBlock().  Each worker repeatedly takes
+// the next unclaimed fin in the block and stores its result in the
+// slot with the same index, so no locking is needed for results.
+//
+#ifdef WIN32
+#define MATCH_LOCK(w)   EnterCriticalSection(&(w)->lock)
+#define MATCH_UNLOCK(w) LeaveCriticalSection(&(w)->lock)
+#else
+#define MATCH_LOCK(w)   pthread_mutex_lock(&(w)->lock)
+#define MATCH_UNLOCK(w) pthread_mutex_unlock(&(w)->lock)
+#endif
+
+void *matchWorkerThread(void *arg)
+{
+	MatchWork *work = (MatchWork *)arg;
+
+	//***2.3 - times are added to the results when the worker is done
+	ProfileCollector collector(work->matcher->mMatchResults->getProfile());
+
+	while (true)
+	{
+		MATCH_LOCK(work);
+		int i = work->next++;
+		bool stop = work->failed;
+		MATCH_UNLOCK(work);
+
+		if (stop || (i >= (int)work->fins.size()))
+			break;
+
+		if (work->cached[i]) //***2.3
+			continue;
+
+		try {
+			SnapshotFin dbFin(work->snapshot, work->fins[i]);
+			work->results[i] = work->matcher->findErrorForMethod(
+					work->registrationMethod, &dbFin, work->useFullFinError,
+					work->abandonAbove);
+		} catch (Error e) {
+			MATCH_LOCK(work);
+			work->failed = true;
+			work->errorMsg = e.errorString();
+			MATCH_UNLOCK(work);
+		} catch (...) {
+			MATCH_LOCK(work);
+			work->failed = true;
+			work->errorMsg = "Match::matchFinBlock() worker failed";
+			MATCH_UNLOCK(work);
 		}
+	}
+
+	return NULL;
+}
+
+#ifdef WIN32
+static DWORD WINAPI matchWorkerThreadWin32(LPVOID arg)
+{
+	matchWorkerThread(arg);
+	return 0;
+}
+#endif
+
+//*******************************************************************
+//
+// void Match::runMatchWorkers(MatchWork *work, int numThreads)
+//
+//    Runs numThreads workers over work->fins (the calling thread is
+//    one of them) and returns when every fin has been registered.
+//
+void Match::runMatchWorkers(MatchWork *work, int numThreads)
+{
+	if (numThreads > (int)work->fins.size())
+		numThreads = work->fins.size();
+
+	if (numThreads <= 1)
+	{
+		matchWorkerThread(work);
+		return;
+	}
+
+	// the display is not thread safe, so workers must never draw
+	MatchingDialog *display = mMatchingDialog;
+	mMatchingDialog = NULL;
+
+#ifdef WIN32
+	std::vector<HANDLE> threads(numThreads - 1);
+	for (int t = 0; t < numThreads - 1; t++)
+		threads[t] = CreateThread(NULL, 0, matchWorkerThreadWin32, work, 0, NULL);
+	matchWorkerThread(work);
+	WaitForMultipleObjects(threads.size(), &threads[0], TRUE, INFINITE);
+	for (int t = 0; t < numThreads - 1; t++)
+		CloseHandle(threads[t]);
+#else
+	std::vector<pthread_t> threads(numThreads - 1);
+	for (int t = 0; t < numThreads - 1; t++)
+		pthread_create(&threads[t], NULL, matchWorkerThread, work);
+	matchWorkerThread(work);
+	for (int t = 0; t < numThreads - 1; t++)
+		pthread_join(threads[t], NULL);
+#endif
+
+	mMatchingDialog = display;
+}
+
+
+//*******************************************************************
+//
+// int numberOfProcessors()
+//
+//    ***2.3 - number of online processors, used to size the worker pool
+//
+int numberOfProcessors()
+{
+#ifdef WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	int n = info.dwNumberOfProcessors;
+#else
+	int n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return (n < 1) ? 1 : n;
+}
+
+//*******************************************************************
+//
+// double wallClockSeconds()
+//
+//    ***2.3 - Elapsed (not CPU) time, so match times stay meaningful
+//    when the catalog is matched on several threads.
+//
+double wallClockSeconds()
+{
+#ifdef WIN32
+	return GetTickCount() / 1000.0;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+
+//*******************************************************************
+//
+// void Match::setTopK(int k)
+//
+//    ***2.3 - Turns top-K mode on (k > 0) or off (k <= 0) for the fins
+//    not yet matched.  In top-K mode the optimal registration methods
+//    stop optimizing a fin once it is clear it will not rank in the
+//    top k, and the fin is kept in the results as not ranked.
+//
+void Match::setTopK(int k)
+{
+	mTopK = (k > 0) ? k : 0;
+
+	// keep the k best of the errors seen so far
+	while ((int)mTopKErrors.size() > mTopK)
+	{
+		pop_heap(mTopKErrors.begin(), mTopKErrors.end());
+		mTopKErrors.pop_back();
+	}
+}
+
+//*******************************************************************
+//
+int Match::getTopK() const
+{
+	return mTopK;
+}
+
+//*******************************************************************
+//
+int Match::getNumAbandoned() const
+{
+	return mNumAbandoned;
+}
+
+//*******************************************************************
+//
+// double Match::abandonThreshold() const
+//
+//    ***2.3 - Optimizer error above which a fin may be abandoned, or
+//    -1.0 if none may be (top-K mode off, or fewer than K fins matched).
+//
+double Match::abandonThreshold() const
+{
+	if ((mTopK <= 0) || ((int)mTopKErrors.size() < mTopK))
+		return -1.0;
+
+	return TOP_K_ABANDON_RATIO * mTopKErrors.front(); // K-th best
+}
+
+//*******************************************************************
+//
+// void Match::noteTopKError(double error)
+//
+//    ***2.3 - mTopKErrors is a max-heap of the mTopK best optimizer
+//    errors, so its front is the K-th best.
+//
+void Match::noteTopKError(double error)
+{
+	if ((int)mTopKErrors.size() < mTopK)
+	{
+		mTopKErrors.push_back(error);
+		push_heap(mTopKErrors.begin(), mTopKErrors.end());
+	}
+	else if (error < mTopKErrors.front())
+	{
+		pop_heap(mTopKErrors.begin(), mTopKErrors.end());
+		mTopKErrors.back() = error;
+		push_heap(mTopKErrors.begin(), mTopKErrors.end());
+	}
+}
+
+
+//*******************************************************************
+//
+// void Match::setShortlistFraction(float fraction)
+//
+//    ***2.3 - fraction <= 0 or >= 1 registers every selected fin
+//
+void Match::setShortlistFraction(float fraction)
+{
+	if ((fraction <= 0.0f) || (fraction >= 1.0f))
+		mShortlistFraction = 0.0f;
+	else
+		mShortlistFraction = fraction;
+}
+
+//*******************************************************************
+//
+int Match::getShortlistSize() const
+{
+	return mShortlistSize;
+}
+
+//*******************************************************************
+//
+int Match::getNumPrefilterCandidates() const
+{
+	return mNumPrefilterCandidates;
+}
+
+//*******************************************************************
+//
+int Match::getPrefilterTrueRank() const
+{
+	return mPrefilterTrueRank;
+}
+
+//*******************************************************************
+//
+// void Match::buildShortlist(bool categoryToMatch[], bool useAbsoluteOffsets)
+//
+//    ***2.3 - Stage one of two stage matching.  Ranks every catalog fin
+//    in the selected categories by the distance between its shape
+//    descriptor and that of the unknown, and marks the best
+//    mShortlistFraction of them (at least one) for registration.
+//    Catalog positions are absolute offsets or list positions, as for
+//    matchSingleFin().  The outline index, when set and available, is
+//    asked instead (see buildNearestShortlist()).
+//
+void Match::buildShortlist(bool categoryToMatch[], bool useAbsoluteOffsets)
+{
+	mShortlistBuilt = true;
+
+	if ((mNearestCandidates > 0) && useAbsoluteOffsets
+	    && buildNearestShortlist(categoryToMatch))
+		return;
+
+	int dbSize = (useAbsoluteOffsets) ? mDatabase->sizeAbsolute() : mDatabase->size();
+
+	if (mShortlistFraction <= 0.0f)
+	{
+		// no index to ask, so every fin is registered
+		mInShortlist.assign(dbSize, 1);
+		return;
+	}
+
+	shapeDescriptor(
+			mUnknownFin->mFinOutline->getFloatContour(),
+			mUnknownBeginLE,
+			mUnknownTipPosition,
+			mUnknownEndTE,
+			mUnknownDescriptor);
+
+	// (descriptor distance, catalog position) of each candidate
+	std::vector<std::pair<float,int> > candidates;
+	std::vector<char> hasUnknownID(dbSize, 0);
+
+	if (useAbsoluteOffsets)
+	{
+		// these fins are needed in the snapshot for registration anyway
+		MatchSnapshot *snapshot = mDatabase->getMatchSnapshot();
+
+		listCategories(categoryToMatch);
+
+		for (int pos = 0; pos < dbSize; pos++)
+		{
+			int i = (inCategories(pos)) ? snapshot->fetch(pos) : -1;
+
+			if ((-1 == i) || ! categorySelected(snapshot, i, categoryToMatch))
+				continue;
+
+			candidates.push_back(std::make_pair(
+					shapeDescriptorDistance(mUnknownDescriptor, snapshot->descriptor(i)),
+					pos));
+
+			hasUnknownID[pos] = caseInsensitiveStringCompare(
+					snapshot->idCode(i), mUnknownFin->mIDCode);
+		}
+	}
+	else
+	{
+		float descriptor[SHAPE_DESCRIPTOR_SIZE];
+
+		for (int pos = 0; pos < dbSize; pos++)
+		{
+			DatabaseFin<ColorImage> *fin = mDatabase->getItem(pos);
+
+			if (categorySelected(fin->mDamageCategory, categoryToMatch))
+			{
+				try {
+					shapeDescriptor(
+							fin->mFinOutline->getFloatContour(),
+							fin->mFinOutline->getFeaturePoint(LE_BEGIN),
+							fin->mFinOutline->getFeaturePoint(TIP),
+							fin->mFinOutline->getFeaturePoint(POINT_OF_INFLECTION),
+							descriptor);
+				} catch (...) {
+					delete fin;
+					throw;
+				}
+
+				candidates.push_back(std::make_pair(
+						shapeDescriptorDistance(mUnknownDescriptor, descriptor),
+						pos));
+
+				hasUnknownID[pos] = caseInsensitiveStringCompare(
+						fin->mIDCode, mUnknownFin->mIDCode);
+			}
+
+			delete fin;
+		}
+	}
+
+	// ties go to the earlier catalog position
+	sort(candidates.begin(), candidates.end());
+
+	mNumPrefilterCandidates = candidates.size();
+
+	mShortlistSize = (int)ceil(mShortlistFraction * mNumPrefilterCandidates);
+	if ((mShortlistSize < 1) && (mNumPrefilterCandidates > 0))
+		mShortlistSize = 1;
+
+	mInShortlist.assign(dbSize, 0);
+	mPrefilterTrueRank = -1;
+
+	for (int r = 0; r < mNumPrefilterCandidates; r++)
+	{
+		int pos = candidates[r].second;
+
+		if (r < mShortlistSize)
+			mInShortlist[pos] = 1;
+
+		if ((-1 == mPrefilterTrueRank) && hasUnknownID[pos])
+			mPrefilterTrueRank = r + 1;
+	}
+
+	mMatchResults->setShortlist(mShortlistSize, mNumPrefilterCandidates);
+}
+
+//*******************************************************************
+//
+// bool Match::inShortlist(int position) const
+//
+//    ***2.3 - true if the fin at this catalog position is to be
+//    registered, always true without the prefilter
+//
+bool Match::inShortlist(int position) const
+{
+	if (! mShortlistBuilt)
+		return true;
+
+	return (position < (int)mInShortlist.size()) && mInShortlist[position];
+}
+
+//*******************************************************************
+//
+// void Match::setNearestCandidates(int m)
+//
+//    ***2.3 - m <= 0 turns the outline index prefilter off
+//
+void Match::setNearestCandidates(int m)
+{
+	mNearestCandidates = (m > 0) ? m : 0;
+}
+
+//*******************************************************************
+//
+int Match::getNearestCandidates() const
+{
+	return mNearestCandidates;
+}
+
+//*******************************************************************
+//
+// bool Match::shortlistPending() const
+//
+//    ***2.3 - true if stage one of two stage matching is wanted and has
+//    not been done yet
+//
+bool Match::shortlistPending() const
+{
+	return ((mShortlistFraction > 0.0f) || (mNearestCandidates > 0)) && ! mShortlistBuilt;
+}
+
+//*******************************************************************
+//
+// bool Match::buildNearestShortlist(bool categoryToMatch[])
+//
+//    ***2.3 - Stage one of two stage matching by outline index.  Marks
+//    the mNearestCandidates fins nearest the unknown, of those in the
+//    selected categories (and added since, see matchAddedSince()), by
+//    absolute position.  Fins the index has no embedding for cannot be
+//    ranked, so are always registered.  Returns false, and marks
+//    nothing, if the database has no index or the unknown's outline
+//    cannot be embedded.
+//
+bool Match::buildNearestShortlist(bool categoryToMatch[])
+{
+	OutlineIndex *index = mDatabase->getOutlineIndex();
+
+	if (NULL == index)
+		return false;
+
+	float embedding[OUTLINE_EMBEDDING_SIZE];
+
+	if (! outlineEmbedding(
+			mUnknownFin->mFinOutline->getFloatContour(),
+			mUnknownBeginLE,
+			mUnknownTipPosition,
+			mUnknownEndTE,
+			embedding))
+		return false;
+
+	int dbSize = mDatabase->sizeAbsolute();
+
+	listCategories(categoryToMatch);
+
+	std::vector<char> accept(dbSize, 0);
+	for (int pos = 0; pos < dbSize; pos++)
+		accept[pos] = addedSince(pos) && inCategories(pos);
+
+	std::vector<int> nearest;
+	index->nearest(embedding, mNearestCandidates, accept, &nearest);
+
+	mInShortlist.assign(dbSize, 0);
+
+	for (int i = 0; i < (int)nearest.size(); i++)
+		mInShortlist[nearest[i]] = 1;
+
+	int numUnindexed = 0;
+	const std::vector<int> &unindexed = index->unindexed();
+
+	for (int i = 0; i < (int)unindexed.size(); i++)
+		if ((unindexed[i] < dbSize) && accept[unindexed[i]])
+		{
+			mInShortlist[unindexed[i]] = 1;
+			numUnindexed++;
+		}
+
+	mShortlistSize = nearest.size() + numUnindexed;
+	mNumPrefilterCandidates = index->numAccepted(accept) + numUnindexed;
+
+	// rank of the best catalog fin with the unknown's ID, for the recall
+	std::vector<int> withID;
+	mDatabase->getFinsWithID(mUnknownFin->mIDCode, &withID);
+	mPrefilterTrueRank = index->rank(embedding, withID, accept);
+
+	mMatchResults->setShortlist(mShortlistSize, mNumPrefilterCandidates);
+
+	return true;
+}
+
+
+//*******************************************************************
+//
+// bool Match::matchAddedSince(MatchResults *previous)
+//
+//    ***2.3 - Copies the previous results of fins that have not changed
+//    into this match, and limits matching to the fins that have been
+//    added or updated since.  Results of fins deleted since are
+//    dropped.  The previous results are not changed.
+//
+bool Match::matchAddedSince(MatchResults *previous)
+{
+	if (NULL == previous)
+		throw EmptyArgumentError("Match::matchAddedSince() [MatchResults *previous]");
+
+	if (mCurrentFin > 0)
+		throw Error("Match::matchAddedSince() called after matching started");
+
+	int generation = previous->getCatalogGeneration();
+
+	if ((generation < 0) || (mDatabase->catalogGeneration() < 0))
+		return false;
+
+	std::vector<int> positions;
+	mDatabase->getFinsAddedSince(generation, &positions);
+
+	mAddedSince.assign(mDatabase->sizeAbsolute(), 0);
+	mNumAddedFins = 0;
+
+	for (int i = 0; i < (int)positions.size(); i++)
+	{
+		if ((positions[i] >= 0) && (positions[i] < (int)mAddedSince.size()))
+		{
+			mAddedSince[positions[i]] = 1;
+			mNumAddedFins++;
+		}
+	}
+
+	// fins deleted since are dropped, the snapshot remembers the holes
+	MatchSnapshot *snapshot = mDatabase->getMatchSnapshot();
+
+	for (int i = 0; i < previous->size(); i++)
+	{
+		Result *r = previous->getResultNum(i);
+		int pos = r->getPosition();
+
+		if ((pos < 0) || (pos >= (int)mAddedSince.size()) || (-1 == snapshot->fetch(pos)))
+			continue;
+
+		if (! mAddedSince[pos])
+			mMatchResults->addResult(*r);
+	}
+
+	mMatchAddedOnly = true;
+
+	return true;
+}
+
+//*******************************************************************
+//
+int Match::getNumAddedFins() const
+{
+	return mNumAddedFins;
+}
+
+//*******************************************************************
+//
+// bool Match::addedSince(int position) const
+//
+//    ***2.3 - true if the fin at this absolute position is to be
+//    matched, always true unless matchAddedSince() has been called
+//
+bool Match::addedSince(int position) const
+{
+	if (! mMatchAddedOnly)
+		return true;
+
+	return (position >= 0) && (position < (int)mAddedSince.size()) && mAddedSince[position];
+}
+
+//*******************************************************************
+//
+// void Match::listCategories(bool categoryToMatch[])
+//
+//    ***2.3 - Asks the database which fins are in the selected damage
+//    categories (an indexed query for SQLite catalogs), so that fins in
+//    the others are never loaded.  Only asks again if the selection has
+//    changed.  The category of each fin loaded is still checked, as it
+//    always was, so a database that cannot tell costs nothing extra.
+//
+void Match::listCategories(bool categoryToMatch[])
+{
+	int numCategories = mDatabase->catCategoryNamesMax();
+
+	std::vector<char> selection(numCategories, 0);
+	for (int c = 0; c < numCategories; c++)
+		selection[c] = categoryToMatch[c];
+
+	if (! mListedCategories.empty() && (selection == mListedCategories))
+		return; // asked already
+
+	mListedCategories = selection;
+	mInCategories.clear();
+	mCategoriesListed = false;
+
+	std::vector<int> positions;
+	if (! mDatabase->getFinsInCategories(categoryToMatch, &positions))
+		return;
+
+	mInCategories.assign(mDatabase->sizeAbsolute(), 0);
+	for (int i = 0; i < (int)positions.size(); i++)
+		if ((positions[i] >= 0) && (positions[i] < (int)mInCategories.size()))
+			mInCategories[positions[i]] = 1;
+
+	mCategoriesListed = true;
+}
+
+//*******************************************************************
+//
+// bool Match::inCategories(int position) const
+//
+//    ***2.3 - false if the fin at this absolute position is known to be
+//    in an unselected category.  Fins added since the list was made are
+//    loaded and checked.
+//
+bool Match::inCategories(int position) const
+{
+	if (! mCategoriesListed || (position < 0) || (position >= (int)mInCategories.size()))
+		return true;
+
+	return (0 != mInCategories[position]);
+}
+
+//*******************************************************************
+//
+// bool Match::prepareRegistration(int registrationMethod)
+//
+//    ***2.3 - Selects the error function once, before any thread calls
+//    registerSnapshotFin().
+//
+bool Match::prepareRegistration(int registrationMethod)
+{
+	return registrationMethodSupported(registrationMethod);
+}
+
+//*******************************************************************
+//
+// double Match::registerSnapshotFin(int registrationMethod,
+//                                   MatchSnapshot *snapshot, int i,
+//                                   bool useFullFinError)
+//
+//    ***2.3 - Same registration and error as matchFinBlock(), but the
+//    mapped outlines are thrown away and nothing is kept in the results,
+//    the match cache or the top-K errors, so only the Match is read.
+//
+double Match::registerSnapshotFin(
+		int registrationMethod,
+		MatchSnapshot *snapshot,
+		int i,
+		bool useFullFinError)
+{
+	if (NULL == snapshot)
+		throw EmptyArgumentError("Match::registerSnapshotFin() [MatchSnapshot *snapshot]");
+
+	if ((i < 0) || (i >= snapshot->size()))
+		throw BoundsError("Match::registerSnapshotFin()");
+
+	SnapshotFin dbFin(snapshot, i);
+	mseInfo result = findErrorForMethod(registrationMethod, &dbFin, useFullFinError);
+
+	delete result.c1;
+	delete result.c2;
+
+	return result.error;
+}
+
+//*******************************************************************
+//
+// int Match::prepareSlices(int registrationMethod, bool categoryToMatch[],
+//                          bool useFullFinError, int sliceSize)
+//
+//    ***2.3 - Selects every catalog fin not yet matched that
+//    matchFinBlock() would register, in catalog order, and fills in the
+//    results found in the match cache.  The mapped outlines are not kept,
+//    as there is no display to show them.  Returns the number of slices.
+//
+int Match::prepareSlices(int registrationMethod, bool categoryToMatch[],
+                         bool useFullFinError, int sliceSize)
+{
+	if (sliceSize < 1)
+		throw InvalidArgumentError("Match::prepareSlices() [int sliceSize]");
+
+	deleteSliceWork();
+
+	mSliceWork = new MatchWork();
+	mSliceWork->matcher = this;
+	mSliceWork->registrationMethod = registrationMethod;
+	mSliceWork->useFullFinError = useFullFinError;
+	mSliceWork->snapshot = mDatabase->getMatchSnapshot();
+	mSliceSize = sliceSize;
+
+	bool methodOK = registrationMethodSupported(registrationMethod);
+
+	if (shortlistPending())
+		buildShortlist(categoryToMatch, true);
+
+	int dbSize = mDatabase->sizeAbsolute();
+
+	listCategories(categoryToMatch);
+
+	for (; mCurrentFin < dbSize; mCurrentFin++)
+	{
+		int thisFin = (addedSince(mCurrentFin) && inCategories(mCurrentFin)
+		               && inShortlist(mCurrentFin))
+		              ? mSliceWork->snapshot->fetch(mCurrentFin) : -1;
+
+		if ((-1 != thisFin) && methodOK
+		    && categorySelected(mSliceWork->snapshot, thisFin, categoryToMatch)
+		    && inShortlist(mCurrentFin))
+			mSliceWork->fins.push_back(thisFin);
+	}
+
+	int numFins = mSliceWork->fins.size();
+
+	mSliceWork->results.resize(numFins);
+	mSliceWork->cached.resize(numFins, 0);
+
+	mSliceUseCache = methodOK && loadMatchCache(registrationMethod, useFullFinError);
+
+	for (int i = 0; i < numFins; i++)
+	{
+		mseInfo &result = mSliceWork->results[i];
+
+		if (mSliceUseCache && findCachedMatch(mSliceWork->snapshot, mSliceWork->fins[i], result))
+		{
+			mSliceWork->cached[i] = 1;
+
+			delete result.c1;
+			delete result.c2;
+			result.c1 = result.c2 = NULL;
+
+			// cached errors set the top-K threshold from the start
+			if (mTopK > 0)
+				noteTopKError(result.optimizerError);
+		}
+	}
+
+	return (numFins + sliceSize - 1) / sliceSize;
+}
+
+//*******************************************************************
+//
+// void Match::registerSlice(int slice, double abandonAbove)
+//
+//    ***2.3 - Registers the fins of one slice that were not in the
+//    cache.  Only reads the Match object and writes the results of this
+//    slice, so different slices may be registered at the same time.
+//
+void Match::registerSlice(int slice, double abandonAbove)
+{
+	if (NULL == mSliceWork)
+		throw Error("Match::registerSlice() prepareSlices() was not called");
+
+	int
+		first = slice * mSliceSize,
+		last = first + mSliceSize;
+
+	if ((slice < 0) || (first >= (int)mSliceWork->fins.size()))
+		throw BoundsError("Match::registerSlice()");
+
+	if (last > (int)mSliceWork->fins.size())
+		last = mSliceWork->fins.size();
+
+	registerSliceFins(first, last, abandonAbove);
+}
+
+//*******************************************************************
+//
+void Match::noteSliceErrors(int slice)
+{
+	if (NULL == mSliceWork)
+		return;
+
+	int
+		first = slice * mSliceSize,
+		last = first + mSliceSize;
+
+	if (last > (int)mSliceWork->fins.size())
+		last = mSliceWork->fins.size();
+
+	noteSliceFinErrors(first, last);
+}
+
+//*******************************************************************
+//
+// void Match::registerCatalogRange(int first, int end, double abandonAbove)
+//
+//    ***2.3 - As registerSlice(), for the fins at catalog positions first
+//    to end - 1.  Different ranges may be registered at the same time.
+//
+void Match::registerCatalogRange(int first, int end, double abandonAbove)
+{
+	if (NULL == mSliceWork)
+		throw Error("Match::registerCatalogRange() prepareSlices() was not called");
+
+	int firstFin, endFin;
+	sliceFins(first, end, firstFin, endFin);
+
+	registerSliceFins(firstFin, endFin, abandonAbove);
+}
+
+//*******************************************************************
+//
+void Match::noteCatalogRangeErrors(int first, int end)
+{
+	if (NULL == mSliceWork)
+		return;
+
+	int firstFin, endFin;
+	sliceFins(first, end, firstFin, endFin);
+
+	noteSliceFinErrors(firstFin, endFin);
+}
+
+//*******************************************************************
+//
+// void Match::sliceFins(int first, int end, int &firstFin, int &endFin) const
+//
+//    ***2.3 - The selected fins at catalog positions first to end - 1 are
+//    mSliceWork->fins[firstFin] to [endFin - 1], as prepareSlices()
+//    selects them in catalog order.
+//
+void Match::sliceFins(int first, int end, int &firstFin, int &endFin) const
+{
+	const std::vector<int> &fins = mSliceWork->fins;
+	MatchSnapshot *snapshot = mSliceWork->snapshot;
+
+	int lo = 0, hi = fins.size();
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (snapshot->finID(fins[mid]) < first)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	firstFin = lo;
+
+	hi = fins.size();
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (snapshot->finID(fins[mid]) < end)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	endFin = lo;
+}
+
+//*******************************************************************
+//
+void Match::registerSliceFins(int firstFin, int endFin, double abandonAbove)
+{
+	ProfileCollector collector(mMatchResults->getProfile());
+
+	for (int i = firstFin; i < endFin; i++)
+	{
+		if (mSliceWork->cached[i])
+			continue;
+
+		SnapshotFin dbFin(mSliceWork->snapshot, mSliceWork->fins[i]);
+		mseInfo &result = mSliceWork->results[i];
+
+		result = findErrorForMethod(
+				mSliceWork->registrationMethod, &dbFin,
+				mSliceWork->useFullFinError, abandonAbove);
+
+		delete result.c1;
+		delete result.c2;
+		result.c1 = result.c2 = NULL;
+	}
+}
+
+//*******************************************************************
+//
+void Match::noteSliceFinErrors(int firstFin, int endFin)
+{
+	if (mTopK <= 0)
+		return;
+
+	for (int i = firstFin; i < endFin; i++)
+		if (! mSliceWork->cached[i] && ! mSliceWork->results[i].abandoned)
+			noteTopKError(mSliceWork->results[i].optimizerError);
+}
+
+//*******************************************************************
+//
+// void Match::finishSlices()
+//
+//    ***2.3 - Adds the results of every slice in catalog order, as
+//    matchFinBlock() does for a block, and writes the new cache entries.
+//
+void Match::finishSlices()
+{
+	if (NULL == mSliceWork)
+		return;
+
+	// addMatchResult() notes each error again
+	mTopKErrors.clear();
+
+	for (int i = 0; i < (int)mSliceWork->fins.size(); i++)
+	{
+		if (mSliceUseCache && ! mSliceWork->cached[i])
+			noteCachedMatch(mSliceWork->snapshot, mSliceWork->fins[i], mSliceWork->results[i]);
+
+		addMatchResult(mSliceWork->snapshot, mSliceWork->fins[i], mSliceWork->results[i]);
+	}
+
+	flushMatchCache();
+
+	deleteSliceWork();
+}
+
+//*******************************************************************
+//
+void Match::deleteSliceWork()
+{
+	if (NULL == mSliceWork)
+		return;
+
+	for (int i = 0; i < (int)mSliceWork->results.size(); i++)
+	{
+		delete mSliceWork->results[i].c1;
+		delete mSliceWork->results[i].c2;
+	}
+
+	delete mSliceWork;
+	mSliceWork = NULL;
+}
+
+//*******************************************************************
+//
+void Match::setCoarseToFine(bool use)
+{
+	mCoarseToFine = use;
+}
+
+//*******************************************************************
+//
+bool Match::getCoarseToFine() const
+{
+	return mCoarseToFine;
+}
+
+//*******************************************************************
+//
+void Match::setUseMatchCache(bool use)
+{
+	mUseMatchCache = use;
+}
+
+//*******************************************************************
+//
+int Match::getNumCacheHits() const
+{
+	return mNumCacheHits;
+}
+
+//*******************************************************************
+//
+// bool Match::loadMatchCache(int registrationMethod, bool useFullFinError)
+//
+//    ***2.3 - Reads the cached results for the unknown and this method
+//    from the database the first time it is called (and again if the
+//    method changes).  Results of coarse-to-fine registration are kept
+//    apart from the others.  Returns false if results are not to be cached:
+//    the cache is off, or the method is not one of the optimal methods,
+//    whose mapped outline is rebuilt from the control points alone.
+//
+bool Match::loadMatchCache(int registrationMethod, bool useFullFinError)
+{
+	if (! mUseMatchCache)
+		return false;
+
+	switch (registrationMethod)
+	{
+	case TRIM_OPTIMAL_TOTAL :
+	case TRIM_OPTIMAL_TIP :
+	case TRIM_OPTIMAL_AREA :
+		break;
+	default :
+		return false;
+	}
+
+	int cacheMethod = registrationMethod;
+	if (mCoarseToFine)
+		cacheMethod += COARSE_TO_FINE_CACHE_METHOD;
+
+	if (mMatchCacheLoaded 
+	    && (mMatchCacheMethod == cacheMethod)
+	    && (mMatchCacheFullFinError == useFullFinError))
+		return true;
+
+	flushMatchCache(); // entries for the previous method, if any
+
+	if (mUnknownHash.empty())
+	{
+		int features[] = {
+				mUnknownBeginLE, mUnknownEndLE, mUnknownNotchPosition,
+				mUnknownTipPosition, mUnknownEndTE};
+
+		mUnknownHash = outlineHash(mUnknownFin->mFinOutline->getFloatContour(), features, 5);
+	}
+
+	mCachedMatches.clear();
+	mDatabase->getCachedMatches(mUnknownHash, cacheMethod, useFullFinError, &mCachedMatches);
+
+	mMatchCacheLoaded = true;
+	mMatchCacheMethod = cacheMethod;
+	mMatchCacheFullFinError = useFullFinError;
+
+	return true;
+}
+
+//*******************************************************************
+//
+// bool Match::findCachedMatch(MatchSnapshot *snapshot, int i,
+//                             mseInfo &result)
+//
+//    ***2.3 - If the result of registering the unknown to fin i of the
+//    snapshot is in the cache, and the fin's outline has not changed
+//    since, fills in result (with new mapped outlines, as
+//    findErrorForMethod() would) and returns true.
+//
+bool Match::findCachedMatch(MatchSnapshot *snapshot, int i, mseInfo &result)
+{
+	map<int, MatchCacheEntry>::const_iterator it = mCachedMatches.find(snapshot->dataPos(i));
 
-		delete thisDBFin; //***1.6 - moved here to fix memory leak
+	if (it == mCachedMatches.end())
+		return false;
 
-		mCurrentFin++;
+	const MatchCacheEntry &entry = it->second;
 
-		if (useAbsoluteOffsets)
-		{
-			if (mCurrentFin == (int)mDatabase->sizeAbsolute())
-				return 1.0;
+	FloatContour *unknownContour = mUnknownFin->mFinOutline->getFloatContour();
 
-			return (float)mCurrentFin / mDatabase->sizeAbsolute();
-		}
-		else
-		{
-			if (mCurrentFin == (int)mDatabase->size())
-				return 1.0;
+	int
+		unknownLength = unknownContour->length(),
+		dbLength = snapshot->numPoints(i);
+
+	if ((entry.outlineHash != snapshot->outlineHash(i))
+	    || (entry.b1 < 0) || (entry.t1 < 0) || (entry.e1 < 0)
+	    || (entry.b1 >= unknownLength) || (entry.t1 >= unknownLength) || (entry.e1 >= unknownLength)
+	    || (entry.b2 < 0) || (entry.t2 < 0) || (entry.e2 < 0)
+	    || (entry.b2 >= dbLength) || (entry.t2 >= dbLength) || (entry.e2 >= dbLength))
+		return false;
+
+	result.c2 = snapshot->newFloatContour(i);
+	result.c1 = mapContour(
+			unknownContour,
+			(*unknownContour)[entry.t1],
+			(*unknownContour)[entry.b1],
+			(*unknownContour)[entry.e1],
+			(*result.c2)[entry.t2],
+			(*result.c2)[entry.b2],
+			(*result.c2)[entry.e2]);
+
+	result.error = entry.error;
+	result.optimizerError = entry.optimizerError;
+	result.abandoned = false;
+	result.b1 = entry.b1;
+	result.t1 = entry.t1;
+	result.e1 = entry.e1;
+	result.b2 = entry.b2;
+	result.t2 = entry.t2;
+	result.e2 = entry.e2;
+
+	mNumCacheHits++;
+
+	return true;
+}
 
-			return (float)mCurrentFin / mDatabase->size();
-		}
+//*******************************************************************
+//
+// void Match::noteCachedMatch(MatchSnapshot *snapshot, int i,
+//                             const mseInfo &result)
+//
+//    ***2.3 - Queues the result of registering the unknown to fin i of
+//    the snapshot for the cache.  Results of optimizations abandoned in
+//    top-K mode are not final, so they are not kept.
+//
+void Match::noteCachedMatch(MatchSnapshot *snapshot, int i, const mseInfo &result)
+{
+	if (result.abandoned)
+		return;
+
+	MatchCacheEntry entry;
+
+	entry.individualID = snapshot->dataPos(i);
+	entry.outlineHash = snapshot->outlineHash(i);
+	entry.error = result.error;
+	entry.optimizerError = result.optimizerError;
+	entry.b1 = result.b1;
+	entry.t1 = result.t1;
+	entry.e1 = result.e1;
+	entry.b2 = result.b2;
+	entry.t2 = result.t2;
+	entry.e2 = result.e2;
+
+	mNewCachedMatches.push_back(entry);
+	mCachedMatches[entry.individualID] = entry;
+}
 
-	} catch (...) {
-		throw;
-	}
+//*******************************************************************
+//
+// void Match::flushMatchCache()
+//
+//    ***2.3 - Writes the queued cache entries to the database.  Entries
+//    still queued when matching is cancelled are simply lost.
+//
+void Match::flushMatchCache()
+{
+	if (mNewCachedMatches.empty())
+		return;
+
+	mDatabase->putCachedMatches(
+			mUnknownHash, mMatchCacheMethod, mMatchCacheFullFinError,
+			mNewCachedMatches);
+
+	mNewCachedMatches.clear();
 }
 
 
@@ -339,19 +1908,19 @@ MatchResults* Match::getMatchResults()
 //    Invoked using ORIGINAL_3_POINT mathing_method
 //
 mseInfo Match::findErrorBetweenFins_Original3Point(
-		DatabaseFin<ColorImage> *dbFin,
+		SnapshotFin *dbFin, //***2.3
 		float &timeTaken)
 {
 	if (NULL == dbFin)
-		throw EmptyArgumentError("Match::findErrorBetweenFins [DatabaseFin<ColorImage> *dbFin]");
+		throw EmptyArgumentError("Match::findErrorBetweenFins [SnapshotFin *dbFin]");
 
 	try {
 
 		int dbTipPosition, dbBeginLE, dbNotchPosition;
 
-		dbTipPosition = dbFin->mFinOutline->getFeaturePoint(TIP); //***008OL
-		dbBeginLE = dbFin->mFinOutline->getFeaturePoint(LE_BEGIN); //***008OL
-		dbNotchPosition = dbFin->mFinOutline->getFeaturePoint(NOTCH); //***008OL
+		dbTipPosition = dbFin->getFeaturePoint(TIP); //***008OL
+		dbBeginLE = dbFin->getFeaturePoint(LE_BEGIN); //***008OL
+		dbNotchPosition = dbFin->getFeaturePoint(NOTCH); //***008OL
 
 		point_t
 			dbTipPositionPoint,
@@ -359,9 +1928,9 @@ mseInfo Match::findErrorBetweenFins_Original3Point(
 			dbNotchPositionPoint;
 			//temp; //***005CM for unsure code section below
 
-		dbTipPositionPoint = dbFin->mFinOutline->getFeaturePointCoords(TIP); //***008OL
-		dbBeginLEPoint = dbFin->mFinOutline->getFeaturePointCoords(LE_BEGIN); //***008OL
-		dbNotchPositionPoint = dbFin->mFinOutline->getFeaturePointCoords(NOTCH); //***008OL
+		dbTipPositionPoint = dbFin->getFeaturePointCoords(TIP); //***008OL
+		dbBeginLEPoint = dbFin->getFeaturePointCoords(LE_BEGIN); //***008OL
+		dbNotchPositionPoint = dbFin->getFeaturePointCoords(NOTCH); //***008OL
 		
 
 		FloatContour *mappedContour = mapContour(
@@ -382,7 +1951,7 @@ mseInfo Match::findErrorBetweenFins_Original3Point(
 		 *     since we are NOT evenly re-spacing either after the mapping.  
 		 */
 
-		FloatContour *floatDBContour = new FloatContour(*(dbFin->mFinOutline->getFloatContour()));
+		FloatContour *floatDBContour = new FloatContour(*(dbFin->getFloatContour()));
 
 		//***1.5 - since contour may get trimmed by error function, create temp copies here
 		FloatContour 
@@ -405,7 +1974,7 @@ mseInfo Match::findErrorBetweenFins_Original3Point(
 		results.c2 = floatDBContour;
 		results.b2 = dbBeginLE;
 		results.t2 = dbTipPosition;
-		results.e2 = dbFin->mFinOutline->getFeaturePoint(POINT_OF_INFLECTION);
+		results.e2 = dbFin->getFeaturePoint(POINT_OF_INFLECTION);
 
 		//***1.5 - now delete the temp contours
 		delete c1;
@@ -434,22 +2003,22 @@ mseInfo Match::findErrorBetweenFins_Original3Point(
 //    of the 13 trials is returned.
 //
 mseInfo Match::findErrorBetweenFins(
-		DatabaseFin<ColorImage> *dbFin,
+		SnapshotFin *dbFin, //***2.3
 		float &timeTaken)
 {
 	if (NULL == dbFin)
-		throw EmptyArgumentError("Match::findErrorBetweenFins [DatabaseFin<ColorImage> *dbFin]");
+		throw EmptyArgumentError("Match::findErrorBetweenFins [SnapshotFin *dbFin]");
 
 	try {
 		//Chain *dbChain = new Chain(dbFin->mFinContour, 3.0); removed ***008OL
 
 		int dbTipPosition, dbBeginLE, dbNotchPosition;
 
-		dbTipPosition = dbFin->mFinOutline->getFeaturePoint(TIP); //***008OL
-		dbBeginLE = dbFin->mFinOutline->getFeaturePoint(LE_BEGIN); //***008OL
-		dbNotchPosition = dbFin->mFinOutline->getFeaturePoint(NOTCH); //***008OL
+		dbTipPosition = dbFin->getFeaturePoint(TIP); //***008OL
+		dbBeginLE = dbFin->getFeaturePoint(LE_BEGIN); //***008OL
+		dbNotchPosition = dbFin->getFeaturePoint(NOTCH); //***008OL
 
-		int dbEndTE = dbFin->mFinOutline->getFeaturePoint(POINT_OF_INFLECTION); //***055ER
+		int dbEndTE = dbFin->getFeaturePoint(POINT_OF_INFLECTION); //***055ER
 
 		point_t
 			dbTipPositionPoint,
@@ -457,11 +2026,11 @@ mseInfo Match::findErrorBetweenFins(
 			dbNotchPositionPoint;
 			//temp; //***005CM for unsure code section below
 
-		dbTipPositionPoint = dbFin->mFinOutline->getFeaturePointCoords(TIP); //***008OL
-		dbBeginLEPoint = dbFin->mFinOutline->getFeaturePointCoords(LE_BEGIN); //***008OL
-		dbNotchPositionPoint = dbFin->mFinOutline->getFeaturePointCoords(NOTCH); //***008OL
+		dbTipPositionPoint = dbFin->getFeaturePointCoords(TIP); //***008OL
+		dbBeginLEPoint = dbFin->getFeaturePointCoords(LE_BEGIN); //***008OL
+		dbNotchPositionPoint = dbFin->getFeaturePointCoords(NOTCH); //***008OL
 																		 
-		FloatContour *floatDBContour = new FloatContour(*(dbFin->mFinOutline->getFloatContour())); //***006CM, 008OL
+		FloatContour *floatDBContour = new FloatContour(*(dbFin->getFloatContour())); //***006CM, 008OL
 
 		//***008OL new strategy 
 		// follows strategy of stepping along database fin and finding "closest"
@@ -488,7 +2057,7 @@ mseInfo Match::findErrorBetweenFins(
 
 		FloatContour *preMapUnknown = new FloatContour(*(mUnknownFin->mFinOutline->getFloatContour()));
          
-		FloatContour *mappedContour;
+		FloatContour *mappedContour = NULL; //***2.3 - reused for each walk
 
 		double newError; //***1.0LK
 
@@ -582,14 +2151,18 @@ mseInfo Match::findErrorBetweenFins(
 			startLeadUnkPt = (*preMapUnknown)[startLeadUnk];
 			startLeadDBPt = (*floatDBContour)[startLeadDB];
 
-			mappedContour = mapContour(
+			if (NULL == mappedContour)
+				mappedContour = new FloatContour();
+
+			mapContour(
 					preMapUnknown,
 					mUnknownTipPositionPoint,
 					startLeadUnkPt,
 					mUnknownNotchPositionPoint,
 					dbTipPositionPoint,
 					startLeadDBPt,
-					dbNotchPositionPoint);
+					dbNotchPositionPoint,
+					mappedContour);
 
 			newError = meanSquaredErrorBetweenOutlineSegments/*Medial*/(
 						mappedContour,
@@ -682,6 +2255,7 @@ mseInfo Match::findErrorBetweenFins(
 			{
 				// initialize database contour and error for result
 				results.c1 = mappedContour;
+				mappedContour = NULL;
 				results.error = newError;
 				//***1.5 - set shifted feature point locations
 				results.b1 = startLeadUnk;
@@ -689,22 +2263,22 @@ mseInfo Match::findErrorBetweenFins(
 			}
 			else if (newError < results.error)
 			{
-				//***1.0LK - delete existing mapped contour and replace with new
+				//***1.0LK - replace existing mapped contour with new
 				// mapped contour and error
-				delete results.c1;
+				//***2.3 - the old one becomes the buffer for the next walk
+				FloatContour *worse = results.c1;
 				results.c1 = mappedContour;
+				mappedContour = worse;
 				results.error = newError;
 				//***1.5 - set shifted feature point locations
 				results.b1 = startLeadUnk;
 				results.b2 = startLeadDB;
 			}
-			else 
-			{
-				//***1.0LK - delete the most recently mapped contour - we don't need it
-				delete mappedContour;
-			}
+			//***2.3 - otherwise the most recently mapped contour is simply
+			// overwritten by the next walk
 		}
 
+		delete mappedContour; //***2.3
 		delete preMapUnknown; //***1.0LK
 
 		// both evenly spaced contours are returned as part of results
@@ -1063,6 +2637,49 @@ mseInfo Match::meanSquaredErrorBetweenOutlines( //***005CM
 }
 
 
+//***2.3 - the trial moves tested on each step of the optimization below,
+// the last two only when the tip may move
+enum {
+	SHORTEN_DB_LEAD = 0,
+	SHORTEN_UNK_LEAD,
+	SHORTEN_DB_TRAIL,
+	SHORTEN_UNK_TRAIL,
+	SHIFT_TIP_TO_LEAD,
+	SHIFT_TIP_TO_TRAIL,
+	NUM_TRIAL_MOVES
+};
+
+//*******************************************************************
+//
+// static int coarseToFineLevel(int testIncUnk, int onePercentUnk,
+//                              int testIncDB, int onePercentDB,
+//                              int numLevels)
+//
+//    ***2.3 - The outline pyramid level at which the optimization below
+//    tests and makes its moves, for coarse-to-fine registration.  It is
+//    one level coarser for each doubling of both test increments beyond
+//    twice their final size (1% of the leading edge), so the first moves
+//    (8% tests, 16% jumps) are made on every 4th point, and the last two
+//    halvings at full resolution.
+//
+static int coarseToFineLevel(
+		int testIncUnk, 
+		int onePercentUnk, 
+		int testIncDB, 
+		int onePercentDB,
+		int numLevels)
+{
+	int level = 0;
+
+	while ((level + 1 < numLevels) 
+	       && (onePercentUnk > 0) && (testIncUnk >= (4 << level) * onePercentUnk)
+	       && (onePercentDB > 0) && (testIncDB >= (4 << level) * onePercentDB))
+		level++;
+
+	return level;
+}
+
+
 //***************************begin****************************************
 //
 // mseInfo Match::findErrorBetweenFinsOptimal(
@@ -1071,22 +2688,31 @@ mseInfo Match::meanSquaredErrorBetweenOutlines( //***005CM
 //    leading and trailing edges based on best of 4 options at each step
 //    in process.
 //
+//    ***2.3 - ErrorMetric gives the error between the mapped unknown and
+//    the database outline (see MedialErrorMetric in Match.h).  With
+//    coarse-to-fine registration, the moves are made on coarser levels
+//    of the two outline pyramids while the test increments are large
+//    (see coarseToFineLevel()), the error of the current mapping being
+//    found again each time the level changes.
+//
+template <class ErrorMetric>
 mseInfo Match::findErrorBetweenFinsOptimal(
-		DatabaseFin<ColorImage> *dbFin,
+		SnapshotFin *dbFin, //***2.3
 		float &timeTaken,
 		//int regSegmentsUsed,
 		bool moveTip, //***1.1
 		bool moveEndsInAndOut, //***1.1
-		bool useFullFinError) //***055ER
+		bool useFullFinError, //***055ER
+		double abandonAbove) //***2.3 - top-K mode
 {
 	if (NULL == dbFin)
-		throw EmptyArgumentError("Match::findErrorBetweenFins [DatabaseFin<ColorImage> *dbFin]");
+		throw EmptyArgumentError("Match::findErrorBetweenFins [SnapshotFin *dbFin]");
 
 	try {
 
 		//***1.85 - new function pointer to generalize algorithm
 		// errorBetweenOutlines = meanSquaredErrorBetweenOutlineSegments;
-		// this is actually set prior to calling this function
+		//***2.3 - now an ErrorMetric, made below for this database fin
 
 		int 
 			dbTipPosition, 
@@ -1094,10 +2720,10 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 			dbNotchPosition, 
 			dbEndTE;
 
-		dbTipPosition = dbFin->mFinOutline->getFeaturePoint(TIP);
-		dbBeginLE = dbFin->mFinOutline->getFeaturePoint(LE_BEGIN);
-		dbNotchPosition = dbFin->mFinOutline->getFeaturePoint(NOTCH);
-		dbEndTE = dbFin->mFinOutline->getFeaturePoint(POINT_OF_INFLECTION);
+		dbTipPosition = dbFin->getFeaturePoint(TIP);
+		dbBeginLE = dbFin->getFeaturePoint(LE_BEGIN);
+		dbNotchPosition = dbFin->getFeaturePoint(NOTCH);
+		dbEndTE = dbFin->getFeaturePoint(POINT_OF_INFLECTION);
 
 		point_t
 			dbTipPositionPoint,
@@ -1105,20 +2731,48 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 			dbNotchPositionPoint,
 			dbEndTEPoint;
 
-		dbTipPositionPoint = dbFin->mFinOutline->getFeaturePointCoords(TIP);
-		dbBeginLEPoint = dbFin->mFinOutline->getFeaturePointCoords(LE_BEGIN);
-		dbNotchPositionPoint = dbFin->mFinOutline->getFeaturePointCoords(NOTCH);
-		dbEndTEPoint = dbFin->mFinOutline->getFeaturePointCoords(POINT_OF_INFLECTION);
+		dbTipPositionPoint = dbFin->getFeaturePointCoords(TIP);
+		dbBeginLEPoint = dbFin->getFeaturePointCoords(LE_BEGIN);
+		dbNotchPositionPoint = dbFin->getFeaturePointCoords(NOTCH);
+		dbEndTEPoint = dbFin->getFeaturePointCoords(POINT_OF_INFLECTION);
 		
-		FloatContour *floatDBContour = new FloatContour(*(dbFin->mFinOutline->getFloatContour()));
+		FloatContour *floatDBContour = new FloatContour(*(dbFin->getFloatContour()));
+
+		ErrorMetric errorBetweenOutlines(this, floatDBContour); //***2.3
 
 		FloatContour *preMapUnknown = new FloatContour(*(mUnknownFin->mFinOutline->getFloatContour()));
 
+		//***2.3 - every trial mapping below is made and measured by
+		// registrationError, at full resolution unless coarse-to-fine
+		// registration is on
+		int numLevels = mCoarseToFine ? OUTLINE_PYRAMID_LEVELS : 1;
+
 		FloatContour 
-			*mappedContour = NULL, 
-			*shortenedDBMappedContour = NULL, 
-			*shortenedUnkMappedContour = NULL,
-			*shiftedUnkTipMappedContour = NULL; //***1.1
+			*unknownLevels[OUTLINE_PYRAMID_LEVELS],
+			*dbLevels[OUTLINE_PYRAMID_LEVELS];
+
+		unknownLevels[0] = preMapUnknown;
+		dbLevels[0] = floatDBContour;
+
+		for (int level = 1; level < numLevels; level++)
+		{
+			unknownLevels[level] = mUnknownLevelContour[level - 1];
+			dbLevels[level] = dbFin->getFloatContour(level);
+		}
+
+		PyramidRegistration<ErrorMetric> registrationError(
+				this, errorBetweenOutlines, unknownLevels, dbLevels, numLevels);
+
+		//***2.3 - every trial mapping below is written into one of these
+		// buffers, so after the first iteration the optimization no longer
+		// allocates contours
+		FloatContour 
+			*mappedContour = new FloatContour(), 
+			*moveMappedContours[NUM_TRIAL_MOVES], // one per trial move
+			*jumpMappedContour = new FloatContour();
+
+		for (int m = 0; m < NUM_TRIAL_MOVES; m++)
+			moveMappedContours[m] = new FloatContour();
 
 		mseInfo results;
 
@@ -1208,21 +2862,14 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 
 		// create initial mapping, using ENTIRE fin contour
 
-		mappedContour = mapContour(
-				preMapUnknown,
-				mUnknownTipPositionPoint,
-				(*preMapUnknown)[startLeadUnk],
-				(*preMapUnknown)[endTrailUnk],
-				dbTipPositionPoint,
-				(*floatDBContour)[startLeadDB],
-				(*floatDBContour)[endTrailDB]);
+		registrationError.setLevel(coarseToFineLevel( //***2.3
+				testIncUnk, onePercentUnk, testIncDB, onePercentDB, numLevels));
 
-		error = (*this.*errorBetweenOutlines)(
+		error = registrationError( //***2.3
 				mappedContour,
 				startLeadUnk,
 				movedTipUnk, //***1.85
 				endTrailUnk,
-				floatDBContour,
 				startLeadDB,
 				dbTipPosition, //***1.85
 				endTrailDB);
@@ -1262,215 +2909,96 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 
 		bool foundBest = false;
 		bool skipThisJump = false; //***1.1
+		int iterations = 0; //***2.3
       
 		while (! foundBest)
 		{
-			// shorten DATABASE leading edge by 1% and test error
-   
-			if (NULL != shortenedDBMappedContour)
-			{
-				delete shortenedDBMappedContour;
-				shortenedDBMappedContour = NULL;
-			}
-
-			shortenedDBMappedContour = mapContour(
-					preMapUnknown,
-					//mUnknownTipPositionPoint,    //***1.1
-					(*preMapUnknown)[movedTipUnk], //***1.1 - only changes if (moveTip == true)
-					(*preMapUnknown)[startLeadUnk],
-					(*preMapUnknown)[endTrailUnk],
-					dbTipPositionPoint,
-					(*floatDBContour)[startLeadDB+/*onePercentDB*/testIncDB], //***1.5
-					(*floatDBContour)[endTrailDB]);
-
-			shortenedDBLeadError = (*this.*errorBetweenOutlines)(
-					shortenedDBMappedContour,
-					startLeadUnk,
-					movedTipUnk, //***1.85
-					endTrailUnk,
-					floatDBContour,
-					startLeadDB+/*onePercentDB*/testIncDB, //***1.5
-					dbTipPosition, //***1.85
-					endTrailDB);
-
-			if (mMatchingDialog != NULL)
-			{
-				// show the display of the outline registration in the dialog
-				mMatchingDialog->showOutlines(shortenedDBMappedContour,floatDBContour);
-			}
-
-			// shorten UNKNOWN leading edge by 1% and test error
-
-			if (NULL != shortenedUnkMappedContour)
-			{
-				delete shortenedUnkMappedContour;
-				shortenedUnkMappedContour = NULL;
-			}
-
-			shortenedUnkMappedContour = mapContour(
-					preMapUnknown,
-					//mUnknownTipPositionPoint,    //***1.1
-					(*preMapUnknown)[movedTipUnk], //***1.1 - only changes if (moveTip == true)
-					(*preMapUnknown)[startLeadUnk+/*onePercentUnk*/testIncUnk], //***1.5
-					(*preMapUnknown)[endTrailUnk],
-					dbTipPositionPoint,
-					(*floatDBContour)[startLeadDB],
-					(*floatDBContour)[endTrailDB]);
-
-			shortenedUnkLeadError = (*this.*errorBetweenOutlines)(
-					shortenedUnkMappedContour,
-					startLeadUnk+/*onePercentUnk*/testIncUnk, //***1.5
-					movedTipUnk, //***1.85
-					endTrailUnk,
-					floatDBContour,
-					startLeadDB,
-					dbTipPosition, //***1.85
-					endTrailDB);
+			//***2.3 - coarse-to-fine, move on to a finer level of the outline
+			// pyramids once the test increments have shrunk enough
+			int level = coarseToFineLevel(
+					testIncUnk, onePercentUnk, testIncDB, onePercentDB, numLevels);
 
-			if (mMatchingDialog != NULL)
+			if (level != registrationError.getLevel())
 			{
-				// show the display of the outline registration in the dialog
-				mMatchingDialog->showOutlines(shortenedUnkMappedContour,floatDBContour);
-			}
+				registrationError.setLevel(level);
 
-			// shorten DATABASE trailing edge by 1% and test error
-
-			if (NULL != shortenedDBMappedContour)
-			{
-				delete shortenedDBMappedContour;
-				shortenedDBMappedContour = NULL;
+				error = registrationError(
+						mappedContour,
+						startLeadUnk,
+						movedTipUnk,
+						endTrailUnk,
+						startLeadDB,
+						dbTipPosition,
+						endTrailDB);
 			}
 
-			shortenedDBMappedContour = mapContour(
-					preMapUnknown,
-					//mUnknownTipPositionPoint,    //***1.1
-					(*preMapUnknown)[movedTipUnk], //***1.1 - only changes if (moveTip == true)
-					(*preMapUnknown)[startLeadUnk],
-					(*preMapUnknown)[endTrailUnk],
-					dbTipPositionPoint,
-					(*floatDBContour)[startLeadDB],
-					(*floatDBContour)[endTrailDB-/*onePercentDB*/testIncDB]); //***1.5
-
-			shortenedDBTrailError = (*this.*errorBetweenOutlines)(
-					shortenedDBMappedContour,
-					startLeadUnk,
-					movedTipUnk, //***1.85
-					endTrailUnk,
-					floatDBContour,
-					startLeadDB,
-					dbTipPosition, //***1.85
-					endTrailDB-/*onePercentDB*/testIncDB); //***1.5
-
-			if (mMatchingDialog != NULL)
+			//***2.3 - in top-K mode stop optimizing a fin that is still far
+			// worse than the K-th best fin after a few steps, the mapping
+			// found so far is used for its final error
+			if ((abandonAbove > 0.0) && (iterations >= TOP_K_MIN_ITERATIONS) 
+			    && (error > abandonAbove))
 			{
-				// show the display of the outline registration in the dialog
-				mMatchingDialog->showOutlines(shortenedDBMappedContour,floatDBContour);
+				results.abandoned = true;
+				break;
 			}
+			iterations++;
+
+			//***2.3 - the trial moves are mapped together in one pass over the
+			// unknown's points, and then measured
+
+			registrationMove_t moves[NUM_TRIAL_MOVES] = {
+				// shorten DATABASE leading edge by 1%
+				{startLeadUnk, movedTipUnk, endTrailUnk, 
+				 startLeadDB+/*onePercentDB*/testIncDB, dbTipPosition, endTrailDB}, //***1.5
+				// shorten UNKNOWN leading edge by 1%
+				{startLeadUnk+/*onePercentUnk*/testIncUnk, movedTipUnk, endTrailUnk, //***1.5
+				 startLeadDB, dbTipPosition, endTrailDB},
+				// shorten DATABASE trailing edge by 1%
+				{startLeadUnk, movedTipUnk, endTrailUnk, 
+				 startLeadDB, dbTipPosition, endTrailDB-/*onePercentDB*/testIncDB}, //***1.5
+				// shorten UNKNOWN trailing edge by 1%
+				{startLeadUnk, movedTipUnk, endTrailUnk-/*onePercentUnk*/testIncUnk, //***1.5
+				 startLeadDB, dbTipPosition, endTrailDB},
+				// shift UNKNOWN tip by 1% toward LEBegin
+				{startLeadUnk, movedTipUnk-testIncUnk, endTrailUnk, 
+				 startLeadDB, dbTipPosition, endTrailDB},
+				// shift UNKNOWN tip by 1% toward TEEnd
+				{startLeadUnk, movedTipUnk+testIncUnk, endTrailUnk, 
+				 startLeadDB, dbTipPosition, endTrailDB}};
 
-			// shorten UNKNOWN trailing edge by 1% and test error
+			// shift UNKNOWN tip by 1% and compute error (test both directions)
+			bool tryTipShifts = moveTip && (jumpSizeUnk <= tipMoveThreshold);
 
-			if (NULL != shortenedUnkMappedContour)
-			{
-				delete shortenedUnkMappedContour;
-				shortenedUnkMappedContour = NULL;
-			}
+			double moveErrors[NUM_TRIAL_MOVES];
 
-			shortenedUnkMappedContour = mapContour(
-					preMapUnknown,
-					//mUnknownTipPositionPoint,    //***1.1
-					(*preMapUnknown)[movedTipUnk], //***1.1 - only changes if (moveTip == true)
-					(*preMapUnknown)[startLeadUnk],
-					(*preMapUnknown)[endTrailUnk-/*onePercentUnk*/testIncUnk], //***1.5
-					dbTipPositionPoint,
-					(*floatDBContour)[startLeadDB],
-					(*floatDBContour)[endTrailDB]);
+			registrationError.measureMoves(
+					tryTipShifts ? NUM_TRIAL_MOVES : SHIFT_TIP_TO_LEAD, 
+					moves, moveMappedContours, moveErrors);
 
-			shortenedUnkTrailError = (*this.*errorBetweenOutlines)(
-					shortenedUnkMappedContour,
-					startLeadUnk,
-					movedTipUnk, //***1.85
-					endTrailUnk-/*onePercentUnk*/testIncUnk, //***1.5
-					floatDBContour,
-					startLeadDB,
-					dbTipPosition, //***1.85
-					endTrailDB);
+			shortenedDBLeadError = moveErrors[SHORTEN_DB_LEAD];
+			shortenedUnkLeadError = moveErrors[SHORTEN_UNK_LEAD];
+			shortenedDBTrailError = moveErrors[SHORTEN_DB_TRAIL];
+			shortenedUnkTrailError = moveErrors[SHORTEN_UNK_TRAIL];
 
 			if (mMatchingDialog != NULL)
 			{
-				// show the display of the outline registration in the dialog
-				mMatchingDialog->showOutlines(shortenedUnkMappedContour,floatDBContour);
+				// show the display of the outline registrations in the dialog
+				for (int m = SHORTEN_DB_LEAD; m <= SHORTEN_UNK_TRAIL; m++)
+					mMatchingDialog->showOutlines(moveMappedContours[m],floatDBContour);
 			}
 
-			// shift UNKNOWN tip by 1% and compute error (test both directions)
-
-			if (moveTip && (jumpSizeUnk <= tipMoveThreshold))
+			if (tryTipShifts)
 			{
-				double shift2LeadError, shift2TrailError;
-
-				// shift Tip toward LEBegin
-
-				if (NULL != shiftedUnkTipMappedContour)
-				{
-					delete shiftedUnkTipMappedContour;
-					shiftedUnkTipMappedContour = NULL;
-				}
-
-				shiftedUnkTipMappedContour = mapContour(
-						preMapUnknown,
-						(*preMapUnknown)[movedTipUnk-/*onePercentUnk*/testIncUnk], //***1.5
-						(*preMapUnknown)[startLeadUnk],
-						(*preMapUnknown)[endTrailUnk],
-						dbTipPositionPoint,
-						(*floatDBContour)[startLeadDB],
-						(*floatDBContour)[endTrailDB]);
-
-				shift2LeadError = (*this.*errorBetweenOutlines)(
-						shiftedUnkTipMappedContour,
-						startLeadUnk,
-						movedTipUnk-testIncUnk, //***1.85
-						endTrailUnk,
-						floatDBContour,
-						startLeadDB,
-						dbTipPosition, //***1.85
-						endTrailDB);
-
-				// shift Tip toward TEEnd
-
-				if (NULL != shiftedUnkTipMappedContour)
-				{
-					delete shiftedUnkTipMappedContour;
-					shiftedUnkTipMappedContour = NULL;
-				}
-
-				shiftedUnkTipMappedContour = mapContour(
-						preMapUnknown,
-						(*preMapUnknown)[movedTipUnk+/*onePercentUnk*/testIncUnk], //***1.5
-						(*preMapUnknown)[startLeadUnk],
-						(*preMapUnknown)[endTrailUnk],
-						dbTipPositionPoint,
-						(*floatDBContour)[startLeadDB],
-						(*floatDBContour)[endTrailDB]);
-
-				shift2TrailError = (*this.*errorBetweenOutlines)(
-						shiftedUnkTipMappedContour,
-						startLeadUnk,
-						movedTipUnk+testIncUnk, //***1.85
-						endTrailUnk,
-						floatDBContour,
-						startLeadDB,
-						dbTipPosition, //***1.85
-						endTrailDB);
-
 				// keep best shift to compare to end shifts
 
-				if (shift2LeadError < shift2TrailError)
+				if (moveErrors[SHIFT_TIP_TO_LEAD] < moveErrors[SHIFT_TIP_TO_TRAIL])
 				{
-					movedTipUnkError = shift2LeadError;
+					movedTipUnkError = moveErrors[SHIFT_TIP_TO_LEAD];
 					movedTipShift = - jumpSizeUnk;
 				} 
 				else
 				{
-					movedTipUnkError = shift2TrailError;
+					movedTipUnkError = moveErrors[SHIFT_TIP_TO_TRAIL];
 					movedTipShift = jumpSizeUnk;
 				}
 			}
@@ -1689,37 +3217,18 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 			{
 				// make a big jump in direction of indicated improvement
 
-				FloatContour *jumpMappedContour = NULL;
 				double jumpError;
 				bool goodJump = false;
 
 				do
 				{
 					// we only end up here more than once when the jump has been too far
-					// in which case there is a contour to be deleted
-
-					if (NULL != jumpMappedContour)
-					{
-						delete jumpMappedContour;
-						jumpMappedContour = NULL;
-					}
 
-					jumpMappedContour = mapContour(
-							preMapUnknown,
-							//mUnknownTipPositionPoint,
-							(*preMapUnknown)[jumpShiftTipUnk], //***1.1
-							(*preMapUnknown)[jumpStartLeadUnk],
-							(*preMapUnknown)[jumpEndTrailUnk],
-							dbTipPositionPoint,
-							(*floatDBContour)[jumpStartLeadDB],
-							(*floatDBContour)[jumpEndTrailDB]);
-
-					jumpError = (*this.*errorBetweenOutlines)(
+					jumpError = registrationError( //***2.3
 		   					jumpMappedContour,
 							jumpStartLeadUnk,
 							jumpShiftTipUnk, //***1.85
 							jumpEndTrailUnk,
-							floatDBContour,
 							jumpStartLeadDB,
 							dbTipPosition, //***1.85
 							jumpEndTrailDB);
@@ -1809,13 +3318,6 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 				} 
 				while (! goodJump && (jumpSizeDB > 0) && (jumpSizeUnk > 0));
 
-				// free the jumpMappedCotour now that we are done
-				if (NULL != jumpMappedContour)
-				{
-					delete jumpMappedContour;
-					jumpMappedContour = NULL;
-				}
-        
 				if ((jumpSizeDB == 0) || (jumpSizeUnk == 0))
 				{
 					// we've run out of space to adjust so we've found the best
@@ -1837,27 +3339,34 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 
 		// at this point all other mapped contours need to be deleted
 
-		if (NULL != shortenedDBMappedContour)
-		{
-			delete shortenedDBMappedContour;
-			shortenedDBMappedContour = NULL;
-		}
-		if (NULL != shortenedUnkMappedContour)
+		for (int m = 0; m < NUM_TRIAL_MOVES; m++) //***2.3
 		{
-			delete shortenedUnkMappedContour;
-			shortenedUnkMappedContour = NULL;
+			delete moveMappedContours[m];
+			moveMappedContours[m] = NULL;
 		}
-		if (NULL != shiftedUnkTipMappedContour)
-		{
-			delete shiftedUnkTipMappedContour;
-			shiftedUnkTipMappedContour = NULL;
-		}
-		if (NULL != mappedContour)
+		delete jumpMappedContour; //***2.3
+		jumpMappedContour = NULL;
+
+		//***2.3 - the optimization may stop before coarse-to-fine registration
+		// reaches full resolution
+		if (0 != registrationError.getLevel())
 		{
-			delete mappedContour;
-			mappedContour = NULL;
+			registrationError.setLevel(0);
+
+			error = registrationError(
+					mappedContour,
+					startLeadUnk,
+					movedTipUnk,
+					endTrailUnk,
+					startLeadDB,
+					dbTipPosition,
+					endTrailDB);
 		}
 
+		results.optimizerError = error; //***2.3
+
+		PROFILE_COUNT(COUNT_OPTIMIZER_ITERATIONS, iterations); //***2.3
+
 		// beginning of leading edge point to use for FINAL MATCH
 		// using TOTAL outlines, not just leading edges
 		startLeadUnkPt = (*preMapUnknown)[startLeadUnk];
@@ -1867,7 +3376,8 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 		endTrailUnkPt = (*preMapUnknown)[endTrailUnk];
 		endTrailDBPt = (*floatDBContour)[endTrailDB];
 
-		mappedContour = mapContour(
+		//***2.3 - mappedContour is kept and handed back in results
+		mapContour(
 				preMapUnknown,
 				//mUnknownTipPositionPoint,
 				(*preMapUnknown)[movedTipUnk], //***1.1
@@ -1875,7 +3385,8 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 				endTrailUnkPt, // changed
 				dbTipPositionPoint,
 				startLeadDBPt,
-				endTrailDBPt); // changed
+				endTrailDBPt, // changed
+				mappedContour);
 
 		// set coutour pointers
 		results.c1 = mappedContour;
@@ -1899,14 +3410,13 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 		if (useFullFinError)
 		{
 			//cout << "Full Fin Error computed!\n";
-			results.error = (*this.*errorBetweenOutlines)(
+			results.error = errorBetweenOutlines(
 					mappedContour,
 					//mUnknownBeginLE, // old limits
 					//mUnknownEndTE,   // old limits
 					startLeadUnk,
 					movedTipUnk, //***1.85
 					endTrailUnk,
-					floatDBContour,
 					//dbBeginLE,       // old limits
 					//dbEndTE);        // old limits
 					startLeadDB,
@@ -1916,12 +3426,11 @@ mseInfo Match::findErrorBetweenFinsOptimal(
 		else
 		{
 			//cout << "Trailing Edge Only Error computed!\n";
-			results.error = (*this.*errorBetweenOutlines)(
+			results.error = errorBetweenOutlines(
 					mappedContour,
 					movedTipUnk,    //***1.5 - testing trailing edge only for final rankings
 					movedTipUnk, //***1.85
 					endTrailUnk,
-					floatDBContour,
 					dbTipPosition,  //***1.5 - testing trailing edge only for final rankings
 					dbTipPosition, //***1.85
 					endTrailDB);
@@ -1988,6 +3497,7 @@ double Match::meanSquaredErrorBetweenOutlineSegmentsNew(
       int start2,
 		int tip2)
 {
+	PROFILE_PHASE(PHASE_ERROR_MSE); //***2.3
 
    double error;
 
@@ -2188,6 +3698,7 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 		int begin2,
 		int end2)
 {
+	PROFILE_PHASE(PHASE_ERROR_MSE); //***2.3
 
 	double error;
 
@@ -2406,6 +3917,7 @@ double Match::meanSquaredErrorBetweenOutlineSegmentsMedial(
 		int begin2,
 		int end2)
 {
+	PROFILE_PHASE(PHASE_ERROR_MSE); //***2.3
 
 	double 
 		error = 50000.0,
@@ -2514,7 +4026,50 @@ double Match::meanSquaredErrorBetweenOutlineSegmentsMedial(
 
 //*******************************************************************
 //
-// double Match::meanSquaredErrorBetweenOutlineSegmentsMedial(...)
+// static void segmentLengths(const float *x, const float *y, int n,
+//                            double *segLen)
+//
+//    ***2.3 - segLen[k] is the length of the segment entering point k
+//    (segLen[0] is 0).  The differences are taken in float and the rest
+//    in double, exactly as the original per-point code did, so the SSE2
+//    and scalar versions give bit-identical lengths.
+//
+static void segmentLengths(const float *x, const float *y, int n, double *segLen)
+{
+	if (n <= 0)
+		return;
+
+	segLen[0] = 0.0; // no segment entering first point
+
+	int k = 1;
+
+#ifdef MATCH_USE_SSE2
+	for (; k + 3 < n; k += 4)
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(x + k), _mm_loadu_ps(x + k - 1));
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(y + k), _mm_loadu_ps(y + k - 1));
+
+		__m128d dxLo = _mm_cvtps_pd(dx), dxHi = _mm_cvtps_pd(_mm_movehl_ps(dx, dx));
+		__m128d dyLo = _mm_cvtps_pd(dy), dyHi = _mm_cvtps_pd(_mm_movehl_ps(dy, dy));
+
+		_mm_storeu_pd(segLen + k, 
+				_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dxLo, dxLo), _mm_mul_pd(dyLo, dyLo))));
+		_mm_storeu_pd(segLen + k + 2, 
+				_mm_sqrt_pd(_mm_add_pd(_mm_mul_pd(dxHi, dxHi), _mm_mul_pd(dyHi, dyHi))));
+	}
+#endif
+
+	for (; k < n; k++)
+	{
+		double dx = x[k] - x[k-1];
+		double dy = y[k] - y[k-1];
+		segLen[k] = sqrt(dx * dx + dy * dy);
+	}
+}
+
+//*******************************************************************
+//
+// double Match::meanSquaredErrorBetweenOutlineSegments(...)
 //
 //    REVISED: 11/14/05
 //    Computes the error between defined outline segments.
@@ -2526,6 +4081,14 @@ double Match::meanSquaredErrorBetweenOutlineSegmentsMedial(
 //    Use arc length ratios between database and unknown to step along
 //    database points and compute corresponding unknown points.
 //
+//    ***2.3 - This is the inner loop of the optimal registration methods,
+//    so it now works on flat copies of the two outlines (one allocation
+//    for all of its scratch space) rather than through the bounds-checked
+//    FloatContour::operator[], and the segment lengths are found four at
+//    a time with SSE2 where the compiler provides it.  The arithmetic and
+//    its order are unchanged, so errors are identical to the previous
+//    version (tolerance 0).
+//
 double Match::meanSquaredErrorBetweenOutlineSegments( 
 		FloatContour *c1, // mapped unknown fin 
 		int begin1,
@@ -2536,25 +4099,113 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 		int mid2, //***1.85 not used here but makes prototype same as area based approach
 		int end2)
 {
+	flatOutline_t flat1, flat2;
+	vector<float> midPoints;
+
+	flattenOutline(c2, flat2);
+
+	return meanSquaredErrorBetweenOutlineSegments(
+			c1, begin1, mid1, end1,
+			c2, flat2, begin2, mid2, end2,
+			flat1, midPoints);
+}
+
+//*******************************************************************
+//
+// void Match::flattenOutline(FloatContour *c, flatOutline_t &flat)
+//
+//    ***2.3 - Copies the points of c into flat, and finds the length of
+//    the segment entering each.  The vectors keep their space when flat
+//    is reused for another outline.
+//
+void Match::flattenOutline(FloatContour *c, flatOutline_t &flat)
+{
+	int n = c->length();
+
+	flat.x.resize(n);
+	flat.y.resize(n);
+	flat.segLen.resize(n);
+
+	for (int k = 0; k < n; k++)
+	{
+		flat.x[k] = (*c)[k].x;
+		flat.y[k] = (*c)[k].y;
+	}
+
+	if (n > 0)
+		segmentLengths(&flat.x[0], &flat.y[0], n, &flat.segLen[0]);
+}
+
+//*******************************************************************
+//
+// double Match::meanSquaredErrorBetweenOutlineSegments(..., flat2, ...,
+//                                                      flat1, midPoints)
+//
+//    ***2.3 - The work of the above, with the database fin c2 already
+//    flattened into flat2.  The unknown is flattened into flat1 and the
+//    midpoints kept in midPoints, so a caller registering many mappings
+//    of the unknown against one database fin (MedialErrorMetric) does no
+//    allocation after the first call.
+//
+double Match::meanSquaredErrorBetweenOutlineSegments( 
+		FloatContour *c1, // mapped unknown fin 
+		int begin1,
+		int mid1,
+		int end1,
+		FloatContour *c2, // envenly spaced database fin
+		const flatOutline_t &flat2,
+		int begin2,
+		int mid2,
+		int end2,
+		flatOutline_t &flat1,
+		std::vector<float> &midPoints)
+{
+	PROFILE_PHASE(PHASE_ERROR_MSE); //***2.3
 
 	double 
 		error = 50000.0,
 		dbArcLength[2], unkArcLength[2]; //***1.982a - lead and trail done separately
 
-	// saved segment lengths, each is length of edge entering indexed point
-	vector<double> segLen1, segLen2;
-
-	int k;
+	int 
+		n1 = c1->length(),
+		n2 = c2->length(),
+		k;
+
+	// the walks below stay between these points, so they are checked once
+	// here rather than by FloatContour::operator[] on every access
+	if ((begin1 < 0) || (mid1 < 0) || (end1 < 0) ||
+	    (begin1 >= n1) || (mid1 >= n1) || (end1 >= n1) ||
+	    (begin2 < 0) || (mid2 < 0) || (end2 < 0) ||
+	    (begin2 >= n2) || (mid2 >= n2) || (end2 >= n2))
+		throw BoundsError("Match::meanSquaredErrorBetweenOutlineSegments()");
+
+	if ((int)flat2.x.size() != n2)
+		throw InvalidArgumentError("Match::meanSquaredErrorBetweenOutlineSegments() [flat2]");
+
+	flattenOutline(c1, flat1);
+
+	// scratch space for midpoints (at most one per database point)
+	if (midPoints.size() < (unsigned)(2 * n2))
+		midPoints.resize(2 * n2);
+
+	// the two outlines, and for each point the length of the edge entering it
+	const float
+		*x1 = &flat1.x[0],
+		*y1 = &flat1.y[0],
+		*x2 = &flat2.x[0],
+		*y2 = &flat2.y[0];
+	float
+		*midX = &midPoints[0],
+		*midY = midX + n2;
+	const double
+		*segLen1 = &flat1.segLen[0],
+		*segLen2 = &flat2.segLen[0];
 
 	// find length of unknown fin outline
 	unkArcLength[0] = 0.0;
 	unkArcLength[1] = 0.0; //***1.982a
-	segLen1.push_back(0.0); // no segment entering first point
-	for (k = 1; k < c1->length(); k++)
+	for (k = 1; k < n1; k++)
 	{
-		double dx = (*c1)[k].x - (*c1)[k-1].x;
-		double dy = (*c1)[k].y - (*c1)[k-1].y;
-		segLen1.push_back(sqrt(dx * dx + dy * dy));
 		if ((begin1 < k) && (k <= mid1))    // leading edge
 			unkArcLength[0] += segLen1[k];
 		else if ((mid1 < k) && (k <= end1)) //***1.982a - trailing edge
@@ -2564,12 +4215,8 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 	// find length of database fin outline
 	dbArcLength[0] = 0.0;
 	dbArcLength[1] = 0.0; //***1.982a
-	segLen2.push_back(0.0); // no segment entering first point
-	for (k = 1; k < c2->length(); k++)
+	for (k = 1; k < n2; k++)
 	{
-		double dx = (*c2)[k].x - (*c2)[k-1].x;
-		double dy = (*c2)[k].y - (*c2)[k-1].y;
-		segLen2.push_back(sqrt(dx * dx + dy * dy));
 		if ((begin2 < k) && (k <= mid2))    // leading edge
 			dbArcLength[0] += segLen2[k];
 		else if ((mid2 < k) && (k <= end2)) //***1.982a - trailing edge
@@ -2596,7 +4243,7 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 	// unknown.  The database fin outline should be evenly spaced at approx.
 	// 3.0 unit intervals
 
-	FloatContour *midPt = new FloatContour;
+	int numMid = 0;
 
 	int start1, limit1, start2, limit2; //***1.982a
 
@@ -2613,39 +4260,42 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 
 	// i is index on database 
 	// j is index on unknown
-	//int i = begin2+1, j = begin1+1;
 
 	i = start2+1; //***1.982a
 	j = start1+1; //***1.982a
 
 	double segLenUsed = 0.0;
 
-	//while (i < end2)
 	while (i < limit2) //***1.982a
 	{
 		// find dist to next point on database fin, and scaled distance to
 		// corresponding point on unknown
 		double howFar = ratio * segLen2[i] + segLenUsed;
 
-		while (segLen1[j] < howFar)
+		while ((j < n1) && (segLen1[j] < howFar))
 		{
 			howFar -= segLen1[j];
 			j++;
 		}
+		if (j >= n1)
+			throw BoundsError("Match::meanSquaredErrorBetweenOutlineSegments()");
+
 		// remember for next iteration
 		segLenUsed = howFar;
 
 		// point is on segment j of unknown, so find it
 
 		double s = (howFar/segLen1[j]);
-		double dx = (*c1)[j].x - (*c1)[j-1].x;
-		double dy = (*c1)[j].y - (*c1)[j-1].y;
-		double x = (*c1)[j-1].x + s * dx;
-		double y = (*c1)[j-1].y + s * dy;
+		double dx = x1[j] - x1[j-1];
+		double dy = y1[j] - y1[j-1];
+		double x = x1[j-1] + s * dx;
+		double y = y1[j-1] + s * dy;
 		
 		// save midpoint (part of medial axis) for use later
 
-		midPt->addPoint(0.5 * ((*c2)[i].x + x),0.5 * ((*c2)[i].y + y));
+		midX[numMid] = (float)(0.5 * (x2[i] + x));
+		midY[numMid] = (float)(0.5 * (y2[i] + y));
+		numMid++;
 
 		i++;
 	}
@@ -2653,31 +4303,30 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 	// now traverse medial axis and find length of perpendicular through
 	// medial axis point with endpoints on the two fin outlines
 
-	//i = begin2 + 1; // index on database fin
-	//j = begin1 + 1; // index on unknown fin
-
 	//***1.982a
 	i = start2 + 1; // index on database fin
 	j = start1 + 1; // index on unknown fin
 
-	/////////////////////////// changes //////////////////////////
 	//***1.75 - keep track of j & i values from previous point pair calculation
 	int iPrev = i;
 	int jPrev = j;
-    ////////////////////////// end changes ////////////////////////////
 
 	bool done = false;
 	int backI = 0, backJ = 0; //***1.75 - how much we are backing up
 
-	for (k = 1; (k+1 < midPt->length()) && (! done); k++)
+	for (k = 1; (k+1 < numMid) && (! done); k++)
 	{
 		double 
 			unkX = 0, unkY = 0,
 			dbX = 0, dbY = 0;
 
+		// mx, my stay float so that differences are rounded as before
+		float
+			mx = midX[k],
+			my = midY[k];
 		double
-			mdx = (*midPt)[k+1].x - (*midPt)[k-1].x,
-			mdy = (*midPt)[k+1].y - (*midPt)[k-1].y;
+			mdx = midX[k+1] - midX[k-1],
+			mdy = midY[k+1] - midY[k-1];
 		bool 
 			foundUnk = false,
 			foundDB = false;
@@ -2688,30 +4337,28 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 		while ((! foundUnk) && (! done))
 		{
 			double 
-				dot1 = ((*c1)[j-1].x - (*midPt)[k].x) * mdx
-				     + ((*c1)[j-1].y - (*midPt)[k].y) * mdy,
-				dot2 = ((*c1)[j].x - (*midPt)[k].x) * mdx
-				     + ((*c1)[j].y - (*midPt)[k].y) * mdy;
+				dot1 = (x1[j-1] - mx) * mdx + (y1[j-1] - my) * mdy,
+				dot2 = (x1[j] - mx) * mdx + (y1[j] - my) * mdy;
 			if (((dot1 <= 0.0) && (0.0 <= dot2)) || ((dot2 <= 0.0) && (0.0 <= dot1)))
 			{
 				// this segment contains a point of intersection with the perpendicular from
 				// the medial axis at point k
 				// slope of unknown fin outline segment between points j-1 and j 
 				double
-					dx1 = (*c1)[j].x - (*c1)[j-1].x,
-					dy1 = (*c1)[j].y - (*c1)[j-1].y;
+					dx1 = x1[j] - x1[j-1],
+					dy1 = y1[j] - y1[j-1];
 
 				double beta = 0.0;
 
 				if ((mdx * dx1 + mdy * dy1) != 0.0)
-					beta = - (mdx * ((*c1)[j-1].x - (*midPt)[k].x) + mdy * ((*c1)[j-1].y - (*midPt)[k].y))
+					beta = - (mdx * (x1[j-1] - mx) + mdy * (y1[j-1] - my))
 					       / (mdx * dx1 + mdy * dy1) ;
 
 				if ((0.0 <= beta) && (beta <= 1.0))
 				{
 					// found the point on this unknown segment
-					unkX = beta * dx1 + (*c1)[j-1].x;
-					unkY = beta * dy1 + (*c1)[j-1].y;
+					unkX = beta * dx1 + x1[j-1];
+					unkY = beta * dy1 + y1[j-1];
 					foundUnk = true;
 				}
 				else
@@ -2721,7 +4368,6 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 			{
 				// move forward along unknown
 				j++;
-				//if (j > end1)
 				if (j > limit1) //***1.982a
 					done = true;
 			}
@@ -2733,7 +4379,6 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 					j--;
 					backJ++;
 				}
-				//if ((j < 1) || (backJ >= 50)) // new constraint
 				if ((j < start1+1) || (backJ >= 50)) //***1.982a - new constraint
 					done = true;
 			}
@@ -2744,30 +4389,28 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 		while ((! foundDB) && (! done))
 		{		
 			double 
-				dot1 = ((*c2)[i-1].x - (*midPt)[k].x) * mdx
-				     + ((*c2)[i-1].y - (*midPt)[k].y) * mdy,
-				dot2 = ((*c2)[i].x - (*midPt)[k].x) * mdx
-				     + ((*c2)[i].y - (*midPt)[k].y) * mdy;
+				dot1 = (x2[i-1] - mx) * mdx + (y2[i-1] - my) * mdy,
+				dot2 = (x2[i] - mx) * mdx + (y2[i] - my) * mdy;
 			if (((dot1 <= 0.0) && (0.0 <= dot2)) || ((dot2 <= 0.0) && (0.0 <= dot1)))
 			{
 				// this segment contains a point of intersection with the perpendicular from
 				// the medial axis at point k
 				// slope of database fin outline segment between points i-1 and i 
 				double
-					dx2 = (*c2)[i].x - (*c2)[i-1].x,
-					dy2 = (*c2)[i].y - (*c2)[i-1].y;
+					dx2 = x2[i] - x2[i-1],
+					dy2 = y2[i] - y2[i-1];
 
 				double beta = 0.0;
 
 				if ((mdx * dx2 + mdy * dy2) != 0.0)
-					beta = - (mdx * ((*c2)[i-1].x - (*midPt)[k].x) + mdy * ((*c2)[i-1].y - (*midPt)[k].y))
+					beta = - (mdx * (x2[i-1] - mx) + mdy * (y2[i-1] - my))
 					       / (mdx * dx2 + mdy * dy2) ;
 
 				if ((0.0 <= beta) && (beta <= 1.0))
 				{
 					// found the point on this database segment
-					dbX = beta * dx2 + (*c2)[i-1].x;
-					dbY = beta * dy2 + (*c2)[i-1].y;
+					dbX = beta * dx2 + x2[i-1];
+					dbY = beta * dy2 + y2[i-1];
 					foundDB = true;
 				}
 				else
@@ -2777,7 +4420,6 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 			{
 				// move forward along database
 				i++;
-				//if (i > end2)
 				if (i > limit2) //***1.982a
 					done = true;
 			}
@@ -2789,7 +4431,6 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 					i--;
 					backI++;
 				}
-				//if ((i < 1) || (backI >= 50)) // new constraint
 				if ((i < start2+1) || (backI >= 50)) //***1.982a - new constraint
 					done = true;
 			}
@@ -2797,11 +4438,7 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 				printf("Error in medial axis code DB2");
 		}
 
-		/////////////////////////// changes ////////////////////
 		//***1.75 
-		// these two lines are the old code
-		//sum += ((dbX - unkX) * (dbX - unkX) + (dbY - unkY) * (dbY - unkY));   
-		//ptsFound++;
 		if (foundDB && foundUnk) // new constraint test
 		{
 			sum += ((dbX - unkX) * (dbX - unkX) + (dbY - unkY) * (dbY - unkY));
@@ -2820,22 +4457,16 @@ double Match::meanSquaredErrorBetweenOutlineSegments(
 			// what they were BEFORE the failure
 			i = iPrev;
 			j = jPrev;
-			//g_print("_");
 			done = false; // force search to continue
 		}
 
-		////////////////////////// end changes /////////////////
-
 		//***055ER
-		//if (mMatchingDialog != NULL)
 		if ((mMatchingDialog != NULL) && (k % 8 == 0))
 		{
 			// show the display of the outline registration in the dialog
 			mMatchingDialog->showErrorPt2Pt(c1,c2,dbX,dbY,unkX,unkY);
 		}
 	}
- 	
-	delete midPt;
 
 	} //***1.982a - end of for (part) loop
 
@@ -2871,6 +4502,7 @@ double Match::areaBasedErrorBetweenOutlineSegments_OLD(
 		int begin2,
 		int end2)
 {
+	PROFILE_PHASE(PHASE_ERROR_AREA); //***2.3
 	double 
 		error = 50000.0,
 		dbArcLength, unkArcLength;
@@ -3142,6 +4774,7 @@ double Match::areaBasedErrorBetweenOutlineSegments(
 		int mid2,
 		int end2)
 {
+	PROFILE_PHASE(PHASE_ERROR_AREA); //***2.3
 	double retVal = areaBasedErrorBetweenOutlineSegments_NEW( 
 		c1, // mapped unknown fin 
 		begin1,
@@ -3156,3 +4789,27 @@ double Match::areaBasedErrorBetweenOutlineSegments(
 	return retVal;
 }
 
+//*******************************************************************
+//
+// ***2.3 - as above, with the segments and intersections found in
+// scratch, whose space is reused from call to call
+//
+double Match::areaBasedErrorBetweenOutlineSegments( 
+		FloatContour *c1, // mapped unknown fin 
+		int begin1,
+		int mid1,
+		int end1,
+		FloatContour *c2, // envenly spaced database fin
+		int begin2,
+		int mid2,
+		int end2,
+		AreaMatchScratch &scratch)
+{
+	PROFILE_PHASE(PHASE_ERROR_AREA);
+
+	return areaBasedErrorBetweenOutlineSegments_NEW( 
+		c1, begin1, mid1, end1,
+		c2, begin2, mid2, end2,
+		scratch);
+}
+
@@ -18,7 +18,13 @@
 #include "../Database.h"
 #include "../DatabaseFin.h"
 #include "../FloatContour.h"
+#include "../mapContour.h" // 2.3
+#include "../MatchCache.h"
+#include "../MatchSnapshot.h"
+#include "../OutlineIndex.h" // 2.3
+#include "../shapeDescriptor.h"
 #include "MatchResults.h"
+#include "AreaMatch.h" // 2.3
 
 // new defined constants (8/2/05) to specify method of alignment / mapping
 
@@ -54,6 +60,26 @@
 
 #define IGNORE_MID_POSIT            0
 
+// 2.3 - top-K mode of the optimal registration methods.  Once K fins have
+// been matched, a fin whose error is still more than TOP_K_ABANDON_RATIO
+// times the K-th best converged error after TOP_K_MIN_ITERATIONS steps of
+// the optimization is not optimized any further.  These limits are a
+// heuristic taken from the error history of the sample catalog, NOT a
+// bound: the optimization error can still fall and the ranking uses the
+// trailing edge only, so an abandoned fin could in rare cases have ranked
+// in the top K.  Very small K (1 or 2) is not recommended.
+
+#define TOP_K_ABANDON_RATIO         3.0
+#define TOP_K_MIN_ITERATIONS        8
+
+// 2.3 - coarse-to-fine registration changes the results, so its match
+// cache entries are kept under the registration method plus this
+#define COARSE_TO_FINE_CACHE_METHOD 1000
+
+// 2.3 - new match cache entries are written to the database once this
+// many are waiting, and when the catalog has been matched
+#define MATCH_CACHE_FLUSH_SIZE      100
+
 // Big note about this (sorta lousy) class:
 // In somewhat bad form, this class always returns a pointer
 // to its MatchResults member to make the whole matching process
@@ -89,6 +115,11 @@ class mseInfo
 		FloatContour *c1, *c2;
 		
 		int b1, t1, e1, b2, t2, e2;
+
+		// 2.3 - top-K mode: error at which the optimization stopped (over the
+		// whole registered outline), and whether it was stopped early
+		double optimizerError;
+		bool abandoned;
 		
 		// constructor and destructor
 
@@ -96,7 +127,9 @@ class mseInfo
 		:	error(10000.0),
 			c1(NULL),
 			c2(NULL),
-			b1(0),t1(0),e1(0),b2(0),t2(0),e2(0)
+			b1(0),t1(0),e1(0),b2(0),t2(0),e2(0),
+			optimizerError(-1.0),
+			abandoned(false)
 		{ }
 
 		~mseInfo()
@@ -107,6 +140,22 @@ class mseInfo
 // YES it does (at least for MSVC++)
 class MatchingDialog;
 
+class MatchWork; // 2.3 - defined in Match.cxx
+
+// 2.3 - an outline as flat arrays, with the length of the segment
+// entering each point (0 for the first)
+typedef struct {
+	std::vector<float> x, y;
+	std::vector<double> segLen;
+} flatOutline_t;
+
+// 2.3 - number of online processors, default size of the matching worker pool
+int numberOfProcessors();
+
+// 2.3 - elapsed (not CPU) time in seconds, for timing work done on
+// several threads
+double wallClockSeconds();
+
 class Match
 {
 	public:
@@ -136,12 +185,135 @@ class Match
 							 bool useFullFinError, //***055ER
 							 bool useAbsoluteOffsets); //***1.3
 
+		// 2.3 - Parallel variant of matchSingleFin().  Matches the next block
+		// of database fins on numThreads worker threads (one per processor
+		// when numThreads <= 0) and merges them in catalog order, so the
+		// results are identical to those of repeated matchSingleFin() calls.
+		//
+		// RETURN:
+		// 	float - percentage of the database completed.  When
+		// 		done, returns 1.0
+		float matchFinBlock(int registrationMethod, int regSegmentsUsed,
+		                    bool categoryToMatch[],
+		                    bool useFullFinError,
+		                    bool useAbsoluteOffsets,
+		                    int numThreads = 0);
+
 		int find_tip_pos(point_t PosPoint, FloatContour *c2); //***005CM
 
 		MatchResults* getMatchResults();
 
 		void setDisplay(MatchingDialog *mDialog);
 
+		// 2.3 - top-K mode, k <= 0 optimizes every fin fully (the default
+		// unless Options::mUseMatchTopK is set)
+		void setTopK(int k);
+		int getTopK() const;
+
+		// 2.3 - number of fins whose optimization was stopped early
+		int getNumAbandoned() const;
+
+		// 2.3 - two stage matching.  With 0 < fraction < 1, the selected
+		// catalog fins are first ranked by shape descriptor (see
+		// shapeDescriptor.h) and only that fraction of them, the most
+		// similar, is registered.  Must be set before matching starts.
+		// Set from Options::mMatchShortlistFraction when
+		// Options::mUseMatchPrefilter is set, otherwise off.
+		void setShortlistFraction(float fraction);
+
+		// 2.3 - prefilter statistics, valid once matching has started:
+		// number of fins kept for registration, of how many candidates,
+		// and the shape descriptor rank (1 is best) of the best catalog
+		// fin with the unknown's ID (-1 if there is none)
+		int getShortlistSize() const;
+		int getNumPrefilterCandidates() const;
+		int getPrefilterTrueRank() const;
+
+		// 2.3 - two stage matching by outline index.  With m > 0, stage
+		// one asks the database's outline index (see OutlineIndex.h) for
+		// the m catalog fins nearest the unknown, among those selected,
+		// and only these are read and registered.  Used instead of the
+		// shape descriptor shortlist when both are set.  Fins whose
+		// categories the database cannot list before loading them are
+		// all candidates, so fewer than m may then be registered.  Needs
+		// absolute offsets and a database that keeps an index, and
+		// otherwise falls back to the shape descriptor shortlist, if
+		// set.  Set from Options::mOutlineIndexCandidates when
+		// Options::mUseOutlineIndex is set, otherwise off.  Must be set
+		// before matching starts.
+		void setNearestCandidates(int m);
+		int getNearestCandidates() const;
+
+		// 2.3 - coarse-to-fine registration.  The optimal methods make
+		// their large early moves on coarse levels of the two outline
+		// pyramids (every 4th, then every 2nd point) and only their final
+		// convergence steps at full resolution.  Coarse errors are close
+		// to, but not the same as, full resolution errors, so the
+		// registrations and rankings can differ slightly from those made
+		// without it.  On when Options::mUseCoarseToFine is set.  Must be
+		// set before matching starts.
+		void setCoarseToFine(bool use);
+		bool getCoarseToFine() const;
+
+		// 2.3 - results of the optimal methods are kept in the database
+		// (see MatchCache.h) and read back instead of registering the same
+		// fins again.  On when Options::mUseMatchCache is set.  Must be set
+		// before matching starts.
+		void setUseMatchCache(bool use);
+
+		// 2.3 - number of fins whose result was read from the cache
+		int getNumCacheHits() const;
+
+		// 2.3 - incremental matching.  Starts from previous results (loaded
+		// with MatchResults::load()) and matches only the catalog fins added
+		// or updated since they were saved (see Database::catalogGeneration()).
+		// Previous results for fins updated since are dropped.  Returns false,
+		// and changes nothing, if the previous results or the catalog have no
+		// generation.  Must be called before matching starts, and only works
+		// with useAbsoluteOffsets (as for match queues).
+		bool matchAddedSince(MatchResults *previous);
+
+		// 2.3 - number of catalog fins to be matched by matchAddedSince()
+		int getNumAddedFins() const;
+
+		// 2.3 - registers the unknown to fin i of snapshot and returns the
+		// error, without adding a result, for jobs that choose their own
+		// pairs of fins (see CatalogSelfMatch).  prepareRegistration() must
+		// be called first, and returns false for unsupported methods.  After
+		// that registerSnapshotFin() may be called from several threads.
+		bool prepareRegistration(int registrationMethod);
+		double registerSnapshotFin(int registrationMethod,
+		                           MatchSnapshot *snapshot, int i,
+		                           bool useFullFinError);
+
+		// 2.3 - matching in slices of the catalog, so that the fins of
+		// several unknowns can be registered at once (see
+		// MatchingQueue::matchAll()).  prepareSlices() selects the rest of
+		// the catalog fins as matchFinBlock() would, reads their cached
+		// results and returns the number of slices of sliceSize fins.  It
+		// reads the database, and the match snapshot must already hold
+		// every catalog fin.  registerSlice() may then be called from
+		// several threads at once for different slices, and finishSlices()
+		// adds all the results in catalog order once every slice is done.
+		// Only works with absolute offsets and no display.
+		int prepareSlices(int registrationMethod, bool categoryToMatch[],
+		                  bool useFullFinError, int sliceSize);
+		void registerSlice(int slice, double abandonAbove);
+		void finishSlices();
+
+		// 2.3 - top-K mode between slices: the threshold to pass to
+		// registerSlice(), and noteSliceErrors() to call when the slice is
+		// done.  Neither may be called by two threads at once.
+		double abandonThreshold() const;
+		void noteSliceErrors(int slice);
+
+		// 2.3 - the same by catalog position rather than by slice, for
+		// batches of unknowns that share each block of catalog fins (see
+		// MatchingQueue::matchBatch()).  Registers, or notes the errors of,
+		// the selected fins at absolute positions first to end - 1.
+		void registerCatalogRange(int first, int end, double abandonAbove);
+		void noteCatalogRangeErrors(int first, int end);
+
 	private:
 		DatabaseFin<ColorImage> *mUnknownFin;
 		Database *mDatabase;
@@ -152,6 +324,98 @@ class Match
 
 		Options *mOptions; // 054
 
+		// 2.3 - top-K mode
+		int mTopK;
+		std::vector<double> mTopKErrors; // max-heap of the K best optimizer errors
+		int mNumAbandoned;
+
+		void noteTopKError(double error);
+
+		// 2.3 - shape descriptor prefilter
+		float mShortlistFraction;        // 0 when off
+		bool mShortlistBuilt;
+		std::vector<char> mInShortlist;  // by catalog position
+		int
+			mShortlistSize,
+			mNumPrefilterCandidates,
+			mPrefilterTrueRank;
+		float mUnknownDescriptor[SHAPE_DESCRIPTOR_SIZE];
+
+		void buildShortlist(bool categoryToMatch[], bool useAbsoluteOffsets);
+		bool inShortlist(int position) const;
+
+		// 2.3 - outline index shortlist
+		int mNearestCandidates;          // 0 when off
+
+		bool shortlistPending() const;
+		bool buildNearestShortlist(bool categoryToMatch[]);
+
+		// 2.3 - incremental matching
+		bool mMatchAddedOnly;
+		std::vector<char> mAddedSince;  // by absolute position
+		int mNumAddedFins;
+
+		bool addedSince(int position) const;
+
+		// 2.3 - fins in the selected damage categories, as listed by the
+		// database before any fin is loaded
+		bool mCategoriesListed;
+		std::vector<char> mListedCategories; // the categoryToMatch[] listed
+		std::vector<char> mInCategories;     // by absolute position
+
+		void listCategories(bool categoryToMatch[]);
+		bool inCategories(int position) const;
+
+		// 2.3 - coarse-to-fine registration, the coarser levels of the
+		// unknown's outline pyramid (by level - 1)
+		bool mCoarseToFine;
+		FloatContour *mUnknownLevelContour[OUTLINE_PYRAMID_LEVELS - 1];
+
+		// 2.3 - persistent match cache
+		bool mUseMatchCache;
+		bool mMatchCacheLoaded;
+		int mMatchCacheMethod;
+		bool mMatchCacheFullFinError;
+		std::string mUnknownHash;
+		std::map<int, MatchCacheEntry> mCachedMatches;  // by Individuals id
+		std::vector<MatchCacheEntry> mNewCachedMatches; // not yet written
+		int mNumCacheHits;
+
+		bool loadMatchCache(int registrationMethod, bool useFullFinError);
+		bool findCachedMatch(MatchSnapshot *snapshot, int i, mseInfo &result);
+		void noteCachedMatch(MatchSnapshot *snapshot, int i, const mseInfo &result);
+		void flushMatchCache();
+
+		// 2.3 - helpers shared by matchSingleFin() and matchFinBlock()
+
+		bool categorySelected(MatchSnapshot *snapshot, int i, bool categoryToMatch[]);
+		bool categorySelected(const std::string &damage, bool categoryToMatch[]);
+
+		// 2.3 - false for methods findErrorForMethod() cannot register with
+		bool registrationMethodSupported(int registrationMethod);
+
+		mseInfo findErrorForMethod(
+				int registrationMethod,
+				SnapshotFin *dbFin,
+				bool useFullFinError,
+				double abandonAbove = -1.0); // 2.3
+
+		void addMatchResult(MatchSnapshot *snapshot, int i, mseInfo &result);
+
+		// 2.3 - matching in slices, see prepareSlices()
+		MatchWork *mSliceWork;
+		int mSliceSize;
+		bool mSliceUseCache;
+
+		void deleteSliceWork();
+		void sliceFins(int first, int end, int &firstFin, int &endFin) const;
+		void registerSliceFins(int firstFin, int endFin, double abandonAbove);
+		void noteSliceFinErrors(int firstFin, int endFin);
+
+		void runMatchWorkers(MatchWork *work, int numThreads);
+
+		friend void *matchWorkerThread(void *arg);
+
 		int
 			mUnknownTipPosition,
 			mUnknownNotchPosition,
@@ -167,7 +431,7 @@ class Match
 			mUnknownEndTEPoint;
 
 		mseInfo findErrorBetweenFins( // 005CM
-				DatabaseFin<ColorImage> *dbFin,
+				SnapshotFin *dbFin, // 2.3
 				float &timeTaken);
 
 		double meanSquaredErrorBetweenChains(
@@ -194,7 +458,11 @@ class Match
 		//		bool useFullFinError); // 055ER
 
 		// 1.85 - new member function pointer
-		double (Match::*errorBetweenOutlines)(FloatContour*,int,int,int,FloatContour*,int,int,int);
+		// 2.3 - replaced by the ErrorMetric of findErrorBetweenFinsOptimal()
+		//double (Match::*errorBetweenOutlines)(FloatContour*,int,int,int,FloatContour*,int,int,int);
+
+		// 2.3 - flat copy of an outline (see meanSquaredErrorBetweenOutlineSegments())
+		static void flattenOutline(FloatContour *c, flatOutline_t &flat);
 
 		double meanSquaredErrorBetweenOutlineSegments( 
 				FloatContour *c1, // mapped unknown fin 
@@ -206,6 +474,21 @@ class Match
 				int mid2, // 1.85 not used here but makes prototype same as area based approach
 				int end2);
 
+		// 2.3 - the same, with the database fin already flattened and
+		// scratch space for the unknown (see MedialErrorMetric)
+		double meanSquaredErrorBetweenOutlineSegments( 
+				FloatContour *c1, // mapped unknown fin 
+				int begin1,
+				int mid1,
+				int end1,
+				FloatContour *c2, // envenly spaced database fin
+				const flatOutline_t &flat2, // c2 flattened
+				int begin2,
+				int mid2,
+				int end2,
+				flatOutline_t &flat1, // scratch, c1 flattened here
+				std::vector<float> &midPoints); // scratch
+
 		double areaBasedErrorBetweenOutlineSegments_OLD( // 1.85 - new, calls external function
 				FloatContour *c1, // mapped unknown fin 
 				int begin1,
@@ -224,6 +507,18 @@ class Match
 				int mid2,
 				int end2);
 
+		// 2.3 - the same, reusing scratch (see AreaErrorMetric)
+		double areaBasedErrorBetweenOutlineSegments(
+				FloatContour *c1, // mapped unknown fin 
+				int begin1,
+				int mid1,
+				int end1,
+				FloatContour *c2, // envenly spaced database fin
+				int begin2,
+				int mid2,
+				int end2,
+				AreaMatchScratch &scratch);
+
 		double meanSquaredErrorBetweenOutlineSegmentsNew( 
 				FloatContour *c1, // mapped unknown fin 
 				int begin1,
@@ -240,13 +535,21 @@ class Match
 				int begin2,
 				int end2);
 
+		// 2.3 - a template over the error metric (see MedialErrorMetric),
+		// so each registration method gets its own optimizer with the
+		// metric's calls made directly
+		template <class ErrorMetric>
 		mseInfo findErrorBetweenFinsOptimal(
-				DatabaseFin<ColorImage> *dbFin,
+				SnapshotFin *dbFin, // 2.3
 				float &timeTaken,
 				//int regSegmentsUsed,
 				bool moveTip, // 1.1
 				bool moveEndsInAndOut, // 1.1
-				bool useFullFinError); // 055ER
+				bool useFullFinError, // 055ER
+				double abandonAbove = -1.0); // 2.3 - top-K mode
+
+		friend class MedialErrorMetric; // 2.3
+		friend class AreaErrorMetric; // 2.3
 
 		// 1.75 - newest method of computing error
 
@@ -261,7 +564,7 @@ class Match
 		//-------------- reconstruction of original methods JHS -----
 
 		mseInfo findErrorBetweenFins_Original3Point(
-				DatabaseFin<ColorImage> *dbFin,
+				SnapshotFin *dbFin, // 2.3
 				float &timeTaken);
 
 		mseInfo meanSquaredErrorBetweenOutlines_Original( // 005CM
@@ -271,4 +574,226 @@ class Match
 				int tip2);
 };
 
+// 2.3 - error metrics for Match::findErrorBetweenFinsOptimal().  One is
+// made for each catalog fin registered, from its evenly spaced outline,
+// and gives the error between that outline and the mapped unknown.  The
+// mid points (tips) are only used by some metrics.
+
+// meanSquaredErrorBetweenOutlineSegments(), used by TRIM_OPTIMAL_TOTAL
+// and TRIM_OPTIMAL_TIP.  The database outline is flattened, and its
+// segment lengths found, once for the fin rather than on every call, and
+// the scratch space is kept from one call to the next.
+class MedialErrorMetric
+{
+	public:
+		MedialErrorMetric(Match *match, FloatContour *dbContour)
+		:	mMatch(match),
+			mDBContour(dbContour)
+		{
+			Match::flattenOutline(dbContour, mDBFlat);
+		}
+
+		double operator()(
+				FloatContour *unknown, int begin1, int mid1, int end1,
+				int begin2, int mid2, int end2)
+		{
+			return mMatch->meanSquaredErrorBetweenOutlineSegments(
+					unknown, begin1, mid1, end1,
+					mDBContour, mDBFlat, begin2, mid2, end2,
+					mUnknownFlat, mMidPoints);
+		}
+
+	private:
+		Match *mMatch;
+		FloatContour *mDBContour;
+		flatOutline_t
+			mDBFlat,
+			mUnknownFlat;
+		std::vector<float> mMidPoints;
+};
+
+// areaBasedErrorBetweenOutlineSegments(), used by TRIM_OPTIMAL_AREA.  The
+// space for its segments and intersections is kept from one call to the
+// next.
+class AreaErrorMetric
+{
+	public:
+		AreaErrorMetric(Match *match, FloatContour *dbContour)
+		:	mMatch(match),
+			mDBContour(dbContour)
+		{ }
+
+		double operator()(
+				FloatContour *unknown, int begin1, int mid1, int end1,
+				int begin2, int mid2, int end2)
+		{
+			return mMatch->areaBasedErrorBetweenOutlineSegments(
+					unknown, begin1, mid1, end1,
+					mDBContour, begin2, mid2, end2,
+					mScratch);
+		}
+
+	private:
+		Match *mMatch;
+		FloatContour *mDBContour;
+		AreaMatchScratch mScratch;
+};
+
+// 2.3 - one trial mapping of Match::findErrorBetweenFinsOptimal(), by
+// the begin, mid (tip) and end points of the unknown (1) and database
+// fin (2) outlines
+typedef struct {
+	int begin1, mid1, end1;
+	int begin2, mid2, end2;
+} registrationMove_t;
+
+// 2.3 - most moves mapped in one pass by PyramidRegistration::measureMoves()
+#define MAX_MEASURED_MOVES          8
+
+// 2.3 - maps the unknown onto a catalog fin and gives the ErrorMetric
+// error between them, for Match::findErrorBetweenFinsOptimal().  The
+// mapping control points are the begin, mid (tip) and end points of the
+// error, and all are given as indices into the full outlines.  With
+// coarse-to-fine registration, the mapping and error can be made at a
+// coarser level of the two outline pyramids instead, where the indices
+// are rounded to the nearest point of that level.  At level 0 the
+// unknown is mapped and measured exactly as without pyramids.
+template <class ErrorMetric>
+class PyramidRegistration
+{
+	public:
+		// unknown[] and db[] hold the outlines by level, level 0 measured
+		// with fullMetric
+		PyramidRegistration(
+				Match *match,
+				ErrorMetric &fullMetric,
+				FloatContour *unknown[],
+				FloatContour *db[],
+				int numLevels)
+		:	mNumLevels(numLevels),
+			mLevel(0)
+		{
+			for (int level = 0; level < numLevels; level++)
+			{
+				mUnknown[level] = unknown[level];
+				mDB[level] = db[level];
+				mMetric[level] = (0 == level) ? &fullMetric : new ErrorMetric(match, db[level]);
+			}
+		}
+
+		~PyramidRegistration()
+		{
+			for (int level = 1; level < mNumLevels; level++)
+				delete mMetric[level];
+		}
+
+		int getNumLevels() const { return mNumLevels; }
+		int getLevel() const { return mLevel; }
+		void setLevel(int level) { mLevel = level; }
+
+		// mapped is the buffer the unknown is mapped into
+		double operator()(
+				FloatContour *mapped, int begin1, int mid1, int end1,
+				int begin2, int mid2, int end2)
+		{
+			const FloatContour
+				&unknown = *mUnknown[0],
+				&db = *mDB[0];
+
+			mapContour(
+					mUnknown[mLevel],
+					unknown[mid1],
+					unknown[begin1],
+					unknown[end1],
+					db[mid2],
+					db[begin2],
+					db[end2],
+					mapped);
+
+			if (0 == mLevel)
+				return (*mMetric[0])(mapped, begin1, mid1, end1, begin2, mid2, end2);
+
+			int
+				n1 = mUnknown[mLevel]->length(),
+				n2 = mDB[mLevel]->length();
+
+			return (*mMetric[mLevel])(
+					mapped,
+					levelIndex(begin1, n1), levelIndex(mid1, n1), levelIndex(end1, n1),
+					levelIndex(begin2, n2), levelIndex(mid2, n2), levelIndex(end2, n2));
+		}
+
+		// The same for several moves, the unknown being mapped for all of
+		// them in one pass over its points (see mapContours()) before the
+		// errors are found.  mapped[] are the buffers, one per move.
+		void measureMoves(
+				int numMoves, const registrationMove_t moves[],
+				FloatContour *mapped[], double errors[])
+		{
+			if (numMoves > MAX_MEASURED_MOVES)
+			{
+				measureMoves(MAX_MEASURED_MOVES, moves, mapped, errors);
+				measureMoves(numMoves - MAX_MEASURED_MOVES, moves + MAX_MEASURED_MOVES,
+				             mapped + MAX_MEASURED_MOVES, errors + MAX_MEASURED_MOVES);
+				return;
+			}
+
+			const FloatContour
+				&unknown = *mUnknown[0],
+				&db = *mDB[0];
+
+			float coeff[MAX_MEASURED_MOVES][2][3];
+
+			int m;
+			for (m = 0; m < numMoves; m++)
+				affineMapCoefficients(
+						unknown[moves[m].mid1],
+						unknown[moves[m].begin1],
+						unknown[moves[m].end1],
+						db[moves[m].mid2],
+						db[moves[m].begin2],
+						db[moves[m].end2],
+						coeff[m]);
+
+			mapContours(mUnknown[mLevel], numMoves, coeff, mapped);
+
+			int
+				n1 = mUnknown[mLevel]->length(),
+				n2 = mDB[mLevel]->length();
+
+			for (m = 0; m < numMoves; m++)
+				errors[m] = (*mMetric[mLevel])(
+						mapped[m],
+						levelIndex(moves[m].begin1, n1), 
+						levelIndex(moves[m].mid1, n1), 
+						levelIndex(moves[m].end1, n1),
+						levelIndex(moves[m].begin2, n2), 
+						levelIndex(moves[m].mid2, n2), 
+						levelIndex(moves[m].end2, n2));
+		}
+
+	private:
+		int 
+			mNumLevels,
+			mLevel;
+		FloatContour 
+			*mUnknown[OUTLINE_PYRAMID_LEVELS],
+			*mDB[OUTLINE_PYRAMID_LEVELS];
+		ErrorMetric *mMetric[OUTLINE_PYRAMID_LEVELS];
+
+		// nearest point of the level in use to point i of the full outline
+		int levelIndex(int i, int levelLength) const
+		{
+			if (0 == mLevel)
+				return i;
+
+			int k = (i + (1 << mLevel) / 2) >> mLevel;
+			return (k < levelLength) ? k : levelLength - 1;
+		}
+
+		// not copied
+		PyramidRegistration(const PyramidRegistration &);
+		PyramidRegistration &operator=(const PyramidRegistration &);
+};
+
 #endif
@@ -9,7 +9,9 @@
 //*******************************************************************
 
 #include <ctype.h>
+#ifndef DARWIN_NO_GUI
 #include "../interface/ErrorDialog.h" //***1.9
+#endif
 #include "MatchResults.h"
 #include "../DatabaseFin.h"
 #include "../Error.h"
@@ -19,9 +21,152 @@
 
 
 #include <iomanip>
+#include <algorithm> //***2.3
+#include <cstdlib>
+
+#ifdef WIN32
+#include <windows.h> //***2.3 - mapping binary results
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 using namespace std;
 
+//***2.3 - binary form of saved results (see MatchResults::saveBinary()):
+// the header, one fixed width record per result in the saved order, and
+// then the strings, each ending in '\0' and found by its offset from the
+// start of the strings
+
+#define MATCHRESULTS_BINARY_MAGIC   "DARWINMR"
+#define MATCHRESULTS_BINARY_VERSION 1
+
+// record flags
+#define MR_RECORD_RANKED  0x1
+#define MR_RECORD_MAPPED  0x2   // mappingCoefficients are set
+
+typedef struct {
+	char magic[8];
+	int
+		version,
+		headerSize,              // sizes guard against builds with other
+		recordSize,              // structure layouts
+		numResults,
+		textFileSize,            // of the .res written with this file
+		catalogGeneration,
+		shortlistSize,
+		numPrefilterCandidates,
+		stringsOffset,           // from the start of the file
+		stringsSize,
+		finID,                   // offsets in the strings
+		tracedFinFile,
+		databaseFile;
+	float timeTaken;
+	int unused;
+} matchResultsFileHeader_t;
+
+typedef struct {
+	int
+		position,                // of the fin in the catalog
+		flags;
+	double error;
+	int controlPoints[6];        // unknown begin, tip, end, then database fin's
+	float mappingCoefficients[2][3];
+	int
+		strings,                 // offset of ID, name, damage, date, location
+		unused;                  // and image filename, one after the other
+} matchResultRecord_t;
+
+//*******************************************************************
+//
+// class MappedFile
+//
+//    ***2.3 - A whole file mapped read only into memory for as long as
+//    the MappedFile lives.  data() is NULL if the file could not be
+//    mapped (missing or empty).
+//
+class MappedFile
+{
+	public:
+		MappedFile(string fileName);
+		~MappedFile();
+
+		const char *data() const { return mData; }
+		size_t size() const { return mSize; }
+
+	private:
+		const char *mData;
+		size_t mSize;
+#ifdef WIN32
+		HANDLE
+			mFile,
+			mMapping;
+#endif
+};
+
+//*******************************************************************
+//
+MappedFile::MappedFile(string fileName)
+	: mData(NULL),
+	  mSize(0)
+{
+#ifdef WIN32
+	mMapping = NULL;
+	mFile = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+	                    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (INVALID_HANDLE_VALUE == mFile)
+		return;
+
+	DWORD size = GetFileSize(mFile, NULL);
+	if ((INVALID_FILE_SIZE == size) || (0 == size))
+		return;
+
+	mMapping = CreateFileMapping(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (NULL == mMapping)
+		return;
+
+	mData = (const char *)MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0);
+	if (NULL != mData)
+		mSize = size;
+#else
+	int fd = open(fileName.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+
+	struct stat info;
+	if ((0 == fstat(fd, &info)) && (info.st_size > 0))
+	{
+		void *data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED != data)
+		{
+			mData = (const char *)data;
+			mSize = info.st_size;
+		}
+	}
+
+	close(fd); // the mapping stays
+#endif
+}
+
+//*******************************************************************
+//
+MappedFile::~MappedFile()
+{
+#ifdef WIN32
+	if (NULL != mData)
+		UnmapViewOfFile(mData);
+	if (NULL != mMapping)
+		CloseHandle(mMapping);
+	if (INVALID_HANDLE_VALUE != mFile)
+		CloseHandle(mFile);
+#else
+	if (NULL != mData)
+		munmap((void *)mData, mSize);
+#endif
+}
+
 //*******************************************************************
 //***1.5
 //
@@ -36,15 +181,19 @@ bool MatchResults::LastSortedByError()
 //  This should only be called once -- after all results are added to list, and before results 
 //  are displayed.  This is probably best done from the MatchResults constructor.
 //
+//  ***2.3 - fins that were not ranked (abandoned early in top-K matching) are
+//  sorted after all ranked fins and are shown with a rank of "--"
+//
 void MatchResults::setRankings()
 {
 	if (mLastSortBy != MR_ERROR)
 		return;
 			
-	list<Result>::iterator it = mResults.begin();
 	//for (int i=0; i<mResults.size(); i++, it++)
-	for (int i = 0; it != mResults.end(); i++, it++) //***2.22 - better to limit with iterator
+	for (int i = 0; i < (int)mOrder.size(); i++) //***2.3 - in sorted order
 	{
+		Result *it = &mResults[mOrder[i]];
+
 		//***2.22 - I have no idea why this worked before.  alocate 5 chars
 		// write 5 chars "%4d " AND an additional '\0' and then go back and
 		// put a '\0' in position 4.  This overwrites the char array by one position
@@ -53,7 +202,10 @@ void MatchResults::setRankings()
 		//rank[4] = '\0';
 		
 		char rank[6]; //***2.22 - this fixes it
-		sprintf(rank, "%4d ",i+1);
+		if (it->isRanked())
+			sprintf(rank, "%4d ",i+1);
+		else
+			sprintf(rank, "  -- "); //***2.3
 
 		it->setRank(rank);
 	}
@@ -66,6 +218,7 @@ void MatchResults::addResult(const Result& r)
 {
 	try {
 		mResults.push_back(r);
+		mOrder.push_back(mResults.size() - 1); //***2.3
 		//sort(); //***1.5 - DO NOT sort here, only sort once AFTER list is built
 	} catch (...) {
 		throw;
@@ -74,109 +227,74 @@ void MatchResults::addResult(const Result& r)
 
 //*******************************************************************
 //
+// class ResultLess
 //
-void MatchResults::sort(mr_sort_t sortBy, int &active)
+//    ***2.3 - Orders indices into a vector of results by one mr_sort_t
+//    key.  By error, every ranked fin comes before the unranked ones.
+//
+class ResultLess
 {
-	try {
-		//***1.0 - keep track of where active result ends up and 
-		// reset value of active so redisplay of lists and icons
-		// has correct active result after sort
-		int newActive = -1;
-
-		mLastSortBy = sortBy;
-
-		list<Result> sortedResults;
-
-		//***1.0 - need list of indices since mResults list is erased as we go
-		list<int> actIndex;
-		for (int i=0; i<mResults.size(); i++)
-			actIndex.push_back(i);
+	public:
+		ResultLess(const vector<Result> &results, mr_sort_t sortBy)
+		:	mResults(results),
+			mSortBy(sortBy)
+		{ }
 
-		while (mResults.size() > 0) {
-			list<Result>::iterator it = mResults.begin();
-			list<Result>::iterator saveIt = it;
-
-			list<int>::iterator actIt = actIndex.begin(); //***1.0
-			list<int>::iterator actItLow = actIt;         //***1.0
+		bool operator()(int a, int b) const
+		{
+			const Result
+				&ra = mResults[a],
+				&rb = mResults[b];
 
-			string lowest;
-			float lowestNum;
-			switch (sortBy) {
+			switch (mSortBy) {
 				case MR_ERROR:
-					lowestNum = atof(it->getError().c_str());
-					break;
+					if (ra.isRanked() != rb.isRanked())
+						return ra.isRanked();
+					return ra.getErrorValue() < rb.getErrorValue();
 				case MR_NAME:
-					lowest = it->getName();
-					break;
+					return ra.getName() < rb.getName();
 				case MR_IDCODE:
-					lowest = it->getIdCode();
-					break;
+					return ra.getIdCode() < rb.getIdCode();
 				case MR_DAMAGE:
-					lowest = it->getDamage();
-					break;
+					return ra.getDamage() < rb.getDamage();
 				case MR_DATE:
-					lowest = it->getDate();
-					break;
+					return ra.getDate() < rb.getDate();
 				case MR_LOCATION:
-					lowest = it->getLocation();
-					break;
+					return ra.getLocation() < rb.getLocation();
 			}
-	
-			++it;
-
-			++actIt; //***1.0
-
-			while (it != mResults.end()) {
-				string compare;
-				float compareNum;
-				switch (sortBy) {
-					case MR_ERROR:
-						compareNum = atof(it->getError().c_str());
-						break;
-					case MR_NAME:
-						compare = it->getName();
-						break;
-					case MR_IDCODE:
-						compare = it->getIdCode();
-						break;
-					case MR_DAMAGE:
-						compare = it->getDamage();
-						break;
-					case MR_DATE:
-						compare = it->getDate();
-						break;
-					case MR_LOCATION:
-						compare = it->getLocation();
-						break;
-				}
-
-				if (sortBy == MR_ERROR && compareNum < lowestNum) {
-					lowestNum = compareNum;
-					saveIt = it;
-					actItLow = actIt; //***1.0
-				} else if (compare < lowest) {
-					lowest = compare;
-					saveIt = it;
-					actItLow = actIt; //***1.0
-				}
+			return false;
+		}
 
-				++it;
+	private:
+		const vector<Result> &mResults;
+		mr_sort_t mSortBy;
+};
 
-				++actIt; //***1.0
-			}
+//*******************************************************************
+//
+// void MatchResults::sort(mr_sort_t sortBy, int &active)
+//
+//    ***2.3 - A stable sort of the result order, so results with equal
+//    keys keep their current order, as they did with the old selection
+//    sort.  Only indices are moved, never the results themselves.
+//
+void MatchResults::sort(mr_sort_t sortBy, int &active)
+{
+	try {
+		//***1.0 - keep track of where active result ends up and 
+		// reset value of active so redisplay of lists and icons
+		// has correct active result after sort
+		int activeResult = ((active >= 0) && (active < (int)mOrder.size())) ? mOrder[active] : -1;
 
-			sortedResults.push_back(*saveIt);
-			mResults.erase(saveIt);
+		mLastSortBy = sortBy;
 
-			//***1.0 - save new position of old active Result
-			if (((*actItLow) == active) && (newActive == -1))
-				newActive = sortedResults.size() - 1;
-			actIndex.erase(actItLow);
-		}
+		std::stable_sort(mOrder.begin(), mOrder.end(), ResultLess(mResults, sortBy));
 
-		mResults = sortedResults;
+		active = -1;
+		for (int i = 0; (i < (int)mOrder.size()) && (-1 == active); i++)
+			if (mOrder[i] == activeResult)
+				active = i;
 
-		active = newActive; //***1.0
 	} catch (...) {
 		throw;
 	}
@@ -190,12 +308,7 @@ Result* MatchResults::getResultNum(int resultNum)
 	if (resultNum >= (int)mResults.size())
 		throw Error("Request for item out of bounds in MatchResults::getResultNum");	
 	try {
-		list<Result>::iterator it = mResults.begin();
-
-		for (int i = 0; i < resultNum; i++)
-			++it;
-
-		return &(*it);
+		return &mResults[mOrder[resultNum]]; //***2.3
 
 	} catch (...) {
 		throw;
@@ -235,11 +348,25 @@ int MatchResults::findRank()
 	return -1;
 }
 
+//*******************************************************************
+//***2.3
+//
+int MatchResults::numUnranked() const
+{
+	int n = 0;
+	for (vector<Result>::const_iterator it = mResults.begin(); it != mResults.end(); ++it)
+		if (! it->isRanked())
+			n++;
+	return n;
+}
+
 //*******************************************************************
 //
 //
 void MatchResults::save(std::string fileName)
 {
+	PROFILE_PHASE(PHASE_SAVE_RESULTS); //***2.3
+
 	try {
 		ofstream outFile(fileName.c_str());
 
@@ -262,6 +389,23 @@ void MatchResults::save(std::string fileName)
 				outFile << "The ID is ranked " << rank << endl;
 		}
 
+		//***2.3 - fins abandoned early in top-K matching, their rank is "--"
+		int numAbandoned = numUnranked();
+		if (numAbandoned > 0)
+			outFile << "Abandoned Early: " << numAbandoned << endl;
+
+		//***2.3 - catalog generation, for bringing these results up to date
+		if (mCatalogGeneration >= 0)
+			outFile << "Catalog Generation: " << mCatalogGeneration << endl;
+
+		//***2.3 - fins registered after the shape descriptor prefilter
+		if (mShortlistSize >= 0)
+			outFile << "Prefilter Shortlist: " << mShortlistSize
+			        << " of " << mNumPrefilterCandidates << endl;
+
+		//***2.3 - time spent in each phase of matching
+		mProfile.summarize(outFile, "Profile: ");
+
 		if (mTimeTaken > 0.0)
 			outFile << "Match Time: " << mTimeTaken << endl << endl;
 
@@ -277,8 +421,12 @@ void MatchResults::save(std::string fileName)
 
 			r->getMappingControlPoints(uBegin,uTip,uEnd,dbBegin,dbTip,dbEnd);
 
-			outFile << "  " << i + 1
-				<< "\t" << r->getError()
+			outFile << "  ";
+			if (r->isRanked()) //***2.3
+				outFile << i + 1;
+			else
+				outFile << "--";
+			outFile << "\t" << r->getError()
 				<< "\t" << r->getIdCode()
 				<< "\t" << r->getPosition()
 				<< "\t" << uBegin
@@ -290,12 +438,241 @@ void MatchResults::save(std::string fileName)
 				<< "\t" << r->getDamage()
 				<< endl;
 		}
+
+		//***2.3 - and the binary form, which load() reads much faster
+		if (mFinID != "")
+		{
+			int textFileSize = (int)outFile.tellp();
+			outFile.close();
+
+			if (! saveBinary(binaryFilename(fileName), textFileSize))
+				cout << "Could not write " << binaryFilename(fileName)
+				     << ", results will be reloaded from the text" << endl;
+		}
 		
 	} catch (...) {
 		throw;
 	}
 }
 
+//*******************************************************************
+//***2.3
+//
+string MatchResults::binaryFilename(string fileName)
+{
+	string::size_type p = fileName.rfind(".res");
+
+	if ((string::npos != p) && (p + 4 == fileName.length()))
+		return fileName.substr(0, p) + ".resb";
+
+	return fileName + ".resb";
+}
+
+//*******************************************************************
+//
+// static int appendString(string &strings, string s)
+//
+//    ***2.3 - Adds s and its '\0' to the strings of a binary results
+//    file and returns its offset.
+//
+static int appendString(string &strings, string s)
+{
+	int offset = strings.length();
+
+	strings.append(s.c_str(), s.length() + 1);
+
+	return offset;
+}
+
+//*******************************************************************
+//
+// bool MatchResults::saveBinary(string fileName, int textFileSize)
+//
+//    ***2.3 - Writes the results in the order shown, with the errors at
+//    full precision and the mapping coefficients, as a header, fixed
+//    width records and the strings (see matchResultsFileHeader_t).
+//    Returns false if the file could not be written.
+//
+bool MatchResults::saveBinary(string fileName, int textFileSize)
+{
+	string strings;
+
+	matchResultsFileHeader_t header;
+	memset(&header, 0, sizeof(header));
+
+	memcpy(header.magic, MATCHRESULTS_BINARY_MAGIC, sizeof(header.magic));
+	header.version = MATCHRESULTS_BINARY_VERSION;
+	header.headerSize = sizeof(matchResultsFileHeader_t);
+	header.recordSize = sizeof(matchResultRecord_t);
+	header.numResults = mResults.size();
+	header.textFileSize = textFileSize;
+	header.catalogGeneration = mCatalogGeneration;
+	header.shortlistSize = mShortlistSize;
+	header.numPrefilterCandidates = mNumPrefilterCandidates;
+	header.timeTaken = mTimeTaken;
+	header.finID = appendString(strings, mFinID);
+	header.tracedFinFile = appendString(strings, mTracedFinFile);
+	header.databaseFile = appendString(strings, mDatabaseFile);
+
+	vector<matchResultRecord_t> records(mResults.size() + 1); // never empty
+	memset(&records[0], 0, records.size() * sizeof(matchResultRecord_t));
+
+	for (int i = 0; i < (int)mResults.size(); i++)
+	{
+		Result *r = getResultNum(i);
+		matchResultRecord_t &rec = records[i];
+
+		rec.position = r->getPosition();
+		rec.error = r->getErrorValue();
+
+		if (r->isRanked())
+			rec.flags |= MR_RECORD_RANKED;
+
+		if (r->getMappingCoefficients(rec.mappingCoefficients))
+			rec.flags |= MR_RECORD_MAPPED;
+
+		r->getMappingControlPoints(
+				rec.controlPoints[0], rec.controlPoints[1], rec.controlPoints[2],
+				rec.controlPoints[3], rec.controlPoints[4], rec.controlPoints[5]);
+
+		rec.strings = appendString(strings, r->getIdCode());
+		appendString(strings, r->getName());
+		appendString(strings, r->getDamage());
+		appendString(strings, r->getDate());
+		appendString(strings, r->getLocation());
+		appendString(strings, r->getImageFilename());
+	}
+
+	header.stringsOffset = sizeof(header) + mResults.size() * sizeof(matchResultRecord_t);
+	header.stringsSize = strings.length();
+
+	ofstream outFile(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+
+	if (!outFile)
+		return false;
+
+	outFile.write((const char *)&header, sizeof(header));
+	outFile.write((const char *)&records[0], mResults.size() * sizeof(matchResultRecord_t));
+	outFile.write(strings.data(), strings.length());
+
+	return outFile.good();
+}
+
+//*******************************************************************
+//
+// bool MatchResults::loadBinary(Database *db, string fileName)
+//
+//    ***2.3 - Called by load() once the header of the text file fileName
+//    has been read and checked.  Maps the binary form of the results and
+//    adds them without reading any catalog fins.  Returns false, having
+//    added nothing, unless the binary file was saved with this text file
+//    (same size, ID and catalog) and the catalog generation is unchanged,
+//    in which case the positions and fields in it are still right.
+//
+bool MatchResults::loadBinary(Database *db, string fileName)
+{
+	if ((mCatalogGeneration < 0) || (db->catalogGeneration() != mCatalogGeneration))
+		return false;
+
+	ifstream textFile(fileName.c_str(), ios::in | ios::binary);
+	textFile.seekg(0, ios::end);
+	int textFileSize = (int)textFile.tellg();
+	textFile.close();
+
+	MappedFile file(binaryFilename(fileName));
+
+	if (file.size() < sizeof(matchResultsFileHeader_t))
+		return false;
+
+	const char *data = file.data();
+	const matchResultsFileHeader_t *header = (const matchResultsFileHeader_t *)data;
+
+	if ((0 != memcmp(header->magic, MATCHRESULTS_BINARY_MAGIC, sizeof(header->magic)))
+	    || (MATCHRESULTS_BINARY_VERSION != header->version)
+	    || (sizeof(matchResultsFileHeader_t) != header->headerSize)
+	    || (sizeof(matchResultRecord_t) != header->recordSize)
+	    || (header->numResults < 0)
+	    || (header->stringsOffset != (int)(sizeof(matchResultsFileHeader_t)
+	                                 + header->numResults * sizeof(matchResultRecord_t)))
+	    || (header->stringsSize <= 0)
+	    || (file.size() != (size_t)header->stringsOffset + header->stringsSize))
+		return false;
+
+	// every string ends within the strings, so none can be read past them
+	const char *strings = data + header->stringsOffset;
+	if ('\0' != strings[header->stringsSize - 1])
+		return false;
+
+	if ((header->textFileSize != textFileSize)
+	    || (header->catalogGeneration != mCatalogGeneration)
+	    || (header->finID < 0) || (header->finID >= header->stringsSize)
+	    || (header->databaseFile < 0) || (header->databaseFile >= header->stringsSize)
+	    || (mFinID != strings + header->finID)
+	    || (mDatabaseFile != strings + header->databaseFile))
+		return false;
+
+	const matchResultRecord_t *records =
+			(const matchResultRecord_t *)(data + sizeof(matchResultsFileHeader_t));
+
+	for (int i = 0; i < header->numResults; i++)
+	{
+		int s = records[i].strings;
+
+		if ((s < 0) || (s >= header->stringsSize))
+			return false;
+
+		for (int f = 0; f < 5; f++) // the image filename is last
+		{
+			s += strlen(strings + s) + 1;
+			if (s >= header->stringsSize)
+				return false;
+		}
+	}
+
+	mResults.reserve(mResults.size() + header->numResults);
+	mOrder.reserve(mOrder.size() + header->numResults);
+
+	for (int i = 0; i < header->numResults; i++)
+	{
+		const matchResultRecord_t &rec = records[i];
+
+		const char
+			*idCode = strings + rec.strings,
+			*name = idCode + strlen(idCode) + 1,
+			*damage = name + strlen(name) + 1,
+			*date = damage + strlen(damage) + 1,
+			*location = date + strlen(date) + 1,
+			*imageFilename = location + strlen(location) + 1;
+
+		Result r(
+				imageFilename,
+				rec.position,
+				rec.error,
+				idCode,
+				name,
+				damage,
+				date,
+				location);
+
+		r.setMappingControlPoints(
+				rec.controlPoints[0], rec.controlPoints[1], rec.controlPoints[2],
+				rec.controlPoints[3], rec.controlPoints[4], rec.controlPoints[5]);
+
+		if (rec.flags & MR_RECORD_MAPPED)
+			r.setMappingCoefficients(rec.mappingCoefficients);
+
+		r.setRanked(0 != (rec.flags & MR_RECORD_RANKED));
+
+		addResult(r);
+	}
+
+	mShortlistSize = header->shortlistSize;
+	mNumPrefilterCandidates = header->numPrefilterCandidates;
+	mTimeTaken = header->timeTaken;
+
+	return true;
+}
+
 //*******************************************************************
 //
 //
@@ -337,12 +714,18 @@ DatabaseFin<ColorImage> *MatchResults::load(Database *db, std::string fileName)
 		// or some part of path that is a prefix to the SurveyArea.  If the database
 		// is in the same SurveyArea and has the same database name, then we can
 		// proceed with the building of the MatchResults
-		int p = mDatabaseFile.find("surveyAreas"); 
+		//***2.3 - a catalog outside of any surveyAreas folder (as darwin-match
+		// allows) is compared by its whole path
+		string::size_type p = mDatabaseFile.find("surveyAreas"); 
+		if (string::npos == p)
+			p = 0;
 		string rqdAreaAndDB = mDatabaseFile.substr(p);  // survey area and database name
 		string rqdPreamble = mDatabaseFile.substr(0,p);    // strip it to get preamble
 
 		string currentDBFile = db->getFilename();
 		p = currentDBFile.find("surveyAreas"); 
+		if (string::npos == p)
+			p = 0;
 		string currentAreaAndDB = currentDBFile.substr(p); // survey area and catalog name
 		string currentPreamble = currentDBFile.substr(0,p); // strip it to get preamble
 
@@ -386,6 +769,7 @@ DatabaseFin<ColorImage> *MatchResults::load(Database *db, std::string fileName)
 
 				//ErrorDialog *err = new ErrorDialog(msg);
 				//err->show();
+#ifndef DARWIN_NO_GUI
 				//***2.22 - replacing own ErrorDialog with GtkMessageDialogs
 				GtkWidget *errd = gtk_message_dialog_new (NULL,
 										GTK_DIALOG_DESTROY_WITH_PARENT,
@@ -394,6 +778,9 @@ DatabaseFin<ColorImage> *MatchResults::load(Database *db, std::string fileName)
 										msg.c_str());
 				gtk_dialog_run (GTK_DIALOG (errd));
 				gtk_widget_destroy (errd);
+#else
+				cerr << msg << endl; //***2.3 - no dialogs in darwin-match
+#endif
 				return NULL;
 			}
 		}
@@ -405,10 +792,20 @@ DatabaseFin<ColorImage> *MatchResults::load(Database *db, std::string fileName)
 		else
 			unkFin = openFinz(mTracedFinFile);
 
+		setSource(db, unkFin->mFinOutline->getFloatContour()); //***2.3 - for loadContours()
 
-		getline(inFile,line); // skip Ranking
-		getline(inFile,line); // skip headers
-		getline(inFile,line); // skip line separator
+		//***2.3 - skip ranking, match time, abandoned count and headers up to
+		// and including the line separator, as not every file has them all
+		while (getline(inFile,line) && (line.find("____") != 0))
+		{
+			if (line.find("Catalog Generation: ") == 0)
+				mCatalogGeneration = atoi(line.substr(20).c_str());
+		}
+
+		//***2.3 - the binary form, when it is up to date, needs no parsing
+		// and no catalog fins
+		if (loadBinary(db, fileName))
+			return unkFin;
 
 		// get match info on each matched database fin
 		while (getline(inFile,line))
@@ -418,6 +815,8 @@ DatabaseFin<ColorImage> *MatchResults::load(Database *db, std::string fileName)
 			string rank = line.substr(0,pos); 
 			line = line.substr(pos+1);
 
+			bool ranked = (rank.find("--") == string::npos); //***2.3
+
 			pos = line.find("\t");
 			string error = line.substr(0,pos);
 			line = line.substr(pos+1);
@@ -494,23 +893,12 @@ DatabaseFin<ColorImage> *MatchResults::load(Database *db, std::string fileName)
 				cout << "Disaster " << thisDBFin->getID() 
 				     << " " << dbFinID << "\n";
 
-			FloatContour *mappedUnknownContour = mapContour(
-					unkFin->mFinOutline->getFloatContour(),
-					(*(unkFin->mFinOutline->getFloatContour()))[uTip],
-					(*(unkFin->mFinOutline->getFloatContour()))[uBegin],
-					(*(unkFin->mFinOutline->getFloatContour()))[uEnd],
-					(*(thisDBFin->mFinOutline->getFloatContour()))[dbTip],
-					(*(thisDBFin->mFinOutline->getFloatContour()))[dbBegin],
-					(*(thisDBFin->mFinOutline->getFloatContour()))[dbEnd]);
-
+			//***2.3 - the mapped contours and thumbnail are now only loaded
+			// for the results that are displayed, see loadContours()
 			Result r(
-					mappedUnknownContour,                      //***1.3 - Mem Leak - constructor make copy now
-					thisDBFin->mFinOutline->getFloatContour(), //***1.3 - Mem Leak - constructor make copy now
 					thisDBFin->mImageFilename,
-					thisDBFin->mThumbnailPixmap,
-					thisDBFin->mThumbnailRows,
 					dbFinPosition, // position of fin in database
-					error,
+					atof(error.c_str()), //***2.3
 					thisDBFin->mIDCode,
 					thisDBFin->mName,
 					thisDBFin->mDamageCategory,
@@ -521,9 +909,10 @@ DatabaseFin<ColorImage> *MatchResults::load(Database *db, std::string fileName)
 					uBegin,uTip,uEnd,  // beginning, tip & end of unknown fin
 					dbBegin,dbTip,dbEnd); // beginning, tip & end of database fin
 
+			r.setRanked(ranked); //***2.3
+
 			addResult(r);
 
-			delete mappedUnknownContour; //***1.3 - Mem Leak
 			delete thisDBFin;
 		}
 
@@ -539,3 +928,121 @@ DatabaseFin<ColorImage> *MatchResults::load(Database *db, std::string fileName)
 		throw;
 	}
 }
+
+//*******************************************************************
+//***2.3
+//
+void MatchResults::setSource(Database *db, const FloatContour *unknownContour)
+{
+	mDatabase = db;
+
+	delete mUnknownContour;
+	mUnknownContour = NULL;
+
+	if (NULL != unknownContour)
+		mUnknownContour = new FloatContour(*unknownContour);
+}
+
+//*******************************************************************
+//***2.3
+//
+bool MatchResults::loadThumbnail(int resultNum)
+{
+	Result *r = getResultNum(resultNum);
+
+	if (NULL != r->mThumbnailPixmap)
+		return true;
+
+	return loadFromDatabase(r, false);
+}
+
+//*******************************************************************
+//***2.3
+//
+bool MatchResults::loadContours(int resultNum)
+{
+	Result *r = getResultNum(resultNum);
+
+	if ((NULL != r->unknownContour) && (NULL != r->dbContour))
+		return true;
+
+	return loadFromDatabase(r, true);
+}
+
+//*******************************************************************
+//
+// bool MatchResults::loadFromDatabase(Result *r, bool contours)
+//
+//    ***2.3 - Fetches the catalog fin of r and copies its thumbnail, and
+//    if contours is set its evenly spaced outline and the unknown mapped
+//    onto it through the control points of r.
+//
+bool MatchResults::loadFromDatabase(Result *r, bool contours)
+{
+	if ((NULL == mDatabase) || (contours && (NULL == mUnknownContour)))
+		return false;
+
+	DatabaseFin<ColorImage> *thisDBFin = mDatabase->getItemAbsolute(r->getPosition());
+
+	if (NULL == thisDBFin)
+		return false;
+
+	try {
+
+		if ((NULL == r->mThumbnailPixmap) && (NULL != thisDBFin->mThumbnailPixmap))
+		{
+			r->mThumbnailRows = thisDBFin->mThumbnailRows;
+			r->mThumbnailPixmap = new char*[r->mThumbnailRows];
+
+			for (int i = 0; i < r->mThumbnailRows; i++) {
+				r->mThumbnailPixmap[i] = new char[strlen(thisDBFin->mThumbnailPixmap[i]) + 1];
+				strcpy(r->mThumbnailPixmap[i], thisDBFin->mThumbnailPixmap[i]);
+			}
+		}
+
+		if (contours)
+		{
+			FloatContour *dbContour = thisDBFin->mFinOutline->getFloatContour();
+
+			int uBegin,uTip,uEnd,dbBegin,dbTip,dbEnd;
+			r->getMappingControlPoints(uBegin,uTip,uEnd,dbBegin,dbTip,dbEnd);
+
+			if ((uBegin < 0) || (uTip < 0) || (uEnd < 0)
+			    || (uBegin >= mUnknownContour->length()) || (uTip >= mUnknownContour->length())
+			    || (uEnd >= mUnknownContour->length())
+			    || (dbBegin < 0) || (dbTip < 0) || (dbEnd < 0)
+			    || (dbBegin >= dbContour->length()) || (dbTip >= dbContour->length())
+			    || (dbEnd >= dbContour->length()))
+				throw BoundsError("MatchResults::loadContours() mapping control points");
+
+			delete r->unknownContour;
+			delete r->dbContour;
+
+			// the transform is only solved for when not saved with r
+			float coeff[2][3];
+			if (r->getMappingCoefficients(coeff))
+			{
+				r->unknownContour = new FloatContour();
+				mapContour(mUnknownContour, coeff, r->unknownContour);
+			}
+			else
+				r->unknownContour = mapContour(
+						mUnknownContour,
+						(*mUnknownContour)[uTip],
+						(*mUnknownContour)[uBegin],
+						(*mUnknownContour)[uEnd],
+						(*dbContour)[dbTip],
+						(*dbContour)[dbBegin],
+						(*dbContour)[dbEnd]);
+			r->dbContour = new FloatContour(*dbContour);
+		}
+
+	} catch (...) {
+		delete thisDBFin;
+		throw;
+	}
+
+	delete thisDBFin;
+
+	return true;
+}
@@ -14,8 +14,11 @@
 #include "../Database.h"
 #pragma warning(disable:4786) //  1.95 removes debug warnings in <string> <vector> <map> etc
 #include <string>
-#include <list>
+#include <vector> //  2.3 - was <list>
+#include <cstdio>
+#include <cstring>
 #include "../FloatContour.h" //  005CM
+#include "../MatchProfile.h" //  2.3
 
 // original sizes - should be 128x128 and 64x64 when revised later
 // const int MATCHRESULTS_THUMB_HEIGHT = 60, MATCHRESULTS_THUMB_WIDTH = 60;
@@ -25,24 +28,31 @@ const int MATCHRESULTS_THUMB_HEIGHT = 25, MATCHRESULTS_THUMB_WIDTH = 25;
 
 // This class is a little silly, I admit... for some reason I feel like
 // doing it this way right now, though.
+//
+//  2.3 - A Result is now only a record of the match (position, error,
+// descriptive fields and mapping control points).  The mapped contours
+// and the thumbnail are NULL until MatchResults::loadContours() or
+// MatchResults::loadThumbnail() fills them in for a result that is to
+// be displayed, so that matching a large catalog does not keep two
+// contours and a thumbnail for every fin.
 class Result {
 
 	public:
 	
 		Result(
-			FloatContour *unknown, //  005CM
-			FloatContour *db, //  005CM
 			std::string filename,	//  001DB
-			char **thumbnailPixmap, //  1.0
-			int thumbnailRows, //  1.0
 			int position,
-			std::string error,
+			double error, //  2.3 - was formatted string
 			std::string idcode,
 			std::string name,
 			std::string damage,
 			std::string date,
 			std::string location
 		) :	
+			unknownContour(NULL), //  2.3 - loaded when needed
+			dbContour(NULL),
+			mThumbnailPixmap(NULL),
+			mThumbnailRows(0),
 			mFilename(filename), //  001DB
 			mPosition(position),
 			mError(error),
@@ -51,53 +61,15 @@ class Result {
 			mDamage(damage),
 			mLocation(location),
 			mRank(""), //  1.5
+			mRanked(true), //  2.3
 			mUnkShiftedLEBegin(0), //  1.1 - following indices set to defaults by constructor
 			mUnkShiftedTip(0),
 			mUnkShiftedTEEnd(0),
 			mDBShiftedLEBegin(0), 
 			mDBShiftedTip(0), 
-			mDBShiftedTEEnd(0)
-
-		{
-			unknownContour = new FloatContour(*unknown); //  1.3 - Mem Leak - make copies now
-			dbContour = new FloatContour(*db);           //  1.3 - Mem Leak - make copies now
-
-			// MAJOR change JHS
-			// removed reloading of image and recreation of thumbnail here
-/*
-			ColorImage *temp = new ColorImage(filename); //  001DB
-						convColorToPixmapString(
-						temp,   //  001DB
-						MATCHRESULTS_THUMB_HEIGHT,
-						MATCHRESULTS_THUMB_WIDTH,
-						mThumbnailPixmap,
-						mThumbnailRows);
-			delete temp;  //  001DB
-*/
-
-			//  1.0
-			if (NULL == thumbnailPixmap) 
-			{
-				mThumbnailPixmap = NULL;
-				mThumbnailRows = 0;
-			} 
-			else
-			{	
-				// in the future we will revise this call and create a smaller version
-				// rather than copying or creating a pixelized larger version
-				// 
-				// makeDoubleSizePixmapString(thumbnailPixmap, mThumbnailPixmap, mThumbnailRows);
-				
-				// simply copy the thumbnail for now and use 25 x 25 thumnails everywhere
-				mThumbnailRows = thumbnailRows;
-				mThumbnailPixmap = new char*[mThumbnailRows];
-
-				for (int i = 0; i < mThumbnailRows; i++) {
-					mThumbnailPixmap[i] = new char[strlen(thumbnailPixmap[i]) + 1];
-					strcpy(mThumbnailPixmap[i], thumbnailPixmap[i]);
-				}
-			}
-		}
+			mDBShiftedTEEnd(0),
+			mHasMappingCoefficients(false) //  2.3
+		{ }
 
 /* 1.1 - this form of constructor is never used - JHS
 		Result(
@@ -122,6 +94,10 @@ class Result {
 
 		Result(const Result& r)
 		: 
+			unknownContour(NULL),
+			dbContour(NULL),
+			mThumbnailPixmap(NULL),
+			mThumbnailRows(0),
       		mFilename(r.mFilename),   //  001DB
 			mPosition(r.mPosition),
 			mError(r.mError),
@@ -130,43 +106,23 @@ class Result {
 			mDamage(r.mDamage),
 			mLocation(r.mLocation),
 			mRank(r.mRank), //  1.5
-			unknownContour(new FloatContour(*r.unknownContour)), //  1.3 - Mem Leak - make copies now
-			dbContour(new FloatContour(*r.dbContour)),           //  1.3 - Mem Leak - make copies now
+			mRanked(r.mRanked), //  2.3
 			mUnkShiftedLEBegin(r.mUnkShiftedLEBegin), 
 			mUnkShiftedTip(r.mUnkShiftedTip), 
 			mUnkShiftedTEEnd(r.mUnkShiftedTEEnd),
 			mDBShiftedLEBegin(r.mDBShiftedLEBegin), 
 			mDBShiftedTip(r.mDBShiftedTip), 
-			mDBShiftedTEEnd(r.mDBShiftedTEEnd)
+			mDBShiftedTEEnd(r.mDBShiftedTEEnd),
+			mHasMappingCoefficients(r.mHasMappingCoefficients) //  2.3
 
 		{
-			if (NULL == r.mThumbnailPixmap) {
-				mThumbnailPixmap = NULL;
-				mThumbnailRows = 0;
-			} else {
-				mThumbnailRows = r.mThumbnailRows;
-				mThumbnailPixmap = new char*[mThumbnailRows];
-
-				for (int i = 0; i < mThumbnailRows; i++) {
-					mThumbnailPixmap[i] = new char[strlen(r.mThumbnailPixmap[i]) + 1];
-					strcpy(mThumbnailPixmap[i], r.mThumbnailPixmap[i]);
-				}
-			}
+			memcpy(mMappingCoefficients, r.mMappingCoefficients, sizeof(mMappingCoefficients)); //  2.3
+			copyLoaded(r); //  2.3
 		}
 
 		~Result()
 		{
-			if (NULL != mThumbnailPixmap)
-				freePixmapString(mThumbnailPixmap, mThumbnailRows);
-			//  1.3 - cannot delete the contours here - don't remember why
-			// they are (probably) just pointers to contours managed elsewhere
-			
-			//  1.3 - MemLeak - must delete copies now
-			if (NULL != unknownContour)
-				delete unknownContour;
-			if (NULL != dbContour)
-				delete dbContour;
-			
+			freeLoaded(); //  2.3
 		}
 
 		Result& operator=(const Result &r)
@@ -174,6 +130,7 @@ class Result {
 			if (this == &r)
 				return *this;
 
+			mFilename = r.mFilename;
 			mPosition = r.mPosition;
 			mError = r.mError;
 			mIdCode = r.mIdCode;
@@ -181,21 +138,19 @@ class Result {
 			mDamage = r.mDamage;
 			mLocation = r.mLocation;
 			mRank = r.mRank; //  1.5
-			unknownContour = r.unknownContour; //  005CM
-			dbContour = r.dbContour; //  005CM
-
-			if (NULL == r.mThumbnailPixmap) {
-				mThumbnailPixmap = NULL;
-				mThumbnailRows = 0;
-			} else {
-				mThumbnailRows = r.mThumbnailRows;
-				mThumbnailPixmap = new char*[mThumbnailRows];
-
-				for (int i = 0; i < mThumbnailRows; i++) {
-					mThumbnailPixmap[i] = new char[strlen(r.mThumbnailPixmap[i]) + 1];
-					strcpy(mThumbnailPixmap[i], r.mThumbnailPixmap[i]);
-				}
-			}		
+			mRanked = r.mRanked; //  2.3
+			mUnkShiftedLEBegin = r.mUnkShiftedLEBegin;
+			mUnkShiftedTip = r.mUnkShiftedTip;
+			mUnkShiftedTEEnd = r.mUnkShiftedTEEnd;
+			mDBShiftedLEBegin = r.mDBShiftedLEBegin;
+			mDBShiftedTip = r.mDBShiftedTip;
+			mDBShiftedTEEnd = r.mDBShiftedTEEnd;
+			mHasMappingCoefficients = r.mHasMappingCoefficients; //  2.3
+			memcpy(mMappingCoefficients, r.mMappingCoefficients, sizeof(mMappingCoefficients));
+
+			//  2.3 - copies, not the pointers, so each Result owns its own
+			freeLoaded();
+			copyLoaded(r);
 
 			return *this;
 		}
@@ -203,14 +158,28 @@ class Result {
 		int getPosition() const { return mPosition; }
 		std::string getName() const { return mName; }
 		std::string getDate() const { return mDate; }
-		std::string getError() const { return mError; }
+		//  2.3 - the error is kept as a number and only formatted for
+		// display and saving
+		std::string getError() const
+		{
+			char error[32];
+			sprintf(error, "%6.2f", mError);
+			return error;
+		}
+		double getErrorValue() const { return mError; }
 		std::string getIdCode() const { return mIdCode; }
 		std::string getDamage() const { return mDamage; }
 		std::string getLocation() const { return mLocation; }
 		std::string getRank() const { return mRank; } //  1.5
+		std::string getImageFilename() const { return mFilename; } //  2.3
 
 		void setRank (const std::string rank) {mRank = rank;} //  1.5
 
+		//  2.3 - false for a fin whose registration was abandoned early in
+		// top-K matching, its error is not comparable with the ranked fins
+		bool isRanked() const { return mRanked; }
+		void setRanked(bool ranked) { mRanked = ranked; }
+
 		//  1.1 - sets six indices for points used in final contour mapping
 		void setMappingControlPoints(
 				int unkLEBegin, int unkTip, int unkTEEnd,
@@ -236,28 +205,83 @@ class Result {
 			dbTip = mDBShiftedTip;
 			dbTEEnd = mDBShiftedTEEnd;
 		}
+
+		//  2.3 - the affine transform (see affineMapCoefficients()) taking
+		// the unknown's control points onto the database fin's, so that the
+		// mapped unknown can be rebuilt without solving for it again.  Set
+		// by Match and by binary loads, getMappingCoefficients() returns
+		// false for results read from a text file.
+		void setMappingCoefficients(const float coeff[2][3])
+		{
+			memcpy(mMappingCoefficients, coeff, sizeof(mMappingCoefficients));
+			mHasMappingCoefficients = true;
+		}
+
+		bool getMappingCoefficients(float coeff[2][3]) const
+		{
+			if (mHasMappingCoefficients)
+				memcpy(coeff, mMappingCoefficients, sizeof(mMappingCoefficients));
+			return mHasMappingCoefficients;
+		}
 		
 		//  005CM - contours used in final match
+		//  2.3 - NULL until loaded by MatchResults::loadContours()
 		FloatContour 
 			*unknownContour,
 			*dbContour;
 
+		//  2.3 - NULL until loaded by MatchResults::loadThumbnail()
 		char **mThumbnailPixmap;
 		int mThumbnailRows;
 
+		//  2.3 - drops the loaded contours and thumbnail
+		void freeLoaded()
+		{
+			if (NULL != mThumbnailPixmap)
+				freePixmapString(mThumbnailPixmap, mThumbnailRows);
+			mThumbnailPixmap = NULL;
+			mThumbnailRows = 0;
+
+			delete unknownContour;
+			delete dbContour;
+			unknownContour = dbContour = NULL;
+		}
+
 	private:
+
+		//  2.3 - copies whatever r has loaded
+		void copyLoaded(const Result &r)
+		{
+			if (NULL != r.unknownContour)
+				unknownContour = new FloatContour(*r.unknownContour);
+			if (NULL != r.dbContour)
+				dbContour = new FloatContour(*r.dbContour);
+
+			if (NULL != r.mThumbnailPixmap)
+			{
+				mThumbnailRows = r.mThumbnailRows;
+				mThumbnailPixmap = new char*[mThumbnailRows];
+
+				for (int i = 0; i < mThumbnailRows; i++) {
+					mThumbnailPixmap[i] = new char[strlen(r.mThumbnailPixmap[i]) + 1];
+					strcpy(mThumbnailPixmap[i], r.mThumbnailPixmap[i]);
+				}
+			}
+		}
 	
 		std::string mFilename;    //  001DB - image file for database fin
 		int mPosition;            // position (index) of database fin in database file
+		double mError;            //  2.3 - was string, see getError()
 
 		std::string
-			mError,
 			mIdCode,
 			mName,
 			mDamage,
 			mDate,
 			mLocation,
 			mRank; //  1.5
+
+		bool mRanked; //  2.3
 		
 		//  1.1 - new members to track three point correspondences for final mapping in match
 
@@ -269,6 +293,9 @@ class Result {
 			mDBShiftedTip, 
 			mDBShiftedTEEnd;
 
+		bool mHasMappingCoefficients; //  2.3
+		float mMappingCoefficients[2][3];
+
 };	
 
 typedef enum {MR_ERROR, MR_NAME, MR_IDCODE, MR_DAMAGE, MR_DATE, MR_LOCATION} mr_sort_t;
@@ -283,7 +310,12 @@ class MatchResults {
 			mTimeTaken(-1.00),
 			mFinID(""),
 			mTracedFinFile(""),
-			mDatabaseFile("")
+			mDatabaseFile(""),
+			mShortlistSize(-1), //  2.3
+			mNumPrefilterCandidates(0), //  2.3
+			mCatalogGeneration(-1), //  2.3
+			mDatabase(NULL), //  2.3
+			mUnknownContour(NULL) //  2.3
 		{ }
 			  
 		MatchResults(std::string id)
@@ -292,7 +324,12 @@ class MatchResults {
 			mTimeTaken(-1.00),
 			mFinID(id),
 			mTracedFinFile(""),
-			mDatabaseFile("")
+			mDatabaseFile(""),
+			mShortlistSize(-1), //  2.3
+			mNumPrefilterCandidates(0), //  2.3
+			mCatalogGeneration(-1), //  2.3
+			mDatabase(NULL), //  2.3
+			mUnknownContour(NULL) //  2.3
 		{ }
 
 
@@ -303,14 +340,26 @@ class MatchResults {
 			mTimeTaken(results.mTimeTaken),
 			mFinID(results.mFinID),
 			mResults(results.mResults),
+			mOrder(results.mOrder), //  2.3
 			mTracedFinFile(results.mTracedFinFile),
-			mDatabaseFile(results.mDatabaseFile)
-		{ }
+			mDatabaseFile(results.mDatabaseFile),
+			mShortlistSize(results.mShortlistSize), //  2.3
+			mNumPrefilterCandidates(results.mNumPrefilterCandidates), //  2.3
+			mCatalogGeneration(results.mCatalogGeneration), //  2.3
+			mProfile(results.mProfile), //  2.3
+			mDatabase(results.mDatabase), //  2.3
+			mUnknownContour(NULL) //  2.3
+		{
+			if (NULL != results.mUnknownContour)
+				mUnknownContour = new FloatContour(*results.mUnknownContour);
+		}
 
 		//  1.0LK - fixing memory leak
 		~MatchResults()
 		{
 			mResults.clear();
+			mOrder.clear(); //  2.3
+			delete mUnknownContour; //  2.3
 		}
 
 		void addResult(const Result& r);
@@ -328,6 +377,7 @@ class MatchResults {
 
 		// doesn't make a copy to save time... so DON'T DELETE
 		// THE RESULT WHEN DONE
+		//  2.3 - and don't keep it past the next addResult()
 		Result* getResultNum(int resultNum);
 
 		void setTimeTaken(float timeTaken);
@@ -337,10 +387,37 @@ class MatchResults {
 		// 	time is undefined.
 		float getTimeTaken();
 
+		//  2.3 - also writes the binary form of the results next to
+		// fileName, see binaryFilename()
 		void save(std::string fileName);
 
+		//  2.3 - the binary form of results saved as fileName: the .res
+		// name with ".resb" in its place.  load() reads it instead of the
+		// text when it was saved with that very text file and the catalog
+		// has not changed since (same catalog generation).  Written in the
+		// byte order of the machine, another machine just reads the text.
+		static std::string binaryFilename(std::string fileName);
+
 		int findRank();
 
+		int numUnranked() const; //  2.3 - fins abandoned early in top-K matching
+
+		//  2.3 - number of fins registered after the shape descriptor prefilter,
+		// of how many candidates (saved in the file header)
+		void setShortlist(int shortlistSize, int numCandidates)
+		{	mShortlistSize = shortlistSize; mNumPrefilterCandidates = numCandidates; }
+
+		//  2.3 - generation of the catalog when matching began (see
+		// Database::catalogGeneration()), saved in the file header so that
+		// the results can later be brought up to date (see
+		// Match::matchAddedSince())
+		void setCatalogGeneration(int generation) { mCatalogGeneration = generation; }
+		int getCatalogGeneration() const { return mCatalogGeneration; }
+
+		//  2.3 - where Match collects the time spent in each phase of
+		// matching (see MatchProfile.h), saved in the file header
+		MatchProfile *getProfile() { return &mProfile; }
+
 		//  1.1 - the following functions used in MatchQueue context
 
 		void setFinFilename(std::string fname) //  1.1
@@ -351,11 +428,30 @@ class MatchResults {
 
 		DatabaseFin<ColorImage> *load(Database *db, std::string fileName);
 
+		//  2.3 - where loadContours() and loadThumbnail() find the fins: the
+		// catalog matched and the evenly spaced outline of the unknown
+		// (copied), set by Match and by load()
+		void setSource(Database *db, const FloatContour *unknownContour);
+
+		//  2.3 - fill in the thumbnail, or the mapped unknown and database
+		// contours, of one result the first time they are needed.  The
+		// mapped unknown is rebuilt from the mapping control points, as
+		// when results are loaded from a file.  Return false if the fin is
+		// no longer in the catalog, or the source has not been set.
+		bool loadThumbnail(int resultNum);
+		bool loadContours(int resultNum);
+
 
 	private:
+
+		MatchResults& operator=(const MatchResults &results); //  2.3 - not defined, do not assign
 	
 		mr_sort_t mLastSortBy;
-		std::list<Result> mResults;		
+		//  2.3 - results in the order they were added, and the current
+		// (sorted) order as indices into mResults, so that sorting never
+		// copies a Result
+		std::vector<Result> mResults;
+		std::vector<int> mOrder;
 		float mTimeTaken;
 		std::string mFinID; // this is the unknown fin ID
 
@@ -364,6 +460,21 @@ class MatchResults {
 
 		std::string mTracedFinFile; //  1.1 - "" or file containing saved unknown DatabaseFin
 		std::string mDatabaseFile; //  1.1 - "" or database file matched by MatchQueue
+
+		int
+			mShortlistSize, //  2.3 - -1 when the prefilter was not used
+			mNumPrefilterCandidates,
+			mCatalogGeneration; //  2.3 - -1 when not known
+
+		MatchProfile mProfile; //  2.3
+
+		Database *mDatabase;             //  2.3 - see setSource()
+		FloatContour *mUnknownContour;
+
+		bool loadFromDatabase(Result *r, bool contours); //  2.3
+
+		bool saveBinary(std::string fileName, int textFileSize); //  2.3
+		bool loadBinary(Database *db, std::string fileName);
 };
 
 #endif
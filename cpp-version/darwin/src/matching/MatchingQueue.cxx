@@ -16,19 +16,186 @@
 #include "Error.h"
 #include <iostream>
 #include <fstream>
+#include <deque> //***2.3
+#include <vector>
 
 #include "Match.h"
 #include "MatchResults.h"
 #include "MatchingQueue.h"
+#include "../MatchSnapshot.h" //***2.3
 
 #ifdef WIN32
+#include <windows.h> //***2.3 - worker threads
 #define PATH_SLASH "\\"
 #else
+#include <pthread.h> //***2.3 - worker threads
+#include <unistd.h>
 #define PATH_SLASH "/"
 #endif
 
 using namespace std;
 
+//***2.3 - locks of the matchAll() worker pool
+#ifdef WIN32
+typedef CRITICAL_SECTION queueLock_t;
+#define QUEUE_LOCK_INIT(l)     InitializeCriticalSection(&(l))
+#define QUEUE_LOCK_DESTROY(l)  DeleteCriticalSection(&(l))
+#define QUEUE_LOCK(l)          EnterCriticalSection(&(l))
+#define QUEUE_UNLOCK(l)        LeaveCriticalSection(&(l))
+#define QUEUE_PAUSE()          Sleep(1)
+#else
+typedef pthread_mutex_t queueLock_t;
+#define QUEUE_LOCK_INIT(l)     pthread_mutex_init(&(l), NULL)
+#define QUEUE_LOCK_DESTROY(l)  pthread_mutex_destroy(&(l))
+#define QUEUE_LOCK(l)          pthread_mutex_lock(&(l))
+#define QUEUE_UNLOCK(l)        pthread_mutex_unlock(&(l))
+#define QUEUE_PAUSE()          usleep(1000)
+#endif
+
+//*******************************************************************
+//
+// class QueueUnknown
+//
+//    ***2.3 - One unknown being matched by MatchingQueue::matchAll(),
+//    from the time its slices are queued until the last one is done.
+//
+class QueueUnknown
+{
+	public:
+		int itemNum;
+		DatabaseFin<ColorImage> *fin;
+		Match *matcher;
+
+		int slicesLeft;        // guarded by lock
+		double seconds;        // spent matching it, guarded by lock
+
+		// also guards the matcher's top-K errors (see Match::noteSliceErrors())
+		queueLock_t lock;
+
+		QueueUnknown()
+		:	itemNum(-1),
+			fin(NULL),
+			matcher(NULL),
+			slicesLeft(0),
+			seconds(0.0)
+		{
+			QUEUE_LOCK_INIT(lock);
+		}
+
+		~QueueUnknown()
+		{
+			delete matcher;
+			delete fin;
+			QUEUE_LOCK_DESTROY(lock);
+		}
+};
+
+typedef struct {
+	int unknown;   // item number in the queue
+	int slice;     // see Match::registerSlice()
+} queueTask_t;
+
+//*******************************************************************
+//
+// class QueueWork
+//
+//    ***2.3 - Everything shared by the worker threads of matchAll().
+//    Each worker has its own deque of tasks.  It takes its own tasks
+//    from the front, oldest unknown first, and when it runs out it
+//    steals from the back of another worker's deque, so thieves take
+//    the work furthest from being needed.  When no task is left to
+//    take, a worker loads the next unknown and queues its slices.
+//
+//    lock guards the rest of the work, and is held while unknowns are
+//    loaded and finished, so only one thread at a time uses the
+//    database, writes results or adds to the summary.
+//
+class QueueWork
+{
+	public:
+		MatchingQueue *queue;
+		int registrationMethod;
+		bool *categoryToMatch;
+		bool useFullFinError;
+		std::string outFolder;
+		bool update;
+		std::ostream *out;
+
+		int numWorkers;
+		std::vector<std::deque<queueTask_t> > tasks;
+		queueLock_t *taskLocks;   // one per deque of tasks
+
+		std::vector<QueueUnknown*> unknowns; // by item number, NULL unless in flight
+		int
+			nextItem,
+			numItems,
+			numInFlight,
+			maxInFlight,        // bounds the number of unknowns in memory
+			numMatched;
+
+		// matchBatch() only: the unknowns of the current batch, and the
+		// blocks of catalog fins claimed by the workers
+		std::vector<int> batch;
+		int
+			nextBlock,
+			numBlocks,
+			blockSize;
+		bool failed;
+		std::string errorMsg;
+
+		queueLock_t lock;
+
+		QueueWork(int workers, int items)
+		:	queue(NULL),
+			registrationMethod(0),
+			categoryToMatch(NULL),
+			useFullFinError(false),
+			update(false),
+			out(&std::cout),
+			numWorkers(workers),
+			tasks(workers),
+			unknowns(items, (QueueUnknown*)NULL),
+			nextItem(0),
+			numItems(items),
+			numInFlight(0),
+			maxInFlight(2 * workers),
+			numMatched(0),
+			nextBlock(0),
+			numBlocks(0),
+			blockSize(MATCHING_QUEUE_BLOCK_SIZE),
+			failed(false)
+		{
+			taskLocks = new queueLock_t[workers];
+			for (int w = 0; w < workers; w++)
+				QUEUE_LOCK_INIT(taskLocks[w]);
+			QUEUE_LOCK_INIT(lock);
+		}
+
+		~QueueWork()
+		{
+			for (int i = 0; i < (int)unknowns.size(); i++)
+				delete unknowns[i]; // left by a failure
+
+			for (int w = 0; w < numWorkers; w++)
+				QUEUE_LOCK_DESTROY(taskLocks[w]);
+			delete[] taskLocks;
+			QUEUE_LOCK_DESTROY(lock);
+		}
+
+		// lock must be held, only the first failure is reported
+		void setFailed(std::string msg)
+		{
+			if (! failed)
+				errorMsg = msg;
+			failed = true;
+		}
+};
+
+typedef struct {
+	QueueWork *work;
+	int worker;
+} queueWorkerArg_t;
+
 MatchingQueue::MatchingQueue(Database *d, Options *o)
 	:
 		mFinDatabase(d),
@@ -68,6 +235,15 @@ void MatchingQueue::setupMatching()
 	mWorstRank = 0; 
 	mBestRank = 0;
 	mTotalTime = 0.0;
+	mNumMatched = 0;   //***2.3
+	mNumAbandoned = 0; //***2.3
+	mNumPrefiltered = 0; //***2.3
+	mNumPrefilterTrue = 0;
+	mNumPrefilterKept = 0;
+	mNumShortlisted = 0;
+	mNumPrefilterCandidates = 0;
+	mNumCacheHits = 0; //***2.3
+	mProfile.reset(); //***2.3
 	mFirstRun = true;
 
 	mCurrentFinID = -1; // start prior to first unknown fin in list
@@ -92,26 +268,50 @@ Match *MatchingQueue::getNextUnknownToMatch()
 	if (mCurrentFinID >= (int)mFileNames.size())
 		return NULL;
 
+	mMatcher = newMatcher(mCurrentFinID, mUnknownFin); //***2.3
+
+	if (NULL == mMatcher)
+		return NULL;
+
+	mResults = mMatcher->getMatchResults();
+
+	return mMatcher;
+}
+
+//*******************************************************************
+//
+// Match *MatchingQueue::newMatcher(int itemNum,
+//                                  DatabaseFin<ColorImage> *&unknownFin)
+//
+//    ***2.3 - Loads unknown fin itemNum of the queue into unknownFin and
+//    returns a new Match for it, both to be deleted by the caller.
+//    Returns NULL (and unknownFin NULL) if the fin could not be loaded.
+//
+Match *MatchingQueue::newMatcher(int itemNum, DatabaseFin<ColorImage> *&unknownFin)
+{
+	unknownFin = NULL;
+
 	//mUnknownFin = this->getItemNum(mCurrentFinID); replaced
-	string tracedFinFilename = this->getItemNum(mCurrentFinID); //***1.1
+	string tracedFinFilename = this->getItemNum(itemNum); //***1.1
 	
 	if(string::npos == tracedFinFilename.rfind(".finz"))
 	{
 		if (isTracedFinFile(tracedFinFilename))
-			mUnknownFin = new DatabaseFin<ColorImage>(tracedFinFilename); //***1.1
+			unknownFin = new DatabaseFin<ColorImage>(tracedFinFilename); //***1.1
 	}
 	else
-		mUnknownFin = openFinz(tracedFinFilename);
+		unknownFin = openFinz(tracedFinFilename);
 
-	if (NULL == mUnknownFin)
+	if (NULL == unknownFin)
 		return NULL;         //***2.0 - in case .finz or .fin file was corrupt
 
-	mMatcher = new Match(mUnknownFin, mFinDatabase, mOptions);
-	mResults = mMatcher->getMatchResults();
-	mResults->setFinFilename(tracedFinFilename); //***1.1
-	mResults->setDatabaseFilename(mOptions->mDatabaseFileName); //***1.1
+	Match *matcher = new Match(unknownFin, mFinDatabase, mOptions);
 
-	return mMatcher;
+	MatchResults *results = matcher->getMatchResults();
+	results->setFinFilename(tracedFinFilename); //***1.1
+	results->setDatabaseFilename(mOptions->mDatabaseFileName); //***1.1
+
+	return matcher;
 }
 
 Match *MatchingQueue::getCurrentUnknownToMatch()
@@ -133,10 +333,58 @@ float MatchingQueue::matchProgress()
 
 void MatchingQueue::finalizeMatch()
 {
-	int rank = mResults->findRank();
+	addToSummary(mMatcher, mResults); //***2.3
+
+	if (NULL != mUnknownFin)
+	{
+		delete mUnknownFin;
+		mUnknownFin = NULL;
+	}
+
+	if (NULL != mMatcher)
+	{
+		delete mMatcher;
+		mMatcher = NULL;
+	}
+}
+
+//*******************************************************************
+//
+// void MatchingQueue::addToSummary(Match *matcher, MatchResults *results)
+//
+//    Adds the results of one unknown to the statistics reported by
+//    summarizeMatching().  ***2.3 - split from finalizeMatch() so that
+//    matchAll() can use it, with only one thread at a time calling it.
+//
+void MatchingQueue::addToSummary(Match *matcher, MatchResults *results)
+{
+	int rank = results->findRank();
+
+	//***2.3 - recall of the shape descriptor prefilter (stage one)
+	bool prefilterDroppedID = false;
+	if ((NULL != matcher) && (matcher->getNumPrefilterCandidates() > 0))
+	{
+		mNumPrefiltered++;
+		mNumShortlisted += matcher->getShortlistSize();
+		mNumPrefilterCandidates += matcher->getNumPrefilterCandidates();
+
+		int trueRank = matcher->getPrefilterTrueRank();
+		if (trueRank != -1)
+		{
+			mNumPrefilterTrue++;
+			if (trueRank <= matcher->getShortlistSize())
+				mNumPrefilterKept++;
+			else
+				prefilterDroppedID = true;
+		}
+	}
 
 	if (rank == -1)
-		mNumNoID++;
+	{
+		// an ID dropped by the prefilter is reported with the prefilter
+		if (! prefilterDroppedID)
+			mNumNoID++;
+	}
 	else {
 		if (mFirstRun) {
 			mFirstRun = false;
@@ -155,7 +403,7 @@ void MatchingQueue::finalizeMatch()
 		mNumID++;
 	}
 
-	float t = mResults->getTimeTaken();
+	float t = results->getTimeTaken();
 
 	if (t == -1.0)
 		mNumInvalidTimes++;
@@ -164,17 +412,576 @@ void MatchingQueue::finalizeMatch()
 		mTotalTime += t;
 	}
 
-	if (NULL != mUnknownFin)
+	mNumMatched += results->size(); //***2.3
+	mNumAbandoned += results->numUnranked(); //***2.3
+
+	if (NULL != matcher)
+		mNumCacheHits += matcher->getNumCacheHits(); //***2.3
+
+	mProfile.add(*results->getProfile()); //***2.3
+}
+
+//*******************************************************************
+//***2.3
+//
+string MatchingQueue::resultsFilename(int itemNum, string outFolder)
+{
+	string finFileRoot = getItemNum(itemNum);
+	string::size_type pos = finFileRoot.find_last_of("/\\");
+	if (string::npos != pos)
+		finFileRoot = finFileRoot.substr(pos+1);
+	finFileRoot = finFileRoot.substr(0,finFileRoot.rfind('.')); // strip .fin or .finz
+
+	// break out database name to make part of results filename
+	string dbName = mOptions->mDatabaseFileName;
+	pos = dbName.find_last_of("/\\");
+	if (string::npos != pos)
+		dbName = dbName.substr(pos+1);
+	dbName = dbName.substr(0,dbName.rfind(".db"));
+
+	return outFolder + PATH_SLASH + dbName + "-DB-match-for-" + finFileRoot + ".res";
+}
+
+//*******************************************************************
+//
+// static bool takeTask(QueueWork *work, int worker, queueTask_t &task)
+//
+//    ***2.3 - The oldest task of this worker, or else the newest task of
+//    another.  Returns false if there is none to take.
+//
+static bool takeTask(QueueWork *work, int worker, queueTask_t &task)
+{
+	bool found = false;
+
+	QUEUE_LOCK(work->taskLocks[worker]);
+	if (! work->tasks[worker].empty())
 	{
-		delete mUnknownFin;
-		mUnknownFin = NULL;
+		task = work->tasks[worker].front();
+		work->tasks[worker].pop_front();
+		found = true;
 	}
+	QUEUE_UNLOCK(work->taskLocks[worker]);
 
-	if (NULL != mMatcher)
+	for (int v = 1; (v < work->numWorkers) && ! found; v++)
 	{
-		delete mMatcher;
-		mMatcher = NULL;
+		int victim = (worker + v) % work->numWorkers;
+
+		QUEUE_LOCK(work->taskLocks[victim]);
+		if (! work->tasks[victim].empty())
+		{
+			task = work->tasks[victim].back();
+			work->tasks[victim].pop_back();
+			found = true;
+		}
+		QUEUE_UNLOCK(work->taskLocks[victim]);
+	}
+
+	return found;
+}
+
+//*******************************************************************
+//
+// static bool runTask(QueueWork *work, const queueTask_t &task)
+//
+//    ***2.3 - Registers one slice of the catalog to its unknown.  Returns
+//    true if that was its last slice, so the unknown is to be finished.
+//    Failures are left in work for matchAll() to report.
+//
+static bool runTask(QueueWork *work, const queueTask_t &task)
+{
+	QueueUnknown *unknown = work->unknowns[task.unknown];
+
+	try {
+		QUEUE_LOCK(unknown->lock);
+		double abandonAbove = unknown->matcher->abandonThreshold();
+		QUEUE_UNLOCK(unknown->lock);
+
+		double startTime = wallClockSeconds();
+
+		unknown->matcher->registerSlice(task.slice, abandonAbove);
+
+		double seconds = wallClockSeconds() - startTime;
+
+		QUEUE_LOCK(unknown->lock);
+		unknown->matcher->noteSliceErrors(task.slice);
+		unknown->seconds += seconds;
+		bool last = (0 == --unknown->slicesLeft);
+		QUEUE_UNLOCK(unknown->lock);
+
+		return last;
+
+	} catch (Error e) {
+		QUEUE_LOCK(work->lock);
+		work->setFailed(e.errorString());
+		QUEUE_UNLOCK(work->lock);
+	} catch (...) {
+		QUEUE_LOCK(work->lock);
+		work->setFailed("MatchingQueue::matchAll() worker failed");
+		QUEUE_UNLOCK(work->lock);
 	}
+
+	return false;
+}
+
+//*******************************************************************
+//
+// void *queueWorkerThread(void *arg)
+//
+//    ***2.3 - One worker of matchAll(), runs until every unknown is
+//    finished or one of the workers fails.
+//
+void *queueWorkerThread(void *arg)
+{
+	QueueWork *work = ((queueWorkerArg_t *)arg)->work;
+	int worker = ((queueWorkerArg_t *)arg)->worker;
+
+	while (true)
+	{
+		queueTask_t task;
+		bool haveTask = takeTask(work, worker, task);
+
+		QUEUE_LOCK(work->lock);
+
+		bool
+			stop = work->failed,
+			pause = false;
+
+		if (! stop && ! haveTask)
+		{
+			if ((work->nextItem < work->numItems) && (work->numInFlight < work->maxInFlight))
+			{
+				try {
+					work->queue->prepareNextUnknown(work, worker);
+				} catch (Error e) {
+					work->setFailed(e.errorString());
+				} catch (...) {
+					work->setFailed("MatchingQueue::matchAll() could not load an unknown");
+				}
+			}
+			else if ((work->nextItem >= work->numItems) && (0 == work->numInFlight))
+				stop = true;
+			else
+				pause = true; // the last tasks are running elsewhere
+		}
+
+		QUEUE_UNLOCK(work->lock);
+
+		if (stop)
+			break;
+
+		if (haveTask && runTask(work, task))
+		{
+			QUEUE_LOCK(work->lock);
+			try {
+				if (! work->failed)
+					work->queue->finishUnknown(work, task.unknown);
+			} catch (Error e) {
+				work->setFailed(e.errorString());
+			} catch (...) {
+				work->setFailed("MatchingQueue::matchAll() could not save results");
+			}
+			QUEUE_UNLOCK(work->lock);
+		}
+		else if (pause)
+			QUEUE_PAUSE();
+	}
+
+	return NULL;
+}
+
+//*******************************************************************
+//
+// void *batchWorkerThread(void *arg)
+//
+//    ***2.3 - One worker of matchBatch().  Claims the next block of
+//    catalog fins and registers it to every unknown of the batch in
+//    turn, so the block's outlines stay in cache from one unknown to
+//    the next, until every block is done or a worker fails.
+//
+void *batchWorkerThread(void *arg)
+{
+	QueueWork *work = ((queueWorkerArg_t *)arg)->work;
+
+	while (true)
+	{
+		QUEUE_LOCK(work->lock);
+		int block = (work->failed) ? work->numBlocks : work->nextBlock++;
+		QUEUE_UNLOCK(work->lock);
+
+		if (block >= work->numBlocks)
+			break;
+
+		int
+			first = block * work->blockSize,
+			end = first + work->blockSize;
+
+		try {
+			for (int b = 0; b < (int)work->batch.size(); b++)
+			{
+				QueueUnknown *unknown = work->unknowns[work->batch[b]];
+
+				QUEUE_LOCK(unknown->lock);
+				double abandonAbove = unknown->matcher->abandonThreshold();
+				QUEUE_UNLOCK(unknown->lock);
+
+				double startTime = wallClockSeconds();
+
+				unknown->matcher->registerCatalogRange(first, end, abandonAbove);
+
+				double seconds = wallClockSeconds() - startTime;
+
+				QUEUE_LOCK(unknown->lock);
+				unknown->matcher->noteCatalogRangeErrors(first, end);
+				unknown->seconds += seconds;
+				QUEUE_UNLOCK(unknown->lock);
+			}
+		} catch (Error e) {
+			QUEUE_LOCK(work->lock);
+			work->setFailed(e.errorString());
+			QUEUE_UNLOCK(work->lock);
+		} catch (...) {
+			QUEUE_LOCK(work->lock);
+			work->setFailed("MatchingQueue::matchBatch() worker failed");
+			QUEUE_UNLOCK(work->lock);
+		}
+	}
+
+	return NULL;
+}
+
+#ifdef WIN32
+static DWORD WINAPI queueWorkerThreadWin32(LPVOID arg)
+{
+	queueWorkerThread(arg);
+	return 0;
+}
+
+static DWORD WINAPI batchWorkerThreadWin32(LPVOID arg)
+{
+	batchWorkerThread(arg);
+	return 0;
+}
+#endif
+
+//*******************************************************************
+//
+// static void runQueueWorkers(QueueWork *work, bool batch)
+//
+//    ***2.3 - Runs work->numWorkers workers of matchAll(), or of
+//    matchBatch() when batch is set, the calling thread being one of
+//    them, and returns when they are all done.
+//
+static void runQueueWorkers(QueueWork *work, bool batch)
+{
+	int numThreads = work->numWorkers;
+
+	std::vector<queueWorkerArg_t> args(numThreads);
+	for (int t = 0; t < numThreads; t++)
+	{
+		args[t].work = work;
+		args[t].worker = t;
+	}
+
+#ifdef WIN32
+	std::vector<HANDLE> threads(numThreads);
+	for (int t = 1; t < numThreads; t++)
+		threads[t] = CreateThread(NULL, 0,
+				(batch) ? batchWorkerThreadWin32 : queueWorkerThreadWin32,
+				&args[t], 0, NULL);
+#else
+	std::vector<pthread_t> threads(numThreads);
+	for (int t = 1; t < numThreads; t++)
+		pthread_create(&threads[t], NULL,
+				(batch) ? batchWorkerThread : queueWorkerThread,
+				&args[t]);
+#endif
+
+	if (batch)
+		batchWorkerThread(&args[0]);
+	else
+		queueWorkerThread(&args[0]);
+
+#ifdef WIN32
+	if (numThreads > 1)
+		WaitForMultipleObjects(numThreads - 1, &threads[1], TRUE, INFINITE);
+	for (int t = 1; t < numThreads; t++)
+		CloseHandle(threads[t]);
+#else
+	for (int t = 1; t < numThreads; t++)
+		pthread_join(threads[t], NULL);
+#endif
+}
+
+//*******************************************************************
+//
+// int MatchingQueue::loadNextUnknown(QueueWork *work)
+//
+//    ***2.3 - Loads the next unknown that can be loaded and selects the
+//    catalog fins it is to be registered with (see Match::prepareSlices()).
+//    work->lock must be held.  Returns its item number, or -1 if there
+//    are no more unknowns.
+//
+int MatchingQueue::loadNextUnknown(QueueWork *work)
+{
+	ostream &out = *work->out;
+
+	ProfileCollector collector(&mProfile);
+
+	while (work->nextItem < work->numItems)
+	{
+		int item = work->nextItem++;
+
+		double startTime = wallClockSeconds();
+
+		DatabaseFin<ColorImage> *fin = NULL;
+		Match *matcher = newMatcher(item, fin);
+
+		// NULL indicates a problem loading an unknown .fin or .finz
+		if (NULL == matcher)
+		{
+			cerr << "Skipping row " << item << ": " << getItemNum(item) << endl;
+			continue;
+		}
+
+		QueueUnknown *unknown = new QueueUnknown();
+		unknown->itemNum = item;
+		unknown->fin = fin;
+		unknown->matcher = matcher;
+
+		work->unknowns[item] = unknown;
+		work->numInFlight++;
+
+		string resFilename = resultsFilename(item, work->outFolder);
+
+		if (work->update && ifstream(resFilename.c_str()))
+		{
+			MatchResults previous;
+			DatabaseFin<ColorImage> *previousUnknown = previous.load(mFinDatabase, resFilename);
+
+			if (NULL == previousUnknown)
+				out << "Could not load " << resFilename << ", matching in full" << endl;
+			else
+			{
+				delete previousUnknown;
+
+				if (matcher->matchAddedSince(&previous))
+					out << "Updating " << resFilename << " with "
+					    << matcher->getNumAddedFins() << " fins added or changed since catalog generation "
+					    << previous.getCatalogGeneration() << endl;
+				else
+					out << resFilename << " has no catalog generation, matching in full" << endl;
+			}
+		}
+
+		unknown->slicesLeft = matcher->prepareSlices(
+				work->registrationMethod, work->categoryToMatch,
+				work->useFullFinError, MATCHING_QUEUE_SLICE_SIZE);
+
+		unknown->seconds = wallClockSeconds() - startTime;
+
+		return item;
+	}
+
+	return -1;
+}
+
+//*******************************************************************
+//
+// bool MatchingQueue::prepareNextUnknown(QueueWork *work, int worker)
+//
+//    ***2.3 - Loads the next unknown and queues its slices of the catalog,
+//    one per task, for this worker.  work->lock must be held.  Returns
+//    false if there are no more unknowns.
+//
+bool MatchingQueue::prepareNextUnknown(QueueWork *work, int worker)
+{
+	int item = loadNextUnknown(work);
+
+	if (-1 == item)
+		return false;
+
+	int numSlices = work->unknowns[item]->slicesLeft;
+
+	if (0 == numSlices)
+		finishUnknown(work, item); // nothing left to register
+	else
+	{
+		QUEUE_LOCK(work->taskLocks[worker]);
+		for (int s = 0; s < numSlices; s++)
+		{
+			queueTask_t task;
+			task.unknown = item;
+			task.slice = s;
+			work->tasks[worker].push_back(task);
+		}
+		QUEUE_UNLOCK(work->taskLocks[worker]);
+	}
+
+	return true;
+}
+
+//*******************************************************************
+//
+// void MatchingQueue::finishUnknown(QueueWork *work, int item)
+//
+//    ***2.3 - Once every slice of unknown item is registered, adds its
+//    results, saves them and adds them to the summary.  work->lock must
+//    be held.  The match time saved is the time spent on this unknown
+//    by all the workers together.
+//
+void MatchingQueue::finishUnknown(QueueWork *work, int item)
+{
+	ostream &out = *work->out;
+
+	QueueUnknown *unknown = work->unknowns[item];
+	Match *matcher = unknown->matcher;
+
+	matcher->finishSlices();
+
+	MatchResults *results = matcher->getMatchResults();
+
+	out << "Matched " << getItemNum(item) << endl;
+
+	if (matcher->getNumAbandoned() > 0)
+		out << "  " << matcher->getNumAbandoned() << " of "
+		    << results->size()
+		    << " catalog fins abandoned early (top " << matcher->getTopK() << ")" << endl;
+
+	if (matcher->getNumPrefilterCandidates() > 0)
+	{
+		out << "  prefilter registered " << matcher->getShortlistSize()
+		    << " of " << matcher->getNumPrefilterCandidates() << " fins, ";
+		if (matcher->getPrefilterTrueRank() == -1)
+			out << "ID not in catalog" << endl;
+		else
+			out << "matching fin ranked " << matcher->getPrefilterTrueRank()
+			    << " by shape" << endl;
+	}
+
+	string resFilename = resultsFilename(item, work->outFolder);
+	out << "  " << resFilename << endl;
+
+	results->setTimeTaken((float)unknown->seconds);
+	results->sort(); // list must be sorted here, not as built
+	{
+		ProfileCollector collector(&mProfile); // after the results' own profile is saved
+		results->save(resFilename);
+	}
+
+	addToSummary(matcher, results);
+
+	delete unknown;
+	work->unknowns[item] = NULL;
+	work->numInFlight--;
+	work->numMatched++;
+}
+
+//*******************************************************************
+//
+// int MatchingQueue::matchAll(int registrationMethod, bool categoryToMatch[],
+//                             bool useFullFinError, string outFolder,
+//                             int numThreads, bool update, ostream &out)
+//
+//    ***2.3 - Runs the worker pool described at QueueWork, the calling
+//    thread being one of the workers.  Every catalog fin is fetched into
+//    the match snapshot first, so the workers never change it.
+//
+int MatchingQueue::matchAll(int registrationMethod, bool categoryToMatch[],
+                            bool useFullFinError, string outFolder,
+                            int numThreads, bool update, ostream &out)
+{
+	if (numThreads <= 0)
+		numThreads = numberOfProcessors();
+
+	MatchSnapshot *snapshot = mFinDatabase->getMatchSnapshot();
+	{
+		ProfileCollector collector(&mProfile);
+		for (int pos = 0; pos < (int)mFinDatabase->sizeAbsolute(); pos++)
+			snapshot->fetch(pos);
+	}
+
+	QueueWork work(numThreads, mFileNames.size());
+	work.queue = this;
+	work.registrationMethod = registrationMethod;
+	work.categoryToMatch = categoryToMatch;
+	work.useFullFinError = useFullFinError;
+	work.outFolder = outFolder;
+	work.update = update;
+	work.out = &out;
+
+	runQueueWorkers(&work, false);
+
+	mCurrentFinID = mFileNames.size(); // as if matched one at a time
+
+	if (work.failed)
+		throw Error(work.errorMsg);
+
+	return work.numMatched;
+}
+
+//*******************************************************************
+//
+// int MatchingQueue::matchBatch(int registrationMethod, bool categoryToMatch[],
+//                               bool useFullFinError, string outFolder,
+//                               int numThreads, bool update, ostream &out)
+//
+//    ***2.3 - Loads the unknowns MATCHING_QUEUE_BATCH_SIZE at a time and
+//    runs batchWorkerThread() on each batch, then finishes its unknowns
+//    in queue order.  Every catalog fin is fetched into the match
+//    snapshot first, so the workers never change it.
+//
+int MatchingQueue::matchBatch(int registrationMethod, bool categoryToMatch[],
+                              bool useFullFinError, string outFolder,
+                              int numThreads, bool update, ostream &out)
+{
+	if (numThreads <= 0)
+		numThreads = numberOfProcessors();
+
+	MatchSnapshot *snapshot = mFinDatabase->getMatchSnapshot();
+	int dbSize = mFinDatabase->sizeAbsolute();
+	{
+		ProfileCollector collector(&mProfile);
+		for (int pos = 0; pos < dbSize; pos++)
+			snapshot->fetch(pos);
+	}
+
+	QueueWork work(numThreads, mFileNames.size());
+	work.queue = this;
+	work.registrationMethod = registrationMethod;
+	work.categoryToMatch = categoryToMatch;
+	work.useFullFinError = useFullFinError;
+	work.outFolder = outFolder;
+	work.update = update;
+	work.out = &out;
+	work.numBlocks = (dbSize + work.blockSize - 1) / work.blockSize;
+
+	while (! work.failed && (work.nextItem < work.numItems))
+	{
+		// loaded and finished by this thread alone, between runs of the
+		// workers, so work.lock is not needed
+		work.batch.clear();
+		while ((int)work.batch.size() < MATCHING_QUEUE_BATCH_SIZE)
+		{
+			int item = loadNextUnknown(&work);
+			if (-1 == item)
+				break;
+			work.batch.push_back(item);
+		}
+
+		work.nextBlock = 0;
+
+		runQueueWorkers(&work, true);
+
+		for (int b = 0; (b < (int)work.batch.size()) && ! work.failed; b++)
+			finishUnknown(&work, work.batch[b]);
+	}
+
+	mCurrentFinID = mFileNames.size(); // as if matched one at a time
+
+	if (work.failed)
+		throw Error(work.errorMsg);
+
+	return work.numMatched;
 }
 
 void MatchingQueue::summarizeMatching(ostream& out)
@@ -243,7 +1050,7 @@ void MatchingQueue::summarizeMatching(ostream& out)
 		else
 			out << "Out of " << mNumID << " fins with IDs" << endl;
 				
-		cout << "\tAverage rank: " << (float)mSum / mNumID << endl;
+		out << "\tAverage rank: " << (float)mSum / mNumID << endl;
 
 		if (mNumTopTen == 0)
 			out << "\tNo fins ranked in the top ten.";
@@ -272,6 +1079,48 @@ void MatchingQueue::summarizeMatching(ostream& out)
 		out << "1 fin with no ID provided." << endl;
 	else	
 		out << mNumNoID << " fins with no ID provided." << endl;
+
+	//***2.3 - report on top-K matching
+	if (mNumAbandoned > 0)
+		out << endl << mNumAbandoned << " of " << mNumMatched
+		    << " catalog fin registrations ("
+		    << (float) mNumAbandoned / mNumMatched * 100.0
+		    << "%) were abandoned early (top-K matching)." << endl;
+
+	//***2.3 - report on the match cache
+	if (mNumCacheHits > 0)
+		out << endl << mNumCacheHits << " of " << mNumMatched
+		    << " catalog fin registrations ("
+		    << (float) mNumCacheHits / mNumMatched * 100.0
+		    << "%) were read from the match cache." << endl;
+
+	//***2.3 - report on the shape descriptor or outline index prefilter
+	if (mNumPrefiltered > 0)
+	{
+		out << endl << ((mOptions->mUseOutlineIndex) ? "Outline index" : "Shape descriptor")
+		    << " prefilter registered " << mNumShortlisted
+		    << " of " << mNumPrefilterCandidates << " candidate fins ("
+		    << (float) mNumShortlisted / mNumPrefilterCandidates * 100.0
+		    << "%)." << endl;
+
+		if (mNumPrefilterTrue > 0)
+		{
+			out << "\tThe matching catalog fin was shortlisted for " << mNumPrefilterKept
+			    << " of " << mNumPrefilterTrue << " fins with an ID in the catalog (recall "
+			    << (float) mNumPrefilterKept / mNumPrefilterTrue * 100.0 << "%)." << endl;
+
+			if (mNumPrefilterKept < mNumPrefilterTrue)
+				out << "\t" << mNumPrefilterTrue - mNumPrefilterKept
+				    << " fins with an ID are not included in the rankings above." << endl;
+		}
+	}
+
+	//***2.3 - time spent in each phase, over all unknowns and threads
+	if (! mProfile.empty())
+	{
+		out << endl << "Time spent in each phase of matching (inclusive):" << endl;
+		mProfile.summarize(out, "\t");
+	}
 }
 
 list<queueItem_t> MatchingQueue::getQueue()
@@ -419,6 +1268,9 @@ void MatchingQueue::load(string fileName)
 		inFile.getline(c, BUFFERSIZE);
 		entry = c;
 
+		if (entry.empty())
+			continue; //***2.3 - blank (usually trailing) line, not a fin
+
 		//***1.1 - we assume ALL traced fin files are in the DARWINHOME/tracedFins
 		// folder, so we prepend the DARWINHOME part of the path here. The entries in
 		// the queue file contain the path and fin filename relative to DARWINHOME.
@@ -15,10 +15,12 @@
 #pragma warning(disable:4786) //***1.95 removes debug warnings in <string> <vector> <map> etc
 #include <string>
 #include <list>
+#include <iostream>
 #include "Match.h"
 #include "../CatalogSupport.h"
 #include "../DatabaseFin.h"
 #include "../Database.h"
+#include "../MatchProfile.h" //***2.3
 
 
 typedef struct {
@@ -28,6 +30,16 @@ typedef struct {
 		location;
 } queueItem_t;
 
+//***2.3 - catalog fins registered in each task of matchAll()
+#define MATCHING_QUEUE_SLICE_SIZE   16
+
+//***2.3 - matchBatch(): unknowns loaded at once, and catalog positions
+// registered to all of them in each task
+#define MATCHING_QUEUE_BATCH_SIZE   64
+#define MATCHING_QUEUE_BLOCK_SIZE   16
+
+class QueueWork; //***2.3 - defined in MatchingQueue.cxx
+
 class MatchingQueue
 {
 	public:
@@ -63,6 +75,38 @@ class MatchingQueue
 
 		float matchProgress(); //***1.1
 
+		//***2.3 - Matches every unknown in the queue at once on a pool of
+		// numThreads worker threads (one per processor when numThreads <= 0).
+		// Each task registers one unknown against one slice of the catalog,
+		// and idle workers steal tasks from busy ones, so small and large
+		// unknowns balance across processors.  As each unknown completes its
+		// results are saved in outFolder (see resultsFilename()) and added
+		// to the summary.  With update set, an unknown whose results are
+		// already there is only matched against the fins added or changed
+		// since (see Match::matchAddedSince()).  setupMatching() must be
+		// called first, and progress is reported to out.  Returns the
+		// number of unknowns matched.
+		int matchAll(int registrationMethod, bool categoryToMatch[],
+		             bool useFullFinError, std::string outFolder,
+		             int numThreads = 0, bool update = false,
+		             std::ostream &out = std::cout);
+
+		//***2.3 - The same with the loops turned inside out.  Each task
+		// registers one block of catalog fins to every unknown of a batch
+		// of MATCHING_QUEUE_BATCH_SIZE unknowns, so each catalog outline
+		// is brought into cache once per batch rather than once per
+		// unknown.  Better than matchAll() for long queues against a large
+		// catalog, but each batch waits for its slowest block and its
+		// results are only saved once the whole batch is done.
+		int matchBatch(int registrationMethod, bool categoryToMatch[],
+		               bool useFullFinError, std::string outFolder,
+		               int numThreads = 0, bool update = false,
+		               std::ostream &out = std::cout);
+
+		//***2.3 - <outFolder>/<catalog>-DB-match-for-<fin file>.res, as named
+		// by the MatchingQueueDialog
+		std::string resultsFilename(int itemNum, std::string outFolder);
+
 	private:
 		std::list<std::string> mFileNames;
 		Database *mFinDatabase;
@@ -84,6 +128,18 @@ class MatchingQueue
 			mBestRank;
 
 		float mTotalTime;
+
+		int
+			mNumMatched,     //***2.3 - catalog fins matched, over all unknowns
+			mNumAbandoned,   //***2.3 - of which abandoned early (top-K mode)
+			mNumPrefiltered,      //***2.3 - unknowns matched with the shape prefilter
+			mNumPrefilterTrue,    //***2.3 - of which had their ID in the catalog
+			mNumPrefilterKept,    //***2.3 - of which kept that ID in the shortlist
+			mNumShortlisted,      //***2.3 - fins registered after the prefilter
+			mNumPrefilterCandidates,
+			mNumCacheHits;        //***2.3 - results read from the match cache
+
+		MatchProfile mProfile;   //***2.3 - time spent in each phase of matching
 		
 		bool mFirstRun;
 
@@ -95,6 +151,17 @@ class MatchingQueue
 
 		MatchResults *mResults;
 
+		//***2.3 - shared by getNextUnknownToMatch() and matchAll()
+		Match *newMatcher(int itemNum, DatabaseFin<ColorImage> *&unknownFin);
+		void addToSummary(Match *matcher, MatchResults *results);
+
+		//***2.3 - matchAll() tasks, see MatchingQueue.cxx
+		int loadNextUnknown(QueueWork *work);
+		bool prepareNextUnknown(QueueWork *work, int worker);
+		void finishUnknown(QueueWork *work, int unknown);
+
+		friend void *queueWorkerThread(void *arg);
+
 };
 
 #endif
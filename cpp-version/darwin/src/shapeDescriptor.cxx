@@ -0,0 +1,171 @@
+//*******************************************************************
+//   file: shapeDescriptor.cxx
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+//*******************************************************************
+
+#pragma warning(disable:4786) // removes debug warnings in <string> <vector> <map> etc
+#include <cmath>
+#include <vector>
+
+#include "shapeDescriptor.h"
+#include "Chain.h"
+#include "Error.h"
+
+using namespace std;
+
+// fraction of each edge (from the tip) summarized at each scale
+static const double SCALE[SHAPE_DESCRIPTOR_SCALES] =
+		{1.0, 0.95, 0.9, 0.85, 0.8, 0.75, 0.7};
+
+//*******************************************************************
+//
+// static void edgeDescriptor(const vector<double> &angle, int tip,
+//                            int end, double scale, float *bins)
+//
+//    Mean tangent angle in each of SHAPE_DESCRIPTOR_BINS equal parts of
+//    the first scale of the edge from tip towards end (end may be before
+//    or after tip), less the mean of all parts.
+//
+static void edgeDescriptor(
+		const vector<double> &angle,
+		int tip,
+		int end,
+		double scale,
+		float *bins)
+{
+	double
+		span = scale * (end - tip), // signed
+		mean = 0.0;
+
+	for (int b = 0; b < SHAPE_DESCRIPTOR_BINS; b++)
+	{
+		double
+			p0 = tip + span * b / SHAPE_DESCRIPTOR_BINS,
+			p1 = tip + span * (b + 1) / SHAPE_DESCRIPTOR_BINS;
+
+		int
+			from = (int)floor(((p0 < p1) ? p0 : p1) + 0.5),
+			to = (int)floor(((p0 < p1) ? p1 : p0) + 0.5);
+
+		if (to <= from) // fewer points than parts
+			to = from + 1;
+
+		double sum = 0.0;
+		for (int i = from; i < to; i++)
+			sum += angle[i];
+
+		bins[b] = (float)(sum / (to - from));
+		mean += bins[b];
+	}
+
+	mean /= SHAPE_DESCRIPTOR_BINS;
+
+	for (int b = 0; b < SHAPE_DESCRIPTOR_BINS; b++)
+		bins[b] -= (float)mean;
+}
+
+//*******************************************************************
+//
+// void shapeDescriptor(const FloatContour *c, int begin, int tip,
+//                      int end, float descriptor[SHAPE_DESCRIPTOR_SIZE])
+//
+//    ***2.3 - Fills descriptor with the leading edge (tip to begin) at
+//    each scale, then the trailing edge (tip to end) at each scale.
+//
+//    PRE:  0 <= begin < tip < end < c->length()
+//
+void shapeDescriptor(
+		const FloatContour *c,
+		int begin,
+		int tip,
+		int end,
+		float descriptor[SHAPE_DESCRIPTOR_SIZE])
+{
+	if (NULL == c)
+		throw EmptyArgumentError("shapeDescriptor() [const FloatContour *c]");
+
+	if ((begin < 0) || (begin >= tip) || (tip >= end) || (end >= c->length()))
+		throw BoundsError("shapeDescriptor()");
+
+	// Chain does not change the contour, it only reads the points
+	Chain chain(const_cast<FloatContour *>(c));
+	const double *turn = chain.getRelativeData();
+
+	// relative angle i is the turn between the edges into points i-1
+	// and i, so summing them gives the tangent angle along the outline
+
+	vector<double> angle(end + 1);
+	angle[0] = 0.0;
+	for (int i = 1; i <= end; i++)
+		angle[i] = angle[i-1] - turn[i];
+
+	float *bins = descriptor;
+
+	for (int s = 0; s < SHAPE_DESCRIPTOR_SCALES; s++, bins += SHAPE_DESCRIPTOR_BINS)
+		edgeDescriptor(angle, tip, begin, SCALE[s], bins);
+
+	for (int s = 0; s < SHAPE_DESCRIPTOR_SCALES; s++, bins += SHAPE_DESCRIPTOR_BINS)
+		edgeDescriptor(angle, tip, end, SCALE[s], bins);
+}
+
+//*******************************************************************
+//
+// static float binDistance(const float *bins1, const float *bins2)
+//
+//    Mean squared difference of one edge at one scale of each fin.
+//
+static float binDistance(const float *bins1, const float *bins2)
+{
+	float sum = 0.0f;
+
+	for (int b = 0; b < SHAPE_DESCRIPTOR_BINS; b++)
+	{
+		float diff = bins1[b] - bins2[b];
+		sum += diff * diff;
+	}
+
+	return sum / SHAPE_DESCRIPTOR_BINS;
+}
+
+//*******************************************************************
+//
+// float shapeDescriptorDistance(const float *descriptor1,
+//                               const float *descriptor2)
+//
+//    ***2.3 - Comparing the whole edge of one fin with part of the edge
+//    of the other allows for either tracing being the longer one.
+//
+float shapeDescriptorDistance(
+		const float *descriptor1,
+		const float *descriptor2)
+{
+	float distance = 0.0f;
+
+	for (int edge = 0; edge < 2; edge++)
+	{
+		const float
+			*edge1 = descriptor1 + edge * SHAPE_DESCRIPTOR_SCALES * SHAPE_DESCRIPTOR_BINS,
+			*edge2 = descriptor2 + edge * SHAPE_DESCRIPTOR_SCALES * SHAPE_DESCRIPTOR_BINS;
+
+		float best = binDistance(edge1, edge2);
+
+		for (int s = 1; s < SHAPE_DESCRIPTOR_SCALES; s++)
+		{
+			float d = binDistance(edge1, edge2 + s * SHAPE_DESCRIPTOR_BINS);
+			if (d < best)
+				best = d;
+
+			d = binDistance(edge1 + s * SHAPE_DESCRIPTOR_BINS, edge2);
+			if (d < best)
+				best = d;
+		}
+
+		distance += best;
+	}
+
+	return distance;
+}
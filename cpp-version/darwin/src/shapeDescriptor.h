@@ -0,0 +1,53 @@
+//*******************************************************************
+//   file: shapeDescriptor.h
+//
+// author: DARWIN Research Group
+//
+//   mods:
+//
+// ***2.3 - A small, registration tolerant summary of a fin outline,
+// used to rank the whole catalog cheaply before the (expensive)
+// optimal registration is run on the most similar fins only.
+//
+// Each edge (tip back to the beginning of the leading edge, and tip
+// out to the end of the trailing edge) is summarized by the tangent
+// angle along it, accumulated from the turning angles of the Chain
+// and averaged in SHAPE_DESCRIPTOR_BINS equal parts.  The mean angle
+// of each edge is subtracted, so the descriptor does not depend on
+// the position, size or rotation of the fin in the image.
+//
+// Tracings of the same fin seldom begin and end at the same places,
+// and the optimal registration trims up to 35% of each edge for that
+// reason.  So each edge is also summarized over its first 95%, 90%
+// ... 70% from the tip, and shapeDescriptorDistance() uses the best
+// of these for each edge.
+//
+//*******************************************************************
+
+#ifndef SHAPEDESCRIPTOR_H
+#define SHAPEDESCRIPTOR_H
+
+#include "FloatContour.h"
+
+#define SHAPE_DESCRIPTOR_BINS       16   // per edge and scale
+#define SHAPE_DESCRIPTOR_SCALES     7    // 100%, 95% ... 70% of the edge
+
+#define SHAPE_DESCRIPTOR_SIZE       (2 * SHAPE_DESCRIPTOR_SCALES * SHAPE_DESCRIPTOR_BINS)
+
+// c must be evenly spaced, begin, tip and end are indices of c
+// (normally LE_BEGIN, TIP and POINT_OF_INFLECTION)
+void shapeDescriptor(
+		const FloatContour *c,
+		int begin,
+		int tip,
+		int end,
+		float descriptor[SHAPE_DESCRIPTOR_SIZE]);
+
+// sum over both edges of the smallest mean squared difference (in
+// degrees squared) between the two edges at any pair of scales where
+// one of them is whole, 0 for fins of identical shape
+float shapeDescriptorDistance(
+		const float *descriptor1,
+		const float *descriptor2);
+
+#endif